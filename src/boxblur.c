@@ -27,11 +27,20 @@
 #include "boxblur.h"
 #include "vidstabdefines.h"
 
+#include <assert.h>
+
 
 void boxblur_hori_C(unsigned char* dest, const unsigned char* src,
                     int width, int height, int dest_strive, int src_strive, int size);
 void boxblur_vert_C(unsigned char* dest, const unsigned char* src,
                     int width, int height, int dest_strive, int src_strive, int size);
+static void boxblur_vert(unsigned char* dest, const unsigned char* src,
+                         int width, int height, int dest_strive, int src_strive,
+                         int size, int scale, VSIntegralImage* integral,
+                         VSThreadPool* pool, int numThreads);
+static void boxblur_hori(unsigned char* dest, const unsigned char* src,
+                         int width, int height, int dest_strive, int src_strive,
+                         int size, int scale, VSThreadPool* pool, int numThreads);
 
 /* ---- magic-number reciprocal for the `acc/size` in the two passes ----------
 
@@ -160,6 +169,108 @@ void boxblurPlanar(VSFrame* dest, const VSFrame* src,
     vsFrameFree(&buf);
 }
 
+int vsIntegralImageAllocate(VSIntegralImage* ii, int width, int height){
+  size_t n = (size_t)(width+1) * (size_t)(height+1);
+  ii->width    = width;
+  ii->height   = height;
+  ii->linesize = width+1;
+  // zeroed: the first row and column are never written
+  ii->sum   = (uint32_t*)vs_zalloc(n * sizeof(uint32_t));
+  ii->sqsum = (uint64_t*)vs_zalloc(n * sizeof(uint64_t));
+  if(!ii->sum || !ii->sqsum){
+    vsIntegralImageFree(ii);
+    return VS_ERROR;
+  }
+  return VS_OK;
+}
+
+void vsIntegralImageFree(VSIntegralImage* ii){
+  if(ii->sum)   vs_free(ii->sum);
+  if(ii->sqsum) vs_free(ii->sqsum);
+  ii->sum   = NULL;
+  ii->sqsum = NULL;
+}
+
+/* second half of the table: the columns already hold the vertical prefix
+   sums, adding them up along each row yields the summed-area table. Rows are
+   independent of each other. */
+static void integralImageRow(void* ctx, int row){
+  VSIntegralImage* ii = (VSIntegralImage*)ctx;
+  const int j = row + 1;
+  uint32_t* s = ii->sum   + j*ii->linesize;
+  uint64_t* q = ii->sqsum + j*ii->linesize;
+  for(int i=1; i <= ii->width; i++){
+    s[i] += s[i-1];
+    q[i] += q[i-1];
+  }
+}
+
+static void integralImageRowPrefix(VSIntegralImage* ii, VSThreadPool* pool,
+                                   int numThreads){
+  vsParallelFor(pool, numThreads, ii->height, integralImageRow, ii);
+}
+
+void vsIntegralImageCompute(VSIntegralImage* ii, const uint8_t* data, int linesize,
+                            VSThreadPool* pool, int numThreads){
+  const int l = ii->linesize;
+  for(int j=0; j < ii->height; j++){
+    const uint8_t* p = data + j*linesize;
+    uint32_t* s = ii->sum   + (j+1)*l + 1;
+    uint64_t* q = ii->sqsum + (j+1)*l + 1;
+    for(int i=0; i < ii->width; i++){
+      s[i] = s[i-l] + p[i];
+      q[i] = q[i-l] + (uint32_t)p[i]*p[i];
+    }
+  }
+  integralImageRowPrefix(ii, pool, numThreads);
+}
+
+void boxblurPlanarIntegral(VSFrame* dest, const VSFrame* src,
+    VSFrame* buffer, const VSFrameInfo* fi,
+    unsigned int size, VSIntegralImage* ii){
+  assert(ii->width == fi->width && ii->height == fi->height);
+  boxblurPlanarScaled(dest, src, buffer, fi, size, 1, ii, NULL, 0);
+}
+
+void boxblurPlanarScaled(VSFrame* dest, const VSFrame* src,
+                         VSFrame* buffer, const VSFrameInfo* fi,
+                         unsigned int size, int scale, VSIntegralImage* ii,
+                         VSThreadPool* pool, int numThreads){
+  if(scale < 1)
+    scale = 1;
+  const int width = fi->width/scale;
+  assert(!ii || (ii->width == width && ii->height == fi->height/scale));
+  if(size<2 && scale == 1){ // no blur, as in boxblurPlanar
+    if(dest!=src)
+      vsFrameCopyPlane(dest, src, fi, 0);
+    if(ii)
+      vsIntegralImageCompute(ii, dest->data[0], dest->linesize[0], pool, numThreads);
+    return;
+  }
+  VSFrame buf;
+  int localbuffer=0;
+  if(buffer==0){
+    VSFrameInfo bfi;
+    vsFrameInfoInit(&bfi, width, fi->height, PF_GRAY8);
+    vsFrameAllocate(&buf,&bfi);
+    localbuffer=1;
+  }else{
+    buf = *buffer;
+  }
+  // same as in boxblurPlanar, the kernel is measured in source pixels
+  size  = VS_CLAMP((size/2)*2+1,3,VS_MIN(fi->height/2,fi->width/2));
+
+  boxblur_hori(buf.data[0], src->data[0], fi->width, fi->height,
+               buf.linesize[0], src->linesize[0], size, scale, pool, numThreads);
+  boxblur_vert(dest->data[0], buf.data[0], width, fi->height,
+               dest->linesize[0], buf.linesize[0], size, scale, ii, pool, numThreads);
+  if(ii)
+    integralImageRowPrefix(ii, pool, numThreads);
+
+  if(localbuffer)
+    vsFrameFree(&buf);
+}
+
 /* /\* */
 /*   The algorithm: */
 /*   see boxblurPlanar but here we for Packed */
@@ -187,51 +298,161 @@ void boxblurPlanar(VSFrame* dest, const VSFrame* src,
 /* } */
 
 
-void boxblur_hori_C(unsigned char* dest, const unsigned char* src,
-                    int width, int height, int dest_strive, int src_strive, int size){
+/* one row of the horizontal pass; the rows go through vsParallelFor */
+typedef struct {
+  unsigned char* dest;
+  const unsigned char* src;
+  int width, dest_strive, src_strive, size, scale;
+  VSReciprocal rec;
+} BoxblurHoriJob;
+
+static void boxblur_hori_row(void* ctx, int j){
+  const BoxblurHoriJob* job = (const BoxblurHoriJob*)ctx;
+  const int width = job->width, size = job->size;
+  const int size2 = size/2; // size of one side of the kernel without center
+  const VSReciprocal rec = job->rec;
+  int i,k;
+  unsigned int acc;
+  const unsigned char *start, *end; // start and end of kernel
+  unsigned char *current;     // current destination pixel
+  start = end = job->src + j*job->src_strive;
+  current = job->dest + j*job->dest_strive;
+  // initialize accumulator
+  acc= (*start)*(size2+1); // left half of kernel with first pixel
+  for(k=0; k<size2; k++){  // right half of kernel
+    acc+=(*end);
+    end++;
+  }
+  if(job->scale > 1){
+    /* keeps only the centre pixel of every block of scale columns: output
+       column o is the blurred source column o*scale + scale/2. The running
+       sum still walks the whole row, only the stores are dropped. */
+    const int scale = job->scale, outw = width/scale;
+    int o;
+    for(i=0, o=0; o < outw; i++){
+      acc = acc + (*end) - (*start);
+      if(i > size2) start++;
+      if(i < width - size2 - 1) end++;
+      if(i == o*scale + scale/2){
+        current[o++] = rec.valid ? (unsigned char)((acc * rec.mul) >> rec.shift)
+                                 : (unsigned char)(acc/size);
+      }
+    }
+    return;
+  }
+  // go through the image
+  if(rec.valid){
+    for(i=0; i< width; i++){
+      acc = acc + (*end) - (*start);
+      if(i > size2) start++;
+      if(i < width - size2 - 1) end++;
+      (*current) = (unsigned char)((acc * rec.mul) >> rec.shift);
+      current++;
+    }
+  }else{
+    for(i=0; i< width; i++){
+      acc = acc + (*end) - (*start);
+      if(i > size2) start++;
+      if(i < width - size2 - 1) end++;
+      (*current) = acc/size;
+      current++;
+    }
+  }
+}
 
-  int j;
-  int size2 = size/2; // size of one side of the kernel without center
+/* With scale > 1 only every scale-th column is stored, see boxblur_hori_row
+   and boxblurPlanarScaled. */
+static void boxblur_hori(unsigned char* dest, const unsigned char* src,
+                         int width, int height, int dest_strive, int src_strive,
+                         int size, int scale, VSThreadPool* pool, int numThreads){
+  BoxblurHoriJob job;
+  job.dest = dest;
+  job.src = src;
+  job.width = width;
+  job.dest_strive = dest_strive;
+  job.src_strive = src_strive;
+  job.size = size;
+  job.scale = scale;
   /* one integer division per pixel sits in the middle of the serial running
      sum here; the exact reciprocal removes it (see vs_reciprocal) */
-  const VSReciprocal rec = vs_reciprocal(size, vs_boxblur_accmax(size));
+  job.rec = vs_reciprocal(size, vs_boxblur_accmax(size));
   /* Every row is an independent accumulator chain, so this parallelises with
      no sharing at all.  (It used to be commented out as "no speedup"; that no
      longer holds -- at 1080p the two boxblur passes are several ms of purely
      serial work per frame, which is a large part of the frame time once the
      motion search itself runs on all cores.) */
-#ifdef USE_OMP
-#pragma omp parallel for schedule(static)
-#endif
-  for(j=0; j< height; j++){
-    int i,k;
-    unsigned int acc;
-    const unsigned char *start, *end; // start and end of kernel
-    unsigned char *current;     // current destination pixel
-    start = end = src + j*src_strive;
-    current = dest + j*dest_strive;
-    // initialize accumulator
-    acc= (*start)*(size2+1); // left half of kernel with first pixel
-    for(k=0; k<size2; k++){  // right half of kernel
-      acc+=(*end);
-      end++;
-    }
-    // go through the image
-    if(rec.valid){
-      for(i=0; i< width; i++){
-        acc = acc + (*end) - (*start);
-        if(i > size2) start++;
-        if(i < width - size2 - 1) end++;
-        (*current) = (unsigned char)((acc * rec.mul) >> rec.shift);
-        current++;
-      }
+  vsParallelFor(pool, numThreads, height, boxblur_hori_row, &job);
+}
+
+void boxblur_hori_C(unsigned char* dest, const unsigned char* src,
+                    int width, int height, int dest_strive, int src_strive, int size){
+  boxblur_hori(dest, src, width, height, dest_strive, src_strive, size, 1, NULL, 0);
+}
+
+/* one block of columns of the vertical pass, see boxblur_vert */
+typedef struct {
+  unsigned char* dest;
+  const unsigned char* src;
+  int width, height, dest_strive, src_strive, size, scale;
+  VSReciprocal rec;
+  VSIntegralImage* integral;
+  uint32_t* acc;
+} BoxblurVertJob;
+
+/* The block width keeps one block's accumulators plus the two source rows
+   comfortably in L1. */
+#define BOXBLUR_VERT_BLOCK 512
+
+static void boxblur_vert_block(void* ctx, int cb){
+  const BoxblurVertJob* job = (const BoxblurVertJob*)ctx;
+  const unsigned char* src = job->src;
+  const int height = job->height, size = job->size, scale = job->scale;
+  const int size2 = size/2;
+  const int outh = height/scale;
+  const int src_strive = job->src_strive;
+  uint32_t* acc = job->acc;
+  VSIntegralImage* integral = job->integral;
+  int c0 = cb*BOXBLUR_VERT_BLOCK;
+  int c1 = c0 + BOXBLUR_VERT_BLOCK; if(c1 > job->width) c1 = job->width;
+  int ii, jj, kk;
+
+  // initialize accumulators: left half of the kernel with the first row ...
+  for(ii=c0; ii<c1; ii++)
+    acc[ii] = (uint32_t)src[ii] * (uint32_t)(size2+1);
+  // ... plus rows 0 .. size2-1 for the right half
+  for(kk=0; kk<size2; kk++){
+    const unsigned char* row = src + (kk < height ? kk : height-1)*src_strive;
+    for(ii=c0; ii<c1; ii++)
+      acc[ii] += row[ii];
+  }
+
+  for(jj=0; jj<height; jj++){
+    int er = jj + size2;          if(er > height-1) er = height-1;
+    int sr = jj - size2 - 1;      if(sr < 0)        sr = 0;
+    const unsigned char* endRow   = src + er*src_strive;
+    const unsigned char* startRow = src + sr*src_strive;
+    unsigned char* out = job->dest + (jj/scale)*job->dest_strive;
+
+    for(ii=c0; ii<c1; ii++)
+      acc[ii] += (uint32_t)endRow[ii] - (uint32_t)startRow[ii];
+    if(jj % scale != scale/2 || jj/scale >= outh)
+      continue;
+    if(job->rec.valid){
+      const uint32_t mul = job->rec.mul;
+      const int shift = job->rec.shift;
+      for(ii=c0; ii<c1; ii++)
+        out[ii] = (unsigned char)((acc[ii] * mul) >> shift);
     }else{
-      for(i=0; i< width; i++){
-        acc = acc + (*end) - (*start);
-        if(i > size2) start++;
-        if(i < width - size2 - 1) end++;
-        (*current) = acc/size;
-        current++;
+      for(ii=c0; ii<c1; ii++)
+        out[ii] = (unsigned char)(acc[ii]/size);
+    }
+    if(integral){ // column prefix sums, the row prefix follows later
+      uint32_t* s = integral->sum + (jj/scale+1)*integral->linesize + 1;
+      uint64_t* q = integral->sqsum + (jj/scale+1)*integral->linesize + 1;
+      const int l = integral->linesize;
+      for(ii=c0; ii<c1; ii++){
+        s[ii] = s[ii-l] + out[ii];
+        q[ii] = q[ii-l] + (uint32_t)out[ii]*out[ii];
       }
     }
   }
@@ -243,12 +464,19 @@ void boxblur_hori_C(unsigned char* dest, const unsigned char* src,
      acc(-1) = src[0][i]*(size2+1) + sum over rows 0..size2-1
      acc(j)  = acc(j-1) + src[endRow(j)][i] - src[startRow(j)][i]
    with  endRow(j)   = min(j + size2, height - 1)
-         startRow(j) = max(0, j - size2 - 1) */
-void boxblur_vert_C(unsigned char* dest, const unsigned char* src,
-        int width, int height, int dest_strive, int src_strive, int size){
+         startRow(j) = max(0, j - size2 - 1)
+   If integral is given, the vertical prefix sums of the output are written
+   into its tables on the way, see boxblurPlanarIntegral.  With scale > 1 only
+   the centre row of every block of scale rows is stored, as row j/scale of
+   dest (see boxblurPlanarScaled); the accumulators still see every row. */
+static void boxblur_vert(unsigned char* dest, const unsigned char* src,
+                         int width, int height, int dest_strive, int src_strive,
+                         int size, int scale, VSIntegralImage* integral,
+                         VSThreadPool* pool, int numThreads){
 
   int i,j,k;
   int size2 = size/2; // size of one side of the kernel without center
+  const int outh = height/scale;
   uint32_t* acc;
   /* without this the output loop below cannot vectorize at all: `acc[i]/size`
      has a runtime divisor and there is no SIMD integer divide (see
@@ -272,8 +500,16 @@ void boxblur_vert_C(unsigned char* dest, const unsigned char* src,
         a = a - (*start) + (*end);
         if(j > size2) start+=src_strive;
         if(j < height - size2 - 1) end+=src_strive;
+        if(j % scale != scale/2 || j/scale >= outh)
+          continue;
         *current = rec.valid ? (unsigned char)((a * rec.mul) >> rec.shift)
                              : (unsigned char)(a/(uint32_t)size);
+        if(integral){
+          const int l = integral->linesize;
+          const int t = (j/scale+1)*l + i+1;
+          integral->sum[t]   = integral->sum[t-l]   + *current;
+          integral->sqsum[t] = integral->sqsum[t-l] + (uint32_t)(*current) * (*current);
+        }
         current+=dest_strive;
       }
     }
@@ -282,51 +518,28 @@ void boxblur_vert_C(unsigned char* dest, const unsigned char* src,
 
   /* Columns are independent of each other, so the work is split into blocks of
      columns.  Threads touch disjoint ranges of acc[] and of every row, so no
-     synchronisation and no per-thread buffer is needed.  The block width keeps
-     one block's accumulators plus the two source rows comfortably in L1. */
+     synchronisation and no per-thread buffer is needed. */
   {
-    const int BLOCK = 512;
-    int nblocks = (width + BLOCK - 1) / BLOCK;
-    int cb;
-#ifdef USE_OMP
-#pragma omp parallel for schedule(static)
-#endif
-    for(cb=0; cb<nblocks; cb++){
-      int c0 = cb*BLOCK;
-      int c1 = c0 + BLOCK; if(c1 > width) c1 = width;
-      int ii, jj, kk;
-
-      // initialize accumulators: left half of the kernel with the first row ...
-      for(ii=c0; ii<c1; ii++)
-        acc[ii] = (uint32_t)src[ii] * (uint32_t)(size2+1);
-      // ... plus rows 0 .. size2-1 for the right half
-      for(kk=0; kk<size2; kk++){
-        const unsigned char* row = src + (kk < height ? kk : height-1)*src_strive;
-        for(ii=c0; ii<c1; ii++)
-          acc[ii] += row[ii];
-      }
-
-      for(jj=0; jj<height; jj++){
-        int er = jj + size2;          if(er > height-1) er = height-1;
-        int sr = jj - size2 - 1;      if(sr < 0)        sr = 0;
-        const unsigned char* endRow   = src + er*src_strive;
-        const unsigned char* startRow = src + sr*src_strive;
-        unsigned char* out = dest + jj*dest_strive;
-
-        for(ii=c0; ii<c1; ii++)
-          acc[ii] += (uint32_t)endRow[ii] - (uint32_t)startRow[ii];
-        if(rec.valid){
-          const uint32_t mul = rec.mul;
-          const int shift = rec.shift;
-          for(ii=c0; ii<c1; ii++)
-            out[ii] = (unsigned char)((acc[ii] * mul) >> shift);
-        }else{
-          for(ii=c0; ii<c1; ii++)
-            out[ii] = (unsigned char)(acc[ii]/size);
-        }
-      }
-    }
+    BoxblurVertJob job;
+    job.dest = dest;
+    job.src = src;
+    job.width = width;
+    job.height = height;
+    job.dest_strive = dest_strive;
+    job.src_strive = src_strive;
+    job.size = size;
+    job.scale = scale;
+    job.rec = rec;
+    job.integral = integral;
+    job.acc = acc;
+    vsParallelFor(pool, numThreads, (width + BOXBLUR_VERT_BLOCK - 1) / BOXBLUR_VERT_BLOCK,
+                  boxblur_vert_block, &job);
   }
 
   vs_free(acc);
 }
+
+void boxblur_vert_C(unsigned char* dest, const unsigned char* src,
+        int width, int height, int dest_strive, int src_strive, int size){
+  boxblur_vert(dest, src, width, height, dest_strive, src_strive, size, 1, NULL, NULL, 0);
+}
@@ -28,6 +28,7 @@
 
 #include "frameinfo.h"
 #include "vidstab_api.h"
+#include "threadpool.h"
 /** BoxBlurColor     - blur also color channels,
     BoxBlurKeepColor - copy original color channels
     BoxBlurNoColor   - do not touch color channels in dest
@@ -45,4 +46,60 @@ VS_API void boxblurPlanar(VSFrame* dest, const VSFrame* src,
     VSFrame* buffer, const VSFrameInfo* fi,
     unsigned int size, BoxBlurColorMode colormode);
 
+/** summed-area tables of a luma plane, used for O(1) statistics of a
+ * rectangle. Both tables have (width+1)*(height+1) entries, the entry at
+ * (x,y) holds the sum over all pixels above and left of (x,y), so the first
+ * row and column are 0. The plain sums are kept in 32 bit and may wrap around:
+ * the sum over any rectangle is still exact as long as it is below 2^32.
+ */
+typedef struct _vsintegralimage {
+  int       width;
+  int       height;
+  int       linesize;     // entries per row of the tables (width+1)
+  uint32_t* sum;          // sum of pixel values
+  uint64_t* sqsum;        // sum of squared pixel values
+} VSIntegralImage;
+
+/** allocates the tables for a plane of the given size
+ *  @return VS_OK on success otherwise VS_ERROR */
+VS_API int vsIntegralImageAllocate(VSIntegralImage* ii, int width, int height);
+VS_API void vsIntegralImageFree(VSIntegralImage* ii);
+
+/** fills the tables from the given plane (width x height of ii); the rows run
+ *  on pool, or on numThreads threads without one (see vsParallelFor) */
+VS_API void vsIntegralImageCompute(VSIntegralImage* ii, const uint8_t* data, int linesize,
+                                   VSThreadPool* pool, int numThreads);
+
+/** sum and sum of squares of the size x size block with upper left corner x,y */
+static inline void vsIntegralImageBox(const VSIntegralImage* ii, int x, int y, int size,
+                                      uint32_t* sum, uint64_t* sqsum){
+  const int l = ii->linesize;
+  const int a = y*l + x, b = a + size, c = a + size*l, d = c + size;
+  *sum   = ii->sum[d]   - ii->sum[b]   - ii->sum[c]   + ii->sum[a];
+  *sqsum = ii->sqsum[d] - ii->sqsum[b] - ii->sqsum[c] + ii->sqsum[a];
+}
+
+/** boxblurPlanar of the luminance only (BoxBlurNoColor) that fills the
+ * summed-area tables of the blurred plane on the way. The vertical prefix sums
+ * are accumulated while the result rows are written, so the table costs one
+ * extra pass over the table rows and none over the image.
+ */
+VS_API void boxblurPlanarIntegral(VSFrame* dest, const VSFrame* src,
+    VSFrame* buffer, const VSFrameInfo* fi,
+    unsigned int size, VSIntegralImage* ii);
+
+/** boxblurPlanar of the luminance that also downsamples by an integer factor:
+ * dest (and ii, if given) is (fi->width/scale) x (fi->height/scale) and pixel
+ * (x,y) of it is the blurred source pixel (x*scale + scale/2, y*scale + scale/2).
+ * The kernel size is in source pixels, so choosing it >= scale makes the blur
+ * the anti-aliasing filter. buffer, if given, needs fi->height rows of
+ * fi->width/scale pixels. With scale <= 1 this is boxblurPlanarIntegral, or
+ * the luminance of boxblurPlanar if ii is NULL. The rows run on pool, or
+ * without one on numThreads threads (see vsParallelFor; 0: OpenMP default).
+ */
+VS_API void boxblurPlanarScaled(VSFrame* dest, const VSFrame* src,
+    VSFrame* buffer, const VSFrameInfo* fi,
+    unsigned int size, int scale, VSIntegralImage* ii, VSThreadPool* pool,
+    int numThreads);
+
 #endif
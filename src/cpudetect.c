@@ -25,6 +25,7 @@
 
 #include "cpudetect.h"
 #include "vidstabdefines.h"
+#include "vsthread.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -184,28 +185,26 @@ static int vs_cpu_env_is_explicit(void) {
          strcmp(e, "avx512") == 0 || strcmp(e, "neon")   == 0;
 }
 
+/* Both answers are worked out once, under vs_call_once: the callers may be
+   on any thread (vsContextInit), and a plain flag would let one of them see
+   it set before the value. */
+static vs_once cpuOnce = VS_ONCE_INIT;
+static unsigned int cpuFlags = 0;
+static int cpuForced = 0;
+
+static void vs_cpu_detect_once(void) {
+  cpuFlags  = vs_cpu_detect() & vs_cpu_compiled_in() & vs_cpu_env_mask();
+  cpuForced = vs_cpu_env_is_explicit();
+}
+
 unsigned int vs_cpu_flags(void) {
-  /* Benign race: concurrent first callers all compute the same value.  Worth
-     avoiding a mutex for, since this is read on hot-ish paths. */
-  static int done = 0;
-  static unsigned int cached = 0;
-
-  if (!done) {
-    cached = vs_cpu_detect() & vs_cpu_compiled_in() & vs_cpu_env_mask();
-    done = 1;
-  }
-  return cached;
+  vs_call_once(&cpuOnce, vs_cpu_detect_once);
+  return cpuFlags;
 }
 
 int vs_cpu_simd_forced(void) {
-  static int done = 0;
-  static int cached = 0;
-
-  if (!done) {
-    cached = vs_cpu_env_is_explicit();
-    done = 1;
-  }
-  return cached;
+  vs_call_once(&cpuOnce, vs_cpu_detect_once);
+  return cpuForced;
 }
 
 const char* vs_cpu_flags_name(unsigned int flags) {
@@ -197,10 +197,26 @@ static void exprAdd(L1Expr* e, int col, double v){
   e->n++;
 }
 
+/** the update transforms B_0 .. B_{num-1} that are given rather than solved
+    for (a window of the receding horizon); their terms become constants */
+typedef struct {
+  const VSTransformLS* B;
+  int num;
+} L1Known;
+
 /** accumulates s * (F B_t) into the four component expressions r.
       (F B).x =  fa Bx + fb By + fx        (F B).a = fa Ba - fb Bb
       (F B).y = -fb Bx + fa By + fy        (F B).b = fa Bb + fb Ba  */
-static void exprAddFB(L1Expr r[4], const VSTransformLS* F, int t, double s, int N){
+static void exprAddFB(L1Expr r[4], const VSTransformLS* F, int t, double s, int N,
+                      const L1Known* known){
+  if (t < known->num) {
+    VSTransformLS fb = concat_transformLS(F, &known->B[t]);
+    r[PX].konst += s * fb.x;
+    r[PY].konst += s * fb.y;
+    r[PA].konst += s * fb.a;
+    r[PB].konst += s * fb.b;
+    return;
+  }
   exprAdd(&r[PX], vs_l1_col(0, t, PX, N),  s * F->a);
   exprAdd(&r[PX], vs_l1_col(0, t, PY, N),  s * F->b);
   r[PX].konst += s * F->x;
@@ -214,7 +230,14 @@ static void exprAddFB(L1Expr r[4], const VSTransformLS* F, int t, double s, int
 }
 
 /** accumulates s * B_t into the four component expressions r */
-static void exprAddB(L1Expr r[4], int t, double s, int N){
+static void exprAddB(L1Expr r[4], int t, double s, int N, const L1Known* known){
+  if (t < known->num) {
+    r[PX].konst += s * known->B[t].x;
+    r[PY].konst += s * known->B[t].y;
+    r[PA].konst += s * known->B[t].a;
+    r[PB].konst += s * known->B[t].b;
+    return;
+  }
   for (int p = PX; p <= PB; p++) exprAdd(&r[p], vs_l1_col(0, t, p, N), s);
 }
 
@@ -224,27 +247,27 @@ static void exprAddB(L1Expr r[4], int t, double s, int N){
     below denotes the identity of the parameter space, not the identity
     transform composed with B. */
 static void buildResidual(L1Expr r[4], int order, const VSTransformLS* F,
-                          int t, int N){
+                          int t, int N, const L1Known* known){
   for (int p = PX; p <= PB; p++) exprReset(&r[p]);
   switch (order) {
    case 1:  // R_t
-    exprAddFB(r, &F[t + 1], t + 1, +1.0, N);
-    exprAddB (r,             t,    -1.0, N);
+    exprAddFB(r, &F[t + 1], t + 1, +1.0, N, known);
+    exprAddB (r,             t,    -1.0, N, known);
     break;
    case 2:  // R_{t+1} - R_t = F_{t+2}B_{t+2} - (I + F_{t+1})B_{t+1} + B_t
-    exprAddFB(r, &F[t + 2], t + 2, +1.0, N);
-    exprAddB (r,             t + 1, -1.0, N);
-    exprAddFB(r, &F[t + 1], t + 1, -1.0, N);
-    exprAddB (r,             t,     +1.0, N);
+    exprAddFB(r, &F[t + 2], t + 2, +1.0, N, known);
+    exprAddB (r,             t + 1, -1.0, N, known);
+    exprAddFB(r, &F[t + 1], t + 1, -1.0, N, known);
+    exprAddB (r,             t,     +1.0, N, known);
     break;
    case 3:  // R_{t+2} - 2R_{t+1} + R_t
             //   = F_{t+3}B_{t+3} - (I+2F_{t+2})B_{t+2} + (2I+F_{t+1})B_{t+1} - B_t
-    exprAddFB(r, &F[t + 3], t + 3, +1.0, N);
-    exprAddB (r,             t + 2, -1.0, N);
-    exprAddFB(r, &F[t + 2], t + 2, -2.0, N);
-    exprAddB (r,             t + 1, +2.0, N);
-    exprAddFB(r, &F[t + 1], t + 1, +1.0, N);
-    exprAddB (r,             t,     -1.0, N);
+    exprAddFB(r, &F[t + 3], t + 3, +1.0, N, known);
+    exprAddB (r,             t + 2, -1.0, N, known);
+    exprAddFB(r, &F[t + 2], t + 2, -2.0, N, known);
+    exprAddB (r,             t + 1, +2.0, N, known);
+    exprAddFB(r, &F[t + 1], t + 1, +1.0, N, known);
+    exprAddB (r,             t,     -1.0, N, known);
     break;
    default:
     break;
@@ -287,11 +310,12 @@ static double exprEval(const L1Expr* e, const double* x){
 static double objectiveOf(const VSTransformLS* F, int N, const VSL1Config* conf,
                           const double* Bflat){
   const double weight[3] = { conf->w1, conf->w2, conf->w3 };
+  const L1Known none = { NULL, 0 };
   double total = 0.0;
   L1Expr r[4];
   for (int order = 1; order <= 3; order++) {
     for (int t = 0; t < N - order; t++) {
-      buildResidual(r, order, F, t, N);
+      buildResidual(r, order, F, t, N, &none);
       for (int p = PX; p <= PB; p++) {
         double w = weight[order - 1] * ((p == PA || p == PB) ? conf->wAffine : 1.0);
         total += w * fabs(exprEval(&r[p], Bflat));
@@ -371,23 +395,77 @@ VSL1Config vsL1GetDefaultConfig(void){
   c.maxScale    = 1.1;
   c.maxSkewDev  = 0.1;
   c.verbose     = 0;
+  c.window      = 0;
+  c.commit      = 0;
+  c.numThreads  = 1;
+  memset(&c.executor, 0, sizeof(c.executor));
   return c;
 }
 
-int vsCameraPathOptimalL1LS(const VSTransformLS* F, int N, VSTransformLS* B,
-                            const VSL1Config* conf, double* objective){
+/** the requirements on the arguments shared by the entry points */
+static int checkArguments(const VSTransformLS* F, int N, const VSTransformLS* B,
+                          const VSL1Config* conf){
   if (!F || !B || !conf) return VS_ERROR;
   /* the third derivative needs frames t .. t+3 */
   if (N < 4) return VS_ERROR;
   if (!(conf->frameWidth > 0.0) || !(conf->frameHeight > 0.0)) return VS_ERROR;
   if (!(conf->cropRatio > 0.0) || conf->cropRatio > 1.0) return VS_ERROR;
   if (!(conf->minScale > 0.0) || conf->minScale > conf->maxScale) return VS_ERROR;
+  return VS_OK;
+}
 
+/** The program of one call, handed from one window of the receding horizon
+    to the next: a window of as many frames fills it again (vs_lp_reset), so
+    that the solver keeps what it derived from the structure of the last one.
+    The threads of the solver, see VSL1Config.numThreads, live as long. */
+typedef struct {
+  VSLinProg*    lp;
+  int           N;       // frames lp was made for
+  VSThreadPool* pool;    // NULL: OpenMP or serial
+  int           threads;
+} L1Program;
+
+static int l1ProgramInit(L1Program* prog, const VSL1Config* conf){
+  memset(prog, 0, sizeof(*prog));
+  prog->threads = VS_MAX(conf->numThreads, 1);
+  if (conf->executor.parallel_for) {
+    prog->pool = vsThreadPoolFromExecutor(&conf->executor);
+    if (!prog->pool) return VS_ERROR;
+  } else if (prog->threads > 1) {
+    prog->pool = vsThreadPoolCreate(prog->threads);
+  }
+  return VS_OK;
+}
+
+static void l1ProgramFree(L1Program* prog){
+  vs_lp_free(prog->lp);
+  vsThreadPoolDestroy(prog->pool);
+  memset(prog, 0, sizeof(*prog));
+}
+
+/** Builds and solves the program over the N frames, with B_t given for
+    t < known->num (known->B may be B itself).  Only B[known->num .. N-1] is
+    written.  The columns of the given B_t stay in the program so that the
+    layout is that of N frames; no smoothness row refers to them, so they
+    only sit in their inclusion rows and their values are dropped.
+    prog keeps the program for the next call. */
+static int solveL1(const VSTransformLS* F, int N, VSTransformLS* B,
+                   const L1Known* known, const VSL1Config* conf, L1Program* prog){
   const int numrows = vs_l1_numrows(N);
   const int numcols = vs_l1_numcols(N);
-  VSLinProg* lp = vs_lp_new("vid.stab L1 camera path", numrows, numcols,
-                            vs_l1_maxentries(N));
-  if (!lp) return VS_ERROR;
+  VSLinProg* lp;
+  if (prog->lp && prog->N == N) {
+    lp = prog->lp;
+    vs_lp_reset(lp);
+  } else {
+    lp = vs_lp_new("vid.stab L1 camera path", numrows, numcols,
+                   vs_l1_maxentries(N));
+    if (!lp) return VS_ERROR;
+    vs_lp_free(prog->lp);
+    prog->lp = lp;
+    prog->N  = N;
+    vs_lp_set_threads(lp, prog->pool, prog->threads);
+  }
 
   const double weight[3] = { conf->w1, conf->w2, conf->w3 };
 
@@ -425,7 +503,7 @@ int vsCameraPathOptimalL1LS(const VSTransformLS* F, int N, VSTransformLS* B,
   L1Expr r[4];
   for (int order = 1; order <= 3; order++) {
     for (int t = 0; t < N - order; t++) {
-      buildResidual(r, order, F, t, N);
+      buildResidual(r, order, F, t, N, known);
       for (int p = PX; p <= PB; p++) {
         emitPair(lp,
                  vs_l1_row(order, t, p, 0, N),
@@ -466,32 +544,103 @@ int vsCameraPathOptimalL1LS(const VSTransformLS* F, int N, VSTransformLS* B,
   if (status != VS_OK) {
     vs_log_error("vid.stab", "L1 camera path: %s (%s, %i rows, %i cols)",
                  vs_lp_status_msg(lp), vs_lp_backend_name(), numrows, numcols);
-    vs_lp_free(lp);
     return VS_ERROR;
   }
-  for (int t = 0; t < N; t++) {
+  if (conf->verbose & VS_DEBUG) {
+    vs_log_msg("vid.stab", "L1 camera path: %i frames, %i iterations",
+               N, vs_lp_get_iterations(lp));
+  }
+  for (int t = known->num; t < N; t++) {
     B[t].x     = vs_lp_get_col_value(lp, vs_l1_col(0, t, PX, N));
     B[t].y     = vs_lp_get_col_value(lp, vs_l1_col(0, t, PY, N));
     B[t].a     = vs_lp_get_col_value(lp, vs_l1_col(0, t, PA, N));
     B[t].b     = vs_lp_get_col_value(lp, vs_l1_col(0, t, PB, N));
     B[t].extra = 0;
   }
-  vs_lp_free(lp);
-
-  enforceFeasibility(B, N, conf);
-  if (objective) {
-    double* Bflat = (double*)vs_malloc(sizeof(double) * 4 * N);
-    if (Bflat) {
-      for (int t = 0; t < N; t++) {
-        Bflat[vs_l1_col(0, t, PX, N)] = B[t].x;
-        Bflat[vs_l1_col(0, t, PY, N)] = B[t].y;
-        Bflat[vs_l1_col(0, t, PA, N)] = B[t].a;
-        Bflat[vs_l1_col(0, t, PB, N)] = B[t].b;
-      }
-      *objective = objectiveOf(F, N, conf, Bflat);
-      vs_free(Bflat);
+  enforceFeasibility(B + known->num, N - known->num, conf);
+  return VS_OK;
+}
+
+/** The receding horizon, see VSL1Config.window.  A window starts with the
+    last three frames the windows before kept, given, and spans conf->window
+    frames behind them; the last one runs to the end of the clip and keeps
+    all of it. */
+static int solveWindowed(const VSTransformLS* F, int N, VSTransformLS* B,
+                         const VSL1Config* conf, L1Program* prog){
+  const int W = VS_MAX(conf->window, 4);
+  const int S = conf->commit > 0 ? VS_MIN(conf->commit, W) : VS_MAX(W / 2, 1);
+  VSTransformLS* Bw = (VSTransformLS*)vs_malloc(sizeof(VSTransformLS) * (W + 3));
+  if (!Bw) return VS_ERROR;
+  int status = VS_OK;
+
+  int start = 0;
+  while (status == VS_OK && start < N) {
+    const int numFixed = VS_MIN(start, 3);
+    const int base = start - numFixed;
+    const int len  = VS_MIN(N - base, numFixed + W);
+    const L1Known known = { Bw, numFixed };
+    memcpy(Bw, B + base, sizeof(VSTransformLS) * numFixed);
+    /* F[base] is not read, just as F[0] of the whole clip */
+    status = solveL1(F + base, len, Bw, &known, conf, prog);
+    if (status != VS_OK) break;
+    int keep = (base + len == N) ? len - numFixed : S;
+    memcpy(B + start, Bw + numFixed, sizeof(VSTransformLS) * keep);
+    if (conf->verbose & VS_DEBUG) {
+      vs_log_msg("vid.stab", "L1 camera path: window %i..%i, kept %i frames",
+                 base, base + len - 1, keep);
     }
+    start += keep;
+  }
+  vs_free(Bw);
+  return status;
+}
+
+/** the objective of B to *objective, if that is not NULL */
+static void reportObjective(const VSTransformLS* F, int N, const VSTransformLS* B,
+                            const VSL1Config* conf, double* objective){
+  if (!objective) return;
+  double* Bflat = (double*)vs_malloc(sizeof(double) * 4 * N);
+  if (!Bflat) return;
+  for (int t = 0; t < N; t++) {
+    Bflat[vs_l1_col(0, t, PX, N)] = B[t].x;
+    Bflat[vs_l1_col(0, t, PY, N)] = B[t].y;
+    Bflat[vs_l1_col(0, t, PA, N)] = B[t].a;
+    Bflat[vs_l1_col(0, t, PB, N)] = B[t].b;
   }
+  *objective = objectiveOf(F, N, conf, Bflat);
+  vs_free(Bflat);
+}
+
+int vsCameraPathOptimalL1Window(const VSTransformLS* F, int N, VSTransformLS* B,
+                                int numFixed, const VSL1Config* conf,
+                                double* objective){
+  if (checkArguments(F, N, B, conf) != VS_OK) return VS_ERROR;
+  if (numFixed < 0 || numFixed >= N) return VS_ERROR;
+  const L1Known known = { B, numFixed };
+  L1Program prog;
+  if (l1ProgramInit(&prog, conf) != VS_OK) return VS_ERROR;
+  int status = solveL1(F, N, B, &known, conf, &prog);
+  l1ProgramFree(&prog);
+  if (status != VS_OK) return VS_ERROR;
+  reportObjective(F, N, B, conf, objective);
+  return VS_OK;
+}
+
+int vsCameraPathOptimalL1LS(const VSTransformLS* F, int N, VSTransformLS* B,
+                            const VSL1Config* conf, double* objective){
+  if (checkArguments(F, N, B, conf) != VS_OK) return VS_ERROR;
+  L1Program prog;
+  if (l1ProgramInit(&prog, conf) != VS_OK) return VS_ERROR;
+  int status;
+  if (conf->window > 0 && conf->window < N) {
+    status = solveWindowed(F, N, B, conf, &prog);
+  } else {
+    const L1Known none = { NULL, 0 };
+    status = solveL1(F, N, B, &none, conf, &prog);
+  }
+  l1ProgramFree(&prog);
+  if (status != VS_OK) return VS_ERROR;
+  reportObjective(F, N, B, conf, objective);
   return VS_OK;
 }
 
@@ -541,6 +690,9 @@ VSL1Config vsL1ConfigFromTransformConfig(const VSTransformData* td){
   c.frameWidth  = td->fiSrc.width;
   c.frameHeight = td->fiSrc.height;
   c.verbose     = td->conf.verbose;
+  c.window      = VS_MAX(td->conf.l1Window, 0);
+  c.numThreads  = VS_MAX(td->ctx.numThreads, 1);
+  c.executor    = td->conf.executor;
   return c;
 }
 
@@ -614,9 +766,15 @@ int cameraPathOptimalL1(VSTransformData* td, VSTransformations* trans){
   /* The LP behind this can take a noticeable while on a long clip, and it runs
      after detection has already finished, so without a word here the tool looks
      hung.  Reported unconditionally for that reason. */
-  vs_log_info(td->conf.modName,
-              "Camera path optimization in progress (L1, %i frames, %s)...\n",
-              N, vs_lp_backend_name());
+  if (conf.window > 0 && conf.window < N) {
+    vs_log_info(td->conf.modName,
+                "Camera path optimization in progress (L1, %i frames in windows of %i, %s)...\n",
+                N, VS_MAX(conf.window, 4), vs_lp_backend_name());
+  } else {
+    vs_log_info(td->conf.modName,
+                "Camera path optimization in progress (L1, %i frames, %s)...\n",
+                N, vs_lp_backend_name());
+  }
 
   double objective = 0.0;
   int status = vsCameraPathOptimalL1LS(F, N, B, &conf, &objective);
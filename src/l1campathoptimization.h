@@ -116,6 +116,27 @@ typedef struct _VSL1Config {
   double maxScale;    ///< upper bound on a, default 1.1
   double maxSkewDev;  ///< proximity: |b| <= maxSkewDev (paper: 0.1)
   int    verbose;
+  /** receding horizon: if 0 < window < N the program is solved over windows
+      of that many frames, one after another, instead of over the whole clip.
+      Each window keeps the first `commit` frames of its solution and the next
+      one starts behind them, with the last three kept frames given, so that
+      P and its first two derivatives continue across the seam.  Memory and
+      the cost of a solve are then bounded by the window, at the price of an
+      objective somewhat above the optimum.  Default 0: the whole clip. */
+  int    window;
+  /** frames a window keeps, in [1,window]; 0 (the default): window/2 */
+  int    commit;
+  /** threads the solver runs on, default 1.  From 5 on the normal equations
+      are split into as many parts as the clip has room for (none if that is
+      fewer than 5), factored at the same time; the path then
+      differs from that of one thread within the accuracy of the solver, but
+      is the same on every run with the same numThreads, whatever the machine
+      or the executor.  vsL1ConfigFromTransformConfig takes the numThreads of
+      the context of td. */
+  int    numThreads;
+  /** the parallel loops of the host, see threadpool.h; a zeroed one (the
+      default) selects threads of vid.stab */
+  VSExecutor executor;
 } VSL1Config;
 
 VS_API VSL1Config vsL1GetDefaultConfig(void);
@@ -127,14 +148,31 @@ VS_API VSL1Config vsL1GetDefaultConfig(void);
                  read; pass the identity.
     @param N     number of frames, must be >= 4
     @param B     output array of N update transforms (caller allocated)
-    @param conf  parameters, must not be NULL
-    @param objective if not NULL, receives the optimal objective value
+    @param conf  parameters, must not be NULL; see conf->window for solving
+                 a long clip window by window
+    @param objective if not NULL, receives the objective value of B
     @return VS_OK on success, VS_ERROR if the LP could not be solved
  */
 VS_API int vsCameraPathOptimalL1LS(const VSTransformLS* F, int N,
                                    VSTransformLS* B, const VSL1Config* conf,
                                    double* objective);
 
+/** One window of the receding horizon: like vsCameraPathOptimalL1LS() over
+    all N frames, only that B[0] .. B[numFixed-1] are given rather than solved
+    for.  The smoothness terms that reach back into them are kept, which is
+    what joins the window to the frames before it; at most the last three of
+    them take part, so a caller streaming the path passes those.
+
+    @param B        in: the given B[0..numFixed-1]; out: B[numFixed..N-1]
+    @param numFixed number of given update transforms, 0 <= numFixed < N
+    @param objective if not NULL, receives the objective value of all of B
+    conf->window is ignored here.
+    @return VS_OK on success, VS_ERROR if the LP could not be solved
+ */
+VS_API int vsCameraPathOptimalL1Window(const VSTransformLS* F, int N,
+                                       VSTransformLS* B, int numFixed,
+                                       const VSL1Config* conf, double* objective);
+
 /** Camera path optimization for a list of relative vid.stab transforms.
     trans->ts is replaced in place by the update transforms B_t, in the same
     sense as cameraPathGaussian(): applying ts[t] to frame t yields the
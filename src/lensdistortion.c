@@ -641,39 +641,59 @@ VSLensEstimate vsEstimateLensDistortionFromMatches(const VSFrameInfo* fi,
 VSLensEstimate vsEstimateLensDistortion(const VSFrameInfo* fi,
                                         const VSManyLocalMotions* motions,
                                         const VSLensEstimateConfig* cfg){
+  if(!motions){
+    VSLensEstimate est;
+    est.k = 0; est.residual = 0; est.curvature = 0;
+    est.iterations = 0; est.determined = 0;
+    return est;
+  }
+  return vsEstimateLensDistortionFrames(fi, vs_vector_size((const VSVector*)motions),
+                                        vs_manylocalmotions_get_frame, motions, cfg);
+}
+
+VSLensEstimate vsEstimateLensDistortionFrames(const VSFrameInfo* fi, int numFrames,
+                                              VSMotionFrameFn frame, const void* motions,
+                                              const VSLensEstimateConfig* cfg){
   VSLensEstimate est;
   VSPointMatches* frames;
-  double* storage;
-  int numFrames, i, j, totalFields = 0, offset = 0;
+  VSMotionSet set;
+  double* storage = 0;
+  size_t capacity = 0;
+  int i, j, totalFields = 0, offset = 0;
 
   est.k = 0; est.residual = 0; est.curvature = 0;
   est.iterations = 0; est.determined = 0;
-  if(!fi || !motions) return est;
-  numFrames = vs_vector_size((const VSVector*)motions);
-  if(numFrames < 1) return est;
-
-  for(i=0; i<numFrames; i++)
-    totalFields += vs_vector_size(VSMLMGet(motions, i));
-  if(totalFields < 1) return est;
+  if(!fi || !frame || numFrames < 1) return est;
 
-  frames  = (VSPointMatches*)vs_malloc(sizeof(VSPointMatches)*numFrames);
-  storage = (double*)vs_malloc(sizeof(double)*4*totalFields);
-  if(!frames || !storage){ vs_free(frames); vs_free(storage); return est; }
+  frames = (VSPointMatches*)vs_malloc(sizeof(VSPointMatches)*numFrames);
+  if(!frames) return est;
+  vs_motionset_init(&set, 0);
 
+  /* one pass over the clip: a compact clip expands a frame at a time, so the
+     points are packed as the frames come and the storage grows with them */
   for(i=0; i<numFrames; i++){
-    const LocalMotions* lms = VSMLMGet(motions, i);
-    int n = vs_vector_size(lms);
-    double* px = storage + 4*offset;
-    double* py = px + n, *qx = px + 2*n, *qy = px + 3*n;
+    int n;
+    double *px, *py, *qx, *qy;
+    if(frame(motions, i, &set) != VS_OK) break;
+    n = set.num;
+    if(4*((size_t)offset + n) > capacity){
+      size_t ncap = capacity < 4096 ? 4096 : capacity;
+      double* nstorage;
+      while(ncap < 4*((size_t)offset + n)) ncap *= 2;
+      nstorage = (double*)vs_realloc(storage, sizeof(double)*ncap);
+      if(!nstorage) break;
+      storage = nstorage;
+      capacity = ncap;
+    }
+    px = storage + 4*(size_t)offset;
+    py = px + n; qx = px + 2*n; qy = px + 3*n;
     for(j=0; j<n; j++){
-      const LocalMotion* lm = LMGet(lms, j);
+      const LocalMotion* lm = MSGet(&set, j);
       px[j] = lm->f.x;
       py[j] = lm->f.y;
       qx[j] = (double)lm->f.x + lm->v.x;
       qy[j] = (double)lm->f.y + lm->v.y;
     }
-    frames[i].px = px; frames[i].py = py;
-    frames[i].qx = qx; frames[i].qy = qy;
     /* No caller-supplied mask; the estimator masks internally.  NULL is what
        the readers expect on the first, unmasked pass -- vsLensFitSimilarity
        tests (!act || act[j]) -- and vs_malloc does not zero, so leaving it
@@ -685,6 +705,19 @@ VSLensEstimate vsEstimateLensDistortion(const VSFrameInfo* fi,
     frames[i].n  = n;
     offset += n;
   }
+  vs_motionset_fini(&set);
+  totalFields = offset;
+  if(i < numFrames || totalFields < 1){ vs_free(frames); vs_free(storage); return est; }
+
+  /* the storage has moved while it grew, so the pointers are set at the end */
+  offset = 0;
+  for(i=0; i<numFrames; i++){
+    int n = frames[i].n;
+    double* px = storage + 4*(size_t)offset;
+    frames[i].px = px; frames[i].py = px + n;
+    frames[i].qx = px + 2*n; frames[i].qy = px + 3*n;
+    offset += n;
+  }
 
   est = vsEstimateLensDistortionFromMatches(fi, frames, numFrames, cfg);
   vs_free(frames);
@@ -726,6 +759,18 @@ VSTransform vsLensMotionsToTransform(const VSFrameInfo* fi, const VSLensDistorti
                                      const LocalMotions* motions,
                                      const VSLensEstimateConfig* cfg,
                                      double* residual){
+  VSTransform t = null_transform();
+  VSMotionSet set;
+  if(!motions || vs_motionset_from_vector(&set, motions) != VS_OK) { t.extra = 1; return t; }
+  t = vsLensMotionSetToTransform(fi, ld, &set, cfg, residual);
+  vs_motionset_fini(&set);
+  return t;
+}
+
+VSTransform vsLensMotionSetToTransform(const VSFrameInfo* fi, const VSLensDistortion* ld,
+                                       const VSMotionSet* motions,
+                                       const VSLensEstimateConfig* cfg,
+                                       double* residual){
   VSLensEstimateConfig defcfg = vsLensEstimateGetDefaultConfig();
   VSTransform t = null_transform();
   VSPointMatches m;
@@ -734,7 +779,7 @@ VSTransform vsLensMotionsToTransform(const VSFrameInfo* fi, const VSLensDistorti
   int n, j;
 
   if(!fi || !ld || !motions) { t.extra = 1; return t; }
-  n = vs_vector_size(motions);
+  n = motions->num;
   if(n < 3){ t.extra = 1; return t; }
   if(!cfg) cfg = &defcfg;
 
@@ -744,7 +789,7 @@ VSTransform vsLensMotionsToTransform(const VSFrameInfo* fi, const VSLensDistorti
   res = buf + 4*n;
 
   for(j=0; j<n; j++){
-    const LocalMotion* lm = LMGet(motions, j);
+    const LocalMotion* lm = MSGet(motions, j);
     buf[j]       = lm->f.x;
     buf[n+j]     = lm->f.y;
     buf[2*n+j]   = (double)lm->f.x + lm->v.x;
@@ -165,6 +165,12 @@ VS_API VSTransform vsLensMotionsToTransform(const VSFrameInfo* fi,
                                             const LocalMotions* motions,
                                             const VSLensEstimateConfig* cfg,
                                             double* residual);
+/// vsLensMotionsToTransform of a motion set
+VS_API VSTransform vsLensMotionSetToTransform(const VSFrameInfo* fi,
+                                              const VSLensDistortion* ld,
+                                              const VSMotionSet* motions,
+                                              const VSLensEstimateConfig* cfg,
+                                              double* residual);
 
 /** as above, taking the local motions that vsMotionDetection produces.
     Displacements there are integers, so expect roughly a hundredth of
@@ -173,6 +179,14 @@ VS_API VSLensEstimate vsEstimateLensDistortion(const VSFrameInfo* fi,
                                                const VSManyLocalMotions* motions,
                                                const VSLensEstimateConfig* cfg);
 
+/** as above, for a clip of numFrames frames that frame(motions, i, ...)
+    hands out one at a time (vs_compactmotions_get_frame for a
+    VSManyCompactMotions, vs_manylocalmotions_get_frame for the above). */
+VS_API VSLensEstimate vsEstimateLensDistortionFrames(const VSFrameInfo* fi, int numFrames,
+                                                     VSMotionFrameFn frame,
+                                                     const void* motions,
+                                                     const VSLensEstimateConfig* cfg);
+
 #endif
 
 /*
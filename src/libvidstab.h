@@ -32,8 +32,11 @@
 #include "motiondetect.h"
 #include "transform.h"
 #include "vsvector.h"
+#include "motionset.h"
+#include "trffile.h"
 #include "serialize.h"
 #include "localmotion2transform.h"
+#include "stabilizer.h"
 
 #endif  /* LIBVIDSTAB_H_ */
 
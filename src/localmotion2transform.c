@@ -26,6 +26,7 @@
 
 #include "localmotion2transform.h"
 #include "lensdistortion.h"
+#include "transform_internal.h"
 #include "transformtype_operations.h"
 #include <assert.h>
 #include <string.h>
@@ -37,10 +38,83 @@
 /*   return t.tv_sec*1000 + t.tv_usec/1000; */
 /* } */
 
-int vsLocalmotions2Transforms(VSTransformData* td,
-                              const VSManyLocalMotions* motions,
-                              VSTransformations* trans ){
-  int len = vs_vector_size(motions);
+/* Lens distortion is estimated over the whole clip rather than during
+   detection because it is a single parameter pooled over the entire clip: the
+   detection pass is streaming and never sees more than one frame pair, while
+   this pass sees all of them (or, streaming, a sample of them).  The estimate
+   is only used when it came back determined and is large enough to move a
+   pixel worth mentioning, so ordinary undistorted footage takes exactly the
+   path it did before.  Returns whether the transforms are to be fitted
+   through the lens; apply = 0 only reports the estimate. */
+static int estimateLens(VSTransformData* td, int len, VSMotionFrameFn frame,
+                        const void* motions, int apply, VSLensDistortion* lens){
+  VSLensEstimateConfig lcfg = vsLensEstimateGetDefaultConfig();
+  VSLensEstimate le;
+  int useLens;
+  /* k and the perspective term are confounded -- both expand the periphery
+     -- so the estimator has to know the field of view or it explains one
+     with the other.  Left unset it returned the wrong sign by 70 degrees
+     on synthetic footage, and reported it as determined, because its
+     confidence gate keys on scatter and this is bias. */
+  lcfg.f = focal_from_fov(td->conf.fov, td->fiSrc.width);
+  le = vsEstimateLensDistortionFrames(&td->fiSrc, len, frame, motions, &lcfg);
+  /* |k| below this shifts a corner pixel by well under a pixel, so acting on
+     it would only add noise. */
+  useLens = le.determined && fabs(le.k) > 0.01;
+  *lens = vsLensDistortionInit(&td->fiSrc, le.k);
+  /* Hand the estimate to the render path.  An explicit conf.lensK wins: the
+     user knows their lens better than a fit over one clip does. */
+  if(fabs(td->conf.lensK) <= 0.01 && useLens && apply)
+    vsTransformSetLensK(td, le.k);
+  /* Reported unconditionally: k is a single number for the whole clip and it
+     says something about the footage the user cannot get anywhere else. */
+  vs_ctx_log_info(&td->ctx, td->conf.modName,
+              "Lens distortion: k=%.4f +- %.4f from %i motions (%i dropped), %s\n",
+              le.k, le.uncertainty, le.used, le.rejected,
+              useLens ? (apply ? "correcting transforms"
+                               : "not corrected, the motions cannot be read twice")
+                      : (le.determined ? "too small to matter" : "not determined"));
+  return useLens && apply;
+}
+
+/* the transform of one frame, written to f (global_motions.trf) if given */
+static VSTransform fitTransform(VSTransformData* td, const VSMotionSet* set,
+                                int useLens, const VSLensDistortion* lens, FILE* f){
+  VSTransform t;
+  if(td->conf.simpleMotionCalculation!=0){
+    t=vsSimpleMotionSetToTransform(td->fiSrc, td->conf.modName, set);
+  }else if(useLens){
+    double residual = 0;
+    VSLensEstimateConfig lcfg = vsLensEstimateGetDefaultConfig();
+    /* Same model as the estimate, and as calcTransformQuality uses on the
+       other branch: this is the path a clip with a determined k takes, so
+       without it fov would be silently dropped for exactly the footage that
+       most needs it. */
+    lcfg.f = focal_from_fov(td->conf.fov, td->fiSrc.width);
+    t=vsLensMotionSetToTransform(&td->fiSrc, lens, set, &lcfg, &residual);
+    if(f) fprintf(f,"0 %f %f %f %f %i\n#\t\t\t\t\t %f lens\n",
+                  t.x, t.y, t.alpha, t.zoom, t.extra, residual);
+  }else{
+    t=vsMotionSetToTransform(td, set, f);
+  }
+  return t;
+}
+
+static int lensWanted(const VSTransformData* td){
+  return td->conf.estimateLensDistortion && td->conf.simpleMotionCalculation==0;
+}
+
+int lensSampleSize(const VSTransformData* td){
+  if(!lensWanted(td))
+    return 0;
+  return td->conf.lensSampleFrames > 0 ? td->conf.lensSampleFrames : 1000;
+}
+
+int vsMotionFrames2Transforms(VSTransformData* td, int len, VSMotionFrameFn frame,
+                              const void* motions, VSTransformations* trans){
+  VSMotionSet set;
+  VSLensDistortion lens;
+  int useLens = 0;
   assert(trans->len==0 && trans->ts == 0);
   trans->ts = vs_malloc(sizeof(VSTransform)*len );
   /* long start= timeOfDayinMS(); */
@@ -49,65 +123,24 @@ int vsLocalmotions2Transforms(VSTransformData* td,
     f = fopen("global_motions.trf","w");
   }
 
-  /* Lens distortion is estimated here rather than during detection because it
-     is a single parameter pooled over the entire clip: the detection pass is
-     streaming and never sees more than one frame pair, while this pass holds
-     all of them.  The estimate is only used when it came back determined and
-     is large enough to move a pixel worth mentioning, so ordinary undistorted
-     footage takes exactly the path it did before. */
-  VSLensDistortion lens;
-  int useLens = 0;
-  if(td->conf.estimateLensDistortion && td->conf.simpleMotionCalculation==0){
-    VSLensEstimateConfig lcfg = vsLensEstimateGetDefaultConfig();
-    VSLensEstimate le;
-    /* k and the perspective term are confounded -- both expand the periphery
-       -- so the estimator has to know the field of view or it explains one
-       with the other.  Left unset it returned the wrong sign by 70 degrees
-       on synthetic footage, and reported it as determined, because its
-       confidence gate keys on scatter and this is bias. */
-    lcfg.f = focal_from_fov(td->conf.fov, td->fiSrc.width);
-    le = vsEstimateLensDistortion(&td->fiSrc, motions, &lcfg);
-    /* |k| below this shifts a corner pixel by well under a pixel, so acting on
-       it would only add noise. */
-    useLens = le.determined && fabs(le.k) > 0.01;
-    lens = vsLensDistortionInit(&td->fiSrc, le.k);
-    /* Hand the estimate to the render path.  An explicit conf.lensK wins: the
-       user knows their lens better than a fit over one clip does. */
-    if(fabs(td->conf.lensK) <= 0.01 && useLens)
-      vsTransformSetLensK(td, le.k);
-    /* Reported unconditionally: k is a single number for the whole clip and it
-       says something about the footage the user cannot get anywhere else. */
-    vs_log_info(td->conf.modName,
-                "Lens distortion: k=%.4f +- %.4f from %i motions (%i dropped), %s\n",
-                le.k, le.uncertainty, le.used, le.rejected,
-                useLens ? "correcting transforms"
-                        : (le.determined ? "too small to matter" : "not determined"));
-  }
-
-  if(td->conf.simpleMotionCalculation==0){
-    for(int i=0; i< vs_vector_size(motions); i++) {
-      if(useLens){
-        double residual = 0;
-        VSLensEstimateConfig lcfg = vsLensEstimateGetDefaultConfig();
-        /* Same model as the estimate above, and as calcTransformQuality uses
-           on the other branch: this is the path a clip with a determined k
-           takes, so without it fov would be silently dropped for exactly the
-           footage that most needs it. */
-        lcfg.f = focal_from_fov(td->conf.fov, td->fiSrc.width);
-        trans->ts[i]=vsLensMotionsToTransform(&td->fiSrc, &lens,
-                                              VSMLMGet(motions,i), &lcfg, &residual);
-        if(f) fprintf(f,"0 %f %f %f %f %i\n#\t\t\t\t\t %f lens\n",
-                      trans->ts[i].x, trans->ts[i].y, trans->ts[i].alpha,
-                      trans->ts[i].zoom, trans->ts[i].extra, residual);
-      }else{
-        trans->ts[i]=vsMotionsToTransform(td,VSMLMGet(motions,i), f);
-      }
-    }
-  }else{
-    for(int i=0; i< vs_vector_size(motions); i++) {
-      trans->ts[i]=vsSimpleMotionsToTransform(td->fiSrc, td->conf.modName,VSMLMGet(motions,i));
+  if(lensWanted(td))
+    useLens = estimateLens(td, len, frame, motions, 1, &lens);
+  td->fitLensK = useLens ? lens.k : 0.0;
+
+  vs_motionset_init(&set, 0);
+  for(int i=0; i< len; i++) {
+    if(frame(motions, i, &set) != VS_OK){
+      vs_ctx_log_error(&td->ctx, td->conf.modName,
+                       "cannot get the local motions of frame %i\n", i+1);
+      vs_motionset_fini(&set);
+      vs_free(trans->ts);
+      trans->ts = 0;
+      if(f) fclose(f);
+      return VS_ERROR;
     }
+    trans->ts[i]=fitTransform(td, &set, useLens, &lens, f);
   }
+  vs_motionset_fini(&set);
   trans->len=len;
 
   /* long end = timeOfDayinMS(); */
@@ -117,6 +150,195 @@ int vsLocalmotions2Transforms(VSTransformData* td,
   return VS_OK;
 }
 
+int vsLocalmotions2Transforms(VSTransformData* td,
+                              const VSManyLocalMotions* motions,
+                              VSTransformations* trans ){
+  return vsMotionFrames2Transforms(td, vs_vector_size(motions),
+                                   vs_manylocalmotions_get_frame, motions, trans);
+}
+
+int vsCompactMotions2Transforms(VSTransformData* td,
+                                const VSManyCompactMotions* motions,
+                                VSTransformations* trans ){
+  return vsMotionFrames2Transforms(td, vs_compactmotions_num_frames(motions),
+                                   vs_compactmotions_get_frame, motions, trans);
+}
+
+/* --- streaming ------------------------------------------------------------ */
+
+/* A bounded, uniform sample of the frames of a clip of unknown length
+   (algorithm R), for the lens estimate. The first num frames are kept in
+   order, so a clip of at most num frames is estimated from all of it. */
+typedef struct {
+  VSMotionSet* frames;
+  int num;          // frames held
+  int capacity;
+  long seen;        // frames offered
+  unsigned int rng; // fixed seed: the same file gives the same estimate
+} LensReservoir;
+
+static int reservoirInit(LensReservoir* r, int capacity){
+  r->frames = (VSMotionSet*)vs_malloc(sizeof(VSMotionSet) * capacity);
+  r->num = 0;
+  r->capacity = r->frames ? capacity : 0;
+  r->seen = 0;
+  r->rng = 12345;
+  return r->frames ? VS_OK : VS_ERROR;
+}
+
+static void reservoirFini(LensReservoir* r){
+  for(int i=0; i < r->num; i++)
+    vs_motionset_fini(&r->frames[i]);
+  if(r->frames) vs_free(r->frames);
+  r->frames = 0;
+  r->num = r->capacity = 0;
+}
+
+static int reservoirOffer(LensReservoir* r, const VSMotionSet* set){
+  long slot;
+  r->seen++;
+  if(r->num < r->capacity){
+    vs_motionset_init(&r->frames[r->num], 0);
+    if(vs_motionset_append_set(&r->frames[r->num], set) != VS_OK){
+      vs_motionset_fini(&r->frames[r->num]);
+      return VS_ERROR;
+    }
+    r->num++;
+    return VS_OK;
+  }
+  r->rng = r->rng * 1103515245u + 12345u;
+  slot = (long)(((unsigned long long)(r->rng >> 1) * r->seen) >> 31);
+  if(slot >= r->capacity)
+    return VS_OK;
+  r->frames[slot].num = 0;
+  return vs_motionset_append_set(&r->frames[slot], set);
+}
+
+static int reservoirFrame(const void* dat, int i, VSMotionSet* S){
+  const LensReservoir* r = (const LensReservoir*)dat;
+  S->num = 0;
+  return vs_motionset_append_set(S, &r->frames[i]);
+}
+
+/* reads the frames of f and puts the transform of frame n at trans->ts[n-1]
+   (a frame missing in the file gets that of no motions), or only offers the
+   frames to the reservoir if trans is NULL */
+static int streamFrames(VSTransformData* td, FILE* f, int serializationMode,
+                        VSTransformations* trans, LensReservoir* reservoir,
+                        int useLens, const VSLensDistortion* lens, FILE* gm){
+  VSMotionSet set, none;
+  int index, next = 0, capacity = 0, res = VS_OK;
+  vs_motionset_init(&set, 0);
+  vs_motionset_init(&none, 0);
+  while(res == VS_OK
+        && (index = vsReadMotionSetFromFile(f, &set, serializationMode)) != VS_ERROR){
+    if(index<1 || index>VS_MAX_FRAMES){
+      vs_ctx_log_info(&td->ctx, td->conf.modName, "VID.STAB file: implausible "
+                      "frame number (%i), expect 1..%i", index, VS_MAX_FRAMES);
+      continue;
+    }
+    if(trans && index > capacity){
+      int ncap = capacity < 1024 ? 1024 : capacity;
+      while(ncap < index) ncap *= 2;
+      VSTransform* ts = (VSTransform*)vs_realloc(trans->ts, sizeof(VSTransform) * ncap);
+      if(!ts){
+        res = VS_ERROR;
+        break;
+      }
+      trans->ts = ts;
+      capacity = ncap;
+    }
+    /* a frame missing in the file has no motions, as in vsReadLocalMotionsFile */
+    for(; next < index-1 && res == VS_OK; next++){
+      if(reservoir) res = reservoirOffer(reservoir, &none);
+      if(trans) trans->ts[next] = fitTransform(td, &none, useLens, lens, gm);
+    }
+    if(reservoir && res == VS_OK) res = reservoirOffer(reservoir, &set);
+    if(trans) trans->ts[index-1] = fitTransform(td, &set, useLens, lens, gm);
+    if(index > next) next = index;
+  }
+  if(trans) trans->len = next;
+  vs_motionset_fini(&set);
+  vs_motionset_fini(&none);
+  return res;
+}
+
+int vsStreamMotions2Transforms(VSTransformData* td, FILE* f, VSTransformations* trans){
+  LensReservoir reservoir;
+  VSLensDistortion lens;
+  int useLens = 0, res;
+  FILE* gm = 0;
+  long start;
+  assert(td && f && trans);
+  assert(trans->len==0 && trans->ts == 0);
+  const int serializationMode = vsReadMotionsFileHeader(f);
+  if(serializationMode == VS_ERROR)
+    return VS_ERROR;
+
+  reservoir.frames = 0;
+  reservoir.num = 0;
+  if(lensWanted(td)
+     && reservoirInit(&reservoir, lensSampleSize(td)) != VS_OK){
+    vs_ctx_log_error(&td->ctx, td->conf.modName, "cannot allocate the lens sample\n");
+    return VS_ERROR;
+  }
+  /* The transforms depend on k, so a seekable file is read twice: once for
+     the sample k is estimated from and once to fit the transforms. A stream
+     that cannot be rewound is fitted without the lens in one pass. */
+  start = ftell(f);
+  int twice = reservoir.frames && start >= 0;
+  if(twice){
+    res = streamFrames(td, f, serializationMode, NULL, &reservoir, 0, NULL, NULL);
+    if(res == VS_OK){
+      useLens = estimateLens(td, reservoir.num, reservoirFrame, &reservoir, 1, &lens);
+      res = fseek(f, start, SEEK_SET) == 0 ? VS_OK : VS_ERROR;
+    }
+    reservoirFini(&reservoir);
+    if(res != VS_OK){
+      vs_ctx_log_error(&td->ctx, td->conf.modName,
+                       "cannot read the local motions twice\n");
+      return VS_ERROR;
+    }
+  }
+
+  td->fitLensK = useLens ? lens.k : 0.0;
+  if(td->conf.storeTransforms)
+    gm = fopen("global_motions.trf","w");
+  res = streamFrames(td, f, serializationMode, trans,
+                     reservoir.frames && !twice ? &reservoir : NULL, useLens, &lens, gm);
+  if(gm) fclose(gm);
+  if(reservoir.frames){
+    if(res == VS_OK)
+      estimateLens(td, reservoir.num, reservoirFrame, &reservoir, 0, &lens);
+    reservoirFini(&reservoir);
+  }
+  if(res != VS_OK){
+    vs_ctx_log_error(&td->ctx, td->conf.modName,
+                     "out of memory while reading the local motions\n");
+    vsTransformationsCleanup(trans);
+  }
+  return res;
+}
+
+int vsCachedMotions2Transforms(VSTransformData* td, FILE* f,
+                               VSTransformations* trans, int store){
+  assert(td && f && trans);
+  if(!td->conf.storeTransforms && vsReadTransformsFromFile(td, f, trans) == VS_OK){
+    vs_ctx_log_info(&td->ctx, td->conf.modName,
+                    "read the global transforms of %i frames from the file\n", trans->len);
+    return VS_OK;
+  }
+  if(fseek(f, 0, SEEK_SET) != 0){
+    vs_ctx_log_error(&td->ctx, td->conf.modName, "cannot rewind the local motions file\n");
+    return VS_ERROR;
+  }
+  int res = vsStreamMotions2Transforms(td, f, trans);
+  /* a file that cannot take them costs the next run the fit, nothing else */
+  if(res == VS_OK && store && vsWriteTransformsToFile(td, f, trans) != VS_OK)
+    vs_ctx_log_warn(&td->ctx, td->conf.modName, "the transforms are not stored\n");
+  return res;
+}
+
 VSArray vsTransformToArray(const VSTransform* t){
   VSArray a = vs_array_new(4);
   a.dat[0] = t->x;
@@ -132,14 +354,14 @@ VSTransform vsArrayToTransform(VSArray a){
 
 struct VSGradientDat {
   VSTransformData* td;
-  const LocalMotions* motions;
+  const VSMotionSet* motions;
   VSArray missmatches; // if negative then local motion is ignored
 };
 
 double calcTransformQuality(VSArray params, void* dat){
   struct VSGradientDat* gd= (struct VSGradientDat*) dat;
-  const LocalMotions* motions = gd->motions;
-  int num_motions=vs_vector_size(motions);
+  const VSMotionSet* motions = gd->motions;
+  int num_motions=motions->num;
   VSTransform t = vsArrayToTransform(params);
   double error=0;
 
@@ -156,7 +378,7 @@ double calcTransformQuality(VSArray params, void* dat){
   int num = 1; // we start with 1 to avoid div by zero
   for (int i = 0; i < num_motions; i++) {
     if(gd->missmatches.dat[i]>=0){
-      LocalMotion* m = LMGet(motions,i);
+      const LocalMotion* m = MSGet(motions,i);
       double vx,vy;
       transform_vec_double(&vx, &vy, &pt, (Vec*)&m->f);
       vx -= m->f.x; vy -= m->f.y;
@@ -171,26 +393,20 @@ double calcTransformQuality(VSArray params, void* dat){
   return error/num + fabs(t.alpha)/5.0 + fabs(t.zoom)/500.0;
 }
 
-double intMean(const int* ds, int len) {
-  double sum=0;
-  for (int i = 0; i < len; i++) sum += ds[i];
-  return sum / len;
-}
-
 // only calcates means transform to initialise gradient descent
-VSTransform meanMotions(VSTransformData* td, const LocalMotions* motions){
-  int len = vs_vector_size(motions);
+VSTransform meanMotions(VSTransformData* td, const VSMotionSet* motions){
   VSTransform t = null_transform();
-  if(motions==0 || len==0) {
+  if(motions==0 || motions->num==0) {
     t.extra = 1; // prob. blank frame or too low contrast, ignore later
     return t;
   }
-  int* xs = localmotions_getx(motions);
-  int* ys = localmotions_gety(motions);
-  t.x = intMean(xs,len);
-  t.y = intMean(ys,len);
-  vs_free(xs);
-  vs_free(ys);
+  double sx=0, sy=0;
+  for (int i = 0; i < motions->num; i++) {
+    sx += motions->lms[i].v.x;
+    sy += motions->lms[i].v.y;
+  }
+  t.x = sx / motions->num;
+  t.y = sy / motions->num;
   return t;
 }
 
@@ -220,12 +436,23 @@ int disableFields(VSArray mask, VSArray missqualities, double stddevs){
 VSTransform vsMotionsToTransform(VSTransformData* td,
                                  const LocalMotions* motions,
                                  FILE* f){
+  VSMotionSet set;
+  if(motions==0 || vs_motionset_from_vector(&set, motions) != VS_OK)
+    return vsMotionSetToTransform(td, 0, f);
+  VSTransform t = vsMotionSetToTransform(td, &set, f);
+  vs_motionset_fini(&set);
+  return t;
+}
+
+VSTransform vsMotionSetToTransform(VSTransformData* td,
+                                   const VSMotionSet* motions,
+                                   FILE* f){
   VSTransform t = meanMotions(td, motions);
-  if(motions==0 || vs_vector_size(motions)==0){
+  if(motions==0 || motions->num==0){
     if (f) fprintf(f,"0 0 0 0 0 %i\n# no fields\n", t.extra);
     return t;
   }
-  VSArray missmatches = vs_array_new(vs_vector_size(motions));
+  VSArray missmatches = vs_array_new(motions->num);
   VSArray params = vsTransformToArray(&t);
   double residual;
   struct VSGradientDat dat;
@@ -234,7 +461,7 @@ VSTransform vsMotionsToTransform(VSTransformData* td,
   dat.missmatches = missmatches;
 
   // first we throw away those fields that match badely (during motion detection)
-  VSArray matchQualities = localmotionsGetMatch(motions);
+  VSArray matchQualities = motionsetGetMatch(motions);
   int dis1=disableFields(missmatches, matchQualities, 1.5);
   vs_array_free(matchQualities);
 
@@ -258,8 +485,8 @@ VSTransform vsMotionsToTransform(VSTransformData* td,
   }
 
   if(td->conf.verbose  & VS_DEBUG)
-    vs_log_info(td->conf.modName, "disabled (%i+%i)/%i,\tresidual: %f (%i)\n",
-                dis1, dis2, vs_vector_size(motions), residual, k+1);
+    vs_ctx_log_info(&td->ctx, td->conf.modName, "disabled (%i+%i)/%i,\tresidual: %f (%i)\n",
+                dis1, dis2, motions->num, residual, k+1);
   t = vsArrayToTransform(result);
   vs_array_free(result);
   vs_array_free(missmatches);
@@ -351,11 +578,22 @@ double vsCalcAngle(const LocalMotion* lm, int center_x, int center_y){
 
 VSTransform vsSimpleMotionsToTransform(VSFrameInfo fi, const char* modName,
                                        const LocalMotions* motions){
+  VSMotionSet set;
+  VSTransform t = null_transform();
+  if(motions==0 || vs_motionset_from_vector(&set, motions) != VS_OK)
+    return t;
+  t = vsSimpleMotionSetToTransform(fi, modName, &set);
+  vs_motionset_fini(&set);
+  return t;
+}
+
+VSTransform vsSimpleMotionSetToTransform(VSFrameInfo fi, const char* modName,
+                                         const VSMotionSet* motions){
   int center_x = 0;
   int center_y = 0;
   VSTransform t = null_transform();
   if(motions==0) return t;
-  int num_motions=vs_vector_size(motions);
+  int num_motions=motions->num;
   if(num_motions < 1)
     return t;
   double *angles = (double*) vs_malloc(sizeof(double) * num_motions);
@@ -364,14 +602,14 @@ VSTransform vsSimpleMotionsToTransform(VSFrameInfo fi, const char* modName,
 
   // calc center point of all remaining fields
   for (i = 0; i < num_motions; i++) {
-    center_x += LMGet(motions,i)->f.x;
-    center_y += LMGet(motions,i)->f.y;
+    center_x += MSGet(motions,i)->f.x;
+    center_y += MSGet(motions,i)->f.y;
   }
   center_x /= num_motions;
   center_y /= num_motions;
 
   // cleaned mean
-  meanmotion = cleanmean_localmotions(motions);
+  meanmotion = cleanmean_motionset(motions);
 
   // figure out angle
   if (num_motions < 6) {
@@ -380,7 +618,7 @@ VSTransform vsSimpleMotionsToTransform(VSFrameInfo fi, const char* modName,
   } else {
     for (i = 0; i < num_motions; i++) {
       // substract avg and calc angle
-      LocalMotion m = sub_localmotion(LMGet(motions,i),&meanmotion);
+      LocalMotion m = sub_localmotion(MSGet(motions,i),&meanmotion);
       angles[i] = vsCalcAngle(&m, center_x, center_y);
     }
     double min, max;
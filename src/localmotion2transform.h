@@ -30,6 +30,7 @@
 
 #include "transform.h"
 #include "transformtype.h"
+#include "motionset.h"
 #include "serialize.h"
 #include "vidstab_api.h"
 
@@ -38,6 +39,32 @@
 VS_API int vsLocalmotions2Transforms(VSTransformData* td,
                               const VSManyLocalMotions* motions,
                               VSTransformations* trans );
+/** the same, reading the local motions from the .trf f frame by frame: each
+    frame is fitted when it is read and its motions are dropped, so the pass
+    holds one frame of motions and the transforms. The lens distortion is
+    estimated from a sample of conf.lensSampleFrames frames, all frames of a
+    shorter clip, which needs f to be read twice; if f cannot be rewound (a
+    pipe) the transforms are fitted without the lens. */
+VS_API int vsStreamMotions2Transforms(VSTransformData* td, FILE* f,
+                                      VSTransformations* trans);
+
+/** vsStreamMotions2Transforms, unless the binary .trf f (opened "rb", or "r+b"
+    to store) holds transforms fitted with the same parameters
+    (vsReadTransformsFromFile): these are read then, without reading a frame.
+    With store the transforms fitted here are stored in f for the next run.
+    With conf.storeTransforms (global_motions.trf) the transforms are always
+    fitted. */
+VS_API int vsCachedMotions2Transforms(VSTransformData* td, FILE* f,
+                                      VSTransformations* trans, int store);
+
+/** the same for the len frames that frame(motions, i, ...) hands out, one
+    frame at a time (see VSMotionFrameFn) */
+VS_API int vsMotionFrames2Transforms(VSTransformData* td, int len, VSMotionFrameFn frame,
+                                     const void* motions, VSTransformations* trans);
+/// the same for the compact motions of a clip (see vsReadCompactMotionsFile)
+VS_API int vsCompactMotions2Transforms(VSTransformData* td,
+                                       const VSManyCompactMotions* motions,
+                                       VSTransformations* trans );
 
 /** calculates rotation angle for the given transform and
  * field with respect to the given center-point
@@ -55,6 +82,9 @@ VS_API double vsCalcAngle(const LocalMotion* lm, int center_x, int center_y);
 */
 VS_API VSTransform vsSimpleMotionsToTransform(VSFrameInfo fi, const char* modname,
                                        const LocalMotions* motions);
+/// vsSimpleMotionsToTransform of a motion set
+VS_API VSTransform vsSimpleMotionSetToTransform(VSFrameInfo fi, const char* modname,
+                                                const VSMotionSet* motions);
 
 
 /** calculates the transformation that caused the observed motions.
@@ -65,6 +95,10 @@ VS_API VSTransform vsSimpleMotionsToTransform(VSFrameInfo fi, const char* modnam
 VS_API VSTransform vsMotionsToTransform(VSTransformData* td,
                                  const LocalMotions* motions,
                                  FILE* f);
+/// vsMotionsToTransform of a motion set
+VS_API VSTransform vsMotionSetToTransform(VSTransformData* td,
+                                          const VSMotionSet* motions,
+                                          FILE* f);
 
 
 
@@ -26,6 +26,8 @@
 #ifndef __LPSOLVER_H
 #define __LPSOLVER_H
 
+#include "threadpool.h"
+
 /** Minimal interface to a linear program of the form
  *
  *      minimize    c^T x
@@ -75,12 +77,41 @@ void vs_lp_add_entry(VSLinProg* lp, int row, int col, double val);
     @param verbose if nonzero the backend may print progress information */
 int vs_lp_solve(VSLinProg* lp, int verbose);
 
+/** empties the problem for another one of the same size: no entries, all
+    objective coefficients 0, all rows and columns free.  What the backend
+    derived from the structure of the matrix is kept, and used again if the
+    entries come back at the same positions and in the same order -- as they
+    do for the windows of the camera path. */
+void vs_lp_reset(VSLinProg* lp);
+
+/** a starting point for the next vs_lp_solve, typically the solution of a
+    similar problem: colval has numcols values (vs_lp_get_col_value), rowdual
+    numrows (vs_lp_get_row_dual); either may be NULL.  It is a hint only: a
+    backend may ignore it, and a poor one costs iterations, not accuracy.
+    It applies to one solve. */
+void vs_lp_set_start(VSLinProg* lp, const double* colval, const double* rowdual);
+
+/** the threads vs_lp_solve runs on: numThreads of them, the jobs going to
+    pool if that is not NULL (see threadpool.h), else to OpenMP if it is
+    compiled in.  Default 1, values below count as 1.  The result depends on
+    numThreads -- the built-in backend splits the normal equations into that
+    many parts from 5 threads on -- but on nothing else, so it is the same on
+    every run and every machine.  lp does not own pool.  GLPK ignores it. */
+void vs_lp_set_threads(VSLinProg* lp, VSThreadPool* pool, int numThreads);
+
 /** objective value of the solution; only valid after vs_lp_solve returned VS_OK */
 double vs_lp_get_obj_value(const VSLinProg* lp);
 
 /** value of variable col; only valid after vs_lp_solve returned VS_OK */
 double vs_lp_get_col_value(const VSLinProg* lp, int col);
 
+/** dual value (shadow price) of row `row`; only valid after vs_lp_solve
+    returned VS_OK */
+double vs_lp_get_row_dual(const VSLinProg* lp, int row);
+
+/** iterations the last vs_lp_solve took, 0 if the backend does not say */
+int vs_lp_get_iterations(const VSLinProg* lp);
+
 /** name of the compiled-in backend, for logging */
 const char* vs_lp_backend_name(void);
 
@@ -96,6 +96,28 @@ void vs_lp_free(VSLinProg* p){
   vs_free(p);
 }
 
+void vs_lp_reset(VSLinProg* p){
+  if (!p) return;
+  p->numentries = 0;
+  p->solved     = 0;
+  p->status     = "";
+  for (int i = 1; i <= p->numrows; i++) glp_set_row_bnds(p->lp, i, GLP_FR, 0.0, 0.0);
+  for (int j = 1; j <= p->numcols; j++) {
+    glp_set_col_bnds(p->lp, j, GLP_FR, 0.0, 0.0);
+    glp_set_obj_coef(p->lp, j, 0.0);
+  }
+}
+
+/* the presolver starts every solve from scratch, so a starting point is of no
+   use to it */
+void vs_lp_set_start(VSLinProg* p, const double* colval, const double* rowdual){
+  (void)p; (void)colval; (void)rowdual;
+}
+
+void vs_lp_set_threads(VSLinProg* p, VSThreadPool* pool, int numThreads){
+  (void)p; (void)pool; (void)numThreads;
+}
+
 void vs_lp_set_row_bounds(VSLinProg* p, int row, double lo, double up){
   if (!p || row < 0 || row >= p->numrows) return;
   glp_set_row_bnds(p->lp, row + 1, boundtype(lo, up), lo, up);
@@ -176,6 +198,16 @@ double vs_lp_get_col_value(const VSLinProg* p, int col){
   return glp_get_col_prim(p->lp, col + 1);
 }
 
+double vs_lp_get_row_dual(const VSLinProg* p, int row){
+  if (!p || !p->solved || row < 0 || row >= p->numrows) return 0.0;
+  return glp_get_row_dual(p->lp, row + 1);
+}
+
+int vs_lp_get_iterations(const VSLinProg* p){
+  (void)p;
+  return 0;
+}
+
 const char* vs_lp_status_msg(const VSLinProg* p){
   return (p && p->status) ? p->status : "";
 }
@@ -16,7 +16,9 @@
  *  the update transforms of t .. t+3, so with the rows ordered by time (see the
  *  layout comment in l1campathoptimization.c) the matrix above has a half
  *  bandwidth of about 130 regardless of the number of frames.  A banded
- *  Cholesky is then O(N) per iteration and about fifty lines.
+ *  Cholesky is then O(N) per iteration.  On several threads the band is cut
+ *  into parts that are factored independently and joined through the small
+ *  system of the rows between them, see "banded Cholesky".
  *
  *  Copyright (C) Georg Martius - 2026
  *   georg dot martius at web dot de
@@ -82,11 +84,62 @@
 #ifndef IPM_REG
 #define IPM_REG       1e-11
 #endif
+/* distance from the bounds a starting point given with vs_lp_set_start is
+   moved to, see ipmWarmStart */
+#ifndef IPM_WARMPUSH
+#define IPM_WARMPUSH  1e-2
+#endif
+/* columns of a panel of the blocked Cholesky, see bandCholeskyRange */
+#ifndef IPM_PANEL
+#define IPM_PANEL     32
+#endif
+/* rows a part of the split normal equations has at least, in multiples of
+   the bandwidth, see bandNumParts */
+#ifndef IPM_PARTROWS
+#define IPM_PARTROWS  4
+#endif
+/* parts below which the split does not pay, see bandNumParts */
+#ifndef IPM_MINPARTS
+#define IPM_MINPARTS  5
+#endif
+/* rows of A a job of the loops over them takes, see ipmAxStruct */
+#ifndef IPM_ROWBLOCK
+#define IPM_ROWBLOCK  512
+#endif
 /* refinement passes on the full Newton system, see ipmDirectionRefined */
 #ifndef IPM_REFINE
 #define IPM_REFINE    2
 #endif
 
+/* the threads of a solve, see vs_lp_set_threads */
+typedef struct {
+  VSThreadPool* pool;
+  int           threads;
+} IpmThreads;
+
+/* the program after normalization, see "the solver" below */
+typedef struct {
+  int      m;          // equality rows
+  int      nv;         // variables: structural + one slack per row
+  int      n;          // structural variables
+  int*     colptr;     // CSC of the structural part of A, size n+1
+  int*     rowidx;
+  double*  val;
+  double*  b;
+  double*  c;
+  double*  lo;         // shift that was applied
+  double*  h;          // upper bound of the shifted variable, VS_LP_INF if none
+  double*  scale;      // equilibration factor: true value = lo + scale * v
+  double   objscale;   // the objective was divided by this
+  signed char* sign;   // -1 if the variable was negated during normalization
+  signed char* rowsign; // -1 if the row was negated during normalization
+  int*     rowptr;     // CSR of the same entries, for the loops over rows
+  int*     colidx;
+  int*     cscpos;     // position of every CSR entry in the CSC
+  double*  rval;       // val in CSR order
+  IpmThreads th;
+} IpmProb;
+
 struct VSLinProg {
   int     numrows;
   int     numcols;
@@ -101,29 +154,291 @@ struct VSLinProg {
   double* colup;
   double* obj;
   double* sol;         // primal solution of the structural variables
+  double* rowdual;     // dual solution of the rows
+  double* startcol;    // starting point of the next solve, see vs_lp_set_start
+  double* startdual;
+  int     hasstartcol;
+  int     hasstartdual;
   double  objval;
   int     solved;
+  int     iterations;
   const char* status;
   char    statusbuf[96];
+  /* Kept from one solve to the next, see vs_lp_reset: the normalized program,
+     the CSC position of every entry and the bandwidth -- which depend on where
+     the entries are, not on their values -- and the working memory. */
+  IpmProb q;
+  int*    entpos;
+  int     patternsize;  // number of entries entpos and bw belong to, 0: none
+  int     samepattern;  // the entries added since sit where the pattern has them
+  int     bw;
+  double* banddat;
+  double* pool;
+  IpmThreads th;
+  int     parts;        // of the split band, see bandPartition
+  int*    partrows;
+  double* partdat;
+  size_t  partsize;
 };
 
+static void ipmProbFree(IpmProb* q);
+
 static int isinf_lp(double v){ return v >= VS_LP_INF || v <= -VS_LP_INF; }
 
+/** fn(ctx, i) for i = 0 .. n-1, on the threads of th.  Every loop of the
+    solver writes what an index owns only, in a fixed order, so the result
+    does not depend on how the indices are distributed. */
+static void ipmFor(const IpmThreads* th, int n, vsParallelFn fn, void* ctx){
+  if (th->pool || th->threads > 1) {
+    vsParallelFor(th->pool, th->threads, n, fn, ctx);
+  } else {
+    for (int i = 0; i < n; i++) fn(ctx, i);
+  }
+}
+
 /* ****************************************************************************
  * banded Cholesky
  *
  * The lower triangle of a symmetric matrix with half bandwidth bw is stored
  * column by column: band[j*(bw+1) + d] holds the element (j+d, j).
+ *
+ * With enough threads the rows are split into parts, one per thread, with
+ * bw rows -- a separator -- between a part and the next (bandPartition).  No
+ * row of one part reaches a row of another, so with the parts first the
+ * matrix is
+ *
+ *      [ D  C^T ]
+ *      [ C  S   ],   D block diagonal.
+ *
+ * The parts D_k are factored at the same time, each together with what it
+ * takes off the separators next to it in the Schur complement S - C D^-1 C^T.
+ * That complement is block tridiagonal with bw x bw blocks, a band of
+ * (parts-1)*bw rows, and is factored on its own.  A solve is then a solve with
+ * D, one with the complement and another with D, the first and last again
+ * part by part.  Nothing is dropped, but the rounding differs from that of
+ * the plain factorization, so the result depends on the number of parts --
+ * and on nothing else.
  * ************************************************************************** */
 
 typedef struct {
   int     m;
   int     bw;
   double* dat;
+  IpmThreads th;
+  /* the split, see bandPartition; parts 1: none, the fields below are unused */
+  int     parts;
+  int*    plo;      // part k: rows plo[k] .. phi[k]-1, its separator phi[k] .. plo[k+1]-1
+  int*    phi;
+  double* spikes;   // BAND_SPIKES(bw) for every part, see bandFactorPart
+  double* red;      // the band of the separators, see bandSeparators
+  double* rs;       // its right hand side, (parts-1)*bw
+  double* work;     // m
 } Band;
 
+/* gl, gr, cross and Y (bw x bw each) and the ring of X (bw+1 rows) of a part */
+#define BAND_SPIKES(bw) ((size_t)(bw) * (5 * (size_t)(bw) + 1))
+
 static double* bandAt(Band* b, int col, int d){ return &b->dat[(size_t)col * (b->bw + 1) + d]; }
 
+/** updates column j with column p of the factor (p < j <= p + bw), over the
+    rows j .. hi-1 that both reach: M(i,j) -= L(i,p) L(j,p).  Both columns are
+    contiguous, so this is the loop the compiler vectorizes. */
+static void bandColumnUpdate(Band* b, int p, int j, int hi){
+  const int ld = b->bw + 1;
+  const double* cp = b->dat + (size_t)p * ld + (j - p);
+  double* cj = b->dat + (size_t)j * ld;
+  const double f = cp[0];
+  const int len = VS_MIN(p + b->bw, hi - 1) - j + 1;
+  if (f == 0.0) return;
+  for (int r = 0; r < len; r++) cj[r] -= cp[r] * f;
+}
+
+/** in place Cholesky of the rows and columns lo .. hi-1, L L^T = M; the
+    entries outside are neither read nor written.
+
+    Right-looking in panels of IPM_PANEL columns: a panel is factored on its
+    own, then its columns update the (at most bw) columns after it, each of
+    which stays in the cache for the whole panel.  Every entry still takes its
+    updates in the order of the columns they come from, as in the textbook
+    column-by-column algorithm. */
+static void bandCholeskyRange(Band* b, int lo, int hi){
+  const int bw = b->bw, ld = bw + 1;
+  for (int j0 = lo; j0 < hi; j0 += IPM_PANEL) {
+    const int j1 = VS_MIN(j0 + IPM_PANEL, hi);
+    for (int j = j0; j < j1; j++) {
+      double* cj = b->dat + (size_t)j * ld;
+      const int len = VS_MIN(bw, hi - 1 - j);
+      double d = cj[0];
+      if (!(d > 1e-300)) d = 1e-300;
+      const double piv = sqrt(d);
+      cj[0] = piv;
+      for (int r = 1; r <= len; r++) cj[r] /= piv;
+      for (int k = j + 1; k < j1 && k <= j + len; k++) bandColumnUpdate(b, j, k, hi);
+    }
+    const int kmax = VS_MIN(j1 - 1 + bw, hi - 1);
+    for (int k = j1; k <= kmax; k++)
+      for (int p = VS_MAX(j0, k - bw); p < j1; p++) bandColumnUpdate(b, p, k, hi);
+  }
+}
+
+/** x = L^-1 x over the rows lo .. hi-1, column by column */
+static void bandForward(const Band* b, int lo, int hi, double* x){
+  const int bw = b->bw, ld = bw + 1;
+  for (int p = lo; p < hi; p++) {
+    const double* cp = b->dat + (size_t)p * ld;
+    const double xp = x[p] / cp[0];
+    const int len = VS_MIN(bw, hi - 1 - p);
+    x[p] = xp;
+    for (int r = 1; r <= len; r++) x[p + r] -= cp[r] * xp;
+  }
+}
+
+/** x = L^-T x over the rows lo .. hi-1 */
+static void bandBackward(const Band* b, int lo, int hi, double* x){
+  const int bw = b->bw, ld = bw + 1;
+  for (int i = hi - 1; i >= lo; i--) {
+    const double* ci = b->dat + (size_t)i * ld;
+    const int len = VS_MIN(bw, hi - 1 - i);
+    double s = x[i];
+    for (int r = 1; r <= len; r++) s -= ci[r] * x[i + r];
+    x[i] = s / ci[0];
+  }
+}
+
+/** the number of parts m rows are split into for `threads` threads: every
+    part keeps at least IPM_PARTROWS*bw rows, the first one twice as many,
+    because it has no separator before it and costs less than half as much.
+    The parts together do about twice the work of the plain factorization,
+    so fewer than IPM_MINPARTS are slower than none: 1 then. */
+static int bandNumParts(int m, int bw, int threads){
+  if (bw < 1) return 1;
+  for (; threads > 1; threads--)
+    if ((m - (threads - 1) * bw) / (threads + 1) >= IPM_PARTROWS * bw) break;
+  return threads >= IPM_MINPARTS ? threads : 1;
+}
+
+/** the rows of the b->parts parts of b, see bandNumParts */
+static void bandPartition(Band* b){
+  const int P = b->parts, bw = b->bw, unit = (b->m - (P - 1) * bw) / (P + 1);
+  b->plo[0] = 0;
+  b->phi[0] = 2 * unit;
+  for (int k = 1; k < P; k++) {
+    b->plo[k] = b->phi[k - 1] + bw;
+    b->phi[k] = b->plo[k] + unit;
+  }
+  b->phi[P - 1] = b->m;
+}
+
+/** the band of the separators: their Schur complement, see bandReduce */
+static Band bandSeparators(const Band* b){
+  Band red;
+  memset(&red, 0, sizeof(red));
+  red.m = (b->parts - 1) * b->bw;
+  red.bw = 2 * b->bw - 1;
+  red.dat = b->red;
+  red.th.threads = 1;
+  red.parts = 1;
+  return red;
+}
+
+/** adds the lower triangle of x x^T (x of bw values) to g */
+static void bandAddOuter(double* g, const double* x, int bw){
+  for (int c = 0; c < bw; c++) {
+    const double f = x[c];
+    double* gc = g + (size_t)c * bw;
+    if (f == 0.0) continue;
+    for (int c2 = 0; c2 <= c; c2++) gc[c2] += f * x[c2];
+  }
+}
+
+/** factors part k and derives what it takes off the separators around it:
+    with H the coupling of the separator after the part and G that of the one
+    before, gr = H D^-1 H^T, gl = G D^-1 G^T and cross = H D^-1 G^T.
+    Y = L^-1 H^T is zero above the last bw rows, since H^T is, and gr = Y^T Y.
+    X = L^-1 G^T on the other hand fills the whole part although G^T only
+    reaches its first bw rows; it is carried along bw+1 rows at a time, and
+    gl = X^T X and cross = Y^T X are summed up on the way. */
+static void bandFactorPart(void* ctx, int k){
+  Band* b = (Band*)ctx;
+  const int bw = b->bw, ld = bw + 1, lo = b->plo[k], hi = b->phi[k];
+  double* gl    = b->spikes + (size_t)k * BAND_SPIKES(bw);
+  double* gr    = gl + (size_t)bw * bw;
+  double* cross = gr + (size_t)bw * bw;
+  double* yr    = cross + (size_t)bw * bw;
+  double* ring  = yr + (size_t)bw * bw;
+
+  bandCholeskyRange(b, lo, hi);
+  if (k + 1 < b->parts) {
+    const int r0 = hi - bw;
+    memset(gr, 0, sizeof(double) * bw * bw);
+    for (int i = r0; i < hi; i++) {
+      const double* ci = b->dat + (size_t)i * ld;
+      double* yi = yr + (size_t)(i - r0) * bw;
+      for (int c = 0; c < bw; c++) yi[c] = hi + c - i <= bw ? ci[hi + c - i] : 0.0;
+      for (int p = r0; p < i; p++) {
+        const double l = b->dat[(size_t)p * ld + (i - p)];
+        const double* yp = yr + (size_t)(p - r0) * bw;
+        for (int c = 0; c < bw; c++) yi[c] -= l * yp[c];
+      }
+      for (int c = 0; c < bw; c++) yi[c] /= ci[0];
+      bandAddOuter(gr, yi, bw);
+    }
+  }
+  if (k > 0) {
+    memset(gl, 0, sizeof(double) * bw * bw);
+    memset(cross, 0, sizeof(double) * bw * bw);
+    for (int i = lo; i < hi; i++) {
+      double* xi = ring + (size_t)((i - lo) % ld) * bw;
+      for (int c = 0; c < bw; c++) {
+        const int s = lo - bw + c;
+        xi[c] = i - s <= bw ? b->dat[(size_t)s * ld + (i - s)] : 0.0;
+      }
+      for (int p = VS_MAX(lo, i - bw); p < i; p++) {
+        const double l = b->dat[(size_t)p * ld + (i - p)];
+        const double* xp = ring + (size_t)((p - lo) % ld) * bw;
+        if (l == 0.0) continue;
+        for (int c = 0; c < bw; c++) xi[c] -= l * xp[c];
+      }
+      const double piv = b->dat[(size_t)i * ld];
+      for (int c = 0; c < bw; c++) xi[c] /= piv;
+      bandAddOuter(gl, xi, bw);
+      if (k + 1 < b->parts && i >= hi - bw) {
+        const double* yi = yr + (size_t)(i - hi + bw) * bw;
+        for (int c = 0; c < bw; c++) {
+          const double f = yi[c];
+          double* cc = cross + (size_t)c * bw;
+          for (int c2 = 0; c2 < bw; c2++) cc[c2] += f * xi[c2];
+        }
+      }
+    }
+  }
+}
+
+/** assembles and factors the Schur complement of the separators: separator
+    k keeps its block of M less gr of the part before and gl of the part after
+    it, and meets separator k-1 through -cross of the part between them */
+static void bandReduce(Band* b){
+  const int bw = b->bw, ld = bw + 1;
+  Band red = bandSeparators(b);
+  memset(red.dat, 0, sizeof(double) * (size_t)red.m * (red.bw + 1));
+  for (int k = 0; k + 1 < b->parts; k++) {
+    const double* gr = b->spikes + (size_t)k * BAND_SPIKES(bw) + (size_t)bw * bw;
+    const double* gl = b->spikes + (size_t)(k + 1) * BAND_SPIKES(bw);
+    const int s0 = b->phi[k], r0 = k * bw;
+    for (int c2 = 0; c2 < bw; c2++)
+      for (int c = c2; c < bw; c++)
+        *bandAt(&red, r0 + c2, c - c2) = b->dat[(size_t)(s0 + c2) * ld + (c - c2)]
+          - gr[c * bw + c2] - gl[c * bw + c2];
+    if (k > 0) {
+      const double* cross = gr + (size_t)bw * bw;
+      for (int c = 0; c < bw; c++)
+        for (int c2 = 0; c2 < bw; c2++)
+          *bandAt(&red, r0 - bw + c2, bw + c - c2) = -cross[c * bw + c2];
+    }
+  }
+  bandCholeskyRange(&red, 0, red.m);
+}
+
 /** in place Cholesky, L L^T = M.  The diagonal is scaled by 1 + `releps` as a
     regularization; a relative shift is essential here because the entries of
     Theta span many orders of magnitude near the solution, so any absolute
@@ -132,44 +447,78 @@ static double* bandAt(Band* b, int col, int d){ return &b->dat[(size_t)col * (b-
     is then no longer an exact factorization, but iterative refinement on the
     normal equations recovers the accuracy. */
 static void bandCholesky(Band* b, double releps){
-  const int m = b->m, bw = b->bw;
-  for (int j = 0; j < m; j++) {
-    double d = *bandAt(b, j, 0) * (1.0 + releps);
-    int p0 = j - bw; if (p0 < 0) p0 = 0;
-    for (int p = p0; p < j; p++) {
-      double v = *bandAt(b, p, j - p);
-      d -= v * v;
-    }
-    if (!(d > 1e-300)) d = 1e-300;
-    double piv = sqrt(d);
-    *bandAt(b, j, 0) = piv;
-    int imax = j + bw; if (imax > m - 1) imax = m - 1;
-    for (int i = j + 1; i <= imax; i++) {
-      double s = *bandAt(b, j, i - j);
-      int q0 = i - bw; if (q0 < 0) q0 = 0;
-      for (int p = q0; p < j; p++) {
-        s -= *bandAt(b, p, i - p) * *bandAt(b, p, j - p);
-      }
-      *bandAt(b, j, i - j) = s / piv;
-    }
+  for (int j = 0; j < b->m; j++) *bandAt(b, j, 0) *= 1.0 + releps;
+  if (b->parts == 1) {
+    bandCholeskyRange(b, 0, b->m);
+    return;
   }
+  ipmFor(&b->th, b->parts, bandFactorPart, b);
+  bandReduce(b);
+}
+
+typedef struct {
+  const Band* b;
+  double*     x;
+} BandSolveJob;
+
+/** x = D_k^-1 x on part k */
+static void bandSolvePart(void* ctx, int k){
+  const BandSolveJob* job = (const BandSolveJob*)ctx;
+  bandForward(job->b, job->b->plo[k], job->b->phi[k], job->x);
+  bandBackward(job->b, job->b->plo[k], job->b->phi[k], job->x);
+}
+
+/** x -= D_k^-1 C_k^T x on part k, with the separators around it solved */
+static void bandCorrectPart(void* ctx, int k){
+  const BandSolveJob* job = (const BandSolveJob*)ctx;
+  const Band* b = job->b;
+  const int bw = b->bw, ld = bw + 1, lo = b->plo[k], hi = b->phi[k];
+  double* x = job->x;
+  double* t = b->work;
+  memset(t + lo, 0, sizeof(double) * (hi - lo));
+  if (k > 0)
+    for (int i = lo; i < lo + bw; i++)
+      for (int s = VS_MAX(lo - bw, i - bw); s < lo; s++)
+        t[i] += b->dat[(size_t)s * ld + (i - s)] * x[s];
+  if (k + 1 < b->parts)
+    for (int i = hi - bw; i < hi; i++)
+      for (int s = hi; s <= VS_MIN(i + bw, hi + bw - 1); s++)
+        t[i] += b->dat[(size_t)i * ld + (s - i)] * x[s];
+  bandForward(b, k > 0 ? lo : hi - bw, hi, t);
+  bandBackward(b, lo, hi, t);
+  for (int i = lo; i < hi; i++) x[i] -= t[i];
 }
 
 /** solves L L^T x = r in place on x (which may alias r) */
 static void bandSolve(Band* b, const double* r, double* x){
-  const int m = b->m, bw = b->bw;
-  for (int i = 0; i < m; i++) {
-    double s = r[i];
-    int p0 = i - bw; if (p0 < 0) p0 = 0;
-    for (int p = p0; p < i; p++) s -= *bandAt(b, p, i - p) * x[p];
-    x[i] = s / *bandAt(b, i, 0);
+  if (x != r) memcpy(x, r, sizeof(double) * b->m);
+  if (b->parts == 1) {
+    bandForward(b, 0, b->m, x);
+    bandBackward(b, 0, b->m, x);
+    return;
   }
-  for (int i = m - 1; i >= 0; i--) {
-    double s = x[i];
-    int pmax = i + bw; if (pmax > m - 1) pmax = m - 1;
-    for (int p = i + 1; p <= pmax; p++) s -= *bandAt(b, i, p - i) * x[p];
-    x[i] = s / *bandAt(b, i, 0);
+  const int bw = b->bw, ld = bw + 1;
+  BandSolveJob job;
+  job.b = b; job.x = x;
+  ipmFor(&b->th, b->parts, bandSolvePart, &job);
+  /* the separators, with the right hand side r_S - C D^-1 r_D */
+  for (int k = 0; k + 1 < b->parts; k++) {
+    for (int c = 0; c < bw; c++) {
+      const int s = b->phi[k] + c;
+      double v = x[s];
+      for (int i = VS_MAX(b->phi[k] - bw, s - bw); i < b->phi[k]; i++)
+        v -= b->dat[(size_t)i * ld + (s - i)] * x[i];
+      for (int i = b->plo[k + 1]; i <= VS_MIN(s + bw, b->phi[k + 1] - 1); i++)
+        v -= b->dat[(size_t)s * ld + (i - s)] * x[i];
+      b->rs[k * bw + c] = v;
+    }
   }
+  Band red = bandSeparators(b);
+  bandForward(&red, 0, red.m, b->rs);
+  bandBackward(&red, 0, red.m, b->rs);
+  for (int k = 0; k + 1 < b->parts; k++)
+    memcpy(x + b->phi[k], b->rs + k * bw, sizeof(double) * bw);
+  ipmFor(&b->th, b->parts, bandCorrectPart, &job);
 }
 
 static double vecmaxabs_(const double* v, int n){
@@ -191,6 +540,7 @@ VSLinProg* vs_lp_new(const char* name, int numrows, int numcols, int maxentries)
   p->numcols    = numcols;
   p->maxentries = maxentries;
   p->status     = "";
+  p->th.threads = 1;
   p->ent_row = (int*)   vs_malloc(sizeof(int)    * maxentries);
   p->ent_col = (int*)   vs_malloc(sizeof(int)    * maxentries);
   p->ent_val = (double*)vs_malloc(sizeof(double) * maxentries);
@@ -200,13 +550,13 @@ VSLinProg* vs_lp_new(const char* name, int numrows, int numcols, int maxentries)
   p->colup   = (double*)vs_malloc(sizeof(double) * numcols);
   p->obj     = (double*)vs_zalloc(sizeof(double) * numcols);
   p->sol     = (double*)vs_zalloc(sizeof(double) * numcols);
+  p->rowdual = (double*)vs_zalloc(sizeof(double) * numrows);
   if (!p->ent_row || !p->ent_col || !p->ent_val || !p->rowlo || !p->rowup ||
-      !p->collo || !p->colup || !p->obj || !p->sol) {
+      !p->collo || !p->colup || !p->obj || !p->sol || !p->rowdual) {
     vs_lp_free(p);
     return 0;
   }
-  for (int i = 0; i < numrows; i++) { p->rowlo[i] = -VS_LP_INF; p->rowup[i] = VS_LP_INF; }
-  for (int j = 0; j < numcols; j++) { p->collo[j] = -VS_LP_INF; p->colup[j] = VS_LP_INF; }
+  vs_lp_reset(p);
   return p;
 }
 
@@ -216,9 +566,55 @@ void vs_lp_free(VSLinProg* p){
   vs_free(p->rowlo); vs_free(p->rowup);
   vs_free(p->collo); vs_free(p->colup);
   vs_free(p->obj);   vs_free(p->sol);
+  vs_free(p->rowdual);
+  vs_free(p->startcol); vs_free(p->startdual);
+  ipmProbFree(&p->q);
+  vs_free(p->entpos);
+  vs_free(p->banddat);
+  vs_free(p->pool);
+  vs_free(p->partrows); vs_free(p->partdat);
   vs_free(p);
 }
 
+void vs_lp_reset(VSLinProg* p){
+  if (!p) return;
+  /* ent_row and ent_col are left as they are: vs_lp_add_entry compares the
+     new entries against them */
+  p->numentries  = 0;
+  p->samepattern = 1;
+  p->solved      = 0;
+  p->status      = "";
+  for (int i = 0; i < p->numrows; i++) { p->rowlo[i] = -VS_LP_INF; p->rowup[i] = VS_LP_INF; }
+  for (int j = 0; j < p->numcols; j++) {
+    p->collo[j] = -VS_LP_INF; p->colup[j] = VS_LP_INF; p->obj[j] = 0.0;
+  }
+}
+
+void vs_lp_set_start(VSLinProg* p, const double* colval, const double* rowdual){
+  if (!p) return;
+  p->hasstartcol = p->hasstartdual = 0;
+  if (colval) {
+    if (!p->startcol) p->startcol = (double*)vs_malloc(sizeof(double) * p->numcols);
+    if (p->startcol) {
+      memcpy(p->startcol, colval, sizeof(double) * p->numcols);
+      p->hasstartcol = 1;
+    }
+  }
+  if (rowdual) {
+    if (!p->startdual) p->startdual = (double*)vs_malloc(sizeof(double) * p->numrows);
+    if (p->startdual) {
+      memcpy(p->startdual, rowdual, sizeof(double) * p->numrows);
+      p->hasstartdual = 1;
+    }
+  }
+}
+
+void vs_lp_set_threads(VSLinProg* p, VSThreadPool* pool, int numThreads){
+  if (!p) return;
+  p->th.pool    = pool;
+  p->th.threads = VS_MAX(numThreads, 1);
+}
+
 void vs_lp_set_row_bounds(VSLinProg* p, int row, double lo, double up){
   if (!p || row < 0 || row >= p->numrows) return;
   p->rowlo[row] = lo; p->rowup[row] = up;
@@ -239,6 +635,8 @@ void vs_lp_add_entry(VSLinProg* p, int row, int col, double val){
   if (row < 0 || row >= p->numrows || col < 0 || col >= p->numcols) return;
   if (p->numentries >= p->maxentries) { p->status = "matrix entry buffer overflow"; return; }
   int k = p->numentries++;
+  if (k >= p->patternsize || p->ent_row[k] != row || p->ent_col[k] != col)
+    p->samepattern = 0;
   p->ent_row[k] = row; p->ent_col[k] = col; p->ent_val[k] = val;
 }
 
@@ -259,26 +657,12 @@ void vs_lp_add_entry(VSLinProg* p, int row, int col, double val){
  * but y leaves (A Theta A^T) dy = rhs with Theta = (Z/V + W/T)^-1.
  * ************************************************************************** */
 
-typedef struct {
-  int      m;          // equality rows
-  int      nv;         // variables: structural + one slack per row
-  int      n;          // structural variables
-  int*     colptr;     // CSC of the structural part of A, size n+1
-  int*     rowidx;
-  double*  val;
-  double*  b;
-  double*  c;
-  double*  lo;         // shift that was applied
-  double*  h;          // upper bound of the shifted variable, VS_LP_INF if none
-  double*  scale;      // equilibration factor: true value = lo + scale * v
-  double   objscale;   // the objective was divided by this
-  signed char* sign;   // -1 if the variable was negated during normalization
-} IpmProb;
 
 static void ipmProbFree(IpmProb* q){
   vs_free(q->colptr); vs_free(q->rowidx); vs_free(q->val);
   vs_free(q->b); vs_free(q->c); vs_free(q->lo); vs_free(q->h);
-  vs_free(q->scale); vs_free(q->sign);
+  vs_free(q->scale); vs_free(q->sign); vs_free(q->rowsign);
+  vs_free(q->rowptr); vs_free(q->colidx); vs_free(q->cscpos); vs_free(q->rval);
   memset(q, 0, sizeof(*q));
 }
 
@@ -341,28 +725,47 @@ static void ipmEquilibrate(IpmProb* q){
 
 /** brings the problem into the form described above.  Returns VS_ERROR if a
     variable or a row is free on both sides, which this backend does not
-    support (the camera path program never produces one). */
-static int ipmBuild(VSLinProg* p, IpmProb* q){
+    support (the camera path program never produces one).
+
+    The arrays of q are allocated on the first call and reused after.  With
+    `reuse` set the entries sit where they did in the last call, so the column
+    structure of A (colptr, rowidx, entpos and the CSR) is kept, and only the values
+    are filled in again. */
+static int ipmBuild(VSLinProg* p, IpmProb* q, int reuse){
   const int m = p->numrows, n = p->numcols;
-  memset(q, 0, sizeof(*q));
-  q->m = m; q->n = n; q->nv = n + m; q->objscale = 1.0;
-
-  q->lo    = (double*)vs_malloc(sizeof(double) * q->nv);
-  q->h     = (double*)vs_malloc(sizeof(double) * q->nv);
-  q->scale = (double*)vs_malloc(sizeof(double) * q->nv);
-  q->c     = (double*)vs_zalloc(sizeof(double) * q->nv);
-  q->b     = (double*)vs_zalloc(sizeof(double) * m);
-  q->sign  = (signed char*)vs_malloc(sizeof(signed char) * q->nv);
-  q->colptr = (int*)vs_zalloc(sizeof(int) * (n + 1));
-  q->rowidx = (int*)vs_malloc(sizeof(int) * (p->numentries > 0 ? p->numentries : 1));
-  q->val    = (double*)vs_malloc(sizeof(double) * (p->numentries > 0 ? p->numentries : 1));
-  if (!q->lo || !q->h || !q->scale || !q->c || !q->b || !q->sign || !q->colptr ||
-      !q->rowidx || !q->val) { ipmProbFree(q); return VS_ERROR; }
+  if (!q->lo) {
+    q->m = m; q->n = n; q->nv = n + m;
+    q->lo    = (double*)vs_malloc(sizeof(double) * q->nv);
+    q->h     = (double*)vs_malloc(sizeof(double) * q->nv);
+    q->scale = (double*)vs_malloc(sizeof(double) * q->nv);
+    q->c     = (double*)vs_malloc(sizeof(double) * q->nv);
+    q->b     = (double*)vs_malloc(sizeof(double) * m);
+    q->sign  = (signed char*)vs_malloc(sizeof(signed char) * q->nv);
+    q->rowsign = (signed char*)vs_malloc(sizeof(signed char) * m);
+    q->colptr  = (int*)vs_malloc(sizeof(int) * (n + 1));
+    /* p->maxentries bounds the entries of every problem put into p */
+    q->rowidx = (int*)vs_malloc(sizeof(int) * p->maxentries);
+    q->val    = (double*)vs_malloc(sizeof(double) * p->maxentries);
+    p->entpos = (int*)vs_malloc(sizeof(int) * p->maxentries);
+    q->rowptr = (int*)vs_malloc(sizeof(int) * (m + 1));
+    q->colidx = (int*)vs_malloc(sizeof(int) * p->maxentries);
+    q->cscpos = (int*)vs_malloc(sizeof(int) * p->maxentries);
+    q->rval   = (double*)vs_malloc(sizeof(double) * p->maxentries);
+    if (!q->lo || !q->h || !q->scale || !q->c || !q->b || !q->sign || !q->rowsign
+        || !q->colptr || !q->rowidx || !q->val || !p->entpos
+        || !q->rowptr || !q->colidx || !q->cscpos || !q->rval) {
+      ipmProbFree(q); vs_free(p->entpos); p->entpos = NULL;
+      return VS_ERROR;
+    }
+  }
+  q->objscale = 1.0;
+  memset(q->c, 0, sizeof(double) * q->nv);
+  memset(q->b, 0, sizeof(double) * m);
 
   /* structural variables: negate the ones that are bounded from above only */
   for (int j = 0; j < n; j++) {
     double l = p->collo[j], u = p->colup[j];
-    if (isinf_lp(l) && isinf_lp(u)) { ipmProbFree(q); return VS_ERROR; }
+    if (isinf_lp(l) && isinf_lp(u)) return VS_ERROR;
     if (isinf_lp(l)) {
       q->sign[j] = -1;
       q->lo[j] = -u;
@@ -377,38 +780,56 @@ static int ipmBuild(VSLinProg* p, IpmProb* q){
   }
   /* row slacks: A_i x - s_i = 0 with s_i between the row bounds; a row that is
      bounded from above only is negated, together with its entries */
-  signed char* rowsign = (signed char*)vs_malloc(sizeof(signed char) * m);
-  if (!rowsign) { ipmProbFree(q); return VS_ERROR; }
   for (int i = 0; i < m; i++) {
     double l = p->rowlo[i], u = p->rowup[i];
-    if (isinf_lp(l) && isinf_lp(u)) { vs_free(rowsign); ipmProbFree(q); return VS_ERROR; }
+    if (isinf_lp(l) && isinf_lp(u)) return VS_ERROR;
     int j = n + i;
     q->sign[j] = 1;
     if (isinf_lp(l)) {
-      rowsign[i] = -1;
+      q->rowsign[i] = -1;
       q->lo[j] = -u;
       q->h[j]  = VS_LP_INF;
     } else {
-      rowsign[i] = 1;
+      q->rowsign[i] = 1;
       q->lo[j] = l;
       q->h[j]  = isinf_lp(u) ? VS_LP_INF : (u - l);
     }
   }
 
   /* CSC of A, with the row and column signs folded in */
-  for (int k = 0; k < p->numentries; k++) q->colptr[p->ent_col[k] + 1]++;
-  for (int j = 0; j < n; j++) q->colptr[j + 1] += q->colptr[j];
-  int* fill = (int*)vs_malloc(sizeof(int) * n);
-  if (!fill) { vs_free(rowsign); ipmProbFree(q); return VS_ERROR; }
-  for (int j = 0; j < n; j++) fill[j] = q->colptr[j];
+  if (!reuse) {
+    memset(q->colptr, 0, sizeof(int) * (n + 1));
+    for (int k = 0; k < p->numentries; k++) q->colptr[p->ent_col[k] + 1]++;
+    for (int j = 0; j < n; j++) q->colptr[j + 1] += q->colptr[j];
+    int* fill = (int*)vs_malloc(sizeof(int) * n);
+    if (!fill) return VS_ERROR;
+    for (int j = 0; j < n; j++) fill[j] = q->colptr[j];
+    for (int k = 0; k < p->numentries; k++) {
+      int pos = fill[p->ent_col[k]]++;
+      p->entpos[k] = pos;
+      q->rowidx[pos] = p->ent_row[k];
+    }
+    vs_free(fill);
+    /* the CSR, every row in the order of the columns */
+    memset(q->rowptr, 0, sizeof(int) * (m + 1));
+    for (int k = 0; k < p->numentries; k++) q->rowptr[p->ent_row[k] + 1]++;
+    for (int i = 0; i < m; i++) q->rowptr[i + 1] += q->rowptr[i];
+    fill = (int*)vs_malloc(sizeof(int) * m);
+    if (!fill) return VS_ERROR;
+    for (int i = 0; i < m; i++) fill[i] = q->rowptr[i];
+    for (int j = 0; j < n; j++) {
+      for (int k = q->colptr[j]; k < q->colptr[j + 1]; k++) {
+        int pos = fill[q->rowidx[k]]++;
+        q->colidx[pos] = j;
+        q->cscpos[pos] = k;
+      }
+    }
+    vs_free(fill);
+  }
   for (int k = 0; k < p->numentries; k++) {
     int j = p->ent_col[k], i = p->ent_row[k];
-    int pos = fill[j]++;
-    q->rowidx[pos] = i;
-    q->val[pos] = p->ent_val[k] * rowsign[i] * q->sign[j];
+    q->val[p->entpos[k]] = p->ent_val[k] * q->rowsign[i] * q->sign[j];
   }
-  vs_free(fill);
-  vs_free(rowsign);
 
   /* A(v + lo) - (s + lo_s) = 0  =>  A v - s = lo_s - A lo */
   for (int j = 0; j < n; j++) {
@@ -418,34 +839,63 @@ static int ipmBuild(VSLinProg* p, IpmProb* q){
   for (int i = 0; i < m; i++) q->b[i] += q->lo[n + i];
 
   ipmEquilibrate(q);
+  for (int k = 0; k < q->rowptr[m]; k++) q->rval[k] = q->val[q->cscpos[k]];
   return VS_OK;
 }
 
-/** res = A_struct * v_struct, the structural block alone */
-static void ipmAxStruct(const IpmProb* q, const double* v, double* res){
-  memset(res, 0, sizeof(double) * q->m);
-  for (int j = 0; j < q->n; j++) {
-    double vj = v[j];
-    if (vj == 0.0) continue;
-    for (int k = q->colptr[j]; k < q->colptr[j + 1]; k++)
-      res[q->rowidx[k]] += q->val[k] * vj;
+/* a loop over blocks of IPM_ROWBLOCK rows (or columns) */
+typedef struct {
+  const IpmProb* q;
+  const double*  theta;
+  const double*  x;
+  double*        res;
+  Band*          band;
+} IpmJob;
+
+static int ipmBlocks(int n){ return (n + IPM_ROWBLOCK - 1) / IPM_ROWBLOCK; }
+
+static void ipmAxStructRows(void* ctx, int blk){
+  const IpmJob* job = (const IpmJob*)ctx;
+  const IpmProb* q = job->q;
+  const int i1 = VS_MIN(q->m, (blk + 1) * IPM_ROWBLOCK);
+  for (int i = blk * IPM_ROWBLOCK; i < i1; i++) {
+    double s = 0.0;
+    for (int k = q->rowptr[i]; k < q->rowptr[i + 1]; k++)
+      s += q->rval[k] * job->x[q->colidx[k]];
+    job->res[i] = s;
   }
 }
 
+/** res = A_struct * v_struct, the structural block alone, row by row */
+static void ipmAxStruct(const IpmProb* q, const double* v, double* res){
+  IpmJob job;
+  job.q = q; job.x = v; job.res = res;
+  ipmFor(&q->th, ipmBlocks(q->m), ipmAxStructRows, &job);
+}
+
 /** res = A_struct * v_struct - v_slack  (the full A times v) */
 static void ipmAv(const IpmProb* q, const double* v, double* res){
   ipmAxStruct(q, v, res);
   for (int i = 0; i < q->m; i++) res[i] -= v[q->n + i];
 }
 
-/** res = A^T y */
-static void ipmATy(const IpmProb* q, const double* y, double* res){
-  for (int j = 0; j < q->n; j++) {
+static void ipmATyCols(void* ctx, int blk){
+  const IpmJob* job = (const IpmJob*)ctx;
+  const IpmProb* q = job->q;
+  const int j1 = VS_MIN(q->n, (blk + 1) * IPM_ROWBLOCK);
+  for (int j = blk * IPM_ROWBLOCK; j < j1; j++) {
     double s = 0.0;
     for (int k = q->colptr[j]; k < q->colptr[j + 1]; k++)
-      s += q->val[k] * y[q->rowidx[k]];
-    res[j] = s;
+      s += q->val[k] * job->x[q->rowidx[k]];
+    job->res[j] = s;
   }
+}
+
+/** res = A^T y */
+static void ipmATy(const IpmProb* q, const double* y, double* res){
+  IpmJob job;
+  job.q = q; job.x = y; job.res = res;
+  ipmFor(&q->th, ipmBlocks(q->n), ipmATyCols, &job);
   for (int i = 0; i < q->m; i++) res[q->n + i] = -y[i];
 }
 
@@ -465,24 +915,36 @@ static int ipmBandwidth(const IpmProb* q){
   return bw;
 }
 
-/** assembles A Theta A^T into the band; the slack part contributes only to the
-    diagonal because those columns of A are -e_i */
-static void ipmAssemble(const IpmProb* q, const double* theta, Band* band){
-  memset(band->dat, 0, sizeof(double) * (size_t)band->m * (band->bw + 1));
-  for (int j = 0; j < q->n; j++) {
-    double th = theta[j];
-    if (th == 0.0) continue;
-    for (int k1 = q->colptr[j]; k1 < q->colptr[j + 1]; k1++) {
-      int i1 = q->rowidx[k1];
-      double v1 = th * q->val[k1];
+/* the band columns of a block of rows: column i1 gathers the entries of row
+   i1 of A, column by column, so every entry sums up in the order of j */
+static void ipmAssembleRows(void* ctx, int blk){
+  const IpmJob* job = (const IpmJob*)ctx;
+  const IpmProb* q = job->q;
+  Band* band = job->band;
+  const int i0 = blk * IPM_ROWBLOCK, i1end = VS_MIN(q->m, i0 + IPM_ROWBLOCK);
+  memset(bandAt(band, i0, 0), 0, sizeof(double) * (size_t)(i1end - i0) * (band->bw + 1));
+  for (int i1 = i0; i1 < i1end; i1++) {
+    for (int k1 = q->rowptr[i1]; k1 < q->rowptr[i1 + 1]; k1++) {
+      int j = q->colidx[k1];
+      double th = job->theta[j];
+      if (th == 0.0) continue;
+      double v1 = th * q->rval[k1];
       for (int k2 = q->colptr[j]; k2 < q->colptr[j + 1]; k2++) {
         int i2 = q->rowidx[k2];
         if (i2 < i1) continue;          // lower triangle: store (i2, i1) with i2 >= i1
         *bandAt(band, i1, i2 - i1) += v1 * q->val[k2];
       }
     }
+    *bandAt(band, i1, 0) += job->theta[q->n + i1];
   }
-  for (int i = 0; i < q->m; i++) *bandAt(band, i, 0) += theta[q->n + i];
+}
+
+/** assembles A Theta A^T into the band; the slack part contributes only to the
+    diagonal because those columns of A are -e_i */
+static void ipmAssemble(const IpmProb* q, const double* theta, Band* band){
+  IpmJob job;
+  job.q = q; job.theta = theta; job.band = band;
+  ipmFor(&q->th, ipmBlocks(q->m), ipmAssembleRows, &job);
 }
 
 /** res = A Theta A^T x.  tmp must have room for nv doubles. */
@@ -643,40 +1105,142 @@ static void ipmStepLengths(const IpmProb* q, const double* v, const double* t,
   *alpha_p = ap; *alpha_d = ad;
 }
 
-int vs_lp_solve(VSLinProg* p, int verbose){
-  if (!p) return VS_ERROR;
+/** The starting point from the one given with vs_lp_set_start.
+
+    The solution of a similar problem is close to the solution of this one,
+    but it sits on the boundary -- half of every complementary pair is zero --
+    where an interior point method cannot start: the Newton steps would be cut
+    to nothing by the first bound they meet.  It is therefore moved into the
+    interior first, by IPM_WARMPUSH in the scaled variables and duals, which
+    puts every pair at a complementarity around IPM_WARMPUSH^2 instead of the
+    one of the cold start; what is left is the last few iterations of a solve.
+    What is not given is started as in the cold start. */
+static void ipmWarmStart(const VSLinProg* p, const IpmProb* q, double* v, double* t,
+                         double* z, double* w, double* y, double* tmp){
+  const int n = q->n, m = q->m, nv = q->nv;
+  const double push = IPM_WARMPUSH, mu0 = push * push;
+
+  if (p->hasstartcol) {
+    for (int j = 0; j < n; j++)
+      v[j] = (q->sign[j] * p->startcol[j] - q->lo[j]) / q->scale[j];
+    /* the row activities, in the unnormalized program */
+    memset(tmp, 0, sizeof(double) * m);
+    for (int k = 0; k < p->numentries; k++)
+      tmp[p->ent_row[k]] += p->ent_val[k] * p->startcol[p->ent_col[k]];
+    for (int i = 0; i < m; i++)
+      v[n + i] = (q->rowsign[i] * tmp[i] - q->lo[n + i]) / q->scale[n + i];
+  } else {
+    for (int j = 0; j < nv; j++) v[j] = isinf_lp(q->h[j]) ? 1.0 : 0.5 * q->h[j];
+  }
+  for (int j = 0; j < nv; j++) {
+    if (isinf_lp(q->h[j])) {
+      if (v[j] < push) v[j] = push;
+      t[j] = VS_LP_INF;
+    } else {
+      double pj = VS_MIN(push, 0.25 * q->h[j]);
+      if (v[j] < pj) v[j] = pj;
+      if (v[j] > q->h[j] - pj) v[j] = q->h[j] - pj;
+      t[j] = q->h[j] - v[j];
+      if (t[j] < 1e-6) t[j] = 1e-6;
+      if (v[j] < 1e-6) v[j] = 1e-6;
+    }
+  }
+
+  if (p->hasstartdual) {
+    /* y~ = R^-1 y / objscale with the row signs, the inverse of what
+       vs_lp_solve reports; the reduced costs c - A^T y split into z and w */
+    for (int i = 0; i < m; i++)
+      y[i] = p->startdual[i] * q->rowsign[i] * q->scale[n + i] / q->objscale;
+    ipmATy(q, y, tmp);
+    for (int j = 0; j < nv; j++) {
+      double d = q->c[j] - tmp[j];
+      z[j] = VS_MAX(d, 0.0) + mu0 / v[j];
+      w[j] = isinf_lp(q->h[j]) ? 0.0 : VS_MAX(-d, 0.0) + mu0 / t[j];
+    }
+  } else {
+    memset(y, 0, sizeof(double) * m);
+    for (int j = 0; j < nv; j++) {
+      z[j] = 1.0;
+      w[j] = isinf_lp(q->h[j]) ? 0.0 : 1.0;
+    }
+  }
+}
+
+/** one solve, from the point given with vs_lp_set_start if warm is set */
+static int ipmSolve(VSLinProg* p, int verbose, int warm){
   p->solved = 0;
+  p->iterations = 0;
   if (p->status && p->status[0]) return VS_ERROR;   // e.g. entry buffer overflow
 
-  IpmProb q;
-  if (ipmBuild(p, &q) != VS_OK) {
+  /* the structure of the last solve holds if the entries are where they were */
+  const int reuse = p->samepattern && p->patternsize > 0
+    && p->numentries == p->patternsize;
+  IpmProb* qp = &p->q;
+  if (ipmBuild(p, qp, reuse) != VS_OK) {
     p->status = "problem contains a variable or row that is free on both sides";
+    p->patternsize = 0;
     return VS_ERROR;
   }
+  qp->th = p->th;
+  const IpmProb q = *qp;
   const int m = q.m, nv = q.nv;
 
-  int bw = ipmBandwidth(&q);
+  int bw = reuse ? p->bw : ipmBandwidth(&q);
   /* Guard against a program whose rows are not ordered so that the matrix is
      banded: the band would degenerate into a dense matrix and exhaust memory. */
   if ((double)(bw + 1) * m * (double)sizeof(double) > 2e9) {
     p->status = "constraint matrix is not banded enough for this backend";
-    ipmProbFree(&q);
+    p->patternsize = 0;
     return VS_ERROR;
   }
+  if (!p->banddat || bw != p->bw) {
+    vs_free(p->banddat);
+    p->banddat = (double*)vs_malloc(sizeof(double) * (size_t)m * (bw + 1));
+  }
+  p->bw = bw;
+  p->patternsize = p->banddat ? p->numentries : 0;
+  p->samepattern = 1;
   Band band;
-  band.m = m; band.bw = bw;
-  band.dat = (double*)vs_malloc(sizeof(double) * (size_t)m * (bw + 1));
-
-  /* one block for all working vectors, so the cleanup stays a single free */
-  const int nvecs_nv = 25, nvecs_m = 8;
-  double* pool = (double*)vs_zalloc(sizeof(double) *
-                                    ((size_t)nvecs_nv * nv + (size_t)nvecs_m * m));
-  if (!band.dat || !pool) {
+  memset(&band, 0, sizeof(band));
+  band.m = m; band.bw = bw; band.dat = p->banddat;
+  band.th = p->th;
+  /* the split of the normal equations, see bandPartition */
+  band.parts = bandNumParts(m, bw, p->th.threads);
+  if (band.parts > 1) {
+    const size_t rm = (size_t)(band.parts - 1) * bw;
+    const size_t size = band.parts * BAND_SPIKES(bw) + rm * 2 * bw + rm + m;
+    if (band.parts != p->parts || size != p->partsize) {
+      vs_free(p->partrows); vs_free(p->partdat);
+      p->partrows = (int*)vs_malloc(sizeof(int) * 2 * band.parts);
+      p->partdat  = (double*)vs_malloc(sizeof(double) * size);
+      p->parts    = band.parts;
+      p->partsize = size;
+    }
+    if (!p->partrows || !p->partdat) {
+      vs_free(p->partrows); vs_free(p->partdat);
+      p->partrows = NULL; p->partdat = NULL; p->parts = 0;
+      p->status = "out of memory";
+      return VS_ERROR;
+    }
+    band.plo    = p->partrows;
+    band.phi    = p->partrows + band.parts;
+    band.spikes = p->partdat;
+    band.red    = band.spikes + band.parts * BAND_SPIKES(bw);
+    band.rs     = band.red + rm * 2 * bw;
+    band.work   = band.rs + rm;
+    bandPartition(&band);
+  }
+
+  /* one block for all working vectors, kept for the next solve */
+  const int nvecs_nv = 25, nvecs_m = 9;
+  const size_t poolsize = sizeof(double) * ((size_t)nvecs_nv * nv + (size_t)nvecs_m * m);
+  if (!p->pool) p->pool = (double*)vs_malloc(poolsize);
+  if (!band.dat || !p->pool) {
     p->status = "out of memory";
-    vs_free(band.dat); vs_free(pool); ipmProbFree(&q);
     return VS_ERROR;
   }
-  double* pn = pool;
+  memset(p->pool, 0, poolsize);
+  double* pn = p->pool;
 #define TAKE_NV(name) double* name = pn; pn += nv;
   TAKE_NV(v)    TAKE_NV(t)    TAKE_NV(z)    TAKE_NV(w)
   TAKE_NV(theta) TAKE_NV(dv)  TAKE_NV(dt)   TAKE_NV(dz)
@@ -690,22 +1254,27 @@ int vs_lp_solve(VSLinProg* p, int verbose){
 #define TAKE_M(name) double* name = pm; pm += m;
   TAKE_M(y)  TAKE_M(dy) TAKE_M(rp)   TAKE_M(tmpm)
   TAKE_M(wrk1) TAKE_M(wrk2) TAKE_M(f1) TAKE_M(cy)
+  TAKE_M(besty)
 #undef TAKE_M
 
   /* --- starting point ---------------------------------------------------- */
-  for (int j = 0; j < nv; j++) {
-    if (isinf_lp(q.h[j])) {
-      v[j] = 1.0;
-      t[j] = VS_LP_INF;
-      w[j] = 0.0;
-    } else {
-      v[j] = 0.5 * q.h[j];
-      if (v[j] < 1e-6) v[j] = 1e-6;
-      t[j] = q.h[j] - v[j];
-      if (t[j] < 1e-6) t[j] = 1e-6;
-      w[j] = 1.0;
+  if (warm) {
+    ipmWarmStart(p, &q, v, t, z, w, y, tmpn);
+  } else {
+    for (int j = 0; j < nv; j++) {
+      if (isinf_lp(q.h[j])) {
+        v[j] = 1.0;
+        t[j] = VS_LP_INF;
+        w[j] = 0.0;
+      } else {
+        v[j] = 0.5 * q.h[j];
+        if (v[j] < 1e-6) v[j] = 1e-6;
+        t[j] = q.h[j] - v[j];
+        if (t[j] < 1e-6) t[j] = 1e-6;
+        w[j] = 1.0;
+      }
+      z[j] = 1.0;
     }
-    z[j] = 1.0;
   }
 
   IpmCtx C;
@@ -760,6 +1329,7 @@ int vs_lp_solve(VSLinProg* p, int verbose){
       bestmerit = merit;
       bestiter  = iter;
       memcpy(best, v, sizeof(double) * nv);
+      memcpy(besty, y, sizeof(double) * m);
       stall = 0;
     } else {
       stall++;
@@ -834,6 +1404,9 @@ int vs_lp_solve(VSLinProg* p, int verbose){
       p->sol[j] = val;
       p->objval += p->obj[j] * val;
     }
+    /* back from the equilibrated and sign normalized rows, see ipmWarmStart */
+    for (int i = 0; i < m; i++)
+      p->rowdual[i] = q.rowsign[i] * besty[i] * q.objscale / q.scale[q.n + i];
     p->solved = 1;
     p->status = "";
     if (verbose) {
@@ -846,12 +1419,27 @@ int vs_lp_solve(VSLinProg* p, int verbose){
     p->status = p->statusbuf;
   }
 
-  vs_free(band.dat);
-  vs_free(pool);
-  ipmProbFree(&q);
+  p->iterations = itersdone;
   return p->solved ? VS_OK : VS_ERROR;
 }
 
+int vs_lp_solve(VSLinProg* p, int verbose){
+  if (!p) return VS_ERROR;
+  const int warm = p->hasstartcol || p->hasstartdual;
+  int status = ipmSolve(p, verbose, warm);
+  p->hasstartcol = p->hasstartdual = 0;
+  /* a starting point too far off may stall the solver where the cold start
+     would not: it costs the iterations spent, never the solution.  Only the
+     iterations report to statusbuf, the program itself is not retried. */
+  if (status != VS_OK && warm && p->status == p->statusbuf) {
+    const int iterations = p->iterations;
+    p->status = "";
+    status = ipmSolve(p, verbose, 0);
+    p->iterations += iterations;
+  }
+  return status;
+}
+
 double vs_lp_get_obj_value(const VSLinProg* p){
   return (p && p->solved) ? p->objval : 0.0;
 }
@@ -861,6 +1449,15 @@ double vs_lp_get_col_value(const VSLinProg* p, int col){
   return p->sol[col];
 }
 
+double vs_lp_get_row_dual(const VSLinProg* p, int row){
+  if (!p || !p->solved || row < 0 || row >= p->numrows) return 0.0;
+  return p->rowdual[row];
+}
+
+int vs_lp_get_iterations(const VSLinProg* p){
+  return p ? p->iterations : 0;
+}
+
 const char* vs_lp_status_msg(const VSLinProg* p){
   return (p && p->status) ? p->status : "";
 }
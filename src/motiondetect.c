@@ -56,6 +56,13 @@ typedef struct _contrast_idx {
   int index;
 } contrast_idx;
 
+static contrastSubImgFunc planarContrastFunc(const VSMotionDetect* md);
+static void updateReference(VSMotionDetect* md);
+static void takeReference(VSMotionDetect* md);
+static void freeBatch(VSMotionDetect* md);
+static int coarseMotionsSuffice(const VSMotionDetect* md, const VSMotionSet* motions,
+                                const VSTransform* t, VSTransform* corrected);
+
 
 VSMotionDetectConfig vsMotionDetectGetDefaultConfig(const char* modName){
   VSMotionDetectConfig conf;
@@ -67,6 +74,15 @@ VSMotionDetectConfig vsMotionDetectGetDefaultConfig(const char* modName){
   conf.show              = 0;
   conf.modName           = modName;
   conf.numThreads        = 0;
+  conf.pyramidLevels     = 0;
+  conf.contrastMode      = VSContrastMinMax;
+  conf.motionPrediction  = 0;
+  conf.packedLuma        = 0;
+  conf.skipFinePass      = 0;
+  conf.detectScale       = 1;
+  conf.consensusFields   = 0;
+  conf.executor.parallel_for = NULL;
+  conf.executor.ctx      = NULL;
   return conf;
 }
 
@@ -80,40 +96,140 @@ const VSFrameInfo* vsMotionDetectGetFrameInfo(const VSMotionDetect* md){
 }
 
 
+/* allocates the buffers that are filled from each new frame: curr, its
+   pyramid and summed-area tables. curr and prev are swapped after every
+   frame instead of copied. Packed frames are not blurred, the search reads
+   them in place and only the reference is copied (see updateReference). */
+static int allocFrameBuffers(VSMotionDetect* md){
+  if(md->currfi.pFormat < PF_PACKED){
+    vsFrameAllocate(&md->curr,&md->currfi);
+    if(md->conf.detectScale > 1){ // the horizontal pass keeps all rows
+      VSFrameInfo tmpfi;
+      vsFrameInfoInit(&tmpfi, md->currfi.width, md->fi.height, PF_GRAY8);
+      vsFrameAllocate(&md->currtmp, &tmpfi);
+      if(md->fi.pFormat > PF_PACKED){
+        VSFrameInfo lumafi;
+        vsFrameInfoInit(&lumafi, md->fi.width, md->fi.height, PF_GRAY8);
+        vsFrameAllocate(&md->currluma, &lumafi);
+        if (vsFrameIsNull(&md->currluma))
+          return VS_ERROR;
+      }
+    }else{
+      vsFrameAllocate(&md->currtmp, &md->currfi);
+    }
+    if (vsFrameIsNull(&md->curr) || vsFrameIsNull(&md->currtmp))
+      return VS_ERROR;
+  }
+  for(int l=0; l < md->pyramidLevels; l++){
+    vsFrameAllocate(&md->currpyr[l], &md->pyrfi[l]);
+    if(vsFrameIsNull(&md->currpyr[l]))
+      return VS_ERROR;
+  }
+  if(md->conf.contrastMode == VSContrastVariance)
+    return vsIntegralImageAllocate(&md->integral, md->currfi.width, md->currfi.height);
+  return VS_OK;
+}
+
+static void freeFrameBuffers(VSMotionDetect* md){
+  if(md->currfi.pFormat < PF_PACKED) // otherwise only a view on the caller's frame
+    vsFrameFree(&md->curr);
+  vsFrameNull(&md->curr);
+  vsFrameFree(&md->currtmp);
+  vsFrameFree(&md->currluma);
+  for(int l=0; l < md->pyramidLevels; l++)
+    vsFrameFree(&md->currpyr[l]);
+  vsIntegralImageFree(&md->integral);
+}
+
 int vsMotionDetectInit(VSMotionDetect* md, const VSMotionDetectConfig* conf, const VSFrameInfo* fi){
+  return vsMotionDetectInitContext(md, conf, fi, NULL);
+}
+
+int vsMotionDetectInitContext(VSMotionDetect* md, const VSMotionDetectConfig* conf,
+                              const VSFrameInfo* fi, const VSContext* ctx){
   assert(md && fi);
   md->conf = *conf;
   md->fi = *fi;
+  // kernels, logger and thread defaults of this instance
+  if(ctx)
+    md->ctx = *ctx;
+  else
+    vsContextFromGlobals(&md->ctx);
 
   if(fi->pFormat<=PF_NONE ||  fi->pFormat==PF_PACKED || fi->pFormat>=PF_NUMBER) {
-    vs_log_warn(md->conf.modName, "unsupported Pixel Format (%i)\n",
+    vs_ctx_log_warn(&md->ctx, md->conf.modName, "unsupported Pixel Format (%i)\n",
                 md->fi.pFormat);
     return VS_ERROR;
   }
 
-  /* pick the SIMD kernels for this machine before anything can call them */
-  vs_simd_init();
-  vs_log_info(md->conf.modName, "SIMD: %s\n", vs_simd_active_name());
+  vs_ctx_log_info(&md->ctx, md->conf.modName, "SIMD: %s\n", md->ctx.simdName);
 
-#ifdef USE_OMP
   if(md->conf.numThreads==0)
-    md->conf.numThreads=VS_MAX(omp_get_max_threads()*0.8,1);
-  vs_log_info(md->conf.modName, "Multithreading: use %i threads\n",md->conf.numThreads);
-#endif
+    md->conf.numThreads=md->ctx.numThreads;
+  if(md->conf.numThreads==0)
+    md->conf.numThreads=VS_MAX(vsDefaultNumThreads()*0.8,1);
+  if(!md->conf.executor.parallel_for)
+    md->conf.executor = md->ctx.executor;
+  if(md->conf.executor.parallel_for)
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Multithreading: host executor\n");
+  else
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Multithreading: use %i threads\n",md->conf.numThreads);
+
+  /* with packedLuma the search runs on a luma plane of the packed input */
+  md->currfi = md->fi;
+  if(md->conf.packedLuma && md->fi.pFormat > PF_PACKED){
+    if(!vsFrameInfoInit(&md->currfi, md->fi.width, md->fi.height, PF_GRAY8))
+      return VS_ERROR;
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Packed input: motion detection on luma\n");
+  }
+  /* detectScale: the search runs on the downsampled luma, so not on packed
+     frames, and a small frame is reduced at most to about 96 pixels */
+  if(md->conf.detectScale > 1 && md->currfi.pFormat > PF_PACKED){
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Reduced resolution needs planar input "
+                "(or packedLuma), detecting at full resolution\n");
+    md->conf.detectScale = 1;
+  }
+  while(md->conf.detectScale > 1 &&
+        VS_MIN(md->fi.width, md->fi.height) / md->conf.detectScale < 96)
+    md->conf.detectScale--;
+  md->conf.detectScale = VS_MAX(1, md->conf.detectScale);
+  if(md->conf.detectScale > 1){
+    if(!vsFrameInfoInit(&md->currfi, md->fi.width / md->conf.detectScale,
+                        md->fi.height / md->conf.detectScale, PF_GRAY8))
+      return VS_ERROR;
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Motion detection at %ix%i (1/%i)\n",
+                md->currfi.width, md->currfi.height, md->conf.detectScale);
+  }
 
-  vsFrameAllocate(&md->prev, &md->fi);
+  vsFrameAllocate(&md->prev, &md->currfi);
   if (vsFrameIsNull(&md->prev)) {
-    vs_log_error(md->conf.modName, "malloc failed");
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
     return VS_ERROR;
   }
 
   vsFrameNull(&md->curr);
   vsFrameNull(&md->currorig);
   vsFrameNull(&md->currtmp);
+  vsFrameNull(&md->currluma);
+  md->pyramidLevels = 0;
+  for(int l=0; l < VS_MAX_PYRAMID_LEVELS; l++){
+    vsFrameNull(&md->currpyr[l]);
+    vsFrameNull(&md->prevpyr[l]);
+  }
+  md->integral.sum   = NULL;
+  md->integral.sqsum = NULL;
+  md->batch = NULL;
+  md->batchSize = 0;
+  md->pool = NULL;
+  md->hasPrediction = 0;
+  md->predictionShift = 0;
+  md->predictionMatch = 0;
+  md->predictionNum = 0;
   md->hasSeenOneFrame = 0;
   md->frameNum = 0;
 
-  if(md->serializationMode != ASCII_SERIALIZATION_MODE && md->serializationMode != BINARY_SERIALIZATION_MODE) {
+  if(md->serializationMode != ASCII_SERIALIZATION_MODE && md->serializationMode != BINARY_SERIALIZATION_MODE
+     && md->serializationMode != COMPACT_SERIALIZATION_MODE) {
     md->serializationMode = BINARY_SERIALIZATION_MODE;
   }
 
@@ -121,15 +237,15 @@ int vsMotionDetectInit(VSMotionDetect* md, const VSMotionDetectConfig* conf, con
   md->conf.shakiness = VS_MIN(10,VS_MAX(1,md->conf.shakiness));
   md->conf.accuracy = VS_MIN(15,VS_MAX(1,md->conf.accuracy));
   if (md->conf.accuracy < md->conf.shakiness / 2) {
-    vs_log_info(md->conf.modName, "Accuracy should not be lower than shakiness/2 -- fixed");
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Accuracy should not be lower than shakiness/2 -- fixed");
     md->conf.accuracy = md->conf.shakiness / 2;
   }
   if (md->conf.accuracy > 9 && md->conf.stepSize > 6) {
-    vs_log_info(md->conf.modName, "For high accuracy use lower stepsize  -- set to 6 now");
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "For high accuracy use lower stepsize  -- set to 6 now");
     md->conf.stepSize = 6; // maybe 4
   }
 
-  int minDimension = VS_MIN(md->fi.width, md->fi.height);
+  int minDimension = VS_MIN(md->currfi.width, md->currfi.height);
 //  shift: shakiness 1: height/40; 10: height/4
 //  md->maxShift = VS_MAX(4,(minDimension*md->conf.shakiness)/40);
 //  size: shakiness 1: height/40; 10: height/6 (clipped)
@@ -147,7 +263,9 @@ int vsMotionDetectInit(VSMotionDetect* md, const VSMotionDetectConfig* conf, con
      different machines. */
   fieldSize     = (fieldSize     / VS_SIMD_FIELD_ALIGNMENT + 1) * VS_SIMD_FIELD_ALIGNMENT;
   fieldSizeFine = (fieldSizeFine / VS_SIMD_FIELD_ALIGNMENT + 1) * VS_SIMD_FIELD_ALIGNMENT;
-  if (!initFields(md, &md->fieldscoarse, fieldSize, maxShift, md->conf.stepSize,
+  // the coarse step is in source pixels, like the blur
+  if (!initFields(md, &md->fieldscoarse, fieldSize, maxShift,
+                  VS_MAX(1, md->conf.stepSize / md->conf.detectScale),
                   1, 0, md->conf.contrastThreshold)) {
     return VS_ERROR;
   }
@@ -157,8 +275,60 @@ int vsMotionDetectInit(VSMotionDetect* md, const VSMotionDetectConfig* conf, con
     return VS_ERROR;
   }
 
-  vsFrameAllocate(&md->curr,&md->fi);
-  vsFrameAllocate(&md->currtmp, &md->fi);
+  /* The pyramid is built from the blurred luma, so there is none for packed
+     input. It stops early where the coarse field would shrink below one SIMD
+     block, which for small frames can mean no pyramid at all. */
+  if(md->conf.pyramidLevels > 0 && md->currfi.pFormat < PF_PACKED){
+    int levels = VS_MIN(md->conf.pyramidLevels, VS_MAX_PYRAMID_LEVELS);
+    while(levels > 0 && (fieldSize >> levels) < VS_SIMD_FIELD_ALIGNMENT)
+      levels--;
+    for(int l=0; l < levels; l++){
+      if(!vsFrameInfoInit(&md->pyrfi[l], md->currfi.width >> (l+1),
+                          md->currfi.height >> (l+1), PF_GRAY8))
+        return VS_ERROR;
+    }
+    md->pyramidLevels = levels;
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Coarse-to-fine search on %i pyramid levels\n",
+                levels);
+  }
+
+  if(md->conf.contrastMode == VSContrastVariance && md->currfi.pFormat > PF_PACKED){
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Variance contrast needs planar input, "
+                "using min/max contrast\n");
+    md->conf.contrastMode = VSContrastMinMax;
+  }
+  if(md->conf.skipFinePass && md->currfi.pFormat > PF_PACKED){
+    vs_ctx_log_info(&md->ctx, md->conf.modName, "Sub-pixel fit needs planar input, "
+                "the fine pass is always done\n");
+    md->conf.skipFinePass = 0;
+  }
+
+  if(allocFrameBuffers(md) != VS_OK){
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
+    return VS_ERROR;
+  }
+  for(int l=0; l < md->pyramidLevels; l++){
+    vsFrameAllocate(&md->prevpyr[l], &md->pyrfi[l]);
+    if(vsFrameIsNull(&md->prevpyr[l])){
+      vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
+      return VS_ERROR;
+    }
+  }
+
+  /* the threads are started once here and reused for every frame; without a
+     pool the loops fall back to OpenMP (or run serially) */
+  if(md->conf.executor.parallel_for){
+    md->pool = vsThreadPoolFromExecutor(&md->conf.executor);
+    if(!md->pool){
+      vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
+      return VS_ERROR;
+    }
+  }else if(md->conf.numThreads > 1){
+    md->pool = vsThreadPoolCreate(md->conf.numThreads);
+    if(md->pool)
+      vs_ctx_log_info(&md->ctx, md->conf.modName, "Worker pool of %i threads\n",
+                  vsThreadPoolSize(md->pool));
+  }
 
   md->initialized = 2;
   return VS_OK;
@@ -173,13 +343,49 @@ void vsMotionDetectionCleanup(VSMotionDetect* md) {
     vs_free(md->fieldsfine.fields);
     md->fieldsfine.fields=0;
   }
+  freeBatch(md);
   vsFrameFree(&md->prev);
-  vsFrameFree(&md->curr);
-  vsFrameFree(&md->currtmp);
+  for(int l=0; l < md->pyramidLevels; l++)
+    vsFrameFree(&md->prevpyr[l]);
+  freeFrameBuffers(md);
+  md->pyramidLevels = 0;
+  vsThreadPoolDestroy(md->pool); // the batch states only borrow it
+  md->pool = NULL;
 
   md->initialized = 0;
 }
 
+/// a plane (row) loop over two frames, see halvePlane and packedFrameToLuma
+typedef struct {
+  VSFrame* dest;
+  const VSFrame* src;
+  const VSFrameInfo* fi;
+  int rIndex;
+  vsRgbToLumaFn toLuma;
+} PlaneJob;
+
+/* halves a luma row by averaging 2x2 blocks. The input is already box
+   blurred, so this needs no further low pass of its own. */
+static void halvePlaneRow(void* ctx, int j){
+  const PlaneJob* job = (const PlaneJob*)ctx;
+  const uint8_t* s1 = job->src->data[0] + 2*j*job->src->linesize[0];
+  const uint8_t* s2 = s1 + job->src->linesize[0];
+  uint8_t* d = job->dest->data[0] + j*job->dest->linesize[0];
+  for(int i=0; i < job->fi->width; i++)
+    d[i] = (s1[2*i] + s1[2*i+1] + s2[2*i] + s2[2*i+1] + 2) >> 2;
+}
+
+/// fills currpyr from the blurred current frame
+static void buildPyramid(VSMotionDetect* md){
+  const VSFrame* src = &md->curr;
+  for(int l=0; l < md->pyramidLevels; l++){
+    PlaneJob job = { &md->currpyr[l], src, &md->pyrfi[l], 0, NULL };
+    vsParallelFor(md->pool, md->conf.numThreads, md->pyrfi[l].height,
+                  halvePlaneRow, &job);
+    src = &md->currpyr[l];
+  }
+}
+
 // returns true if match of local motion is better than threshold
 short lm_match_better(void* thresh, void* lm){
   if(((LocalMotion*)lm)->match <= *((double*)thresh))
@@ -188,122 +394,515 @@ short lm_match_better(void* thresh, void* lm){
     return 0;
 }
 
-int vsMotionDetection(VSMotionDetect* md, LocalMotions* motions, VSFrame *frame) {
- assert(md->initialized==2);
+static void packedRowToLuma(void* ctx, int j){
+  const PlaneJob* job = (const PlaneJob*)ctx;
+  job->toLuma(job->dest->data[0] + j*job->dest->linesize[0],
+              job->src->data[0] + j*job->src->linesize[0],
+              job->fi->width, job->fi->bytesPerPixel, job->rIndex);
+}
+
+/* converts a packed RGB frame to the luma plane dest (conf.packedLuma) */
+static void packedFrameToLuma(const VSMotionDetect* md, VSFrame* dest,
+                              const VSFrame* src){
+  PlaneJob job = { dest, src, &md->fi, md->fi.pFormat == PF_BGR24 ? 2 : 0,
+                   md->ctx.rgbToLuma };
+  vsParallelFor(md->pool, md->conf.numThreads, md->fi.height, packedRowToLuma, &job);
+}
 
+/* blurs the frame into curr and derives what the search needs from it
+   (pyramid, summed-area tables). Only the per-frame buffers of md are written. */
+static void prepareFrame(VSMotionDetect* md, VSFrame* frame){
+  const VSFrame* src = frame;
   md->currorig = *frame;
   // smoothen image to do better motion detection
   //  (larger stepsize or eventually gradient descent (need higher resolution))
-  if (md->fi.pFormat > PF_PACKED) {
-    // we could calculate a grayscale version and use the PLANAR stuff afterwards
-    // so far smoothing is only implemented for PLANAR
-    vsFrameCopy(&md->curr, frame, &md->fi);
+  if (md->currfi.pFormat > PF_PACKED) {
+    // smoothing is only implemented for PLANAR, so the search reads the frame
+    // itself (unless conf.packedLuma, see below)
+    md->curr = *frame;
   } else {
-    // box-kernel smoothing (plain average of pixels), which is fine for us
-    boxblurPlanar(&md->curr, frame, &md->currtmp, &md->fi, md->conf.stepSize*1/*1.4*/,
-               BoxBlurNoColor);
+    if (md->fi.pFormat > PF_PACKED) { // packedLuma: blur the luma (in place at full size)
+      VSFrame* luma = md->conf.detectScale > 1 ? &md->currluma : &md->curr;
+      packedFrameToLuma(md, luma, frame);
+      src = luma;
+    }
+    // box-kernel smoothing (plain average of pixels), which is fine for us;
+    // with detectScale the blur is the anti-aliasing filter too
+    boxblurPlanarScaled(&md->curr, src, &md->currtmp,
+                        md->conf.detectScale > 1 ? &md->fi : &md->currfi,
+                        VS_MAX(md->conf.stepSize, md->conf.detectScale),
+                        md->conf.detectScale,
+                        md->conf.contrastMode == VSContrastVariance ? &md->integral : NULL,
+                        md->pool, md->conf.numThreads);
+    if(md->pyramidLevels > 0)
+      buildPyramid(md);
     // two times yields tent-kernel smoothing, which may be better, but I don't
     //  think we need it
     //boxblurPlanar(md->curr, md->curr, md->currtmp, &md->fi, md->stepSize*1,
     // BoxBlurNoColor);
   }
+}
 
-  /* Tripod lead-in: frames before the reference frame emit no motion.
-     Detection is a single streaming pass, so a frame at index < virtualTripod
-     cannot be measured against the reference at index virtualTripod-1, which
-     has not been read yet. These frames are left uncorrected; stabilization
-     begins at the reference frame. For the default virtualTripod=1 the
-     lead-in is frame 0 alone. */
-  int tripodLeadIn = md->conf.virtualTripod >= 1
-                     && md->frameNum < md->conf.virtualTripod;
-
-  if (md->hasSeenOneFrame && !tripodLeadIn) {
-    LocalMotions motionscoarse;
-    LocalMotions motionsfine;
-    vs_vector_init(&motionsfine,0);
-    //    md->curr = frame;
-    if (md->fi.pFormat > PF_PACKED) {
-      motionscoarse = calcTransFields(md, &md->fieldscoarse,
-                                      calcFieldTransPacked, contrastSubImgPacked);
-    } else { // PLANAR
-      motionscoarse = calcTransFields(md, &md->fieldscoarse,
-                                      calcFieldTransPlanar, contrastSubImgPlanar);
+/* Tripod lead-in: frames before the reference frame emit no motion.
+   Detection is a single streaming pass, so a frame at index < virtualTripod
+   cannot be measured against the reference at index virtualTripod-1, which
+   has not been read yet. These frames are left uncorrected; stabilization
+   begins at the reference frame. For the default virtualTripod=1 the
+   lead-in is frame 0 alone. */
+static int isTripodLeadIn(const VSMotionDetect* md){
+  return md->conf.virtualTripod >= 1 && md->frameNum < md->conf.virtualTripod;
+}
+
+/// true if the current frame becomes the reference (for tripod we keep one)
+static int becomesReference(const VSMotionDetect* md){
+  return md->conf.virtualTripod < 1 || md->frameNum < md->conf.virtualTripod;
+}
+
+static VSMotionSet coarseMotions(VSMotionDetect* md){
+  if (md->currfi.pFormat > PF_PACKED) {
+    return calcTransFields(md, &md->fieldscoarse,
+                           calcFieldTransPacked, contrastSubImgPacked);
+  } else { // PLANAR
+    return calcTransFields(md, &md->fieldscoarse,
+                           md->pyramidLevels > 0 ? calcFieldTransPyramid
+                                                 : calcFieldTransPlanar,
+                           planarContrastFunc(md));
+  }
+}
+
+/// mean match quality of the motions, see cleanmean
+static double meanMatchQuality(const VSMotionSet* motions){
+  VSArray matches = motionsetGetMatch(motions);
+  double mean = cleanmean(matches.dat, matches.len, NULL, NULL);
+  vs_array_free(matches);
+  return mean;
+}
+
+/* Whether the search in the reduced window around the prediction can be
+   trusted. It cannot if the motion was not where it was predicted: then many
+   fields end up at the rim of the window, or the matches get clearly worse
+   than they used to be, or fewer fields match at all. */
+static int predictionHolds(const VSMotionDetect* md, const VSMotionSet* motions,
+                           int numExpected){
+  int num = motions->num;
+  int atRim = 0;
+  int rim = md->predictionShift - md->fieldscoarse.stepSize;
+  if(num < 1 || num < numExpected/2)
+    return 0;
+  PreparedTransform pt = prepare_transform(&md->prediction, &md->currfi);
+  for(int i=0; i < num; i++){
+    const LocalMotion* lm = MSGet(motions,i);
+    Vec fieldpos = {lm->f.x, lm->f.y};
+    Vec offset = sub_vec(transform_vec(&pt, &fieldpos), fieldpos);
+    if(abs(lm->v.x - offset.x) >= rim || abs(lm->v.y - offset.y) >= rim)
+      atRim++;
+  }
+  if(4*atRim > num)
+    return 0;
+  return meanMatchQuality(motions) <= 1.5*md->predictionMatch;
+}
+
+/* Keeps the coarse transform of this frame as prediction for the next one.
+   The search radius follows the prediction error: it grows at once to twice
+   the error (plus the coarse step) and shrinks by a quarter per frame. */
+static void updatePrediction(VSMotionDetect* md, const VSTransform* t,
+                             const VSMotionSet* motions, int predicted){
+  const int fullShift = md->fieldscoarse.maxShift;
+  const int minShift  = VS_MAX(16, 2*md->fieldscoarse.stepSize);
+  double meanMatch = meanMatchQuality(motions);
+  if(predicted){
+    double radius = sqrt(md->currfi.width*md->currfi.width + md->currfi.height*md->currfi.height)/2;
+    double err = VS_MAX(fabs(t->x - md->prediction.x), fabs(t->y - md->prediction.y))
+                 + fabs(t->alpha - md->prediction.alpha)*radius;
+    int shift = VS_CLAMP((int)ceil(2*err) + 2*md->fieldscoarse.stepSize,
+                         minShift, fullShift);
+    md->predictionShift = VS_MAX(shift, VS_MAX(minShift, md->predictionShift*3/4));
+    md->predictionMatch = 0.8*md->predictionMatch + 0.2*meanMatch;
+  }else{ // nothing known about the error yet
+    md->predictionShift = VS_MAX(minShift, fullShift/2);
+    md->predictionMatch = meanMatch;
+  }
+  md->prediction    = *t;
+  md->hasPrediction = 1;
+}
+
+/* coarse and fine scan of curr against prev. Nothing is drawn and nothing
+   in md but fieldsfine.offset (and the prediction) is written, so independent
+   frame pairs can run this concurrently, each on its own VSMotionDetect
+   (vsMotionDetectionBatch, which does not do that with motionPrediction).
+*/
+static void detectMotions(VSMotionDetect* md, VSMotionSet* motionscoarse,
+                          VSMotionSet* motionsfine){
+  int predicted = md->conf.motionPrediction && md->hasPrediction;
+  vs_motionset_init(motionsfine,0);
+  if(predicted){
+    const int fullShift = md->fieldscoarse.maxShift;
+    // an early exit returns fewer motions, that is no sign of a failure
+    int numExpected = md->conf.consensusFields > 0
+      ? VS_MIN(md->predictionNum, md->conf.consensusFields) : md->predictionNum;
+    md->fieldscoarse.offset    = md->prediction;
+    md->fieldscoarse.useOffset = 1;
+    md->fieldscoarse.maxShift  = md->predictionShift;
+    *motionscoarse = coarseMotions(md);
+    md->fieldscoarse.useOffset = 0;
+    md->fieldscoarse.maxShift  = fullShift;
+    if(!predictionHolds(md, motionscoarse, numExpected)){
+      vs_ctx_log_info(&md->ctx, md->conf.modName, "motion prediction failed in frame %i, "
+                  "full search\n", md->frameNum);
+      vs_motionset_fini(motionscoarse);
+      *motionscoarse = coarseMotions(md);
+      predicted = 0;
     }
-    int num_motions = vs_vector_size(&motionscoarse);
-    if (num_motions < 1) {
-      vs_log_warn(md->conf.modName, "too low contrast. \
+  }else{
+    *motionscoarse = coarseMotions(md);
+  }
+  int num_motions = motionscoarse->num;
+  if (num_motions < 1) {
+    vs_ctx_log_warn(&md->ctx, md->conf.modName, "too low contrast. \
 (no translations are detected in frame %i)\n", md->frameNum);
-    }else{
-      // calc transformation and perform another scan with small fields
-      VSTransform t = vsSimpleMotionsToTransform(md->fi, md->conf.modName, &motionscoarse);
-      md->fieldsfine.offset    = t;
-      md->fieldsfine.useOffset = 1;
-      LocalMotions motions2;
-      if (md->fi.pFormat > PF_PACKED) {
-        motions2 = calcTransFields(md, &md->fieldsfine,
-                                   calcFieldTransPacked, contrastSubImgPacked);
-      } else { // PLANAR
-        motions2 = calcTransFields(md, &md->fieldsfine,
-                                   calcFieldTransPlanar, contrastSubImgPlanar);
-      }
-      // through out those with bad match (worse than mean of coarse scan)
-      VSArray matchQualities1 = localmotionsGetMatch(&motionscoarse);
-      double meanMatch = cleanmean(matchQualities1.dat, matchQualities1.len, NULL, NULL);
-      // note: we copy the selected motions (instead of vs_vector_filter, which
-      //  would share the elements with motions2 and leak the rejected ones)
-      for(int i=0; i < vs_vector_size(&motions2); i++){
-        LocalMotion* m = LMGet(&motions2,i);
-        if(lm_match_better(&meanMatch, m))
-          vs_vector_append_dup(&motionsfine, m, sizeof(LocalMotion));
-      }
-      if(0){
-        printf("\nMatches: mean:  %f | ", meanMatch);
-        vs_array_print(matchQualities1, stdout);
-        printf("\n         fine: ");
-        VSArray matchQualities2 = localmotionsGetMatch(&motions2);
-        vs_array_print(matchQualities2, stdout);
-        printf("\n");
-        vs_array_free(matchQualities2);
-      }
-      vs_array_free(matchQualities1);
-      vs_vector_del(&motions2);
-    }
-    if (md->conf.show) { // draw fields and transforms into frame.
-      int num_motions_fine = vs_vector_size(&motionsfine);
-      // this has to be done one after another to handle possible overlap
-      if (md->conf.show > 1) {
-        for (int i = 0; i < num_motions; i++)
-          drawFieldScanArea(md, LMGet(&motionscoarse,i), md->fieldscoarse.maxShift);
-      }
-      for (int i = 0; i < num_motions; i++)
-        drawField(md, LMGet(&motionscoarse,i), 1);
-      for (int i = 0; i < num_motions_fine; i++)
-        drawField(md, LMGet(&motionsfine,i), 0);
+    md->hasPrediction = 0;
+  }else{
+    // calc transformation and perform another scan with small fields
+    VSTransform t = vsSimpleMotionSetToTransform(md->currfi, md->conf.modName, motionscoarse);
+    /* the sub-pixel correction only reaches the prediction: the motions keep
+       the integral coarse vectors */
+    int skip = md->conf.skipFinePass
+      && coarseMotionsSuffice(md, motionscoarse, &t,
+                              md->conf.motionPrediction ? &t : NULL);
+    if(md->conf.motionPrediction){
+      updatePrediction(md, &t, motionscoarse, predicted);
+      md->predictionNum = num_motions;
+    }
+    if(skip)
+      return;
+    md->fieldsfine.offset    = t;
+    md->fieldsfine.useOffset = 1;
+    VSMotionSet motions2;
+    if (md->currfi.pFormat > PF_PACKED) {
+      motions2 = calcTransFields(md, &md->fieldsfine,
+                                 calcFieldTransPacked, contrastSubImgPacked);
+    } else { // PLANAR
+      motions2 = calcTransFields(md, &md->fieldsfine,
+                                 calcFieldTransPlanar, planarContrastFunc(md));
+    }
+    // through out those with bad match (worse than mean of coarse scan)
+    VSArray matchQualities1 = motionsetGetMatch(motionscoarse);
+    double meanMatch = cleanmean(matchQualities1.dat, matchQualities1.len, NULL, NULL);
+    vs_motionset_reserve(motionsfine, motions2.num);
+    for(int i=0; i < motions2.num; i++){
+      LocalMotion* m = MSGet(&motions2,i);
+      if(lm_match_better(&meanMatch, m))
+        vs_motionset_append(motionsfine, m);
+    }
+    if(0){
+      printf("\nMatches: mean:  %f | ", meanMatch);
+      vs_array_print(matchQualities1, stdout);
+      printf("\n         fine: ");
+      VSArray matchQualities2 = motionsetGetMatch(&motions2);
+      vs_array_print(matchQualities2, stdout);
+      printf("\n");
+      vs_array_free(matchQualities2);
+    }
+    vs_array_free(matchQualities1);
+    vs_motionset_fini(&motions2);
+  }
+}
+
+/* brings motions found at 1/scale of the resolution (conf.detectScale) to
+   source pixels: a field covers the scale x scale block of every pixel it has */
+static void scaleMotions(VSMotionSet* motions, int scale){
+  for(int i=0; i < motions->num; i++){
+    LocalMotion* lm = MSGet(motions,i);
+    lm->v.x    *= scale;
+    lm->v.y    *= scale;
+    lm->f.x    = lm->f.x*scale + scale/2;
+    lm->f.y    = lm->f.y*scale + scale/2;
+    lm->f.size *= scale;
+  }
+}
+
+/* draws the fields and transforms into the original frame if requested and
+   joins the coarse and fine motions into motions (in source pixels) */
+static void finishMotions(VSMotionDetect* md, VSMotionSet* motions,
+                          VSMotionSet* motionscoarse, VSMotionSet* motionsfine){
+  const int scale = md->conf.detectScale;
+  if (scale > 1) {
+    scaleMotions(motionscoarse, scale);
+    scaleMotions(motionsfine, scale);
+  }
+  if (md->conf.show) { // draw fields and transforms into frame.
+    int num_motions = motionscoarse->num;
+    int num_motions_fine = motionsfine->num;
+    // this has to be done one after another to handle possible overlap
+    if (md->conf.show > 1) {
       for (int i = 0; i < num_motions; i++)
-        drawFieldTrans(md, LMGet(&motionscoarse,i),180);
-      for (int i = 0; i < num_motions_fine; i++)
-        drawFieldTrans(md, LMGet(&motionsfine,i), 64);
-    }
-    *motions = vs_vector_concat(&motionscoarse,&motionsfine);
-    // the concatenation took over the elements, so only release the
-    //  now unused vector buffers (not the elements themselves)
-    vs_vector_fini(&motionscoarse);
-    vs_vector_fini(&motionsfine);
-    //*motions = motionscoarse;
-    //*motions = motionsfine;
+        drawFieldScanArea(md, MSGet(motionscoarse,i), md->fieldscoarse.maxShift*scale);
+    }
+    for (int i = 0; i < num_motions; i++)
+      drawField(md, MSGet(motionscoarse,i), 1);
+    for (int i = 0; i < num_motions_fine; i++)
+      drawField(md, MSGet(motionsfine,i), 0);
+    for (int i = 0; i < num_motions; i++)
+      drawFieldTrans(md, MSGet(motionscoarse,i),180);
+    for (int i = 0; i < num_motions_fine; i++)
+      drawFieldTrans(md, MSGet(motionsfine,i), 64);
+  }
+  // the fine motions go behind the coarse ones, in the array of those
+  *motions = *motionscoarse;
+  vs_motionset_append_set(motions, motionsfine);
+  vs_motionset_fini(motionsfine);
+}
+
+int vsMotionDetection(VSMotionDetect* md, LocalMotions* motions, VSFrame *frame) {
+  VSMotionSet set;
+  int res = vsMotionDetectionSet(md, &set, frame);
+  if(res == VS_OK && vs_motionset_to_vector(&set, motions) != VS_OK){
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
+    res = VS_ERROR;
+  }
+  vs_motionset_fini(&set);
+  return res;
+}
+
+int vsMotionDetectionSet(VSMotionDetect* md, VSMotionSet* motions, VSFrame *frame) {
+ assert(md->initialized==2);
+
+  prepareFrame(md, frame);
+
+  if (md->hasSeenOneFrame && !isTripodLeadIn(md)) {
+    VSMotionSet motionscoarse;
+    VSMotionSet motionsfine;
+    detectMotions(md, &motionscoarse, &motionsfine);
+    // before drawing: for packed input curr is the frame that is drawn into
+    updateReference(md);
+    finishMotions(md, motions, &motionscoarse, &motionsfine);
   } else {
-    vs_vector_init(motions,1); // dummy vector
+    vs_motionset_init(motions,0); // no motions
     md->hasSeenOneFrame = 1;
+    updateReference(md);
   }
 
-  // for tripod we keep a certain reference frame
-  if(md->conf.virtualTripod < 1 || md->frameNum < md->conf.virtualTripod)
-    // copy current frame (smoothed) to prev for next frame comparison
-    vsFrameCopy(&md->prev, &md->curr, &md->fi);
   md->frameNum++;
   return VS_OK;
 }
 
+int vsMotionDetectPrime(VSMotionDetect* md, VSFrame* reference, int firstFrame){
+  assert(md->initialized==2);
+  if(firstFrame < 1){
+    vs_ctx_log_error(&md->ctx, md->conf.modName,
+                     "cannot prime a segment starting at frame %i\n", firstFrame);
+    return VS_ERROR;
+  }
+  prepareFrame(md, reference);
+  takeReference(md);
+  md->hasSeenOneFrame = 1;
+  // the segment before knows the motion, this one searches its first frame fully
+  md->hasPrediction = 0;
+  md->frameNum = firstFrame;
+  return VS_OK;
+}
+
+/* makes the current frame the reference for the next one, if it becomes one */
+static void updateReference(VSMotionDetect* md){
+  if(becomesReference(md))
+    takeReference(md);
+}
+
+/* makes the current frame the reference. curr is filled from scratch every
+   frame, so for planar input the buffers are only swapped; packed frames are
+   the caller's and have to be copied. */
+static void takeReference(VSMotionDetect* md){
+  if (md->currfi.pFormat > PF_PACKED) {
+    vsFrameCopy(&md->prev, &md->curr, &md->fi);
+  } else {
+    VSFrame tmp = md->prev;
+    md->prev = md->curr;
+    md->curr = tmp;
+  }
+  for(int l=0; l < md->pyramidLevels; l++){
+    VSFrame tmp = md->prevpyr[l];
+    md->prevpyr[l] = md->currpyr[l];
+    md->currpyr[l] = tmp;
+  }
+}
+
+/* (Re)creates the per-frame states for batches of n frames. Each one is a
+   copy of md with its own curr (plus pyramid and summed-area tables); prev
+   and prevpyr are only views that are set for every batch. */
+static int allocBatch(VSMotionDetect* md, int n){
+  if(md->batchSize >= n)
+    return VS_OK;
+  freeBatch(md);
+  md->batch = (VSMotionDetect*)vs_zalloc(sizeof(VSMotionDetect) * n);
+  if(!md->batch)
+    return VS_ERROR;
+  for(int k=0; k < n; k++){
+    VSMotionDetect* b = &md->batch[k];
+    *b = *md;
+    b->batch = NULL;
+    b->batchSize = 0;
+    vsFrameNull(&b->curr);
+    vsFrameNull(&b->currtmp);
+    vsFrameNull(&b->currluma);
+    b->integral.sum   = NULL;
+    b->integral.sqsum = NULL;
+    for(int l=0; l < VS_MAX_PYRAMID_LEVELS; l++)
+      vsFrameNull(&b->currpyr[l]);
+    if(allocFrameBuffers(b) != VS_OK){
+      md->batchSize = k+1;
+      freeBatch(md);
+      return VS_ERROR;
+    }
+    md->batchSize = k+1;
+  }
+  return VS_OK;
+}
+
+/// takes over the state of md, keeping the own per-frame buffers
+static void syncBatchState(VSMotionDetect* b, const VSMotionDetect* md){
+  VSMotionDetect own = *b;
+  *b = *md;
+  b->curr     = own.curr;
+  b->currtmp  = own.currtmp;
+  b->currluma = own.currluma;
+  b->integral = own.integral;
+  for(int l=0; l < VS_MAX_PYRAMID_LEVELS; l++)
+    b->currpyr[l] = own.currpyr[l];
+  b->batch     = NULL;
+  b->batchSize = 0;
+}
+
+static void freeBatch(VSMotionDetect* md){
+  for(int k=0; k < md->batchSize; k++)
+    freeFrameBuffers(&md->batch[k]);
+  if(md->batch)
+    vs_free(md->batch);
+  md->batch = NULL;
+  md->batchSize = 0;
+}
+
+/// the two parallel loops of vsMotionDetectionBatch
+typedef struct {
+  VSMotionDetect* batch;
+  VSFrame* frames;
+  const short* measure;
+  VSMotionSet* coarse;
+  VSMotionSet* fine;
+} BatchJob;
+
+static void batchPrepare(void* ctx, int k){
+  BatchJob* job = (BatchJob*)ctx;
+  prepareFrame(&job->batch[k], &job->frames[k]);
+}
+
+static void batchDetect(void* ctx, int k){
+  BatchJob* job = (BatchJob*)ctx;
+  if(job->measure[k])
+    detectMotions(&job->batch[k], &job->coarse[k], &job->fine[k]);
+}
+
+/* The frames are blurred in parallel, then all pairs are searched in
+   parallel. Only the drawing (conf.show) and the joining of the motions run in
+   order, so the result is what n calls of vsMotionDetection would give. */
+int vsMotionDetectionBatch(VSMotionDetect* md, VSFrame* frames, int n,
+                           LocalMotions* motions) {
+  int k;
+  assert(md->initialized==2);
+  if(n < 1)
+    return VS_OK;
+  if(n == 1 || md->conf.motionPrediction){ // the frames depend on each other
+    for(k=0; k < n; k++){
+      if(vsMotionDetection(md, &motions[k], &frames[k]) != VS_OK){
+        while(k-- > 0)
+          vs_vector_del(&motions[k]);
+        return VS_ERROR;
+      }
+    }
+    return VS_OK;
+  }
+  if(allocBatch(md, n) != VS_OK){
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
+    return VS_ERROR;
+  }
+  VSMotionDetect* batch = md->batch;
+  VSMotionDetect* ref = NULL;   // state holding the reference, NULL: md->prev
+  short* measure = (short*)vs_malloc(sizeof(short) * n);
+  VSMotionSet* coarse = (VSMotionSet*)vs_malloc(sizeof(VSMotionSet) * n);
+  VSMotionSet* fine   = (VSMotionSet*)vs_malloc(sizeof(VSMotionSet) * n);
+  if(!measure || !coarse || !fine){
+    vs_free(measure); vs_free(coarse); vs_free(fine);
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
+    return VS_ERROR;
+  }
+
+  for(k=0; k < n; k++){
+    syncBatchState(&batch[k], md);
+    batch[k].frameNum = md->frameNum + k;
+  }
+  BatchJob job = { batch, frames, measure, coarse, fine };
+  vsParallelFor(md->pool, md->conf.numThreads, n, batchPrepare, &job);
+
+  // which frame is compared to which, exactly as the sequential calls would
+  short seen = md->hasSeenOneFrame;
+  for(k=0; k < n; k++){
+    VSMotionDetect* b = &batch[k];
+    b->prev = ref ? ref->curr : md->prev;
+    for(int l=0; l < md->pyramidLevels; l++)
+      b->prevpyr[l] = ref ? ref->currpyr[l] : md->prevpyr[l];
+    measure[k] = seen && !isTripodLeadIn(b);
+    seen = 1;
+    if(becomesReference(b))
+      ref = b;
+  }
+
+  /* the inner parallel loops of calcTransFields find the pool busy and run
+     serially within their pair (with OpenMP: unless nesting is enabled) */
+  vsParallelFor(md->pool, md->conf.numThreads, n, batchDetect, &job);
+
+  // the last reference goes to md, before anything is drawn into the frames
+  if(ref){
+    if (md->currfi.pFormat > PF_PACKED) {
+      vsFrameCopy(&md->prev, &ref->curr, &md->fi);
+    } else {
+      VSFrame tmp = md->prev;
+      md->prev = ref->curr;
+      ref->curr = tmp;
+      for(int l=0; l < md->pyramidLevels; l++){
+        tmp = md->prevpyr[l];
+        md->prevpyr[l] = ref->currpyr[l];
+        ref->currpyr[l] = tmp;
+      }
+    }
+  }
+  int res = VS_OK;
+  for(k=0; k < n; k++){
+    if(measure[k]){
+      VSMotionSet set;
+      finishMotions(&batch[k], &set, &coarse[k], &fine[k]);
+      md->fieldsfine.offset    = batch[k].fieldsfine.offset;
+      md->fieldsfine.useOffset = batch[k].fieldsfine.useOffset;
+      if(vs_motionset_to_vector(&set, &motions[k]) != VS_OK)
+        res = VS_ERROR;
+      vs_motionset_fini(&set);
+    }else if(vs_vector_init(&motions[k],1) != VS_OK){ // dummy vector
+      vs_vector_init(&motions[k],0);
+      res = VS_ERROR;
+    }
+  }
+  md->hasSeenOneFrame = 1;
+  md->frameNum += n;
+
+  vs_free(measure);
+  vs_free(coarse);
+  vs_free(fine);
+  if(res != VS_OK){ // none of the motions is handed out
+    for(k=0; k < n; k++)
+      vs_vector_del(&motions[k]);
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed");
+  }
+  return res;
+}
+
 
 /** initialise measurement fields on the frame.
     The size of the fields and the maxshift is used to
@@ -320,14 +919,14 @@ int initFields(VSMotionDetect* md, VSMotionDetectFields* fs,
   fs->useOffset = 0;
   fs->contrastThreshold = contrastThreshold;
 
-  int rows = VS_MAX(3,(md->fi.height - fs->maxShift*2)/(size+spacing)-1);
-  int cols = VS_MAX(3,(md->fi.width - fs->maxShift*2)/(size+spacing)-1);
+  int rows = VS_MAX(3,(md->currfi.height - fs->maxShift*2)/(size+spacing)-1);
+  int cols = VS_MAX(3,(md->currfi.width - fs->maxShift*2)/(size+spacing)-1);
   // make sure that the remaining rows have the same length
   fs->fieldNum = rows * cols;
   fs->fieldRows = rows;
 
   if (!(fs->fields = (Field*) vs_malloc(sizeof(Field) * fs->fieldNum))) {
-    vs_log_error(md->conf.modName, "malloc failed!\n");
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "malloc failed!\n");
     return 0;
   } else {
     int i, j;
@@ -337,8 +936,8 @@ int initFields(VSMotionDetect* md, VSMotionDetectFields* fs,
     // (stepsize is added in case shift is increased through stepsize)
     if(keepBorder)
       border = size / 2 + fs->maxShift + fs->stepSize;
-    int step_x = (md->fi.width  - 2 * border) / VS_MAX(cols-1,1);
-    int step_y = (md->fi.height - 2 * border) / VS_MAX(rows-1,1);
+    int step_x = (md->currfi.width  - 2 * border) / VS_MAX(cols-1,1);
+    int step_y = (md->currfi.height - 2 * border) / VS_MAX(rows-1,1);
     for (j = 0; j < rows; j++) {
       for (i = 0; i < cols; i++) {
         int idx = j * cols + i;
@@ -349,9 +948,9 @@ int initFields(VSMotionDetect* md, VSMotionDetectFields* fs,
     }
   }
   fs->maxFields = (md->conf.accuracy) * fs->fieldNum / 15;
-  vs_log_info(md->conf.modName, "Fieldsize: %i, Maximal translation: %i pixel\n",
+  vs_ctx_log_info(&md->ctx, md->conf.modName, "Fieldsize: %i, Maximal translation: %i pixel\n",
               fs->fieldSize, fs->maxShift);
-  vs_log_info(md->conf.modName, "Number of used measurement fields: %i out of %i\n",
+  vs_ctx_log_info(&md->ctx, md->conf.modName, "Number of used measurement fields: %i out of %i\n",
               fs->maxFields, fs->fieldNum);
 
   return 1;
@@ -359,7 +958,33 @@ int initFields(VSMotionDetect* md, VSMotionDetectFields* fs,
 
 /** \see contrastSubImg*/
 double contrastSubImgPlanar(VSMotionDetect* md, const Field* field) {
-  return contrastSubImg1(md->curr.data[0], field, md->curr.linesize[0], md->fi.height);
+  return md->ctx.contrastSubImg1(md->curr.data[0], field, md->curr.linesize[0], md->currfi.height);
+}
+
+/**
+   standard deviation of the field relative to its mean, from the summed-area
+   tables of the blurred frame in O(1). For grey levels evenly spread over
+   [a,b] the standard deviation is (b-a)/sqrt(12) and the mean (a+b)/2, so
+   the factor sqrt(3) makes this equal to the Michelson contrast (b-a)/(b+a)
+   there and contrastThreshold keeps roughly its meaning.
+*/
+double contrastSubImgIntegral(VSMotionDetect* md, const Field* field) {
+  int s2 = field->size / 2;
+  double n = (double)field->size * field->size;
+  uint32_t sum;
+  uint64_t sqsum;
+  vsIntegralImageBox(&md->integral, field->x - s2, field->y - s2, field->size,
+                     &sum, &sqsum);
+  double mean = sum / n;
+  double var  = sqsum / n - mean * mean;
+  if (var < 0) var = 0; // rounding
+  return sqrt(3 * var) / (mean + 0.05); // +0.05 to avoid division by 0
+}
+
+/// contrast function for planar frames according to conf.contrastMode
+static contrastSubImgFunc planarContrastFunc(const VSMotionDetect* md) {
+  return md->conf.contrastMode == VSContrastVariance ? contrastSubImgIntegral
+                                                     : contrastSubImgPlanar;
 }
 
 /**
@@ -422,15 +1047,141 @@ static int fieldSearchOffset(Vec* offset, const VSMotionDetect* md,
   if (!fs->useOffset)
     return 1;
   // Todo: we could put the preparedtransform into fs
-  PreparedTransform pt = prepare_transform(&fs->offset, &md->fi);
+  PreparedTransform pt = prepare_transform(&fs->offset, &md->currfi);
   Vec fieldpos = {field->x, field->y};
   *offset = sub_vec(transform_vec(&pt, &fieldpos), fieldpos);
   // is the field still in the frame?
   int border = field->size/2 + fs->maxShift + fs->stepSize;
   int x = fieldpos.x + offset->x;
   int y = fieldpos.y + offset->y;
-  return !(x - border < 0 || x + border >= md->fi.width ||
-           y - border < 0 || y + border >= md->fi.height);
+  return !(x - border < 0 || x + border >= md->currfi.width ||
+           y - border < 0 || y + border >= md->currfi.height);
+}
+
+/* SAD of the field at displacement (d_x,d_y) on the given pyramid level (0 is
+   the full resolution frame). Returns UINT_MAX for displacements that would
+   read outside the level, which calcFieldTransPlanar never has to check for
+   because its window is covered by the field border, but a refinement step
+   on a rounded coarse field can leave it. */
+static unsigned int comparePyramidLevel(const VSMotionDetect* md, int level,
+                                        const Field* field, int d_x, int d_y,
+                                        unsigned int threshold){
+  const VSFrame* c = level ? &md->currpyr[level-1] : &md->curr;
+  const VSFrame* p = level ? &md->prevpyr[level-1] : &md->prev;
+  int width  = level ? md->pyrfi[level-1].width  : md->currfi.width;
+  int height = level ? md->pyrfi[level-1].height : md->currfi.height;
+  int x = field->x - field->size/2 + d_x;
+  int y = field->y - field->size/2 + d_y;
+  if(x < 0 || y < 0 || x + field->size > width || y + field->size > height)
+    return UINT_MAX;
+  return md->ctx.compareSubImg(c->data[0], p->data[0], field, c->linesize[0], p->linesize[0],
+                       height, 1, d_x, d_y, threshold);
+}
+
+/* The SADs of the n <= VS_SAD_RUN displacements (d_x + k*step, d_y) on the
+   given level in one compareSubImgRun pass, see vsCompareSubImgRunFn for what
+   errors[] holds. Runs that leave the level are compared one by one through
+   comparePyramidLevel. */
+static void compareRunPyramidLevel(const VSMotionDetect* md, int level,
+                                   const Field* field, int d_x, int d_y, int step,
+                                   int n, unsigned int threshold, unsigned int* errors){
+  const VSFrame* c = level ? &md->currpyr[level-1] : &md->curr;
+  const VSFrame* p = level ? &md->prevpyr[level-1] : &md->prev;
+  int width  = level ? md->pyrfi[level-1].width  : md->currfi.width;
+  int height = level ? md->pyrfi[level-1].height : md->currfi.height;
+  int x0 = field->x - field->size/2 + d_x;
+  int x1 = x0 + (n-1)*step;
+  int y  = field->y - field->size/2 + d_y;
+  if(VS_MIN(x0,x1) < 0 || y < 0 || VS_MAX(x0,x1) + field->size > width
+     || y + field->size > height){
+    for(int k=0; k < n; k++)
+      errors[k] = comparePyramidLevel(md, level, field, d_x + k*step, d_y, threshold);
+    return;
+  }
+  md->ctx.compareSubImgRun(c->data[0], p->data[0], field, c->linesize[0], p->linesize[0],
+                   height, d_x, d_y, step, n, threshold, errors);
+}
+
+/* scans the square of the given radius around (*d_x,*d_y) on a grid of the
+   given step in an outgoing spiral, so that the most likely positions come
+   first and the threshold cuts the remaining ones short. (*d_x,*d_y) is
+   updated to the best position; returns its error.
+   The horizontal legs of the spiral go through compareSubImgRun, up to
+   VS_SAD_RUN positions at a time. Their threshold is the best error when the
+   run starts rather than the one after each position, which only makes the
+   early exit later: every position that could be the best match gets its
+   exact error and they are taken in spiral order, so the result is that of
+   comparing the positions one by one. */
+static unsigned int spiralSearch(const VSMotionDetect* md, int level,
+                                 const Field* field, int radius, int stepSize,
+                                 int* d_x, int* d_y){
+  unsigned int minerror = UINT_MAX;
+  unsigned int errors[VS_SAD_RUN];
+  int cx = *d_x, cy = *d_y;
+  int i = 0, j = 0;
+  int limit = 1, step = 0, dir = 0;
+  while (j >= -radius && j <= radius && i >= -radius && i <= radius) {
+    if (dir == 0 || dir == 2) { // the rest of the horizontal leg
+      int s = dir == 0 ? stepSize : -stepSize;
+      int inside = (dir == 0 ? radius - i : radius + i) / stepSize + 1;
+      int left = VS_MIN(limit - step, inside);
+      while (left > 0) {
+        int n = VS_MIN(left, VS_SAD_RUN);
+        compareRunPyramidLevel(md, level, field, cx + i, cy + j, s, n, minerror, errors);
+        for (int k = 0; k < n; k++) {
+          if (errors[k] < minerror) {
+            minerror = errors[k];
+            *d_x = cx + i + k*s;
+            *d_y = cy + j;
+          }
+        }
+        i += n*s;
+        step += n;
+        left -= n;
+      }
+      if (step == limit) {
+        dir = dir == 0 ? 1 : 3;
+        step = 0;
+      }
+      continue; // stops here if the leg was cut by the border of the square
+    }
+    unsigned int error = comparePyramidLevel(md, level, field, cx + i, cy + j,
+                                             minerror);
+    if (error < minerror) {
+      minerror = error;
+      *d_x = cx + i;
+      *d_y = cy + j;
+    }
+    step++;
+    if (dir == 1) {
+      j += stepSize;
+      if (step == limit) { dir = 2; step = 0; limit++; }
+    } else {
+      j -= stepSize;
+      if (step == limit) { dir = 0; step = 0; limit++; }
+    }
+  }
+  // make fine grain check around the best match
+  while (stepSize > 1) {
+    int txc = *d_x;
+    int tyc = *d_y;
+    int newStepSize = stepSize/2;
+    int r = stepSize - newStepSize;
+    for (i = txc - r; i <= txc + r; i += newStepSize) {
+      for (j = tyc - r; j <= tyc + r; j += newStepSize) {
+        if (i == txc && j == tyc)
+          continue;
+        unsigned int error = comparePyramidLevel(md, level, field, i, j, minerror);
+        if (error < minerror) {
+          minerror = error;
+          *d_x = i;
+          *d_y = j;
+        }
+      }
+    }
+    stepSize /= 2;
+  }
+  return minerror;
 }
 
 /* calculates the optimal transformation for one field in Planar frames
@@ -440,10 +1191,6 @@ LocalMotion calcFieldTransPlanar(VSMotionDetect* md, VSMotionDetectFields* fs,
                                  const Field* field, int fieldnum) {
   int tx = 0;
   int ty = 0;
-  uint8_t *Y_c = md->curr.data[0], *Y_p = md->prev.data[0];
-  int linesize_c = md->curr.linesize[0], linesize_p = md->prev.linesize[0];
-  // we only use the luminance part of the image
-  int i, j;
   int stepSize = fs->stepSize;
   int maxShift = fs->maxShift;
   Vec offset;
@@ -463,72 +1210,29 @@ LocalMotion calcFieldTransPlanar(VSMotionDetect* md, VSMotionDetectFields* fs,
 #endif
 
 #ifdef USE_SPIRAL_FIELD_CALC
-  unsigned int minerror = UINT_MAX;
-
-  // check all positions by outgoing spiral
-  i = 0; j = 0;
-  int limit = 1;
-  int step = 0;
-  int dir = 0;
-  while (j >= -maxShift && j <= maxShift && i >= -maxShift && i <= maxShift) {
-    unsigned int error = compareSubImg(Y_c, Y_p, field, linesize_c, linesize_p,
-                                       md->fi.height, 1, i + offset.x, j + offset.y,
-                                       minerror);
-
-    if (error < minerror) {
-      minerror = error;
-      tx = i;
-      ty = j;
-    }
-
-    //spiral indexing...
-    step++;
-    switch (dir) {
-     case 0:
-      i += stepSize;
-      if (step == limit) {
-        dir = 1;
-        step = 0;
-      }
-      break;
-     case 1:
-      j += stepSize;
-      if (step == limit) {
-        dir = 2;
-        step = 0;
-        limit++;
-      }
-      break;
-     case 2:
-      i -= stepSize;
-      if (step == limit) {
-        dir = 3;
-        step = 0;
-      }
-      break;
-     case 3:
-      j -= stepSize;
-      if (step == limit) {
-        dir = 0;
-        step = 0;
-        limit++;
-      }
-      break;
-    }
-  }
+  // check all positions by outgoing spiral, including the fine grain check
+  int d_x = offset.x, d_y = offset.y;
+  unsigned int minerror = spiralSearch(md, 0, field, maxShift, stepSize, &d_x, &d_y);
+  tx = d_x - offset.x;
+  ty = d_y - offset.y;
+  stepSize = 1; // as after the fine grain check below
 #else
+  uint8_t *Y_c = md->curr.data[0], *Y_p = md->prev.data[0];
+  int linesize_c = md->curr.linesize[0], linesize_p = md->prev.linesize[0];
+  // we only use the luminance part of the image
+  int i, j;
   /* Here we improve speed by checking first the most probable position
      then the search paths are most effectively cut. (0,0) is a simple start
   */
-  unsigned int minerror = compareSubImg(Y_c, Y_p, field, linesize_c, linesize_p,
-                                        md->fi.height, 1, 0, 0, UINT_MAX);
+  unsigned int minerror = md->ctx.compareSubImg(Y_c, Y_p, field, linesize_c, linesize_p,
+                                        md->currfi.height, 1, 0, 0, UINT_MAX);
   // check all positions...
   for (i = -maxShift; i <= maxShift; i += stepSize) {
     for (j = -maxShift; j <= maxShift; j += stepSize) {
       if( i==0 && j==0 )
         continue; //no need to check this since already done
-      unsigned int error = compareSubImg(Y_c, Y_p, field, linesize_c, linesize_p,
-                                         md->fi.height, 1, i+offset.x, j+offset.y, minerror);
+      unsigned int error = md->ctx.compareSubImg(Y_c, Y_p, field, linesize_c, linesize_p,
+                                         md->currfi.height, 1, i+offset.x, j+offset.y, minerror);
       if (error < minerror) {
         minerror = error;
         tx = i;
@@ -540,8 +1244,6 @@ LocalMotion calcFieldTransPlanar(VSMotionDetect* md, VSMotionDetectFields* fs,
     }
   }
 
-#endif
-
   while(stepSize > 1) {// make fine grain check around the best match
     int txc = tx; // save the shifts
     int tyc = ty;
@@ -551,8 +1253,8 @@ LocalMotion calcFieldTransPlanar(VSMotionDetect* md, VSMotionDetectFields* fs,
       for (j = tyc - r; j <= tyc + r; j += newStepSize) {
         if (i == txc && j == tyc)
           continue; //no need to check this since already done
-        unsigned int error = compareSubImg(Y_c, Y_p, field, linesize_c, linesize_p,
-                                           md->fi.height, 1, i+offset.x, j+offset.y, minerror);
+        unsigned int error = md->ctx.compareSubImg(Y_c, Y_p, field, linesize_c, linesize_p,
+                                           md->currfi.height, 1, i+offset.x, j+offset.y, minerror);
 #ifdef STABVERBOSE
         fprintf(f, "%i %i %f\n", i, j, error);
 #endif
@@ -565,6 +1267,7 @@ LocalMotion calcFieldTransPlanar(VSMotionDetect* md, VSMotionDetectFields* fs,
     }
     stepSize /= 2;
   }
+#endif
 #ifdef STABVERBOSE
   fclose(f);
   vs_log_msg(md->modName, "Minerror: %f\n", minerror);
@@ -585,6 +1288,153 @@ LocalMotion calcFieldTransPlanar(VSMotionDetect* md, VSMotionDetectFields* fs,
   return lm;
 }
 
+/* Fits f(x,y) = a + bx + cy + dx^2 + ey^2 + gxy to the SADs of the 3x3
+   neighbourhood of the motion (which are compared again without threshold:
+   those of the search are cut short by the early exit). On the 3x3 grid the
+   least squares coefficients have a closed form. Returns 0 if the fit has no
+   minimum inside the neighbourhood, otherwise the position of the minimum
+   relative to lm->v and the rms residual of the fit relative to its
+   curvature d + e, in pixels squared. */
+static int subPixelFit(const VSMotionDetect* md, const LocalMotion* lm,
+                       double* sx, double* sy, double* residual){
+  unsigned int err[3][3];
+  double f[3][3], col[3] = {0,0,0}, row[3] = {0,0,0}, sum = 0, rss = 0;
+  int x, y;
+  for (y = 0; y < 3; y++)
+    compareRunPyramidLevel(md, 0, &lm->f, lm->v.x - 1, lm->v.y - 1 + y, 1, 3,
+                           UINT_MAX, err[y]);
+  for (y = 0; y < 3; y++) {
+    for (x = 0; x < 3; x++) {
+      if (err[y][x] == UINT_MAX) // the neighbourhood leaves the frame
+        return 0;
+      f[y][x] = err[y][x];
+      col[x] += f[y][x];
+      row[y] += f[y][x];
+      sum    += f[y][x];
+    }
+  }
+  double b = (col[2] - col[0]) / 6;
+  double c = (row[2] - row[0]) / 6;
+  double d = (col[0] + col[2] - 2*col[1]) / 6;
+  double e = (row[0] + row[2] - 2*row[1]) / 6;
+  double g = (f[0][0] + f[2][2] - f[0][2] - f[2][0]) / 4;
+  double a = (sum - 6*d - 6*e) / 9;
+  double det = 4*d*e - g*g;
+  if (d <= 0 || e <= 0 || det <= 0)
+    return 0;
+  *sx = (g*c - 2*e*b) / det;
+  *sy = (g*b - 2*d*c) / det;
+  if (fabs(*sx) > 1 || fabs(*sy) > 1)
+    return 0;
+  for (y = 0; y < 3; y++) {
+    for (x = 0; x < 3; x++) {
+      double u = x - 1, v = y - 1;
+      double r = f[y][x] - (a + b*u + c*v + d*u*u + e*v*v + g*u*v);
+      rss += r*r;
+    }
+  }
+  *residual = sqrt(rss / 9) / (d + e);
+  return 1;
+}
+
+/* Decides whether the coarse motions are good enough to skip the pass with
+   the fine fields (conf.skipFinePass): three quarters of them need a sub-pixel
+   fit with a small residual that agrees with the coarse transform t to within
+   VS_SUBPIXEL_AGREE pixels. If so and corrected is given, it gets t with the
+   translation corrected by the mean sub-pixel disagreement of those fields.
+   The vectors themselves stay integral, as in the .trf. */
+#define VS_SUBPIXEL_RESIDUAL 0.5
+#define VS_SUBPIXEL_AGREE    0.75
+static int coarseMotionsSuffice(const VSMotionDetect* md, const VSMotionSet* motions,
+                                const VSTransform* t, VSTransform* corrected){
+  int num = motions->num;
+  int agree = 0;
+  double corrx = 0, corry = 0;
+  if (num < 4)
+    return 0;
+  PreparedTransform pt = prepare_transform(t, &md->currfi);
+  for (int i = 0; i < num; i++) {
+    const LocalMotion* lm = MSGet(motions, i);
+    double sx, sy, residual, px, py;
+    if (!subPixelFit(md, lm, &sx, &sy, &residual) || residual > VS_SUBPIXEL_RESIDUAL)
+      continue;
+    Vec fieldpos = {lm->f.x, lm->f.y};
+    transform_vec_double(&px, &py, &pt, &fieldpos);
+    double dx = lm->v.x + sx - (px - lm->f.x);
+    double dy = lm->v.y + sy - (py - lm->f.y);
+    if (fabs(dx) < VS_SUBPIXEL_AGREE && fabs(dy) < VS_SUBPIXEL_AGREE) {
+      corrx += dx;
+      corry += dy;
+      agree++;
+    }
+  }
+  if (4 * agree < 3 * num)
+    return 0;
+  if (corrected) {
+    *corrected = *t;
+    corrected->x += corrx / agree;
+    corrected->y += corry / agree;
+  }
+  return 1;
+}
+
+/* calculates the optimal transformation for one field in Planar frames with a
+ * coarse-to-fine search (see VSMotionDetectConfig.pyramidLevels):
+ * the full window of +-maxShift is only scanned on the coarsest level, where
+ * it is 2^levels times smaller in each direction and the field 4^levels times
+ * smaller in area, with the stepsize scaled down alike. Every finer level
+ * then only looks at a small square around the doubled position of the level
+ * above.
+ * The coarse fields are rounded to the SIMD block size (see
+ * VS_SIMD_FIELD_ALIGNMENT); they only provide the seed, the reported match is
+ * the one of the original field at full resolution.
+ */
+LocalMotion calcFieldTransPyramid(VSMotionDetect* md, VSMotionDetectFields* fs,
+                                  const Field* field, int fieldnum) {
+  const int refineRadius = 2; // covers the rounding of one level plus one pixel
+  int levels = md->pyramidLevels;
+  Vec offset;
+  LocalMotion lm = null_localmotion();
+  if(unlikely(!fieldSearchOffset(&offset, md, fs, field))){
+    lm.match=-1;
+    return lm;
+  }
+
+  // d_x,d_y are absolute displacements (offset included) on the current level
+  int d_x = offset.x / (1 << levels);
+  int d_y = offset.y / (1 << levels);
+  unsigned int minerror = UINT_MAX;
+  for (int l = levels; l >= 0; l--) {
+    Field fl = *field;
+    if (l > 0) {
+      fl.x = field->x >> l;
+      fl.y = field->y >> l;
+      fl.size = VS_MAX(1, ((field->size >> l) + VS_SIMD_FIELD_ALIGNMENT/2)
+                       / VS_SIMD_FIELD_ALIGNMENT) * VS_SIMD_FIELD_ALIGNMENT;
+    }
+    if (l == levels) {
+      minerror = spiralSearch(md, l, &fl, (fs->maxShift + (1 << l) - 1) >> l,
+                                     VS_MAX(1, fs->stepSize >> l), &d_x, &d_y);
+    } else {
+      d_x *= 2;
+      d_y *= 2;
+      minerror = spiralSearch(md, l, &fl, refineRadius, 1, &d_x, &d_y);
+    }
+  }
+
+  if (unlikely(minerror == UINT_MAX ||
+               abs(d_x - offset.x) > fs->maxShift ||
+               abs(d_y - offset.y) > fs->maxShift)) {
+    lm.match =-1.0; // to be kicked out
+    return lm;
+  }
+  lm.f = *field;
+  lm.v.x = d_x;
+  lm.v.y = d_y;
+  lm.match = ((double) minerror)/(field->size*field->size);
+  return lm;
+}
+
 /* calculates the optimal transformation for one field in Packed
  *   slower than the Planar version because it uses all three color channels
  */
@@ -610,14 +1460,14 @@ LocalMotion calcFieldTransPacked(VSMotionDetect* md, VSMotionDetectFields* fs,
   /* Here we improve speed by checking first the most probable position
      then the search paths are most effectively cut. (0,0) is a simple start
   */
-  unsigned int minerror = compareSubImg(I_c, I_p, field, linesize_c, linesize_p, md->fi.height,
+  unsigned int minerror = md->ctx.compareSubImg(I_c, I_p, field, linesize_c, linesize_p, md->fi.height,
                                         bpp, offset.x, offset.y, UINT_MAX);
   // check all positions...
   for (i = -maxShift; i <= maxShift; i += stepSize) {
     for (j = -maxShift; j <= maxShift; j += stepSize) {
       if( i==0 && j==0 )
         continue; //no need to check this since already done
-      unsigned int error = compareSubImg(I_c, I_p, field, linesize_c, linesize_p,
+      unsigned int error = md->ctx.compareSubImg(I_c, I_p, field, linesize_c, linesize_p,
                                          md->fi.height, bpp, i + offset.x, j + offset.y, minerror);
       if (error < minerror) {
         minerror = error;
@@ -634,7 +1484,7 @@ LocalMotion calcFieldTransPacked(VSMotionDetect* md, VSMotionDetectFields* fs,
       for (j = tyc - r; j <= tyc + r; j += 1) {
         if (i == txc && j == tyc)
           continue; //no need to check this since already done
-        unsigned int error = compareSubImg(I_c, I_p, field, linesize_c, linesize_p,
+        unsigned int error = md->ctx.compareSubImg(I_c, I_p, field, linesize_c, linesize_p,
                                            md->fi.height, bpp, i + offset.x, j + offset.y, minerror);
         if (error < minerror) {
           minerror = error;
@@ -749,12 +1599,139 @@ VSVector selectfields(VSMotionDetect* md, VSMotionDetectFields* fs,
  *   check theses fields for vertical and horizontal transformation
  *   use minimal difference of all possible positions
  */
-LocalMotions calcTransFields(VSMotionDetect* md,
-                             VSMotionDetectFields* fields,
-                             calcFieldTransFunc fieldfunc,
-                             contrastSubImgFunc contrastfunc) {
-  LocalMotions localmotions;
-  vs_vector_init(&localmotions,fields->maxFields);
+/* Consensus early exit (conf.consensusFields). The fields are searched in
+   rounds of VS_CONSENSUS_ROUND, in parallel within a round. After each round
+   the motions so far are checked for agreement; the round size does not
+   depend on the number of threads, so neither does the result. A field
+   agrees if both components of v are within VS_CONSENSUS_TOL of the
+   component-wise median. */
+#define VS_CONSENSUS_ROUND 16
+#define VS_CONSENSUS_TOL   1
+#define VS_CONSENSUS_GRID  3
+
+/// cell of the field in a VS_CONSENSUS_GRID x VS_CONSENSUS_GRID grid of the frame
+static int consensusCell(const VSMotionDetect* md, const Field* f){
+  int cx = VS_CLAMP(f->x * VS_CONSENSUS_GRID / md->currfi.width, 0, VS_CONSENSUS_GRID-1);
+  int cy = VS_CLAMP(f->y * VS_CONSENSUS_GRID / md->currfi.height, 0, VS_CONSENSUS_GRID-1);
+  return cy*VS_CONSENSUS_GRID + cx;
+}
+
+/* reorders the selected fields round robin over the grid cells, each cell in
+   the order of selectfields (best contrast first), so that every prefix of
+   the list is spread over the whole frame */
+static void stratifyFields(const VSMotionDetect* md, const VSMotionDetectFields* fs,
+                           VSVector* goodflds){
+  int num = vs_vector_size(goodflds);
+  int taken = 0;
+  if(num < 2)
+    return;
+  contrast_idx* order = (contrast_idx*)vs_malloc(sizeof(contrast_idx) * num);
+  char* used = (char*)vs_zalloc(num);
+  if(!order || !used){ // keep the contrast order
+    vs_free(order); vs_free(used);
+    return;
+  }
+  while(taken < num){
+    for(int c=0; c < VS_CONSENSUS_GRID*VS_CONSENSUS_GRID; c++){
+      for(int k=0; k < num; k++){
+        contrast_idx* ci = (contrast_idx*)vs_vector_get(goodflds,k);
+        if(!used[k] && consensusCell(md, &fs->fields[ci->index]) == c){
+          order[taken++] = *ci;
+          used[k] = 1;
+          break;
+        }
+      }
+    }
+  }
+  for(int k=0; k < num; k++)
+    *(contrast_idx*)vs_vector_get(goodflds,k) = order[k];
+  vs_free(order);
+  vs_free(used);
+}
+
+/* whether the first num motions (match < 0: no result) agree well enough to
+   stop: at least conf.consensusFields and three quarters of the valid ones
+   agree, and so does at least one in every grid cell that has a valid one,
+   which keeps rotation and zoom from passing as consensus */
+static int fieldsAgree(const VSMotionDetect* md, const LocalMotion* motions, int num){
+  int* xs = (int*)vs_malloc(sizeof(int) * 2 * (num > 0 ? num : 1));
+  int* ys;
+  int valid = 0, agree = 0;
+  int cellValid[VS_CONSENSUS_GRID*VS_CONSENSUS_GRID] = {0};
+  int cellAgree[VS_CONSENSUS_GRID*VS_CONSENSUS_GRID] = {0};
+  if(!xs)
+    return 0;
+  ys = xs + num;
+  for(int k=0; k < num; k++){
+    if(motions[k].match < 0) continue;
+    xs[valid] = motions[k].v.x;
+    ys[valid] = motions[k].v.y;
+    valid++;
+  }
+  if(valid < md->conf.consensusFields){
+    vs_free(xs);
+    return 0;
+  }
+  qsort(xs, valid, sizeof(int), cmp_int);
+  qsort(ys, valid, sizeof(int), cmp_int);
+  int mx = xs[valid/2], my = ys[valid/2];
+  vs_free(xs);
+  for(int k=0; k < num; k++){
+    if(motions[k].match < 0) continue;
+    int c = consensusCell(md, &motions[k].f);
+    cellValid[c]++;
+    if(abs(motions[k].v.x - mx) <= VS_CONSENSUS_TOL
+       && abs(motions[k].v.y - my) <= VS_CONSENSUS_TOL){
+      cellAgree[c]++;
+      agree++;
+    }
+  }
+  if(agree < md->conf.consensusFields || 4*agree < 3*valid)
+    return 0;
+  for(int c=0; c < VS_CONSENSUS_GRID*VS_CONSENSUS_GRID; c++){
+    if(cellValid[c] > 0 && cellAgree[c] == 0)
+      return 0;
+  }
+  return 1;
+}
+
+/// one round of fields of calcTransFields
+typedef struct {
+  VSMotionDetect* md;
+  VSMotionDetectFields* fields;
+  calcFieldTransFunc fieldfunc;
+  const VSVector* goodflds;
+  LocalMotion* motionbuf;
+  int start;
+#ifdef STABVERBOSE
+  FILE* file;
+#endif
+} FieldJob;
+
+static void calcFieldJob(void* ctx, int k){
+  const FieldJob* job = (const FieldJob*)ctx;
+  int index = job->start + k;
+  const contrast_idx* ci = (const contrast_idx*)vs_vector_get(job->goodflds, index);
+  LocalMotion m;
+  m = job->fieldfunc(job->md, job->fields, &job->fields->fields[ci->index],
+                     ci->index); // e.g. calcFieldTransPlanar
+  if(m.match >= 0){
+    m.contrast = ci->contrast;
+#ifdef STABVERBOSE
+#pragma omp critical(localmotions_debugout)
+    fprintf(job->file, "%i %i\n%f %f %f %f\n \n\n", m.f.x, m.f.y,
+            m.f.x + m.v.x, m.f.y + m.v.y, m.match, m.contrast);
+#endif
+  }
+  job->motionbuf[index] = m;
+}
+
+VSMotionSet calcTransFields(VSMotionDetect* md,
+                            VSMotionDetectFields* fields,
+                            calcFieldTransFunc fieldfunc,
+                            contrastSubImgFunc contrastfunc) {
+  VSMotionSet localmotions;
+  vs_motionset_init(&localmotions,fields->maxFields);
 
 #ifdef STABVERBOSE
   FILE *file = NULL;
@@ -770,32 +1747,31 @@ LocalMotions calcTransFields(VSMotionDetect* md,
      resulting local motions only depends on the order of goodflds and not on
      the thread scheduling (issue #111). */
   LocalMotion* motionbuf = (LocalMotion*)vs_malloc(sizeof(LocalMotion) * (numfields > 0 ? numfields : 1));
+  // without the consensus exit all fields are one round
+  int consensus = md->conf.consensusFields > 0 && fields == &md->fieldscoarse;
+  int round = consensus ? VS_CONSENSUS_ROUND : VS_MAX(numfields, 1);
+  int start, end = 0;
+  if(consensus)
+    stratifyFields(md, fields, &goodflds);
 
   // use all "good" fields and calculate optimal match to previous frame
-  //MSVC requires the OpenMP loop index to be a signed integer, declared in the same function, and visible if not declared inside the loop.
-  int index;
-#ifdef USE_OMP
-  omp_set_num_threads(md->conf.numThreads);
-#pragma omp parallel for shared(goodflds, md, motionbuf)
-#endif
-  for(index=0; index < numfields; index++){
-    int i = ((contrast_idx*)vs_vector_get(&goodflds,index))->index;
-    LocalMotion m;
-    m = fieldfunc(md, fields, &fields->fields[i], i); // e.g. calcFieldTransPlanar
-    if(m.match >= 0){
-      m.contrast = ((contrast_idx*)vs_vector_get(&goodflds,index))->contrast;
+  FieldJob job = { md, fields, fieldfunc, &goodflds, motionbuf, 0 };
 #ifdef STABVERBOSE
-#pragma omp critical(localmotions_debugout)
-      fprintf(file, "%i %i\n%f %f %f %f\n \n\n", m.f.x, m.f.y,
-              m.f.x + m.v.x, m.f.y + m.v.y, m.match, m.contrast);
+  job.file = file;
 #endif
-    }
-    motionbuf[index] = m;
+  int index;
+  for(start=0; start < numfields; start = end){
+    end = VS_MIN(start + round, numfields);
+    job.start = start;
+    vsParallelFor(md->pool, md->conf.numThreads, end - start, calcFieldJob, &job);
+    // stop once the searched fields agree (conf.consensusFields)
+    if(consensus && end < numfields && fieldsAgree(md, motionbuf, end))
+      break;
   }
   /* serially append in field order: deterministic, independent of thread count */
-  for(index=0; index < numfields; index++){
+  for(index=0; index < end; index++){
     if(motionbuf[index].match >= 0)
-      vs_vector_append_dup(&localmotions, &motionbuf[index], sizeof(LocalMotion));
+      vs_motionset_append(&localmotions, &motionbuf[index]);
   }
   vs_free(motionbuf);
   vs_vector_del(&goodflds);
@@ -36,11 +36,27 @@
 #include "transformtype.h"
 #include "vidstabdefines.h"
 #include "vsvector.h"
+#include "motionset.h"
 #include "frameinfo.h"
+#include "boxblur.h"
+#include "threadpool.h"
+#include "vscontext.h"
 #include "vidstab_api.h"
 
 #define ASCII_SERIALIZATION_MODE 1
 #define BINARY_SERIALIZATION_MODE 2
+/* binary with float contrast and match, 20 bytes per local motion
+   (file format version 2, see VSCompactMotion) */
+#define COMPACT_SERIALIZATION_MODE 3
+
+/** how the contrast of a measurement field is measured.
+    VSContrastMinMax   - Michelson contrast (max-min)/(max+min) of the field
+    VSContrastVariance - standard deviation relative to the mean, scaled to match
+                         the Michelson contrast for evenly spread grey levels.
+                         O(1) per field from a summed-area table of the blurred
+                         luma (planar input only).
+*/
+typedef enum _vscontrastmode { VSContrastMinMax = 0, VSContrastVariance } VSContrastMode;
 
 typedef struct _vsmotiondetectconfig {
   /* meta parameter for maxshift and fieldsize between 1 and 15 */
@@ -55,8 +71,41 @@ typedef struct _vsmotiondetectconfig {
   double      contrastThreshold;
   const char* modName;          // module name (used for logging)
   int         numThreads;       // number of threads to use (automatically set if 0)
+  /* coarse-to-fine search: number of half resolution levels the coarse
+     fields are searched on before the full resolution (0: off, max 3) */
+  int         pyramidLevels;
+  /* contrast measure used to select the fields (see VSContrastMode) */
+  VSContrastMode contrastMode;
+  /* if 1 the coarse fields are searched in a reduced window around the motion
+     of the last frame, with the full window as fallback (def: 0) */
+  int         motionPrediction;
+  /* if 1 packed RGB input is converted to luma and searched like planar
+     input, which is much faster but gives a different result (def: 0) */
+  int         packedLuma;
+  /* if 1 the coarse minima are fitted to sub-pixel precision and the pass
+     with the fine fields only runs if the fits are poor or disagree with the
+     coarse transform. Fewer local motions per frame in the .trf (def: 0).
+     A frame that skips it keeps only the integral coarse vectors: the
+     sub-pixel fit corrects the motion prediction, not the motions, so its
+     transforms can be off by up to half a pixel where the fine pass would
+     have got closer (about 0.3 px more on a pan by half pixels) */
+  int         skipFinePass;
+  /* if > 1 the luma is downsampled by this factor and searched on the small
+     image. The local motions are still in source pixels (def: 1) */
+  int         detectScale;
+  /* if > 0 the coarse fields are searched in a spatially spread order and
+     the search stops once this many fields agree on one translation, as
+     they do for static shots and slow pans. Fewer local motions per frame
+     in the .trf (def: 0) */
+  int         consensusFields;
+  /* parallel loops of the host application (see threadpool.h); if set, no
+     threads are started and numThreads is ignored (def: none) */
+  VSExecutor  executor;
 } VSMotionDetectConfig;
 
+/// maximal number of half resolution levels of the search pyramid
+#define VS_MAX_PYRAMID_LEVELS 3
+
 /** structure for motion detection fields */
 typedef struct _vsmotiondetectfields {
   /* maximum number of pixels we expect the shift of subsequent frames */
@@ -75,19 +124,44 @@ typedef struct _vsmotiondetectfields {
 /** data structure for motion detection part of deshaking*/
 typedef struct _vsmotiondetect {
   VSFrameInfo fi;
+  /* format of curr and prev: fi, or the luma (packedLuma), downsampled by
+     conf.detectScale. All search geometry is in these coordinates. */
+  VSFrameInfo currfi;
 
   VSMotionDetectConfig conf;
 
   VSMotionDetectFields fieldscoarse;
   VSMotionDetectFields fieldsfine;
 
-  VSFrame curr;                 // blurred version of current frame buffer
+  VSFrame curr;                 // blurred version of current frame buffer (packed: only pointer)
   VSFrame currorig;             // current frame buffer (original) (only pointer)
   VSFrame currtmp;              // temporary buffer for blurring
-  VSFrame prev;                 // frame buffer for last frame (copied)
+  VSFrame currluma;             // full size luma (only packedLuma with detectScale)
+  VSFrame prev;                 // frame buffer for last frame (swapped with curr)
+  /* search pyramid (only if conf.pyramidLevels): level l+1 is stored at
+     index l and has half the resolution of level l, level 0 is curr/prev */
+  int pyramidLevels;            // number of levels actually in use
+  VSFrameInfo pyrfi[VS_MAX_PYRAMID_LEVELS];
+  VSFrame currpyr[VS_MAX_PYRAMID_LEVELS];
+  VSFrame prevpyr[VS_MAX_PYRAMID_LEVELS];
+  /* summed-area tables of curr (only for VSContrastVariance on planar input) */
+  VSIntegralImage integral;
+  /* temporal motion prediction (only if conf.motionPrediction) */
+  short hasPrediction;          // true if prediction is valid
+  VSTransform prediction;       // coarse transform of the last frame
+  int predictionShift;          // search radius around the prediction
+  double predictionMatch;       // running mean of the coarse match quality
+  int predictionNum;            // number of coarse motions of the last frame
+  /* per-frame states of vsMotionDetectionBatch, sized for the largest batch */
+  struct _vsmotiondetect* batch;
+  int batchSize;
+  /* worker threads of the parallel loops (NULL: OpenMP or serial) */
+  VSThreadPool* pool;
+  /* kernels, logger and thread defaults, see vscontext.h */
+  VSContext ctx;
   short hasSeenOneFrame;        // true if we have a valid previous frame
   int initialized;              // 1 if initialized and 2 if configured
-  int serializationMode;        // 1 if ascii and 2 if binary
+  int serializationMode;        // 1 if ascii, 2 if binary and 3 if compact binary
 
   int frameNum;
 } VSMotionDetect;
@@ -127,6 +201,12 @@ VS_API VSMotionDetectConfig vsMotionDetectGetDefaultConfig(const char* modName);
 VS_API int vsMotionDetectInit(VSMotionDetect* md, const VSMotionDetectConfig* conf,
                        const VSFrameInfo* fi);
 
+/** vsMotionDetectInit with the kernels, logger and thread defaults of ctx
+ *  (copied, see vscontext.h) instead of the process-wide ones; NULL: as
+ *  vsMotionDetectInit */
+VS_API int vsMotionDetectInitContext(VSMotionDetect* md, const VSMotionDetectConfig* conf,
+                                     const VSFrameInfo* fi, const VSContext* ctx);
+
 /**
  *  Performs a motion detection step
  *  Only the new current frame is given. The last frame
@@ -135,6 +215,46 @@ VS_API int vsMotionDetectInit(VSMotionDetect* md, const VSMotionDetectConfig* co
  * */
 VS_API int vsMotionDetection(VSMotionDetect* md, LocalMotions* motions, VSFrame *frame);
 
+/**
+ *  vsMotionDetection into a motion set: all motions of the frame in one
+ *  array, without an allocation per motion.
+ *  @param motions: calculated local motions (initialized here, release with
+ *                  vs_motionset_fini)
+ * */
+VS_API int vsMotionDetectionSet(VSMotionDetect* md, VSMotionSet* motions, VSFrame *frame);
+
+/**
+ *  Performs the motion detection steps for n subsequent frames at once.
+ *  The frames are blurred and the frame pairs are searched in parallel
+ *  (numThreads), which keeps all cores busy also for small frames.
+ *  The result is identical to n calls of vsMotionDetection. With
+ *  conf.motionPrediction every frame depends on the one before, then the
+ *  frames are processed one after another.
+ *  @param frames: n frames in presentation order (only read, except for show)
+ *  @param motions: array of n, calculated local motions per frame.
+ *                  (must be deleted manually, on VS_ERROR they hold
+ *                  nothing to delete)
+ *  @return VS_OK on success otherwise VS_ERROR (e.g. out of memory)
+ * */
+VS_API int vsMotionDetectionBatch(VSMotionDetect* md, VSFrame* frames, int n,
+                                  LocalMotions* motions);
+
+/**
+ *  Starts the detection of a segment of a clip at frame firstFrame (0 based),
+ *  so that segments can be detected independently (other threads, processes
+ *  or machines) and their files joined with vsMergeMotionsFiles.
+ *  The reference frame is blurred and kept, no motions are emitted: it is
+ *  the frame the first frame of the segment is measured against, the frame
+ *  before it, or with a virtual tripod the tripod frame (virtualTripod-1)
+ *  once the segment starts behind it. The frames of the segment then get the
+ *  numbers they have in the whole clip. With motionPrediction the first frame
+ *  is searched without a prediction, so its motions may differ from those
+ *  of a detection of the whole clip; the other frames do not.
+ *  @param md: initialized, before its first frame
+ *  @return VS_OK, VS_ERROR if firstFrame < 1
+ * */
+VS_API int vsMotionDetectPrime(VSMotionDetect* md, VSFrame* reference, int firstFrame);
+
 /** Deletes internal data structures.
  * In order to use the VSMotionDetect again, you have to call vsMotionDetectInit
  */
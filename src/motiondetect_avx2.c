@@ -32,6 +32,7 @@
 #ifdef VS_HAVE_AVX2
 
 #include <immintrin.h>
+#include <string.h>
 
 /* Rows to accumulate before testing the running sum against the threshold.
    1 means "every row", which makes these kernels return exactly the same value
@@ -114,6 +115,55 @@ unsigned int compareSubImg_thr_avx2(unsigned char* const I1, unsigned char* cons
   return hsum_sad256(acc, accTail);
 }
 
+/* The run version of the above: the 32 byte blocks (and the 16 byte tail) of
+   the current frame row are loaded once and compared against all n windows. */
+void compareSubImgRun_avx2(unsigned char* const I1, unsigned char* const I2,
+                           const Field* field, int linesize1, int linesize2, int height,
+                           int d_x, int d_y, int step, int n,
+                           unsigned int threshold, unsigned int* errors) {
+  int j, k, c;
+  int s2 = field->size / 2;
+  int mainBytes = field->size & ~31;
+  int hasTail   = field->size & 16;
+  unsigned char* p1 = I1 + (field->x - s2) + (field->y - s2) * linesize1;
+  unsigned char* p2 = I2 + (field->x - s2 + d_x) + (field->y - s2 + d_y) * linesize2;
+  __m256i acc[VS_SAD_RUN];
+  __m128i accTail[VS_SAD_RUN];
+
+  for (k = 0; k < n; k++) {
+    acc[k]     = _mm256_setzero_si256();
+    accTail[k] = _mm_setzero_si128();
+  }
+  for (j = 0; j < field->size; j++) {
+    for (c = 0; c < mainBytes; c += 32) {
+      __m256i a = _mm256_loadu_si256((__m256i const*)(p1 + c));
+      for (k = 0; k < n; k++) {
+        __m256i b = _mm256_loadu_si256((__m256i const*)(p2 + k * step + c));
+        acc[k] = _mm256_add_epi64(acc[k], _mm256_sad_epu8(a, b));
+      }
+    }
+    if (hasTail) {
+      __m128i a = _mm_loadu_si128((__m128i const*)(p1 + mainBytes));
+      for (k = 0; k < n; k++) {
+        __m128i b = _mm_loadu_si128((__m128i const*)(p2 + k * step + mainBytes));
+        accTail[k] = _mm_add_epi64(accTail[k], _mm_sad_epu8(a, b));
+      }
+    }
+    // every 4th row, as in compareSubImgRun_sse2
+    if ((j & 3) == 3) {
+      int live = 0;
+      for (k = 0; k < n; k++)
+        live |= hsum_sad256(acc[k], accTail[k]) <= threshold;
+      if (!live)
+        break;
+    }
+    p1 += linesize1;
+    p2 += linesize2;
+  }
+  for (k = 0; k < n; k++)
+    errors[k] = hsum_sad256(acc[k], accTail[k]);
+}
+
 double contrastSubImg1_avx2(unsigned char* const I, const Field* field,
                             int linesize, int height) {
   int j;
@@ -166,6 +216,52 @@ double contrastSubImg1_avx2(unsigned char* const I, const Field* field,
   return (maxi - mini) / (maxi + mini + 0.1); // +0.1 to avoid division by 0
 }
 
+/* 8 pixels per step. Both layouts are first brought to 4 bytes per pixel --
+   for 3 byte pixels each 128 bit lane loads 4 pixels and a byte shuffle
+   spreads them out -- then the channels are widened to 16 bit and
+   _mm256_madd_epi16 with the weights (wR,wG,wB,0) gives wR*R+wG*G and wB*B
+   per pixel, which a horizontal add joins. The weighted sum is at most
+   256*255, so the 32 bit lanes are exact and the result is bit identical to
+   rgbToLuma_C. (_mm256_maddubs_epi16 would save the widening but takes signed
+   weights, and 150 does not fit.) */
+void rgbToLuma_avx2(unsigned char* Y, const unsigned char* src,
+                    int width, int bytesPerPixel, int rIndex) {
+  const int wr = 77, wg = 150, wb = 29;
+  const __m256i weights = rIndex == 0
+    ? _mm256_set1_epi64x(((long long)0 << 48) | ((long long)wb << 32) | (wg << 16) | wr)
+    : _mm256_set1_epi64x(((long long)0 << 48) | ((long long)wr << 32) | (wg << 16) | wb);
+  const __m256i spread = _mm256_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1,
+                                          0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+  const __m256i zero  = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi32(128);
+  /* the 3 byte variant reads 16 bytes at pixel i+4, i.e. up to byte 3*i+28 */
+  const int end = bytesPerPixel == 4 ? width - 8 : width - 10;
+  int i = 0;
+  for (; i <= end; i += 8) {
+    const unsigned char* p = src + i * bytesPerPixel;
+    __m256i px;
+    if (bytesPerPixel == 4) {
+      px = _mm256_loadu_si256((const __m256i*)p);
+    } else {
+      px = _mm256_inserti128_si256(
+             _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+             _mm_loadu_si128((const __m128i*)(p + 12)), 1);
+      px = _mm256_shuffle_epi8(px, spread);
+    }
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), weights);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), weights);
+    // per lane: pixels 0,1 from lo and 2,3 from hi, in order
+    __m256i y = _mm256_srli_epi32(_mm256_add_epi32(_mm256_hadd_epi32(lo, hi), round), 8);
+    y = _mm256_packus_epi16(_mm256_packs_epi32(y, y), zero);
+    int y0 = _mm_cvtsi128_si32(_mm256_castsi256_si128(y));
+    int y1 = _mm_cvtsi128_si32(_mm256_extracti128_si256(y, 1));
+    memcpy(Y + i, &y0, 4);
+    memcpy(Y + i + 4, &y1, 4);
+  }
+  if (i < width)
+    rgbToLuma_C(Y + i, src + i * bytesPerPixel, width - i, bytesPerPixel, rIndex);
+}
+
 #endif /* VS_HAVE_AVX2 */
 
 /*
@@ -32,6 +32,7 @@
 #include "motiondetect_opt.h"
 #include "motiondetect_internal.h"
 #include "vidstabdefines.h"
+#include "vsthread.h"
 
 /* contrastSubImg1() is contrastSubImg() specialised to bytesPerPixel == 1;
    the planar path is the only caller and every SIMD kernel is planar only. */
@@ -43,42 +44,48 @@ static double contrastSubImg1_C(unsigned char* const I, const Field* field,
 /* Safe defaults: correct everywhere, upgraded by vs_simd_init(). */
 vsCompareSubImgFn   compareSubImg   = compareSubImg_thr;
 vsContrastSubImg1Fn contrastSubImg1 = contrastSubImg1_C;
+vsCompareSubImgRunFn compareSubImgRun = compareSubImgRun_C;
+vsRgbToLumaFn       rgbToLuma       = rgbToLuma_C;
 
 /* What vs_simd_init() actually picked.  This is not the same as the highest
    extension the CPU reports (see the AVX-512 note below), so it is recorded
    here rather than derived from vs_cpu_flags(). */
 static const char* vs_simd_selected = "scalar";
 
-void vs_simd_init(void) {
-  static int done = 0;
-  unsigned int flags;
-
-  /* Benign race: every racing caller stores the same pointers. */
-  if (done)
-    return;
-
-  flags = vs_cpu_flags();
+void vs_simd_select(VSContext* ctx) {
+  unsigned int flags = vs_cpu_flags();
   (void)flags;   /* unused in a build with no SIMD kernels at all */
 
+  ctx->compareSubImg    = compareSubImg_thr;
+  ctx->contrastSubImg1  = contrastSubImg1_C;
+  ctx->compareSubImgRun = compareSubImgRun_C;
+  ctx->rgbToLuma        = rgbToLuma_C;
+  ctx->simdName         = "scalar";
+
 #ifdef VS_HAVE_SSE2
   if (flags & VS_CPU_SSE2) {
-    compareSubImg   = compareSubImg_thr_sse2;
-    contrastSubImg1 = contrastSubImg1_SSE;
-    vs_simd_selected = "SSE2";
+    ctx->compareSubImg    = compareSubImg_thr_sse2;
+    ctx->contrastSubImg1  = contrastSubImg1_SSE;
+    ctx->compareSubImgRun = compareSubImgRun_sse2;
+    ctx->simdName         = "SSE2";
   }
 #endif
 #ifdef VS_HAVE_NEON
   if (flags & VS_CPU_NEON) {
-    compareSubImg   = compareSubImg_thr_neon;
-    contrastSubImg1 = contrastSubImg1_neon;
-    vs_simd_selected = "NEON";
+    ctx->compareSubImg    = compareSubImg_thr_neon;
+    ctx->contrastSubImg1  = contrastSubImg1_neon;
+    ctx->compareSubImgRun = compareSubImgRun_neon;
+    ctx->rgbToLuma        = rgbToLuma_neon;
+    ctx->simdName         = "NEON";
   }
 #endif
 #ifdef VS_HAVE_AVX2
   if (flags & VS_CPU_AVX2) {
-    compareSubImg   = compareSubImg_thr_avx2;
-    contrastSubImg1 = contrastSubImg1_avx2;
-    vs_simd_selected = "AVX2";
+    ctx->compareSubImg    = compareSubImg_thr_avx2;
+    ctx->contrastSubImg1  = contrastSubImg1_avx2;
+    ctx->compareSubImgRun = compareSubImgRun_avx2;
+    ctx->rgbToLuma        = rgbToLuma_avx2;
+    ctx->simdName         = "AVX2";
   }
 #endif
 #ifdef VS_HAVE_AVX512
@@ -99,10 +106,11 @@ void vs_simd_init(void) {
      would need a lookup table that ages badly.  So the kernels are built and
      tested, and reachable with VIDSTAB_SIMD=avx512 for anyone who measures a
      win on their hardware, but the automatic choice stays AVX2. */
+  /* no AVX-512 run kernel: runs keep the AVX2 one */
   if ((flags & VS_CPU_AVX512) && vs_cpu_simd_forced()) {
-    compareSubImg   = compareSubImg_thr_avx512;
-    contrastSubImg1 = contrastSubImg1_avx512;
-    vs_simd_selected = "AVX-512";
+    ctx->compareSubImg    = compareSubImg_thr_avx512;
+    ctx->contrastSubImg1  = contrastSubImg1_avx512;
+    ctx->simdName         = "AVX-512";
   }
 #endif
 
@@ -111,12 +119,29 @@ void vs_simd_init(void) {
      Hence an opt in build flag rather than part of the runtime dispatch. */
 #ifdef USE_SSE2_ASM
   if (flags & VS_CPU_SSE2) {
-    compareSubImg = compareSubImg_thr_sse2_asm;
-    vs_simd_selected = "SSE2 (asm)";
+    ctx->compareSubImg    = compareSubImg_thr_sse2_asm;
+    ctx->simdName         = "SSE2 (asm)";
   }
 #endif
+}
+
+static void simdInitGlobals(void) {
+  VSContext ctx;
+  vs_simd_select(&ctx);
+  compareSubImg    = ctx.compareSubImg;
+  contrastSubImg1  = ctx.contrastSubImg1;
+  compareSubImgRun = ctx.compareSubImgRun;
+  rgbToLuma        = ctx.rgbToLuma;
+  vs_simd_selected = ctx.simdName;
+}
 
-  done = 1;
+/* The globals are written exactly once, and a caller returns only after
+   that write, so it sees the final pointers however many threads race here.
+   Instances initialised with their own VSContext never get here. */
+static vs_once simdOnce = VS_ONCE_INIT;
+
+void vs_simd_init(void) {
+  vs_call_once(&simdOnce, simdInitGlobals);
 }
 
 const char* vs_simd_active_name(void) {
@@ -124,6 +149,27 @@ const char* vs_simd_active_name(void) {
   return vs_simd_selected;
 }
 
+void vsContextInit(VSContext* ctx) {
+  vs_simd_select(ctx);
+  ctx->log        = vs_log;
+  ctx->numThreads = 0;
+  ctx->executor.parallel_for = NULL;
+  ctx->executor.ctx = NULL;
+}
+
+void vsContextFromGlobals(VSContext* ctx) {
+  vs_simd_init();
+  ctx->compareSubImg    = compareSubImg;
+  ctx->compareSubImgRun = compareSubImgRun;
+  ctx->contrastSubImg1  = contrastSubImg1;
+  ctx->rgbToLuma        = rgbToLuma;
+  ctx->simdName         = vs_simd_selected;
+  ctx->log              = vs_log;
+  ctx->numThreads       = 0;
+  ctx->executor.parallel_for = NULL;
+  ctx->executor.ctx     = NULL;
+}
+
 /*
  * Local variables:
  *   c-file-style: "stroustrup"
@@ -48,6 +48,8 @@ VS_API int initFields(VSMotionDetect* md, VSMotionDetectFields* fs,
 
 VS_API double contrastSubImgPlanar(VSMotionDetect* md, const Field* field);
 VS_API double contrastSubImgPacked(VSMotionDetect* md, const Field* field);
+/// variance based contrast from md->integral (VSContrastVariance)
+VS_API double contrastSubImgIntegral(VSMotionDetect* md, const Field* field);
 /// \param linesize distance between two rows in BYTES (see vidstabdefines.h)
 /// \param bytesPerPixel distance between two pixels in bytes, 1 for planar
 VS_API double contrastSubImg(unsigned char* const I, const Field* field,
@@ -60,11 +62,13 @@ VS_API VSVector selectfields(VSMotionDetect* md, VSMotionDetectFields* fields,
 
 VS_API LocalMotion calcFieldTransPlanar(VSMotionDetect* md, VSMotionDetectFields* fields,
                                  const Field* field, int fieldnum);
+VS_API LocalMotion calcFieldTransPyramid(VSMotionDetect* md, VSMotionDetectFields* fields,
+                                   const Field* field, int fieldnum);
 VS_API LocalMotion calcFieldTransPacked(VSMotionDetect* md, VSMotionDetectFields* fields,
                                  const Field* field, int fieldnum);
-VS_API LocalMotions calcTransFields(VSMotionDetect* md, VSMotionDetectFields* fields,
-                             calcFieldTransFunc fieldfunc,
-                             contrastSubImgFunc contrastfunc);
+VS_API VSMotionSet calcTransFields(VSMotionDetect* md, VSMotionDetectFields* fields,
+                                   calcFieldTransFunc fieldfunc,
+                                   contrastSubImgFunc contrastfunc);
 
 
 VS_API void drawFieldScanArea(VSMotionDetect* md, const LocalMotion* motion, int maxShift);
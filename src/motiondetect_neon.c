@@ -132,6 +132,50 @@ unsigned int compareSubImg_thr_neon(unsigned char* const I1, unsigned char* cons
   return vs_haddq_u32(vpadalq_u16(acc32, acc16));
 }
 
+/* The run version of the above: each 16 byte block of the current frame row
+   is loaded once and compared against all n windows. */
+void compareSubImgRun_neon(unsigned char* const I1, unsigned char* const I2,
+                           const Field* field, int linesize1, int linesize2, int height,
+                           int d_x, int d_y, int step, int n,
+                           unsigned int threshold, unsigned int* errors) {
+  int j, k, c;
+  int s2 = field->size / 2;
+  unsigned char* p1 = I1 + (field->x - s2) + (field->y - s2) * linesize1;
+  unsigned char* p2 = I2 + (field->x - s2 + d_x) + (field->y - s2 + d_y) * linesize2;
+  uint16x8_t acc16[VS_SAD_RUN];
+  uint32x4_t acc32[VS_SAD_RUN];
+
+  for (k = 0; k < n; k++) {
+    acc16[k] = vdupq_n_u16(0);
+    acc32[k] = vdupq_n_u32(0);
+  }
+  for (j = 0; j < field->size; j++) {
+    for (c = 0; c < field->size; c += 16) {
+      uint8x16_t a = vld1q_u8(p1 + c);
+      for (k = 0; k < n; k++)
+        acc16[k] = vpadalq_u8(acc16[k], vabdq_u8(a, vld1q_u8(p2 + k * step + c)));
+    }
+    if ((j & 15) == 15) {                 /* drain before 16 bit lanes fill up */
+      for (k = 0; k < n; k++) {
+        acc32[k] = vpadalq_u16(acc32[k], acc16[k]);
+        acc16[k] = vdupq_n_u16(0);
+      }
+    }
+    // every 4th row, as in compareSubImgRun_sse2
+    if ((j & 3) == 3) {
+      int live = 0;
+      for (k = 0; k < n; k++)
+        live |= vs_haddq_u32(vpadalq_u16(acc32[k], acc16[k])) <= threshold;
+      if (!live)
+        break;
+    }
+    p1 += linesize1;
+    p2 += linesize2;
+  }
+  for (k = 0; k < n; k++)
+    errors[k] = vs_haddq_u32(vpadalq_u16(acc32[k], acc16[k]));
+}
+
 double contrastSubImg1_neon(unsigned char* const I, const Field* field,
                             int linesize, int height) {
   int j;
@@ -157,6 +201,35 @@ double contrastSubImg1_neon(unsigned char* const I, const Field* field,
   return (maxi - mini) / (maxi + mini + 0.1); // +0.1 to avoid division by 0
 }
 
+/* 16 pixels per step: vld3q/vld4q deinterleave the channels, the weighted
+   sum is at most 256*255 and fits the 16 bit lanes of vmull/vmlal, and
+   vrshrn adds the 128 before the shift -- bit identical to rgbToLuma_C. */
+void rgbToLuma_neon(unsigned char* Y, const unsigned char* src,
+                    int width, int bytesPerPixel, int rIndex) {
+  const uint8x8_t wr = vdup_n_u8(77), wg = vdup_n_u8(150), wb = vdup_n_u8(29);
+  int i = 0;
+  for (; i + 16 <= width; i += 16) {
+    const unsigned char* p = src + i * bytesPerPixel;
+    uint8x16_t r, g, b;
+    if (bytesPerPixel == 4) {
+      uint8x16x4_t px = vld4q_u8(p);
+      r = px.val[rIndex]; g = px.val[1]; b = px.val[2 - rIndex];
+    } else {
+      uint8x16x3_t px = vld3q_u8(p);
+      r = px.val[rIndex]; g = px.val[1]; b = px.val[2 - rIndex];
+    }
+    uint16x8_t lo = vmull_u8(vget_low_u8(r), wr);
+    lo = vmlal_u8(lo, vget_low_u8(g), wg);
+    lo = vmlal_u8(lo, vget_low_u8(b), wb);
+    uint16x8_t hi = vmull_u8(vget_high_u8(r), wr);
+    hi = vmlal_u8(hi, vget_high_u8(g), wg);
+    hi = vmlal_u8(hi, vget_high_u8(b), wb);
+    vst1q_u8(Y + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+  }
+  if (i < width)
+    rgbToLuma_C(Y + i, src + i * bytesPerPixel, width - i, bytesPerPixel, rIndex);
+}
+
 #endif /* VS_HAVE_NEON */
 
 /*
@@ -121,7 +121,91 @@ double contrastSubImg_variance_C(unsigned char* const I,
   return (double)var/numpixel/255.0;
 }
 
+/// plain C implementation of rgbToLuma, the reference for the SIMD kernels
+void rgbToLuma_C(unsigned char* Y, const unsigned char* src,
+                 int width, int bytesPerPixel, int rIndex) {
+  const unsigned char* r = src + rIndex;
+  const unsigned char* g = src + 1;
+  const unsigned char* b = src + 2 - rIndex;
+  for (int i = 0; i < width; i++) {
+    int o = i * bytesPerPixel;
+    Y[i] = (unsigned char)((77 * r[o] + 150 * g[o] + 29 * b[o] + 128) >> 8);
+  }
+}
+
+/// plain C implementation of compareSubImgRun, the reference for the SIMD kernels
+void compareSubImgRun_C(unsigned char* const I1, unsigned char* const I2,
+                        const Field* field, int linesize1, int linesize2, int height,
+                        int d_x, int d_y, int step, int n,
+                        unsigned int threshold, unsigned int* errors) {
+  int j, k, c;
+  int s2 = field->size / 2;
+  unsigned char* p1 = I1 + (field->x - s2) + (field->y - s2) * linesize1;
+  unsigned char* p2 = I2 + (field->x - s2 + d_x) + (field->y - s2 + d_y) * linesize2;
+
+  for (k = 0; k < n; k++)
+    errors[k] = 0;
+  for (j = 0; j < field->size; j++) {
+    int live = 0;
+    for (k = 0; k < n; k++) {
+      const unsigned char* q = p2 + k * step;
+      unsigned int sum = 0;
+      for (c = 0; c < field->size; c++)
+        sum += abs((int) p1[c] - (int) q[c]);
+      errors[k] += sum;
+      live |= errors[k] <= threshold;
+    }
+    if (!live) // all candidates are worse than the best match
+      break;
+    p1 += linesize1;
+    p2 += linesize2;
+  }
+}
+
 #ifdef VS_HAVE_SSE2
+static inline unsigned int hsum_sad128(__m128i v) {
+  return (unsigned int)_mm_cvtsi128_si32(_mm_add_epi32(v, _mm_srli_si128(v, 8)));
+}
+
+void compareSubImgRun_sse2(unsigned char* const I1, unsigned char* const I2,
+                           const Field* field, int linesize1, int linesize2, int height,
+                           int d_x, int d_y, int step, int n,
+                           unsigned int threshold, unsigned int* errors) {
+  int j, k, c;
+  int s2 = field->size / 2;
+  unsigned char* p1 = I1 + (field->x - s2) + (field->y - s2) * linesize1;
+  unsigned char* p2 = I2 + (field->x - s2 + d_x) + (field->y - s2 + d_y) * linesize2;
+  __m128i acc[VS_SAD_RUN];
+
+  for (k = 0; k < n; k++)
+    acc[k] = _mm_setzero_si128();
+  for (j = 0; j < field->size; j++) {
+    /* the current frame block is loaded once for all n windows; the windows
+       of neighbouring candidates overlap, so their loads mostly hit the same
+       cache lines (the field size is a multiple of 16, no tail) */
+    for (c = 0; c < field->size; c += 16) {
+      __m128i a = _mm_loadu_si128((__m128i const *)(p1 + c));
+      for (k = 0; k < n; k++) {
+        __m128i b = _mm_loadu_si128((__m128i const *)(p2 + k * step + c));
+        acc[k] = _mm_add_epi32(acc[k], _mm_sad_epu8(a, b));
+      }
+    }
+    /* every 4th row: an abandoned candidate only has to be above the
+       threshold, and the check costs n reductions */
+    if ((j & 3) == 3) {
+      int live = 0;
+      for (k = 0; k < n; k++)
+        live |= hsum_sad128(acc[k]) <= threshold;
+      if (!live)
+        break;
+    }
+    p1 += linesize1;
+    p2 += linesize2;
+  }
+  for (k = 0; k < n; k++)
+    errors[k] = hsum_sad128(acc[k]);
+}
+
 unsigned int compareSubImg_thr_sse2(unsigned char* const I1, unsigned char* const I2,
                                     const Field* field,
                                     int linesize1, int linesize2, int height,
@@ -33,6 +33,7 @@
 #include "motiondetect.h"
 #include "vidstab_api.h"
 #include "cpudetect.h"
+#include "vscontext.h"
 
 /* --- dispatch ---------------------------------------------------------------
    Which kernel to use is decided at *runtime* (see cpudetect.h), not by the
@@ -44,26 +45,26 @@
    so they are safe to call before vs_simd_init() has run; vs_simd_init() only
    ever upgrades them.  vsMotionDetectInit() calls it. */
 
-typedef unsigned int (*vsCompareSubImgFn)(unsigned char* const I1,
-                                          unsigned char* const I2,
-                                          const Field* field,
-                                          int linesize1, int linesize2, int height,
-                                          int bytesPerPixel, int d_x, int d_y,
-                                          unsigned int threshold);
-
-/// \param linesize distance between two rows in BYTES (see vidstabdefines.h)
-typedef double (*vsContrastSubImg1Fn)(unsigned char* const I, const Field* field,
-                                      int linesize, int height);
+/* The kernel types (vsCompareSubImgFn, ...) are in vscontext.h: every
+   VSContext carries its own set. */
 
 /* Called as compareSubImg(...) / contrastSubImg1(...) exactly like the macros
    they replace. */
 extern VS_API vsCompareSubImgFn   compareSubImg;
 extern VS_API vsContrastSubImg1Fn contrastSubImg1;
+/// used for horizontal runs of candidates in the planar search
+extern VS_API vsCompareSubImgRunFn compareSubImgRun;
+/// used to convert packed input to luma (VSMotionDetectConfig.packedLuma)
+extern VS_API vsRgbToLumaFn       rgbToLuma;
 
 /** Pick the best kernels for this machine.  Idempotent and cheap after the
     first call; safe to call from several threads. */
 VS_API void vs_simd_init(void);
 
+/** The kernels vs_simd_init() would pick, stored in ctx only (the kernel
+    fields and simdName); no global is read or written. */
+VS_API void vs_simd_select(VSContext* ctx);
+
 /** Name of the kernel family currently selected, e.g. "AVX2" or "scalar".
     Calls vs_simd_init() if that has not happened yet. */
 VS_API const char* vs_simd_active_name(void);
@@ -80,6 +81,12 @@ VS_API const char* vs_simd_active_name(void);
 
 VS_API double contrastSubImg_variance_C(unsigned char* const I, const Field* field,
                         int linesize, int height);
+VS_API void rgbToLuma_C(unsigned char* Y, const unsigned char* src,
+                        int width, int bytesPerPixel, int rIndex);
+VS_API void compareSubImgRun_C(unsigned char* const I1, unsigned char* const I2,
+                               const Field* field, int linesize1, int linesize2, int height,
+                               int d_x, int d_y, int step, int n,
+                               unsigned int threshold, unsigned int* errors);
 
 #ifdef VS_HAVE_SSE2
 VS_API double contrastSubImg1_SSE(unsigned char* const I, const Field* field,
@@ -88,15 +95,25 @@ VS_API unsigned int compareSubImg_thr_sse2(unsigned char* const I1, unsigned cha
                                     const Field* field, int linesize1, int linesize2, int height,
                                     int bytesPerPixel, int d_x, int d_y,
                                     unsigned int threshold);
+VS_API void compareSubImgRun_sse2(unsigned char* const I1, unsigned char* const I2,
+                                  const Field* field, int linesize1, int linesize2, int height,
+                                  int d_x, int d_y, int step, int n,
+                                  unsigned int threshold, unsigned int* errors);
 #endif
 
 #ifdef VS_HAVE_AVX2
 VS_API double contrastSubImg1_avx2(unsigned char* const I, const Field* field,
                                    int linesize, int height);
+VS_API void rgbToLuma_avx2(unsigned char* Y, const unsigned char* src,
+                           int width, int bytesPerPixel, int rIndex);
 VS_API unsigned int compareSubImg_thr_avx2(unsigned char* const I1, unsigned char* const I2,
                                     const Field* field, int linesize1, int linesize2, int height,
                                     int bytesPerPixel, int d_x, int d_y,
                                     unsigned int threshold);
+VS_API void compareSubImgRun_avx2(unsigned char* const I1, unsigned char* const I2,
+                                  const Field* field, int linesize1, int linesize2, int height,
+                                  int d_x, int d_y, int step, int n,
+                                  unsigned int threshold, unsigned int* errors);
 #endif
 
 #ifdef VS_HAVE_AVX512
@@ -111,10 +128,16 @@ VS_API unsigned int compareSubImg_thr_avx512(unsigned char* const I1, unsigned c
 #ifdef VS_HAVE_NEON
 VS_API double contrastSubImg1_neon(unsigned char* const I, const Field* field,
                                    int linesize, int height);
+VS_API void rgbToLuma_neon(unsigned char* Y, const unsigned char* src,
+                           int width, int bytesPerPixel, int rIndex);
 VS_API unsigned int compareSubImg_thr_neon(unsigned char* const I1, unsigned char* const I2,
                                     const Field* field, int linesize1, int linesize2, int height,
                                     int bytesPerPixel, int d_x, int d_y,
                                     unsigned int threshold);
+VS_API void compareSubImgRun_neon(unsigned char* const I1, unsigned char* const I2,
+                                  const Field* field, int linesize1, int linesize2, int height,
+                                  int d_x, int d_y, int step, int n,
+                                  unsigned int threshold, unsigned int* errors);
 #endif
 
 #ifdef USE_SSE2_ASM
@@ -0,0 +1,256 @@
+/*
+ * motionset.c -- local motions of a frame in one contiguous array
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ */
+
+#include "motionset.h"
+#include "transformtype_operations.h"
+#include "vidstabdefines.h"
+#include <assert.h>
+#include <string.h>
+
+int vs_motionset_init(VSMotionSet* S, int capacity){
+  assert(S);
+  S->lms = 0;
+  S->num = 0;
+  S->capacity = 0;
+  if(capacity > 0)
+    return vs_motionset_reserve(S, capacity);
+  return VS_OK;
+}
+
+void vs_motionset_fini(VSMotionSet* S){
+  assert(S);
+  if(S->lms) vs_free(S->lms);
+  S->lms = 0;
+  S->num = 0;
+  S->capacity = 0;
+}
+
+int vs_motionset_size(const VSMotionSet* S){
+  assert(S);
+  return S->num;
+}
+
+int vs_motionset_reserve(VSMotionSet* S, int capacity){
+  assert(S);
+  if(capacity <= S->capacity)
+    return VS_OK;
+  if(capacity > VS_MOTIONSET_MAX_SIZE)
+    return VS_ERROR;
+  LocalMotion* lms = (LocalMotion*)vs_realloc(S->lms, sizeof(LocalMotion) * capacity);
+  if(!lms)
+    return VS_ERROR;
+  S->lms = lms;
+  S->capacity = capacity;
+  return VS_OK;
+}
+
+int vs_motionset_append(VSMotionSet* S, const LocalMotion* lm){
+  assert(S && lm);
+  if(S->num >= S->capacity){
+    /* double, but stop before the multiplication would overflow */
+    int nsize = S->capacity < 16 ? 16
+      : (S->capacity <= VS_MOTIONSET_MAX_SIZE/2 ? S->capacity*2 : VS_MOTIONSET_MAX_SIZE);
+    if(vs_motionset_reserve(S, nsize) != VS_OK || S->num >= S->capacity)
+      return VS_ERROR;
+  }
+  S->lms[S->num++] = *lm;
+  return VS_OK;
+}
+
+int vs_motionset_append_set(VSMotionSet* S, const VSMotionSet* other){
+  assert(S && other);
+  if(other->num < 1)
+    return VS_OK;
+  if(other->num > VS_MOTIONSET_MAX_SIZE - S->num
+     || vs_motionset_reserve(S, S->num + other->num) != VS_OK)
+    return VS_ERROR;
+  memcpy(S->lms + S->num, other->lms, sizeof(LocalMotion) * other->num);
+  S->num += other->num;
+  return VS_OK;
+}
+
+int vs_motionset_from_vector(VSMotionSet* S, const LocalMotions* lms){
+  assert(S && lms);
+  int len = vs_vector_size(lms);
+  if(vs_motionset_init(S, len) != VS_OK)
+    return VS_ERROR;
+  for(int i=0; i < len; i++)
+    S->lms[i] = *LMGet(lms,i);
+  S->num = len;
+  return VS_OK;
+}
+
+int vs_motionset_to_vector(const VSMotionSet* S, LocalMotions* lms){
+  assert(S && lms);
+  if(vs_vector_init(lms, S->num > 0 ? S->num : 1) != VS_OK){
+    vs_vector_init(lms, 0);
+    return VS_ERROR;
+  }
+  for(int i=0; i < S->num; i++){
+    if(vs_vector_append_dup(lms, &S->lms[i], sizeof(LocalMotion)) != VS_OK){
+      vs_vector_del(lms);
+      return VS_ERROR;
+    }
+  }
+  return VS_OK;
+}
+
+VSCompactMotion vs_compact_motion(const LocalMotion* lm){
+  VSCompactMotion cm;
+  cm.vx = lm->v.x;
+  cm.vy = lm->v.y;
+  cm.fx = lm->f.x;
+  cm.fy = lm->f.y;
+  cm.fsize = lm->f.size;
+  cm.reserved = 0;
+  cm.contrast = (float)lm->contrast;
+  cm.match = (float)lm->match;
+  return cm;
+}
+
+LocalMotion vs_expand_motion(const VSCompactMotion* cm){
+  LocalMotion lm;
+  lm.v.x = cm->vx;
+  lm.v.y = cm->vy;
+  lm.f.x = cm->fx;
+  lm.f.y = cm->fy;
+  lm.f.size = cm->fsize;
+  lm.contrast = cm->contrast;
+  lm.match = cm->match;
+  return lm;
+}
+
+void vs_compactmotions_init(VSManyCompactMotions* C){
+  assert(C);
+  C->motions = 0;
+  C->num = 0;
+  C->capacity = 0;
+  C->frames = 0;
+  C->numFrames = 0;
+  C->frameCapacity = 0;
+}
+
+void vs_compactmotions_fini(VSManyCompactMotions* C){
+  assert(C);
+  if(C->motions) vs_free(C->motions);
+  if(C->frames) vs_free(C->frames);
+  vs_compactmotions_init(C);
+}
+
+int vs_compactmotions_num_frames(const VSManyCompactMotions* C){
+  assert(C);
+  return C->numFrames;
+}
+
+int vs_compactmotions_set_frame(VSManyCompactMotions* C, int i, const VSMotionSet* S){
+  assert(C && S);
+  if(i < 0 || i == INT_MAX)
+    return VS_ERROR;
+  if(i >= C->frameCapacity){
+    int nsize = C->frameCapacity < 1024 ? 1024 : C->frameCapacity;
+    while(nsize <= i && nsize <= INT_MAX/2) nsize *= 2;
+    if(nsize <= i) nsize = i + 1;
+    if((size_t)nsize > ((size_t)-1) / sizeof(VSCompactFrame))
+      return VS_ERROR;
+    VSCompactFrame* frames =
+      (VSCompactFrame*)vs_realloc(C->frames, sizeof(VSCompactFrame) * nsize);
+    if(!frames)
+      return VS_ERROR;
+    C->frames = frames;
+    C->frameCapacity = nsize;
+  }
+  if(S->num > 0 && C->num + S->num > C->capacity){
+    size_t nsize = C->capacity < 4096 ? 4096 : C->capacity;
+    while(nsize < C->num + S->num) nsize *= 2;
+    if(nsize > ((size_t)-1) / sizeof(VSCompactMotion))
+      return VS_ERROR;
+    VSCompactMotion* motions =
+      (VSCompactMotion*)vs_realloc(C->motions, sizeof(VSCompactMotion) * nsize);
+    if(!motions)
+      return VS_ERROR;
+    C->motions = motions;
+    C->capacity = nsize;
+  }
+  for(int f = C->numFrames; f < i; f++){ // frames in between have no motions
+    C->frames[f].start = C->num;
+    C->frames[f].num = 0;
+  }
+  if(i >= C->numFrames)
+    C->numFrames = i + 1;
+  /* a frame that is set again gets new room at the end, the old motions
+     stay unused in the pool */
+  C->frames[i].start = C->num;
+  C->frames[i].num = S->num;
+  for(int k=0; k < S->num; k++)
+    C->motions[C->num + k] = vs_compact_motion(MSGet(S,k));
+  C->num += S->num;
+  return VS_OK;
+}
+
+const VSCompactMotion* vs_compactmotions_frame(const VSManyCompactMotions* C,
+                                               int i, int* num){
+  assert(C && num);
+  if(i < 0 || i >= C->numFrames || C->frames[i].num < 1){
+    *num = 0;
+    return 0;
+  }
+  *num = C->frames[i].num;
+  return C->motions + C->frames[i].start;
+}
+
+int vs_compactmotions_get_frame(const void* dat, int i, VSMotionSet* S){
+  const VSManyCompactMotions* C = (const VSManyCompactMotions*)dat;
+  int num;
+  const VSCompactMotion* cms = vs_compactmotions_frame(C, i, &num);
+  S->num = 0;
+  if(vs_motionset_reserve(S, num) != VS_OK)
+    return VS_ERROR;
+  for(int k=0; k < num; k++)
+    S->lms[k] = vs_expand_motion(&cms[k]);
+  S->num = num;
+  return VS_OK;
+}
+
+int vs_manylocalmotions_get_frame(const void* dat, int i, VSMotionSet* S){
+  const VSVector* mlms = (const VSVector*)dat;
+  const LocalMotions* lms = i >= 0 && i < vs_vector_size(mlms)
+    ? (const LocalMotions*)vs_vector_get(mlms, i) : 0;
+  int num = lms ? vs_vector_size(lms) : 0; // a frame missing in the file is NULL
+  S->num = 0;
+  if(vs_motionset_reserve(S, num) != VS_OK)
+    return VS_ERROR;
+  for(int k=0; k < num; k++)
+    S->lms[k] = *LMGet(lms,k);
+  S->num = num;
+  return VS_OK;
+}
+
+/*
+ * Local variables:
+ *   c-file-style: "stroustrup"
+ *   c-file-offsets: ((case-label . *) (statement-case-intro . *))
+ *   indent-tabs-mode: nil
+ *   c-basic-offset: 2 t
+ * End:
+ *
+ * vim: expandtab shiftwidth=2:
+ */
@@ -0,0 +1,182 @@
+/*
+ * motionset.h -- local motions of a frame in one contiguous array
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ */
+#ifndef VSMOTIONSET_H
+#define VSMOTIONSET_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "transformtype.h"
+#include "vsvector.h"
+#include "vidstab_api.h"
+
+/**
+   The local motions of a frame as one flat LocalMotion array.
+
+   LocalMotions (a VSVector) holds a pointer to a separately allocated element
+   per motion. A VSMotionSet holds the motions themselves: appending costs no
+   allocation once the capacity is there, and the fitting loops walk one
+   array. The detection and the transform fit work on motion sets; the
+   LocalMotions functions stay and convert at their boundary.
+*/
+typedef struct vsmotionset_ VSMotionSet;
+struct vsmotionset_ {
+  LocalMotion* lms;
+  int num;       // number of motions
+  int capacity;  // number of motions lms has room for
+};
+
+/// helper macro to access a localmotion in a VSMotionSet (no range check)
+#define MSGet(motionset,index) (&(motionset)->lms[index])
+
+/// largest number of motions a set can hold
+#define VS_MOTIONSET_MAX_SIZE ((int)(INT_MAX / sizeof(LocalMotion)))
+
+/**
+ * vs_motionset_init:
+ *     initializes an empty set with room for capacity motions (0: none yet).
+ * Return Value:
+ *     VS_OK on success, VS_ERROR if the memory could not be allocated
+ *     (the set is then empty and usable).
+ */
+VS_API int vs_motionset_init(VSMotionSet* S, int capacity);
+
+/// releases the motions; the set is empty afterwards and can be used again
+VS_API void vs_motionset_fini(VSMotionSet* S);
+
+/// number of motions in the set
+VS_API int vs_motionset_size(const VSMotionSet* S);
+
+/// makes room for at least capacity motions, VS_ERROR if that fails
+VS_API int vs_motionset_reserve(VSMotionSet* S, int capacity);
+
+/// appends a copy of lm, VS_ERROR if the set could not grow
+VS_API int vs_motionset_append(VSMotionSet* S, const LocalMotion* lm);
+
+/// appends copies of all motions of other, VS_ERROR if the set could not grow
+VS_API int vs_motionset_append_set(VSMotionSet* S, const VSMotionSet* other);
+
+/**
+ * vs_motionset_from_vector:
+ *     initializes S with copies of the motions of lms.
+ */
+VS_API int vs_motionset_from_vector(VSMotionSet* S, const LocalMotions* lms);
+
+/**
+ * vs_motionset_to_vector:
+ *     initializes lms with copies of the motions of S, one allocation per
+ *     motion as every LocalMotions (vs_vector_del releases them).
+ *     On VS_ERROR lms is empty.
+ */
+VS_API int vs_motionset_to_vector(const VSMotionSet* S, LocalMotions* lms);
+
+/**
+   Fills S (initialized, its motions are replaced) with the motions of frame
+   i of the clip dat, VS_ERROR if that fails. Lets the clip wide passes walk
+   either a VSManyLocalMotions or a VSManyCompactMotions.
+*/
+typedef int (*VSMotionFrameFn)(const void* dat, int i, VSMotionSet* S);
+
+/**
+   A local motion in 20 bytes instead of the 40 of a LocalMotion: contrast
+   and match as float. This is also the record of the compact binary .trf
+   format (COMPACT_SERIALIZATION_MODE, file format version 2), in the byte
+   order of a little endian host.
+*/
+typedef struct vscompactmotion_ VSCompactMotion;
+struct vscompactmotion_ {
+  int16_t vx, vy;     // v
+  int16_t fx, fy;     // f.x, f.y
+  int16_t fsize;      // f.size
+  int16_t reserved;   // 0, keeps the floats aligned
+  float   contrast;
+  float   match;
+};
+
+/// position and number of the motions of one frame in a VSManyCompactMotions
+typedef struct vscompactframe_ {
+  size_t start;
+  int    num;
+} VSCompactFrame;
+
+/**
+   The local motions of a whole clip as compact motions in one pool, with a
+   start and count per frame. Frames that were never set have no motions.
+   vsReadCompactMotionsFile fills it, vsCompactMotions2Transforms consumes it.
+*/
+typedef struct vsmanycompactmotions_ VSManyCompactMotions;
+struct vsmanycompactmotions_ {
+  VSCompactMotion* motions;
+  size_t num;            // motions in the pool
+  size_t capacity;
+  VSCompactFrame* frames;
+  int numFrames;
+  int frameCapacity;
+};
+
+/// the compact form of lm
+VS_API VSCompactMotion vs_compact_motion(const LocalMotion* lm);
+/// the LocalMotion of a compact motion
+VS_API LocalMotion vs_expand_motion(const VSCompactMotion* cm);
+
+/// initializes an empty clip
+VS_API void vs_compactmotions_init(VSManyCompactMotions* C);
+/// releases all motions; the clip is empty afterwards
+VS_API void vs_compactmotions_fini(VSManyCompactMotions* C);
+/// number of frames (the last frame set plus one)
+VS_API int vs_compactmotions_num_frames(const VSManyCompactMotions* C);
+
+/**
+ * vs_compactmotions_set_frame:
+ *     stores the motions of S as frame i (0 based), replacing what was there.
+ * Return Value:
+ *     VS_OK on success, VS_ERROR for a negative i or if the memory could not
+ *     be allocated (C is unchanged then).
+ */
+VS_API int vs_compactmotions_set_frame(VSManyCompactMotions* C, int i, const VSMotionSet* S);
+
+/**
+ * vs_compactmotions_frame:
+ *     the motions of frame i in place (no copy), their number in *num.
+ *     NULL with *num = 0 for a frame without motions.
+ */
+VS_API const VSCompactMotion* vs_compactmotions_frame(const VSManyCompactMotions* C,
+                                                      int i, int* num);
+
+/// fills S (initialized) with the motions of frame i, a VSMotionFrameFn
+VS_API int vs_compactmotions_get_frame(const void* C, int i, VSMotionSet* S);
+
+/// the same for a VSManyLocalMotions (a VSVector of LocalMotions)
+VS_API int vs_manylocalmotions_get_frame(const void* mlms, int i, VSMotionSet* S);
+
+#endif  /* VSMOTIONSET_H */
+
+/*
+ * Local variables:
+ *   c-file-style: "stroustrup"
+ *   c-file-offsets: ((case-label . *) (statement-case-intro . *))
+ *   indent-tabs-mode: nil
+ *   c-basic-offset: 2 t
+ * End:
+ *
+ * vim: expandtab shiftwidth=2:
+ */
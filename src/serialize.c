@@ -24,13 +24,36 @@
  *
  */
 
+/* a 64 bit off_t for ftello/fseeko on 32 bit systems as well, .trf files of
+   long videos grow past 2 GB; has to come before the first system header */
+#if !defined(_WIN32) && !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include <assert.h>
+#include <math.h>
 #include <string.h>
 
 #include "serialize.h"
 #include "transformtype.h"
 #include "transformtype_operations.h"
 #include "motiondetect.h"
+#include "transform_internal.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/* offsets in files, with 64 bits also where long has 32 (Windows) */
+#ifdef _WIN32
+#define vsFileTell(f) ((int64_t)_ftelli64(f))
+#define vsFileSeek(f, offset, whence) _fseeki64((f), (__int64)(offset), (whence))
+#else
+#define vsFileTell(f) ((int64_t)ftello(f))
+#define vsFileSeek(f, offset, whence) fseeko((f), (off_t)(offset), (whence))
+#endif
 
 #if defined(__BYTE_ORDER) && __BYTE_ORDER == __BIG_ENDIAN || \
     defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ || \
@@ -84,38 +107,27 @@ static double byteSwapDouble(double v)
 
 const char* modname = "vid.stab - serialization";
 
-/*
- * sanity limit for the number of localmotions of a single frame in the binary
- * format. Even 8k material with the smallest measurement fields stays far
- * below this; a larger value means the file is corrupt and we must not try to
- * allocate/parse it (which would also flood the log with parse errors).
- */
-#define VS_MAX_LOCALMOTIONS_PER_FRAME (1<<20)
-
-/*
- * sanity limit for the frame index in a transform file. 1<<22 frames is more
- * than 19 hours of 60fps material; a larger index means the file is corrupt
- * and we must not size the frame vector after it - the index is used as a
- * vector position, so an unbounded one turns into an absurd allocation.
- */
-#define VS_MAX_FRAMES (1<<22)
+/* the compact record on disk is the in-memory VSCompactMotion */
+typedef char vsCompactMotionIs20Bytes[sizeof(VSCompactMotion) == 20 ? 1 : -1];
 
 int vsPrepareFileText(const VSMotionDetect* md, FILE* f);
 int vsPrepareFileBinary(const VSMotionDetect* md, FILE* f);
-int vsWriteToFileText(const VSMotionDetect* md, FILE* f, const LocalMotions* lms);
-int vsWriteToFileBinary(const VSMotionDetect* md, FILE* f, const LocalMotions* lms);
-int vsStoreLocalmotionsText(FILE* f, const LocalMotions* lms);
-int vsStoreLocalmotionsBinary(FILE* f, const LocalMotions* lms);
+int vsWriteToFileText(const VSMotionDetect* md, FILE* f, const VSMotionSet* lms);
+int vsWriteToFileBinary(const VSMotionDetect* md, FILE* f, const VSMotionSet* lms);
+int vsStoreMotionSetText(FILE* f, const VSMotionSet* lms);
+int vsStoreMotionSetBinary(FILE* f, const VSMotionSet* lms, int serializationMode);
 int storeLocalmotionText(FILE* f, const LocalMotion* lm);
 int storeLocalmotionBinary(FILE* f, const LocalMotion* lm);
-LocalMotions vsRestoreLocalmotionsText(FILE* f);
-LocalMotions vsRestoreLocalmotionsBinary(FILE* f);
+int storeLocalmotionCompact(FILE* f, const LocalMotion* lm);
+void vsRestoreMotionSetText(FILE* f, VSMotionSet* lms);
+void vsRestoreMotionSetBinary(FILE* f, VSMotionSet* lms, int serializationMode);
 LocalMotion restoreLocalmotionText(FILE* f);
 int restoreLocalmotionBinary(FILE* f, LocalMotion* lm);
+int restoreLocalmotionCompact(FILE* f, LocalMotion* lm);
 int vsReadFileVersionText(FILE* f);
 int vsReadFileVersionBinary(FILE* f);
-int vsReadFromFileText(FILE* f, LocalMotions* lms);
-int vsReadFromFileBinary(FILE* f, LocalMotions* lms);
+int vsReadFromFileText(FILE* f, VSMotionSet* lms);
+int vsReadFromFileBinary(FILE* f, VSMotionSet* lms, int serializationMode);
 
 int readInt16(int16_t* i, FILE* f){
   int result = fread(i, sizeof(int16_t), 1, f);
@@ -168,6 +180,8 @@ int writeDouble(const double* d, FILE* f){
 int storeLocalmotion(FILE* f, const LocalMotion* lm, int serializationMode){
   if(serializationMode == BINARY_SERIALIZATION_MODE){
     return storeLocalmotionBinary(f, lm);
+  } else if(serializationMode == COMPACT_SERIALIZATION_MODE){
+    return storeLocalmotionCompact(f, lm);
   } else {
     return storeLocalmotionText(f, lm);
   }
@@ -189,6 +203,31 @@ int storeLocalmotionBinary(FILE* f, const LocalMotion* lm) {
   return 1;
 }
 
+/* byte order of a compact record on disk (little endian), swaps on big
+   endian hosts */
+static void compactMotionToDisk(VSCompactMotion* cm){
+  #ifdef __IS_BIG_ENDIAN__
+  uint32_t v;
+  cm->vx = __bswap_16(cm->vx);
+  cm->vy = __bswap_16(cm->vy);
+  cm->fx = __bswap_16(cm->fx);
+  cm->fy = __bswap_16(cm->fy);
+  cm->fsize = __bswap_16(cm->fsize);
+  cm->reserved = __bswap_16(cm->reserved);
+  memcpy(&v, &cm->contrast, 4); v = __bswap_32(v); memcpy(&cm->contrast, &v, 4);
+  memcpy(&v, &cm->match, 4);    v = __bswap_32(v); memcpy(&cm->match, &v, 4);
+  #else
+  (void)cm;
+  #endif
+}
+
+/// one record of the compact format, written with a single fwrite
+int storeLocalmotionCompact(FILE* f, const LocalMotion* lm) {
+  VSCompactMotion cm = vs_compact_motion(lm);
+  compactMotionToDisk(&cm);
+  return fwrite(&cm, sizeof(VSCompactMotion), 1, f);
+}
+
 /*
  * logs why reading a binary record failed. A truncated file is by far the most
  * common cause: a FILE* that was opened in text mode (missing "b" in the fopen
@@ -209,9 +248,11 @@ static void logBinaryReadError(FILE* f, const char* what){
 
 /// restore local motion from file
 LocalMotion restoreLocalmotion(FILE* f, const int serializationMode){
-  if(serializationMode == BINARY_SERIALIZATION_MODE) {
+  if(serializationMode == BINARY_SERIALIZATION_MODE
+     || serializationMode == COMPACT_SERIALIZATION_MODE) {
     LocalMotion lm;
-    if(!restoreLocalmotionBinary(f, &lm)){
+    if(!(serializationMode == COMPACT_SERIALIZATION_MODE
+         ? restoreLocalmotionCompact(f, &lm) : restoreLocalmotionBinary(f, &lm))){
       logBinaryReadError(f, "localmotion");
       return null_localmotion();
     }
@@ -249,111 +290,143 @@ int restoreLocalmotionBinary(FILE* f, LocalMotion* lm){
   return 1;
 }
 
+/// reads one compact record, returns 1 on success and 0 on failure
+int restoreLocalmotionCompact(FILE* f, LocalMotion* lm){
+  VSCompactMotion cm;
+  if(fread(&cm, sizeof(VSCompactMotion), 1, f) != 1) return 0;
+  compactMotionToDisk(&cm); // the swap is its own inverse
+  *lm = vs_expand_motion(&cm);
+  return 1;
+}
+
 int vsStoreLocalmotions(FILE* f, const LocalMotions* lms, const int serializationMode){
-  if(serializationMode == BINARY_SERIALIZATION_MODE) {
-    return vsStoreLocalmotionsBinary(f, lms);
+  VSMotionSet set;
+  int res;
+  if(vs_motionset_from_vector(&set, lms) != VS_OK) return 0;
+  res = vsStoreMotionSet(f, &set, serializationMode);
+  vs_motionset_fini(&set);
+  return res;
+}
+
+int vsStoreMotionSet(FILE* f, const VSMotionSet* lms, const int serializationMode){
+  if(serializationMode == BINARY_SERIALIZATION_MODE
+     || serializationMode == COMPACT_SERIALIZATION_MODE) {
+    return vsStoreMotionSetBinary(f, lms, serializationMode);
   } else {
-    return vsStoreLocalmotionsText(f, lms);
+    return vsStoreMotionSetText(f, lms);
   }
 }
 
-int vsStoreLocalmotionsText(FILE* f, const LocalMotions* lms){
-  int len = vs_vector_size(lms);
+int vsStoreMotionSetText(FILE* f, const VSMotionSet* lms){
+  int len = lms->num;
   int i;
   fprintf(f,"List %i [",len);
   for (i=0; i<len; i++){
     if(i>0) fprintf(f,",");
-    if(storeLocalmotion(f,LMGet(lms,i),ASCII_SERIALIZATION_MODE) <= 0) return 0;
+    if(storeLocalmotion(f,MSGet(lms,i),ASCII_SERIALIZATION_MODE) <= 0) return 0;
   }
   fprintf(f,"]");
   return 1;
 }
 
-int vsStoreLocalmotionsBinary(FILE* f, const LocalMotions* lms){
-  const int len = vs_vector_size(lms);
+int vsStoreMotionSetBinary(FILE* f, const VSMotionSet* lms, int serializationMode){
+  const int len = lms->num;
   int i;
   if(writeInt32(&len, f)<=0) return 0;
   for (i=0; i<len; i++){
-    if(storeLocalmotion(f,LMGet(lms,i),BINARY_SERIALIZATION_MODE) <= 0) return 0;
+    if(storeLocalmotion(f,MSGet(lms,i),serializationMode) <= 0) return 0;
   }
   return 1;
 }
 
 /// restores local motions from file
 LocalMotions vsRestoreLocalmotions(FILE* f, const int serializationMode){
-  if(serializationMode == BINARY_SERIALIZATION_MODE) {
-    return vsRestoreLocalmotionsBinary(f);
+  LocalMotions lms;
+  VSMotionSet set;
+  vs_motionset_init(&set, 0);
+  if(serializationMode == BINARY_SERIALIZATION_MODE
+     || serializationMode == COMPACT_SERIALIZATION_MODE) {
+    vsRestoreMotionSetBinary(f, &set, serializationMode);
   } else {
-    return vsRestoreLocalmotionsText(f);
+    vsRestoreMotionSetText(f, &set);
   }
+  if(vs_motionset_to_vector(&set, &lms) != VS_OK)
+    vs_log_error(modname, "Cannot allocate the localmotions!\n");
+  vs_motionset_fini(&set);
+  return lms;
 }
 
-LocalMotions vsRestoreLocalmotionsText(FILE* f){
-  LocalMotions lms;
+/* the restorers fill the (initialized) set with what they could parse */
+void vsRestoreMotionSetText(FILE* f, VSMotionSet* lms){
   int i;
   int c;
   int len;
-  vs_vector_init(&lms,0);
+  lms->num = 0;
   if(fscanf(f,"List %i [", &len) != 1) {
     vs_log_error(modname, "Cannot parse localmotions list expect 'List len ['!\n");
-    return lms;
+    return;
   }
   if (len>0){
-    vs_vector_init(&lms,len);
+    if(len>VS_MAX_LOCALMOTIONS_PER_FRAME || vs_motionset_reserve(lms, len) != VS_OK){
+      vs_log_error(modname, "Cannot parse the given number of localmotions!\n");
+      return;
+    }
     for (i=0; i<len; i++){
       if(i>0) while((c=fgetc(f)) && c!=',' && c!=EOF);
       LocalMotion lm = restoreLocalmotion(f,ASCII_SERIALIZATION_MODE);
-      vs_vector_append_dup(&lms,&lm,sizeof(LocalMotion));
+      vs_motionset_append(lms, &lm);
     }
   }
-  if(len != vs_vector_size(&lms)){
+  if(len != lms->num){
     vs_log_error(modname, "Cannot parse the given number of localmotions!\n");
-    return lms;
+    return;
   }
   while((c=fgetc(f)) && c!=']' && c!=EOF);
   if(c==EOF){
     vs_log_error(modname, "Cannot parse localmotions list missing ']'!\n");
-    return lms;
+    return;
   }
-  return lms;
 }
 
-LocalMotions vsRestoreLocalmotionsBinary(FILE* f){
-  LocalMotions lms;
+void vsRestoreMotionSetBinary(FILE* f, VSMotionSet* lms, int serializationMode){
   int i;
   int len;
-  vs_vector_init(&lms,0);
+  lms->num = 0;
   if(readInt32(&len, f) <= 0) {
     logBinaryReadError(f, "localmotions list");
-    return lms;
+    return;
   }
   if (len<0 || len>VS_MAX_LOCALMOTIONS_PER_FRAME){
     vs_log_error(modname, "Implausible number of localmotions (%i): the "
                  "transform file is corrupt (see the note on binary file "
                  "handles in serialize.h)!\n", len);
-    return lms;
+    return;
   }
   if (len>0){
-    vs_vector_init(&lms,len);
+    if(vs_motionset_reserve(lms, len) != VS_OK){
+      vs_log_error(modname, "Cannot allocate %i localmotions!\n", len);
+      return;
+    }
     for (i=0; i<len; i++){
       LocalMotion lm;
-      if(!restoreLocalmotionBinary(f,&lm)){
+      if(!(serializationMode == COMPACT_SERIALIZATION_MODE
+           ? restoreLocalmotionCompact(f,&lm) : restoreLocalmotionBinary(f,&lm))){
         /* report only once instead of flooding the log for every record */
         logBinaryReadError(f, "localmotion");
         break;
       }
-      vs_vector_append_dup(&lms,&lm,sizeof(LocalMotion));
+      lms->lms[lms->num++] = lm;
     }
   }
-  if(len != vs_vector_size(&lms)){
+  if(len != lms->num){
     vs_log_error(modname, "Cannot parse the given number of localmotions "
-                 "(got %i of %i)!\n", vs_vector_size(&lms), len);
+                 "(got %i of %i)!\n", lms->num, len);
   }
-  return lms;
 }
 
 int vsPrepareFile(const VSMotionDetect* md, FILE* f){
-  if(md->serializationMode == BINARY_SERIALIZATION_MODE) {
+  if(md->serializationMode == BINARY_SERIALIZATION_MODE
+     || md->serializationMode == COMPACT_SERIALIZATION_MODE) {
     return vsPrepareFileBinary(md, f);
   } else {
     return vsPrepareFileText(md, f);
@@ -371,7 +444,9 @@ int vsPrepareFileText(const VSMotionDetect* md, FILE* f){
 }
 
 int vsPrepareFileBinary(const VSMotionDetect* md, FILE* f){
-  static const unsigned char kFileFormatVersion = LIBVIDSTAB_FILE_FORMAT_VERSION;
+  const unsigned char kFileFormatVersion =
+    md->serializationMode == COMPACT_SERIALIZATION_MODE
+    ? LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT : LIBVIDSTAB_FILE_FORMAT_VERSION;
   if(!f) return VS_ERROR;
   fprintf(f, "TRF%hhu", kFileFormatVersion);
   writeInt32(&md->conf.accuracy, f);
@@ -382,49 +457,63 @@ int vsPrepareFileBinary(const VSMotionDetect* md, FILE* f){
 }
 
 int vsWriteToFile(const VSMotionDetect* md, FILE* f, const LocalMotions* lms){
-  if(md->serializationMode == BINARY_SERIALIZATION_MODE) {
+  VSMotionSet set;
+  int res;
+  if(!f || !lms) return VS_ERROR;
+  if(vs_motionset_from_vector(&set, lms) != VS_OK) return VS_ERROR;
+  res = vsWriteMotionSetToFile(md, f, &set);
+  vs_motionset_fini(&set);
+  return res;
+}
+
+int vsWriteMotionSetToFile(const VSMotionDetect* md, FILE* f, const VSMotionSet* lms){
+  if(md->serializationMode == BINARY_SERIALIZATION_MODE
+     || md->serializationMode == COMPACT_SERIALIZATION_MODE) {
     return vsWriteToFileBinary(md, f, lms);
   } else {
     return vsWriteToFileText(md, f, lms);
   }
 }
 
-int vsWriteToFileText(const VSMotionDetect* md, FILE* f, const LocalMotions* lms){
+int vsWriteToFileText(const VSMotionDetect* md, FILE* f, const VSMotionSet* lms){
   if(!f || !lms) return VS_ERROR;
 
   if(fprintf(f, "Frame %i (", md->frameNum)>0
-     && vsStoreLocalmotions(f, lms, ASCII_SERIALIZATION_MODE)>0 && fprintf(f, ")\n"))
+     && vsStoreMotionSetText(f, lms)>0 && fprintf(f, ")\n"))
     return VS_OK;
   else
     return VS_ERROR;
 }
 
-int vsWriteToFileBinary(const VSMotionDetect* md, FILE* f, const LocalMotions* lms){
+int vsWriteToFileBinary(const VSMotionDetect* md, FILE* f, const VSMotionSet* lms){
   if(!f || !lms) return VS_ERROR;
 
   if(writeInt32(&md->frameNum, f)<=0) return VS_ERROR;
-  if(vsStoreLocalmotions(f, lms, BINARY_SERIALIZATION_MODE)<=0) return VS_ERROR;
+  if(vsStoreMotionSetBinary(f, lms, md->serializationMode)<=0) return VS_ERROR;
 
   return VS_OK;
 }
 
 int vsGuessSerializationMode(FILE* f){
   int serializationMode = ASCII_SERIALIZATION_MODE;
-  const int pos = ftell(f);
+  const int64_t pos = vsFileTell(f);
 
   if(fgetc(f) == 'T' 
       && fgetc(f) == 'R'
       && fgetc(f) == 'F') {
-    serializationMode = BINARY_SERIALIZATION_MODE;
+    /* the version tells the record layout of the binary formats */
+    serializationMode = fgetc(f) == '0' + LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT
+      ? COMPACT_SERIALIZATION_MODE : BINARY_SERIALIZATION_MODE;
   }
   
-  fseek(f, pos, SEEK_SET);
+  vsFileSeek(f, pos, SEEK_SET);
   return serializationMode;
 }
 
 /// reads the header of the file and return the version number
 int vsReadFileVersion(FILE* f, const int serializationMode){
-  if(serializationMode == BINARY_SERIALIZATION_MODE) {
+  if(serializationMode == BINARY_SERIALIZATION_MODE
+     || serializationMode == COMPACT_SERIALIZATION_MODE) {
     return vsReadFileVersionBinary(f);
   } else {
     return vsReadFileVersionText(f);
@@ -434,7 +523,7 @@ int vsReadFileVersion(FILE* f, const int serializationMode){
 int vsReadFileVersionText(FILE* f){
   if(!f) return VS_ERROR;
   int version;
-  if(fscanf(f, "VID.STAB %i\n", &version)!=LIBVIDSTAB_FILE_FORMAT_VERSION)
+  if(fscanf(f, "VID.STAB %i\n", &version)!=1)
     return VS_ERROR;
   else return version;
 }
@@ -444,7 +533,7 @@ int vsReadFileVersionBinary(FILE* f){
   unsigned char version;
   VSMotionDetectConfig conf;
 
-  if(fscanf(f, "TRF%hhu", &version)!=LIBVIDSTAB_FILE_FORMAT_VERSION) goto parse_error_handling;
+  if(fscanf(f, "TRF%hhu", &version)!=1) goto parse_error_handling;
   if(readInt32(&conf.accuracy, f)<=0) goto parse_error_handling;
   if(readInt32(&conf.shakiness, f)<=0) goto parse_error_handling;
   if(readInt32(&conf.stepSize, f)<=0) goto parse_error_handling;
@@ -456,14 +545,28 @@ parse_error_handling:
 }
 
 int vsReadFromFile(FILE* f, LocalMotions* lms, const int serializationMode){
-  if(serializationMode == BINARY_SERIALIZATION_MODE) {
-    return vsReadFromFileBinary(f,lms);
+  VSMotionSet set;
+  int num;
+  vs_motionset_init(&set, 0);
+  num = vsReadMotionSetFromFile(f, &set, serializationMode);
+  if(num != VS_ERROR && vs_motionset_to_vector(&set, lms) != VS_OK){
+    vs_log_error(modname, "Cannot allocate the localmotions of frame %i!\n", num);
+    num = VS_ERROR;
+  }
+  vs_motionset_fini(&set);
+  return num;
+}
+
+int vsReadMotionSetFromFile(FILE* f, VSMotionSet* lms, const int serializationMode){
+  if(serializationMode == BINARY_SERIALIZATION_MODE
+     || serializationMode == COMPACT_SERIALIZATION_MODE) {
+    return vsReadFromFileBinary(f,lms,serializationMode);
   } else {
     return vsReadFromFileText(f,lms);
   }
 }
 
-int vsReadFromFileText(FILE* f, LocalMotions* lms){
+int vsReadFromFileText(FILE* f, VSMotionSet* lms){
   int c = fgetc(f);
   if(c=='F') {
     int num;
@@ -471,7 +574,7 @@ int vsReadFromFileText(FILE* f, LocalMotions* lms){
       vs_log_error(modname,"cannot read file, expect 'Frame num (...'");
       return VS_ERROR;
     }
-    *lms = vsRestoreLocalmotions(f,ASCII_SERIALIZATION_MODE);
+    vsRestoreMotionSetText(f,lms);
     if(fscanf(f,")\n")<0) {
       vs_log_error(modname,"cannot read file, expect '...)'");
       return VS_ERROR;
@@ -480,13 +583,13 @@ int vsReadFromFileText(FILE* f, LocalMotions* lms){
   } else if(c=='#') {
     char l[1024];
     if(fgets(l, sizeof(l), f)==0) return VS_ERROR;
-    return vsReadFromFile(f,lms,ASCII_SERIALIZATION_MODE);
+    return vsReadFromFileText(f,lms);
   } else if(c=='\n' || c=='\r' || c==' ' || c=='\t') {
     /* tolerate CR (and tabs): an ascii transform file written through a
        text-mode handle on Windows has CRLF line endings, and it must remain
        readable through a binary-mode handle (which is required for the binary
        format, see serialize.h) */
-    return vsReadFromFile(f,lms,ASCII_SERIALIZATION_MODE);
+    return vsReadFromFileText(f,lms);
   } else if(c==EOF) {
     return VS_ERROR;
   } else {
@@ -496,10 +599,10 @@ int vsReadFromFileText(FILE* f, LocalMotions* lms){
   }
 }
 
-int vsReadFromFileBinary(FILE* f, LocalMotions* lms){
+int vsReadFromFileBinary(FILE* f, VSMotionSet* lms, int serializationMode){
   int frameNum;
   if(readInt32(&frameNum, f)<=0) return VS_ERROR;
-  *lms = vsRestoreLocalmotions(f, BINARY_SERIALIZATION_MODE);
+  vsRestoreMotionSetBinary(f, lms, serializationMode);
   return frameNum;
 }
 
@@ -513,16 +616,49 @@ static void freeManyLocalMotions(VSManyLocalMotions* mlms){
   vs_vector_del(mlms);
 }
 
-int vsReadLocalMotionsFile(FILE* f, VSManyLocalMotions* mlms){
-  const int serializationMode = vsGuessSerializationMode(f);
+int vsReadMotionsFileHeader(FILE* f){
+  /* one character of look ahead, which ungetc guarantees, tells binary from
+     text; the binary version then tells the record layout. Unlike
+     vsGuessSerializationMode this does not seek, so f can be a pipe. */
+  int c = fgetc(f);
+  int serializationMode = c == 'T' ? BINARY_SERIALIZATION_MODE : ASCII_SERIALIZATION_MODE;
+  if(c == EOF || ungetc(c, f) == EOF)
+    return VS_ERROR;
   int version = vsReadFileVersion(f, serializationMode);
   if(version<1) // old format or unknown
     return VS_ERROR;
-  if(version>1){
-    vs_log_error(modname,"Version of VID.STAB file too large: got %i, expect <= 1",
-                 version);
+  if(serializationMode == BINARY_SERIALIZATION_MODE
+     && version == LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT)
+    serializationMode = COMPACT_SERIALIZATION_MODE;
+  int maxVersion = serializationMode == COMPACT_SERIALIZATION_MODE
+    ? LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT : LIBVIDSTAB_FILE_FORMAT_VERSION;
+  if(version>maxVersion){
+    vs_log_error(modname,"Version of VID.STAB file too large: got %i, expect <= %i",
+                 version, maxVersion);
     return VS_ERROR;
   }
+  return serializationMode;
+}
+
+/* checks the frame index read from a file, the index is used as a position
+   so an implausible one is rejected here rather than passed on as a size */
+static int plausibleFrameIndex(int index, int oldindex){
+  if(index > oldindex+1){
+    vs_log_info(modname,"VID.STAB file: index of frames is not continuous %i -< %i",
+                oldindex, index);
+  }
+  if(index<1 || index>VS_MAX_FRAMES){
+    vs_log_info(modname,"VID.STAB file: implausible frame number (%i), "
+                "expect 1..%i", index, VS_MAX_FRAMES);
+    return 0;
+  }
+  return 1;
+}
+
+int vsReadLocalMotionsFile(FILE* f, VSManyLocalMotions* mlms){
+  const int serializationMode = vsReadMotionsFileHeader(f);
+  if(serializationMode == VS_ERROR)
+    return VS_ERROR;
   assert(mlms);
   // initial number of frames, but it will automatically be increaseed
   if(vs_vector_init(mlms,1024)!=VS_OK)
@@ -531,15 +667,7 @@ int vsReadLocalMotionsFile(FILE* f, VSManyLocalMotions* mlms){
   int oldindex = 0;
   LocalMotions lms;
   while((index = vsReadFromFile(f,&lms,serializationMode)) != VS_ERROR){
-    if(index > oldindex+1){
-      vs_log_info(modname,"VID.STAB file: index of frames is not continuous %i -< %i",
-                  oldindex, index);
-    }
-    if(index<1 || index>VS_MAX_FRAMES){
-      /* the index is used as a position in mlms, so an implausible one is
-         rejected here rather than passed on as a vector size */
-      vs_log_info(modname,"VID.STAB file: implausible frame number (%i), "
-                  "expect 1..%i", index, VS_MAX_FRAMES);
+    if(!plausibleFrameIndex(index, oldindex)){
       vs_vector_del(&lms); // the motions are not stored, so release them
     } else {
       void* old = 0;
@@ -560,6 +688,518 @@ int vsReadLocalMotionsFile(FILE* f, VSManyLocalMotions* mlms){
   return VS_OK;
 }
 
+int vsReadCompactMotionsFile(FILE* f, VSManyCompactMotions* cms){
+  const int serializationMode = vsReadMotionsFileHeader(f);
+  if(serializationMode == VS_ERROR)
+    return VS_ERROR;
+  assert(cms);
+  vs_compactmotions_init(cms);
+  int index;
+  int oldindex = 0;
+  VSMotionSet lms; // one frame at a time, reused
+  vs_motionset_init(&lms, 0);
+  while((index = vsReadMotionSetFromFile(f,&lms,serializationMode)) != VS_ERROR){
+    if(plausibleFrameIndex(index, oldindex)
+       && vs_compactmotions_set_frame(cms, index-1, &lms)!=VS_OK){
+      vs_log_error(modname,"VID.STAB file: cannot store the localmotions of "
+                   "frame %i", index);
+      vs_motionset_fini(&lms);
+      vs_compactmotions_fini(cms); // the caller does not own cms on error
+      return VS_ERROR;
+    }
+    oldindex=index;
+  }
+  vs_motionset_fini(&lms);
+  return VS_OK;
+}
+
+
+
+/* --- the global transforms section ---------------------------------------- */
+/* Layout, after the last frame of a binary file:
+     int32 VS_TRF_END_OF_FRAMES, int32 0   a frame without motions that ends
+                                           the frames for every reader
+     "GTF1"
+     int32 fit version, width, height, simpleMotionCalculation, lens estimated,
+           smoothZoom, lens sample size (lensSampleSize, 0 without the lens)
+     double fov, lens k the transforms were fitted through (0: none)
+     int32 number of transforms
+     per transform: double x, y, alpha, zoom, barrel, rshutter, int32 extra
+   and the footer: int32 offset of the section (low, high word), "GTRF". */
+#define VS_TRANSFORMS_FIT_VERSION 2
+#define VS_TRANSFORMS_KEY_INTS    7
+#define VS_TRANSFORMS_FOOTER_SIZE 12
+
+static int writeTransformsKey(const VSTransformData* td, FILE* f){
+  const int32_t key[VS_TRANSFORMS_KEY_INTS] = {
+    VS_TRANSFORMS_FIT_VERSION, td->fiSrc.width, td->fiSrc.height,
+    td->conf.simpleMotionCalculation != 0,
+    td->conf.estimateLensDistortion != 0 && td->conf.simpleMotionCalculation == 0,
+    td->conf.smoothZoom != 0, lensSampleSize(td) };
+  for(int i=0; i < VS_TRANSFORMS_KEY_INTS; i++)
+    if(writeInt32(&key[i], f)<=0) return 0;
+  return writeDouble(&td->conf.fov, f) > 0 && writeDouble(&td->fitLensK, f) > 0;
+}
+
+/* reads the key of a section and compares it with td, the fitted lens k is
+   put to *lensK */
+static int readTransformsKey(const VSTransformData* td, FILE* f, double* lensK){
+  int32_t key[VS_TRANSFORMS_KEY_INTS];
+  double fov;
+  for(int i=0; i < VS_TRANSFORMS_KEY_INTS; i++)
+    if(readInt32(&key[i], f)<=0) return 0;
+  if(readDouble(&fov, f)<=0 || readDouble(lensK, f)<=0) return 0;
+  return key[0] == VS_TRANSFORMS_FIT_VERSION && key[1] == td->fiSrc.width
+    && key[2] == td->fiSrc.height && key[3] == (td->conf.simpleMotionCalculation != 0)
+    && key[4] == (td->conf.estimateLensDistortion != 0
+                  && td->conf.simpleMotionCalculation == 0)
+    && key[5] == (td->conf.smoothZoom != 0) && key[6] == lensSampleSize(td)
+    && fov == td->conf.fov;
+}
+
+/* the offset of the section of a binary file, -1 if it has none; the size of
+   the file goes to *size */
+static int64_t findTransformsSection(FILE* f, int64_t* size){
+  char magic[4];
+  int32_t lo, hi, marker, len;
+  int64_t offset;
+  if(vsFileSeek(f, 0, SEEK_END) != 0 || (*size = vsFileTell(f)) < 0)
+    return -1;
+  if(*size < 24 + 8 + 4 + VS_TRANSFORMS_FOOTER_SIZE
+     || vsFileSeek(f, *size - VS_TRANSFORMS_FOOTER_SIZE, SEEK_SET) != 0
+     || readInt32(&lo, f)<=0 || readInt32(&hi, f)<=0 || fread(magic, 4, 1, f) != 1
+     || memcmp(magic, "GTRF", 4) != 0)
+    return -1;
+  offset = (int64_t)((uint64_t)(uint32_t)hi << 32 | (uint32_t)lo);
+  if(offset < 24 || offset > *size - 8 - 4 - VS_TRANSFORMS_FOOTER_SIZE
+     || vsFileSeek(f, offset, SEEK_SET) != 0 || readInt32(&marker, f)<=0
+     || readInt32(&len, f)<=0 || fread(magic, 4, 1, f) != 1
+     || marker != VS_TRF_END_OF_FRAMES || len != 0 || memcmp(magic, "GTF1", 4) != 0)
+    return -1;
+  return offset;
+}
+
+int vsWriteTransformsToFile(const VSTransformData* td, FILE* f,
+                            const VSTransformations* trans){
+  char head[3];
+  int64_t size, offset;
+  const int32_t marker = VS_TRF_END_OF_FRAMES, none = 0;
+  assert(td && trans);
+  if(!f || vsFileSeek(f, 0, SEEK_SET) != 0 || fread(head, 3, 1, f) != 1
+     || memcmp(head, "TRF", 3) != 0){
+    vs_log_error(modname, "the global transforms are stored in binary files only\n");
+    return VS_ERROR;
+  }
+  /* a section that is there is overwritten: it starts at the same offset and
+     has the same size, as the number of frames is the same */
+  offset = findTransformsSection(f, &size);
+  if(offset < 0)
+    offset = size;
+  if(offset < 0 || vsFileSeek(f, offset, SEEK_SET) != 0)
+    return VS_ERROR;
+  const int32_t len = trans->len;
+  const int32_t lo = (int32_t)(uint32_t)((uint64_t)offset & 0xffffffffu);
+  const int32_t hi = (int32_t)(uint32_t)((uint64_t)offset >> 32);
+  int ok = writeInt32(&marker, f)>0 && writeInt32(&none, f)>0
+    && fwrite("GTF1", 4, 1, f) == 1 && writeTransformsKey(td, f) && writeInt32(&len, f)>0;
+  for(int i=0; ok && i < trans->len; i++){
+    const VSTransform* t = &trans->ts[i];
+    const int32_t extra = t->extra;
+    ok = writeDouble(&t->x, f)>0 && writeDouble(&t->y, f)>0 && writeDouble(&t->alpha, f)>0
+      && writeDouble(&t->zoom, f)>0 && writeDouble(&t->barrel, f)>0
+      && writeDouble(&t->rshutter, f)>0 && writeInt32(&extra, f)>0;
+  }
+  ok = ok && writeInt32(&lo, f)>0 && writeInt32(&hi, f)>0 && fwrite("GTRF", 4, 1, f) == 1
+    && fflush(f) == 0;
+  if(!ok){
+    vs_log_error(modname, "cannot store the global transforms in the file\n");
+    return VS_ERROR;
+  }
+  return VS_OK;
+}
+
+int vsReadTransformsFromFile(VSTransformData* td, FILE* f, VSTransformations* trans){
+  int64_t size;
+  double lensK;
+  int32_t len;
+  assert(td && f && trans);
+  assert(trans->len==0 && trans->ts == 0);
+  int64_t offset = findTransformsSection(f, &size);
+  if(offset < 0 || !readTransformsKey(td, f, &lensK) || readInt32(&len, f)<=0
+     || len < 0 || len > VS_MAX_FRAMES)
+    return VS_ERROR;
+  trans->ts = (VSTransform*)vs_malloc(sizeof(VSTransform) * (len > 0 ? len : 1));
+  if(!trans->ts)
+    return VS_ERROR;
+  for(int i=0; i < len; i++){
+    VSTransform* t = &trans->ts[i];
+    int32_t extra;
+    if(readDouble(&t->x, f)<=0 || readDouble(&t->y, f)<=0 || readDouble(&t->alpha, f)<=0
+       || readDouble(&t->zoom, f)<=0 || readDouble(&t->barrel, f)<=0
+       || readDouble(&t->rshutter, f)<=0 || readInt32(&extra, f)<=0){
+      vs_free(trans->ts);
+      trans->ts = 0;
+      return VS_ERROR;
+    }
+    t->extra = extra;
+  }
+  trans->len = len;
+  /* what the lens estimation of the fit passes on to the render path */
+  td->fitLensK = lensK;
+  if(fabs(td->conf.lensK) <= 0.01 && fabs(lensK) > 0.01)
+    vsTransformSetLensK(td, lensK);
+  return VS_OK;
+}
+
+
+/* --- checkpoints of the detection ----------------------------------------- */
+/* Layout of a checkpoint file:
+     "VSCK", int32 version
+     the key: int32 values (checkpointKey) and double contrastThreshold
+     int32 frameNum, hasSeenOneFrame, hasPrediction, predictionShift,
+           predictionNum, double predictionMatch, the prediction (6 double,
+           int32 extra)
+     int32 size of the .trf (low, high word), int32 n, the last n bytes of it
+     the reference: the rows of prev and of every pyramid level (plane 0),
+           each image as int32 bytes per row, int32 rows, the rows
+     "VSCK" again, a file that ends early is not taken */
+#define VS_CHECKPOINT_VERSION 1
+#define VS_CHECKPOINT_KEYS 18
+#define VS_CHECKPOINT_TAIL 64
+
+/* everything the local motions and the state depend on: a detection resumed
+   with other values than it was saved with would continue a different run */
+static void checkpointKey(const VSMotionDetect* md, int32_t* key){
+  const int32_t k[VS_CHECKPOINT_KEYS] = {
+    md->fi.width, md->fi.height, md->fi.pFormat,
+    md->currfi.width, md->currfi.height, md->currfi.pFormat,
+    md->pyramidLevels, md->serializationMode,
+    md->conf.shakiness, md->conf.accuracy, md->conf.stepSize, md->conf.virtualTripod,
+    md->conf.contrastMode, md->conf.motionPrediction, md->conf.packedLuma,
+    md->conf.skipFinePass, md->conf.detectScale, md->conf.consensusFields };
+  memcpy(key, k, sizeof(k));
+}
+
+/* the images that hold the reference, plane 0: the luma (or the packed
+   pixels) is all the search reads */
+static int checkpointImages(VSMotionDetect* md, VSFrame** frames, const VSFrameInfo** fis){
+  int n = 0;
+  frames[n] = &md->prev;
+  fis[n++] = &md->currfi;
+  for(int l=0; l < md->pyramidLevels; l++){
+    frames[n] = &md->prevpyr[l];
+    fis[n++] = &md->pyrfi[l];
+  }
+  return n;
+}
+
+static int writeCheckpoint(const VSMotionDetect* md, FILE* trf, FILE* f){
+  int32_t key[VS_CHECKPOINT_KEYS];
+  unsigned char tail[VS_CHECKPOINT_TAIL];
+  const int32_t version = VS_CHECKPOINT_VERSION;
+  const int32_t frameNum = md->frameNum, seen = md->hasSeenOneFrame;
+  const int32_t hasPrediction = md->hasPrediction, extra = md->prediction.extra;
+  const VSTransform* t = &md->prediction;
+  int64_t size;
+
+  if(fflush(trf) != 0 || vsFileSeek(trf, 0, SEEK_END) != 0 || (size = vsFileTell(trf)) < 0)
+    return 0;
+  const int32_t tailLen = size < VS_CHECKPOINT_TAIL ? (int32_t)size : VS_CHECKPOINT_TAIL;
+  if(vsFileSeek(trf, size - tailLen, SEEK_SET) != 0
+     || fread(tail, 1, tailLen, trf) != (size_t)tailLen || vsFileSeek(trf, 0, SEEK_END) != 0)
+    return 0;
+  const int32_t lo = (int32_t)(uint32_t)((uint64_t)size & 0xffffffffu);
+  const int32_t hi = (int32_t)(uint32_t)((uint64_t)size >> 32);
+
+  checkpointKey(md, key);
+  int ok = fwrite("VSCK", 4, 1, f) == 1 && writeInt32(&version, f)>0;
+  for(int i=0; ok && i < VS_CHECKPOINT_KEYS; i++)
+    ok = writeInt32(&key[i], f)>0;
+  ok = ok && writeDouble(&md->conf.contrastThreshold, f)>0
+    && writeInt32(&frameNum, f)>0 && writeInt32(&seen, f)>0
+    && writeInt32(&hasPrediction, f)>0 && writeInt32(&md->predictionShift, f)>0
+    && writeInt32(&md->predictionNum, f)>0 && writeDouble(&md->predictionMatch, f)>0
+    && writeDouble(&t->x, f)>0 && writeDouble(&t->y, f)>0 && writeDouble(&t->alpha, f)>0
+    && writeDouble(&t->zoom, f)>0 && writeDouble(&t->barrel, f)>0
+    && writeDouble(&t->rshutter, f)>0 && writeInt32(&extra, f)>0
+    && writeInt32(&lo, f)>0 && writeInt32(&hi, f)>0 && writeInt32(&tailLen, f)>0
+    && fwrite(tail, 1, tailLen, f) == (size_t)tailLen;
+
+  VSFrame* frames[1 + VS_MAX_PYRAMID_LEVELS];
+  const VSFrameInfo* fis[1 + VS_MAX_PYRAMID_LEVELS];
+  int n = checkpointImages((VSMotionDetect*)md, frames, fis); // only read
+  for(int k=0; ok && k < n; k++){
+    const int32_t w = fis[k]->width * fis[k]->bytesPerPixel, h = fis[k]->height;
+    ok = writeInt32(&w, f)>0 && writeInt32(&h, f)>0;
+    for(int y=0; ok && y < h; y++)
+      ok = fwrite(frames[k]->data[0] + (size_t)y * frames[k]->linesize[0], 1, w, f)
+        == (size_t)w;
+  }
+  return ok && fwrite("VSCK", 4, 1, f) == 1;
+}
+
+int vsMotionDetectCheckpoint(const VSMotionDetect* md, FILE* trf, const char* filename){
+  char tmpname[4096];
+  FILE* f;
+  assert(md && trf && filename);
+  /* written next to the old one and renamed over it, so that a crash while
+     saving leaves the previous checkpoint */
+  if(snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename) >= (int)sizeof(tmpname))
+    return VS_ERROR;
+  f = fopen(tmpname, "wb");
+  if(!f){
+    vs_log_error(modname, "cannot open the checkpoint %s\n", tmpname);
+    return VS_ERROR;
+  }
+  int ok = writeCheckpoint(md, trf, f);
+  ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+  if(ok) remove(filename); // rename does not replace a file there
+#endif
+  if(!ok || rename(tmpname, filename) != 0){
+    vs_log_error(modname, "cannot write the checkpoint %s\n", filename);
+    remove(tmpname);
+    return VS_ERROR;
+  }
+  return VS_OK;
+}
+
+/* cuts the file to size, dropping frames that were written after the
+   checkpoint */
+static int truncateFile(FILE* f, int64_t size){
+  if(fflush(f) != 0)
+    return 0;
+#ifdef _WIN32
+  return _chsize_s(_fileno(f), size) == 0;
+#else
+  return ftruncate(fileno(f), (off_t)size) == 0;
+#endif
+}
+
+/* reads the checkpoint f into md; md is changed only if it is valid and
+   trf is the file it was saved with */
+static int readCheckpoint(VSMotionDetect* md, FILE* trf, FILE* f){
+  char magic[4];
+  int32_t version, key[VS_CHECKPOINT_KEYS], want[VS_CHECKPOINT_KEYS];
+  int32_t frameNum, seen, hasPrediction, predictionShift, predictionNum, extra;
+  int32_t lo, hi, tailLen;
+  double contrastThreshold, predictionMatch;
+  unsigned char tail[VS_CHECKPOINT_TAIL], have[VS_CHECKPOINT_TAIL];
+  VSTransform t;
+  int64_t size, trfSize;
+
+  if(fread(magic, 4, 1, f) != 1 || memcmp(magic, "VSCK", 4) != 0
+     || readInt32(&version, f)<=0 || version != VS_CHECKPOINT_VERSION){
+    vs_log_error(modname, "not a checkpoint of this version\n");
+    return VS_ERROR;
+  }
+  for(int i=0; i < VS_CHECKPOINT_KEYS; i++)
+    if(readInt32(&key[i], f)<=0) return VS_ERROR;
+  checkpointKey(md, want);
+  if(readDouble(&contrastThreshold, f)<=0 || memcmp(key, want, sizeof(key)) != 0
+     || contrastThreshold != md->conf.contrastThreshold){
+    vs_log_error(modname, "the checkpoint is of a detection with other settings\n");
+    return VS_ERROR;
+  }
+  if(readInt32(&frameNum, f)<=0 || readInt32(&seen, f)<=0 || readInt32(&hasPrediction, f)<=0
+     || readInt32(&predictionShift, f)<=0 || readInt32(&predictionNum, f)<=0
+     || readDouble(&predictionMatch, f)<=0 || readDouble(&t.x, f)<=0
+     || readDouble(&t.y, f)<=0 || readDouble(&t.alpha, f)<=0 || readDouble(&t.zoom, f)<=0
+     || readDouble(&t.barrel, f)<=0 || readDouble(&t.rshutter, f)<=0
+     || readInt32(&extra, f)<=0 || readInt32(&lo, f)<=0 || readInt32(&hi, f)<=0
+     || readInt32(&tailLen, f)<=0 || tailLen < 0 || tailLen > VS_CHECKPOINT_TAIL
+     || fread(tail, 1, tailLen, f) != (size_t)tailLen || frameNum < 0)
+    return VS_ERROR;
+  t.extra = extra;
+  trfSize = (int64_t)((uint64_t)(uint32_t)hi << 32 | (uint32_t)lo);
+
+  // the .trf has to hold what it held at the checkpoint, frames after it go
+  if(vsFileSeek(trf, 0, SEEK_END) != 0 || (size = vsFileTell(trf)) < trfSize || tailLen > trfSize
+     || vsFileSeek(trf, trfSize - tailLen, SEEK_SET) != 0
+     || fread(have, 1, tailLen, trf) != (size_t)tailLen || memcmp(tail, have, tailLen) != 0){
+    vs_log_error(modname, "the transform file does not end as it did at the checkpoint\n");
+    return VS_ERROR;
+  }
+
+  /* the reference is read aside and copied into md once the whole
+     checkpoint is there */
+  VSFrame* frames[1 + VS_MAX_PYRAMID_LEVELS];
+  const VSFrameInfo* fis[1 + VS_MAX_PYRAMID_LEVELS];
+  int n = checkpointImages(md, frames, fis);
+  size_t bytes = 0;
+  for(int k=0; k < n; k++)
+    bytes += (size_t)fis[k]->width * fis[k]->bytesPerPixel * fis[k]->height;
+  uint8_t* images = (uint8_t*)vs_malloc(bytes > 0 ? bytes : 1);
+  if(!images)
+    return VS_ERROR;
+  int ok = 1;
+  uint8_t* p = images;
+  for(int k=0; ok && k < n; k++){
+    int32_t w, h;
+    ok = readInt32(&w, f)>0 && readInt32(&h, f)>0
+      && w == fis[k]->width * fis[k]->bytesPerPixel && h == fis[k]->height
+      && fread(p, 1, (size_t)w * h, f) == (size_t)w * h;
+    p += (size_t)w * h;
+  }
+  ok = ok && fread(magic, 4, 1, f) == 1 && memcmp(magic, "VSCK", 4) == 0;
+  if(!ok){
+    vs_free(images);
+    return VS_ERROR;
+  }
+
+  if(size > trfSize && !truncateFile(trf, trfSize)){
+    vs_log_error(modname, "cannot cut the transform file to the checkpoint\n");
+    vs_free(images);
+    return VS_ERROR;
+  }
+  if(vsFileSeek(trf, trfSize, SEEK_SET) != 0){
+    vs_free(images);
+    return VS_ERROR;
+  }
+  p = images;
+  for(int k=0; k < n; k++){
+    const size_t w = (size_t)fis[k]->width * fis[k]->bytesPerPixel;
+    for(int y=0; y < fis[k]->height; y++, p += w)
+      memcpy(frames[k]->data[0] + (size_t)y * frames[k]->linesize[0], p, w);
+  }
+  vs_free(images);
+  md->frameNum = frameNum;
+  md->hasSeenOneFrame = seen;
+  md->hasPrediction = hasPrediction;
+  md->predictionShift = predictionShift;
+  md->predictionNum = predictionNum;
+  md->predictionMatch = predictionMatch;
+  md->prediction = t;
+  return VS_OK;
+}
+
+int vsMotionDetectResume(VSMotionDetect* md, FILE* trf, const char* filename){
+  assert(md && trf && filename);
+  assert(md->initialized == 2);
+  FILE* f = fopen(filename, "rb");
+  if(!f){
+    vs_log_error(modname, "cannot open the checkpoint %s\n", filename);
+    return VS_ERROR;
+  }
+  int res = readCheckpoint(md, trf, f);
+  fclose(f);
+  if(res != VS_OK)
+    vs_log_error(modname, "cannot resume from the checkpoint %s\n", filename);
+  else
+    vs_log_info(modname, "resuming the detection at frame %i\n", md->frameNum);
+  return res;
+}
+
+/* reads the header of a local motions file with the detection settings it
+   names, into the fields of md that vsPrepareFile writes. Text files keep
+   them in comments, which older files may lack (then they stay 0). */
+static int readSegmentHeader(FILE* f, VSMotionDetect* md){
+  memset(md, 0, sizeof(*md));
+  int c = fgetc(f);
+  if(c == EOF || ungetc(c, f) == EOF)
+    return VS_ERROR;
+  if(c == 'T'){
+    unsigned char version;
+    if(fscanf(f, "TRF%hhu", &version)!=1
+       || readInt32(&md->conf.accuracy, f)<=0 || readInt32(&md->conf.shakiness, f)<=0
+       || readInt32(&md->conf.stepSize, f)<=0
+       || readDouble(&md->conf.contrastThreshold, f)<=0)
+      return VS_ERROR;
+    if(version == LIBVIDSTAB_FILE_FORMAT_VERSION)
+      md->serializationMode = BINARY_SERIALIZATION_MODE;
+    else if(version == LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT)
+      md->serializationMode = COMPACT_SERIALIZATION_MODE;
+    else
+      return VS_ERROR;
+    return VS_OK;
+  }
+  int version = vsReadFileVersionText(f);
+  if(version < 1 || version > LIBVIDSTAB_FILE_FORMAT_VERSION)
+    return VS_ERROR;
+  md->serializationMode = ASCII_SERIALIZATION_MODE;
+  while((c = fgetc(f)) == '#'){
+    char l[1024], name[32];
+    double value;
+    if(fgets(l, sizeof(l), f)==0) return VS_ERROR;
+    if(sscanf(l, " %31s = %lf", name, &value) != 2) continue;
+    if(strcmp(name, "accuracy") == 0)         md->conf.accuracy = (int)value;
+    else if(strcmp(name, "shakiness") == 0)   md->conf.shakiness = (int)value;
+    else if(strcmp(name, "stepsize") == 0)    md->conf.stepSize = (int)value;
+    else if(strcmp(name, "mincontrast") == 0) md->conf.contrastThreshold = value;
+  }
+  if(c != EOF && ungetc(c, f) == EOF)
+    return VS_ERROR;
+  return VS_OK;
+}
+
+int vsMergeMotionsFiles(FILE* out, FILE* const* segments, int num){
+  VSMotionDetect first, seg;
+  int next = 0;
+  assert(out && segments);
+  if(num < 1) return VS_ERROR;
+
+  for(int k=0; k < num; k++){
+    VSMotionDetect* hd = k ? &seg : &first;
+    if(readSegmentHeader(segments[k], hd) != VS_OK){
+      vs_log_error(modname, "segment %i is not a local motions file\n", k);
+      return VS_ERROR;
+    }
+    if(k == 0){
+      if(vsPrepareFile(&first, out) != VS_OK) return VS_ERROR;
+    }else if(seg.serializationMode != first.serializationMode
+             || seg.conf.accuracy != first.conf.accuracy
+             || seg.conf.shakiness != first.conf.shakiness
+             || seg.conf.stepSize != first.conf.stepSize
+             || seg.conf.contrastThreshold != first.conf.contrastThreshold){
+      vs_log_error(modname, "segment %i is of another format or other settings "
+                   "than segment 0\n", k);
+      return VS_ERROR;
+    }
+
+    // the frames of a segment follow each other, the segment follows the last
+    int frames = 0, last = 0;
+    for(;;){
+      VSMotionSet set;
+      vs_motionset_init(&set, 0);
+      int index = vsReadMotionSetFromFile(segments[k], &set, first.serializationMode);
+      if(index == VS_ERROR){
+        vs_motionset_fini(&set);
+        break;
+      }
+      int ok = 1;
+      if(frames == 0){
+        if(k == 0){
+          next = index;
+        }else if(index == 1 && next != 1){
+          vs_log_info(modname, "segment %i starts at frame 1, renumbered to %i\n",
+                      k, next);
+        }else if(index != next){
+          vs_log_error(modname, "segment %i starts at frame %i, the one before "
+                       "ends at frame %i\n", k, index, next-1);
+          ok = 0;
+        }
+        if(k > 0 && set.num == 0)
+          vs_log_warn(modname, "the first frame of segment %i has no motions, "
+                      "was the detection primed (vsMotionDetectPrime)?\n", k);
+      }else if(index != last+1){
+        vs_log_error(modname, "segment %i: frame %i follows frame %i\n", k, index, last);
+        ok = 0;
+      }
+      first.frameNum = next;
+      ok = ok && vsWriteMotionSetToFile(&first, out, &set) == VS_OK;
+      vs_motionset_fini(&set);
+      if(!ok) return VS_ERROR;
+      last = index;
+      next++;
+      frames++;
+    }
+    if(frames == 0){
+      vs_log_error(modname, "segment %i holds no frames\n", k);
+      return VS_ERROR;
+    }
+  }
+  return VS_OK;
+}
 
 /**
  * vsReadOldTransforms: read transforms file (Deprecated format)
@@ -28,6 +28,8 @@
 #define __SERIALIZE_H
 
 #define LIBVIDSTAB_FILE_FORMAT_VERSION 1
+/// version of the compact binary format (COMPACT_SERIALIZATION_MODE)
+#define LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT 2
 
 #include "transformtype.h"
 #include "motiondetect.h"
@@ -41,7 +43,8 @@
  * writing and fopen(path, "rb") for reading.
  *
  * The default (BINARY_SERIALIZATION_MODE) transform file format contains
- * arbitrary binary data (int16/int32/double). On platforms that distinguish
+ * arbitrary binary data (int16/int32/double), as does the compact one
+ * (COMPACT_SERIALIZATION_MODE, int16/int32/float). On platforms that distinguish
  * text and binary streams (Windows/MSVCRT, but also OS/2, DOS, ...) a stream
  * opened in text mode mangles that data:
  *   - reading stops at the first 0x1A (Ctrl-Z) byte, which is interpreted as
@@ -55,6 +58,29 @@
  * a caller that forgets the "b" only breaks on Windows.
  */
 
+/*
+ * sanity limit for the number of localmotions of a single frame in the binary
+ * format. Even 8k material with the smallest measurement fields stays far
+ * below this; a larger value means the file is corrupt and we must not try to
+ * allocate/parse it (which would also flood the log with parse errors).
+ */
+#define VS_MAX_LOCALMOTIONS_PER_FRAME (1<<20)
+
+/*
+ * sanity limit for the frame index in a transform file. 1<<22 frames is more
+ * than 19 hours of 60fps material; a larger index means the file is corrupt
+ * and we must not size the frame vector after it - the index is used as a
+ * vector position, so an unbounded one turns into an absurd allocation.
+ */
+#define VS_MAX_FRAMES (1<<22)
+
+/*
+ * frame number that ends the frames of a binary file: what follows is the
+ * section of the global transforms (vsWriteTransformsToFile). A reader of the
+ * frames stops there, as vsReadFromFile returns it as VS_ERROR.
+ */
+#define VS_TRF_END_OF_FRAMES (-1)
+
 /// Vector of LocalMotions
 typedef VSVector VSManyLocalMotions;
 /// helper macro to access a localmotions vector in the VSVector of all Frames
@@ -66,6 +92,8 @@ VS_API int vsGuessSerializationMode(FILE* f);
 
 /// stores local motions to file
 VS_API int vsStoreLocalmotions(FILE* f, const LocalMotions* lms, const int serializationMode);
+/// stores a motion set to file, in the same format
+VS_API int vsStoreMotionSet(FILE* f, const VSMotionSet* lms, const int serializationMode);
 
 /// restores local motions from file
 VS_API LocalMotions vsRestoreLocalmotions(FILE* f, const int serializationMode);
@@ -76,6 +104,8 @@ VS_API int vsPrepareFile(const VSMotionDetect* td, FILE* f);
 
 /// appends the given localmotions to the file
 VS_API int vsWriteToFile(const VSMotionDetect* td, FILE* f, const LocalMotions* lms);
+/// appends the given motion set to the file (as vsWriteToFile)
+VS_API int vsWriteMotionSetToFile(const VSMotionDetect* td, FILE* f, const VSMotionSet* lms);
 
 /// reads the header of the file and return the version number (used by readLocalmotionsFile)
 VS_API int vsReadFileVersion(FILE* f, const int serializationMode);
@@ -85,6 +115,14 @@ VS_API int vsReadFileVersion(FILE* f, const int serializationMode);
  * if nothing is read (used by readLocalmotionsFile)
  */
 VS_API int vsReadFromFile(FILE* f, LocalMotions* lms, const int serializationMode);
+/// as vsReadFromFile, into an initialized motion set
+VS_API int vsReadMotionSetFromFile(FILE* f, VSMotionSet* lms, const int serializationMode);
+
+/*
+ * reads the header of a local motions file and returns its serialization
+ * mode, VS_ERROR if the file is of an old, unknown or newer format
+ */
+VS_API int vsReadMotionsFileHeader(FILE* f);
 
 /*
  * reads the entire file of localmotions, return VS_ERROR on error or if nothing is read
@@ -94,9 +132,78 @@ VS_API int vsReadFromFile(FILE* f, LocalMotions* lms, const int serializationMod
  *   Lines with # at the beginning are comments and will be ignored
  *   Data lines have the structure: Frame NUM (<LocalMotions>)
  *   where LocalMotions ::= List [(LM v.x v.y f.x f.y f.size contrast match),...]
+ *
+ *  The binary formats begin with 'TRF' and the version digit: version 1 has
+ *  double contrast and match (26 bytes per local motion), version 2 is the
+ *  compact format with the VSCompactMotion record (20 bytes). Both are read.
  */
 VS_API int vsReadLocalMotionsFile(FILE* f, VSManyLocalMotions* lms);
 
+/*
+ * reads the entire file of localmotions (any format and version) into a
+ * compact clip, which needs about a third of the memory of a
+ * VSManyLocalMotions. Contrast and match are kept as float. cms is
+ * initialized here; release it with vs_compactmotions_fini.
+ * Returns VS_ERROR on error (cms is then empty).
+ */
+VS_API int vsReadCompactMotionsFile(FILE* f, VSManyCompactMotions* cms);
+
+/*
+ * stores the transforms fitted from the binary local motions file f (opened
+ * "r+b") at its end, with the fitting parameters of td they depend on: frame
+ * size, simpleMotionCalculation, estimateLensDistortion, smoothZoom, fov and
+ * the lens distortion the fit used. A section stored before is replaced.
+ * The frames stay readable by every reader, old versions included.
+ */
+VS_API int vsWriteTransformsToFile(const VSTransformData* td, FILE* f,
+                                   const VSTransformations* trans);
+
+/*
+ * reads the transforms stored in f by vsWriteTransformsToFile, without
+ * reading the frames, and hands their lens distortion to the render path as
+ * the fit would. Returns VS_ERROR if there are none or they were fitted with
+ * other parameters than those of td (f is then at an unspecified position).
+ */
+VS_API int vsReadTransformsFromFile(VSTransformData* td, FILE* f, VSTransformations* trans);
+
+/*
+ * saves the state of the detection after frame md->frameNum to filename: the
+ * counters, the motion prediction and the blurred reference frame (with its
+ * search pyramid), and the size and the last bytes of the local motions file
+ * trf as it is now. trf has to be open for reading too ("w+b"); flush a
+ * VSTrfWriter (vsTrfWriterFlush) before. The file is replaced only once the
+ * new checkpoint is complete, so a crash while saving keeps the last one.
+ */
+VS_API int vsMotionDetectCheckpoint(const VSMotionDetect* md, FILE* trf,
+                                    const char* filename);
+
+/*
+ * continues a detection from the checkpoint filename: md is initialized with
+ * the frame info and settings of the detection that saved it, and trf is its
+ * local motions file, opened "r+b". trf has to hold what it held at the
+ * checkpoint; frames written after it are cut off, and trf is positioned at
+ * its end to append to (vsWriteMotionSetToFile, vsTrfWriterAppend). The next
+ * frame to detect is then frame md->frameNum (0 based).
+ * Returns VS_ERROR, leaving md as it was, if the checkpoint is incomplete, of
+ * other settings or of another file.
+ */
+VS_API int vsMotionDetectResume(VSMotionDetect* md, FILE* trf, const char* filename);
+
+/*
+ * joins the local motions files of num consecutive segments of a clip, each
+ * detected on its own (see vsMotionDetectPrime), into out as one detection
+ * of the whole clip writes it. The segments are read from their current
+ * position to their end, so they can be pipes. They have to be of the same
+ * format and settings, and the frames of each have to follow each other
+ * without a gap; the frames are numbered on from the first of segment 0. A
+ * segment has to start with the frame after the last one of the segment
+ * before (as a primed detection numbers it), or with frame 1 if it is
+ * numbered on its own, and is then renumbered. Global transforms stored in a
+ * segment are not carried over.
+ * Returns VS_ERROR if a segment does not fit (out is then incomplete).
+ */
+VS_API int vsMergeMotionsFiles(FILE* out, FILE* const* segments, int num);
+
 // read the transformations from the given file (Deprecated format)
 VS_API int vsReadOldTransforms(const VSTransformData* td, FILE* f , VSTransformations* trans);
 
@@ -0,0 +1,204 @@
+/*
+ * stabilizer.c -- stabilization in a single pass, with a bounded lookahead
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ */
+#include "stabilizer.h"
+#include "localmotion2transform.h"
+#include "transform_internal.h"
+#include "transformtype_operations.h"
+#include "vidstabdefines.h"
+#include <string.h>
+#include <stdlib.h>
+
+int vsStabilizerInit(VSStabilizer* s, const VSMotionDetectConfig* mdconf,
+                     const VSTransformConfig* tconf, const VSFrameInfo* fi){
+  memset(s, 0, sizeof(*s));
+  if(vsMotionDetectInit(&s->md, mdconf, fi) != VS_OK)
+    return VS_ERROR;
+  if(vsTransformDataInit(&s->td, tconf, fi, fi) != VS_OK){
+    vsMotionDetectionCleanup(&s->md);
+    return VS_ERROR;
+  }
+  s->td.fitLensK = 0.0;
+  if(s->td.conf.camPathAlgo != VSGaussian)
+    vs_ctx_log_info(&s->td.ctx, s->td.conf.modName,
+                    "a single pass smooths the camera path with the gaussian filter\n");
+  if(s->td.conf.estimateLensDistortion && !s->td.conf.simpleMotionCalculation)
+    vs_ctx_log_info(&s->td.ctx, s->td.conf.modName,
+                    "a single pass does not estimate the lens distortion\n");
+
+  int mu = VS_MAX(s->td.conf.smoothing, 0);
+  s->lookahead = mu;
+  s->frames = (VSFrame*)vs_zalloc(sizeof(VSFrame) * (mu+1));
+  s->path   = (VSTransform*)vs_malloc(sizeof(VSTransform) * (2*mu+1));
+  s->zooms  = (double*)vs_malloc(sizeof(double) * (2*mu+1));
+  s->kernel = (double*)vs_malloc(sizeof(double) * (2*mu+1));
+  int ok = s->frames && s->path && s->zooms && s->kernel;
+  for(int i=0; ok && i <= mu; i++){
+    vsFrameAllocate(&s->frames[i], fi);
+    ok = !vsFrameIsNull(&s->frames[i]);
+  }
+  if(!ok){
+    vs_ctx_log_error(&s->td.ctx, s->td.conf.modName, "malloc failed\n");
+    vsStabilizerCleanup(s);
+    return VS_ERROR;
+  }
+  gaussianKernel(s->kernel, mu);
+  return VS_OK;
+}
+
+void vsStabilizerCleanup(VSStabilizer* s){
+  if(s->frames){
+    for(int i=0; i <= s->lookahead; i++)
+      vsFrameFree(&s->frames[i]);
+    vs_free(s->frames);
+  }
+  if(s->path)   vs_free(s->path);
+  if(s->zooms)  vs_free(s->zooms);
+  if(s->kernel) vs_free(s->kernel);
+  if(s->md.initialized){ // td is set up with md
+    vsMotionDetectionCleanup(&s->md);
+    vsTransformDataCleanup(&s->td);
+  }
+  memset(s, 0, sizeof(*s));
+}
+
+int vsStabilizerReady(const VSStabilizer* s){
+  int ready = s->finished ? s->numFrames - s->numDone
+    : s->numFrames - s->lookahead - s->numDone;
+  return VS_MAX(ready, 0);
+}
+
+void vsStabilizerFinish(VSStabilizer* s){
+  s->finished = 1;
+}
+
+int vsStabilizerPush(VSStabilizer* s, VSFrame* frame){
+  VSMotionSet set;
+  VSTransform t;
+  int n = s->numFrames;
+  if(s->finished || vsStabilizerReady(s) > 0){
+    vs_ctx_log_error(&s->td.ctx, s->td.conf.modName,
+                     "a frame is put in while a frame is ready or after the end\n");
+    return VS_ERROR;
+  }
+  vsFrameCopy(&s->frames[n % (s->lookahead+1)], frame, &s->td.fiSrc);
+  if(vsMotionDetectionSet(&s->md, &set, frame) != VS_OK)
+    return VS_ERROR;
+  // as vsLocalmotions2Transforms fits it
+  if(s->td.conf.simpleMotionCalculation!=0)
+    t = vsSimpleMotionSetToTransform(s->td.fiSrc, s->td.conf.modName, &set);
+  else
+    t = vsMotionSetToTransform(&s->td, &set, NULL);
+  vs_motionset_fini(&set);
+
+  /* relative to absolute (integrate transformations) */
+  if(s->td.conf.relative && n > 0)
+    t = add_transforms(&t, &s->last);
+  s->path[n - s->first] = t;
+  s->last = t;
+  s->numFrames++;
+  return VS_OK;
+}
+
+/* the correction of the frame path[i] with the path known up to path[len-1],
+   as vsPreprocessTransforms gives it for a clip that ends there */
+static VSTransform correction(const VSStabilizer* s, int i, int len){
+  VSTransform t = s->path[i];
+  if(s->lookahead > 0){
+    double weightsum;
+    VSTransform avg = gaussianPathAvg(s->path, len, i, s->kernel, s->lookahead, &weightsum);
+    if(weightsum > 0)
+      t = sub_transforms(&t, &avg);
+  }
+  limitCorrection(&s->td, &t);
+  return t;
+}
+
+/* the zoom the frames in the window around path[i] need, each eased in and
+   out at speed per frame. The frames after it are taken with the corrections
+   the path known so far gives them. */
+static double windowZoom(VSStabilizer* s, int i, int len, double speed){
+  double zoom = s->zooms[i];
+  for(int j = VS_MAX(0, i - s->lookahead); j < VS_MIN(len, i + s->lookahead + 1); j++){
+    double req;
+    if(j > i){
+      VSTransform c = correction(s, j, len);
+      req = vsTransformRequiredZoom(&s->td, &c);
+    }else{
+      req = s->zooms[j];
+    }
+    zoom = VS_MAX(zoom, req - abs(i-j)*speed);
+  }
+  return zoom;
+}
+
+int vsStabilizerPop(VSStabilizer* s, VSFrame* dest, VSTransform* tout){
+  if(vsStabilizerReady(s) < 1){
+    vs_ctx_log_error(&s->td.ctx, s->td.conf.modName, "no frame is ready\n");
+    return VS_ERROR;
+  }
+  const VSTransformConfig* conf = &s->td.conf;
+  int e = s->numDone, i = e - s->first, len = s->numFrames - s->first;
+  VSTransform t = correction(s, i, len);
+
+  if(conf->optZoom == 1 || conf->optZoom == 2){
+    s->zooms[i] = vsTransformRequiredZoom(&s->td, &t);
+    s->zoomSum += s->zooms[i];
+    if(conf->optZoom == 2){
+      double prezoom  = conf->zoom > 0. ? conf->zoom : 0.;
+      double postzoom = conf->zoom < 0. ? conf->zoom : 0.;
+      double meanzoom = s->zoomSum / (e+1) + prezoom;
+      double req = VS_MAX(meanzoom, windowZoom(s, i, len, conf->zoomSpeed));
+      t.zoom = VS_MAX(t.zoom, req) + postzoom;
+    }else{
+      s->staticZoom = VS_MAX(s->staticZoom, windowZoom(s, i, len, 0.));
+      t.zoom += VS_CLAMP(conf->zoom + s->staticZoom, -60, 60);
+    }
+  }else if(conf->zoom != 0){ /* apply global zoom */
+    t.zoom += conf->zoom;
+  }
+
+  if(vsTransformPrepare(&s->td, &s->frames[e % (s->lookahead+1)], dest) != VS_OK
+     || vsDoTransform(&s->td, t) != VS_OK || vsTransformFinish(&s->td) != VS_OK)
+    return VS_ERROR;
+  if(tout)
+    *tout = t;
+
+  // the window of the next frame starts one later
+  s->numDone++;
+  if(s->numDone - s->lookahead > s->first){
+    memmove(s->path, s->path+1, sizeof(VSTransform) * (len-1));
+    memmove(s->zooms, s->zooms+1, sizeof(double) * (len-1));
+    s->first++;
+  }
+  return VS_OK;
+}
+
+/*
+ * Local variables:
+ *   c-file-style: "stroustrup"
+ *   c-file-offsets: ((case-label . *) (statement-case-intro . *))
+ *   indent-tabs-mode: nil
+ *   c-basic-offset: 2 t
+ * End:
+ *
+ * vim: expandtab shiftwidth=2:
+ */
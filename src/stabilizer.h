@@ -0,0 +1,114 @@
+/*
+ * stabilizer.h -- stabilization in a single pass, with a bounded lookahead
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ */
+#ifndef VSSTABILIZER_H
+#define VSSTABILIZER_H
+
+#include "frameinfo.h"
+#include "motiondetect.h"
+#include "transform.h"
+#include "vidstab_api.h"
+
+/**
+   Detection and transformation in one pass, for live and near-live output.
+   Every frame is detected when it comes in and kept until the gaussian
+   window of the camera path around it (conf.smoothing frames on either side)
+   is complete; it is then transformed and handed out. A frame thus comes out
+   smoothing frames after it went in, and only smoothing+1 frames are held.
+
+   The camera path and its corrections are those of the two passes
+   (vsLocalmotions2Transforms and vsPreprocessTransforms with the gaussian
+   camera path), bit for bit, as long as the lens distortion is not estimated
+   (a lens given by conf.lensK is applied). The optimal zoom is computed over
+   the window instead of the clip: optZoom=2 zooms as much as the frames in
+   the window need, easing in and out at zoomSpeed, above the mean of the
+   frames so far; optZoom=1 keeps the largest such zoom, so it only ever
+   zooms in.
+*/
+typedef struct _VSStabilizer {
+  VSMotionDetect md;
+  VSTransformData td;
+
+  int lookahead;        // conf.smoothing of td
+  VSFrame* frames;      // the lookahead+1 frames not handed out, by number
+  VSTransform* path;    // camera path of the frames first .. numFrames-1
+  VSTransform last;     // camera path of the frame numFrames-1, which a
+                        // window of 0 frames has taken out of path already
+  double* zooms;        // required zoom of the frames handed out, as path
+  double* kernel;       // weights of the gaussian window
+  int first;            // number of the frame in path[0]
+  int numFrames;        // frames put in
+  int numDone;          // frames handed out
+  int finished;         // no more frames come in
+  double zoomSum;       // sum of the required zooms of the frames handed out
+  double staticZoom;    // optZoom=1: the largest zoom so far
+} VSStabilizer;
+
+/**
+ * vsStabilizerInit:
+ *     sets up the detection (mdconf) and the transformation (tconf) of
+ *     frames of fi. The camera path is the gaussian one, whatever
+ *     conf.camPathAlgo asks for.
+ * Return Value:
+ *     VS_OK, VS_ERROR on lack of memory.
+ */
+VS_API int vsStabilizerInit(VSStabilizer* s, const VSMotionDetectConfig* mdconf,
+                            const VSTransformConfig* tconf, const VSFrameInfo* fi);
+
+/// releases everything of s
+VS_API void vsStabilizerCleanup(VSStabilizer* s);
+
+/**
+ * vsStabilizerPush:
+ *     detects the next frame of the clip and keeps a copy of it. Frames that
+ *     are ready have to be taken (vsStabilizerPop) before.
+ * Return Value:
+ *     VS_OK, VS_ERROR if a frame is ready or after vsStabilizerFinish.
+ */
+VS_API int vsStabilizerPush(VSStabilizer* s, VSFrame* frame);
+
+/// the clip ends: the frames still held become ready
+VS_API void vsStabilizerFinish(VSStabilizer* s);
+
+/// the number of frames that are ready to be taken
+VS_API int vsStabilizerReady(const VSStabilizer* s);
+
+/**
+ * vsStabilizerPop:
+ *     transforms the next frame that is ready into dest (of the frame info
+ *     given to vsStabilizerInit). t, if not NULL, gets the transform applied.
+ * Return Value:
+ *     VS_OK, VS_ERROR if no frame is ready.
+ */
+VS_API int vsStabilizerPop(VSStabilizer* s, VSFrame* dest, VSTransform* t);
+
+#endif  /* VSSTABILIZER_H */
+
+/*
+ * Local variables:
+ *   c-file-style: "stroustrup"
+ *   c-file-offsets: ((case-label . *) (statement-case-intro . *))
+ *   indent-tabs-mode: nil
+ *   c-basic-offset: 2 t
+ * End:
+ *
+ * vim: expandtab shiftwidth=2:
+ */
@@ -0,0 +1,262 @@
+/*
+ *  threadpool.c
+ *
+ *  Per-instance worker threads for the parallel loops of vid.stab.
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "threadpool.h"
+#include "vidstabdefines.h"
+#include "vsthread.h"
+
+#ifdef USE_OMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef VS_USE_THREADPOOL
+/* One job at a time: the indices of the running job are claimed in chunks
+   from next, under the lock, by the caller and every worker that wakes up.
+   Workers read fn and ctx afresh with every chunk, so one that wakes up late
+   never runs an index of a job whose caller has already returned. */
+struct _vsthreadpool {
+  VSExecutor exec;       // parallel_for set: no threads, the host runs the loops
+  int execBusy;          // a loop of exec is running
+  int numThreads;        // workers + the calling thread
+  int numWorkers;
+  vs_thread* workers;
+  vs_mutex lock;         // guards everything below
+  vs_cond wake;          // a new job or quit
+  vs_cond done;          // a worker left the job
+  unsigned generation;   // counts the jobs, workers wait for it to change
+  int busy;              // a job is running, further calls run serially
+  int quit;
+  vsParallelFn fn;
+  void* ctx;
+  int n, next, chunk;
+  int running;           // threads currently in the job
+};
+
+/// takes part in the current job; called and returns with the lock held
+static void runChunks(VSThreadPool* p){
+  p->running++;
+  while(p->next < p->n){
+    int start = p->next;
+    int end = start + p->chunk < p->n ? start + p->chunk : p->n;
+    vsParallelFn fn = p->fn;
+    void* ctx = p->ctx;
+    p->next = end;
+    vs_mutex_unlock(&p->lock);
+    for(int i=start; i < end; i++)
+      fn(ctx, i);
+    vs_mutex_lock(&p->lock);
+  }
+  p->running--;
+  if(p->running == 0)
+    vs_cond_broadcast(&p->done);
+}
+
+VS_THREAD_MAIN(workerMain)
+{
+  VSThreadPool* p = (VSThreadPool*)arg;
+  unsigned seen = 0; // the pool is created before its first job
+  vs_mutex_lock(&p->lock);
+  for(;;){
+    while(!p->quit && p->generation == seen)
+      vs_cond_wait(&p->wake, &p->lock);
+    if(p->quit)
+      break;
+    seen = p->generation;
+    runChunks(p);
+  }
+  vs_mutex_unlock(&p->lock);
+  return 0;
+}
+
+VSThreadPool* vsThreadPoolCreate(int numThreads){
+  if(numThreads < 2)
+    return NULL;
+  VSThreadPool* p = (VSThreadPool*)vs_zalloc(sizeof(VSThreadPool));
+  if(!p)
+    return NULL;
+  p->workers = (vs_thread*)vs_malloc(sizeof(vs_thread) * (numThreads-1));
+  if(!p->workers){
+    vs_free(p);
+    return NULL;
+  }
+  vs_mutex_init(&p->lock);
+  vs_cond_init(&p->wake);
+  vs_cond_init(&p->done);
+  for(int k=0; k < numThreads-1; k++){
+    if(!vs_thread_start(&p->workers[k], workerMain, p))
+      break; // fewer threads than asked for, as many as the system gave
+    p->numWorkers++;
+  }
+  p->numThreads = p->numWorkers + 1;
+  if(p->numWorkers == 0){
+    vsThreadPoolDestroy(p);
+    return NULL;
+  }
+  return p;
+}
+
+void vsThreadPoolDestroy(VSThreadPool* p){
+  if(!p)
+    return;
+  if(p->exec.parallel_for){ // no threads of its own
+    vs_free(p);
+    return;
+  }
+  vs_mutex_lock(&p->lock);
+  p->quit = 1;
+  vs_cond_broadcast(&p->wake);
+  vs_mutex_unlock(&p->lock);
+  for(int k=0; k < p->numWorkers; k++)
+    vs_thread_join(p->workers[k]);
+  vs_cond_destroy(&p->wake);
+  vs_cond_destroy(&p->done);
+  vs_mutex_destroy(&p->lock);
+  vs_free(p->workers);
+  vs_free(p);
+}
+
+int vsThreadPoolSize(const VSThreadPool* p){
+  if(!p)
+    return 1;
+  return p->exec.parallel_for ? 0 : p->numThreads;
+}
+
+/// runs the loop on the pool, false if the pool is busy
+static int poolFor(VSThreadPool* p, int n, vsParallelFn fn, void* ctx){
+  vs_mutex_lock(&p->lock);
+  if(p->busy){
+    vs_mutex_unlock(&p->lock);
+    return 0;
+  }
+  p->busy  = 1;
+  p->fn    = fn;
+  p->ctx   = ctx;
+  p->n     = n;
+  p->next  = 0;
+  // a few chunks per thread: small enough to balance, few enough lock rounds
+  p->chunk = n / (4*p->numThreads) > 0 ? n / (4*p->numThreads) : 1;
+  p->generation++;
+  vs_cond_broadcast(&p->wake);
+  runChunks(p);
+  while(p->running > 0)
+    vs_cond_wait(&p->done, &p->lock);
+  p->busy = 0;
+  vs_mutex_unlock(&p->lock);
+  return 1;
+}
+
+#else /* no VS_USE_THREADPOOL */
+
+struct _vsthreadpool { VSExecutor exec; int execBusy; };
+
+VSThreadPool* vsThreadPoolCreate(int numThreads){
+  (void)numThreads;
+  return NULL;
+}
+
+void vsThreadPoolDestroy(VSThreadPool* p){
+  if(p) // only ever one of vsThreadPoolFromExecutor
+    vs_free(p);
+}
+
+int vsThreadPoolSize(const VSThreadPool* p){
+  return p ? 0 : 1;
+}
+
+#endif /* VS_USE_THREADPOOL */
+
+VSThreadPool* vsThreadPoolFromExecutor(const VSExecutor* exec){
+  if(!exec || !exec->parallel_for)
+    return NULL;
+  VSThreadPool* p = (VSThreadPool*)vs_zalloc(sizeof(VSThreadPool));
+  if(p)
+    p->exec = *exec;
+  return p;
+}
+
+int vsDefaultNumThreads(void){
+#ifdef USE_OMP
+  return omp_get_max_threads();
+#elif defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+#else
+  return 1;
+#endif
+}
+
+void vsParallelFor(VSThreadPool* pool, int numThreads, int n,
+                   vsParallelFn fn, void* ctx){
+  int i;
+  if(n <= 0)
+    return;
+  if(pool && pool->exec.parallel_for){
+    /* A loop of the host never calls back into its executor. A pool belongs
+       to one instance, whose loops are started from one thread at a time, so
+       execBusy is only read by the bodies of the running loop, which the
+       executor orders after the write and before the reset. */
+    if(n == 1 || pool->execBusy){
+      for(i=0; i < n; i++)
+        fn(ctx, i);
+    }else{
+      pool->execBusy = 1;
+      pool->exec.parallel_for(pool->exec.ctx, n, fn, ctx);
+      pool->execBusy = 0;
+    }
+    return;
+  }
+#ifdef VS_USE_THREADPOOL
+  if(pool){
+    if(n == 1 || !poolFor(pool, n, fn, ctx)){ // busy: nested or concurrent
+      for(i=0; i < n; i++)
+        fn(ctx, i);
+    }
+    return;
+  }
+#endif
+#ifdef USE_OMP
+  {
+    int threads = numThreads > 0 ? numThreads : omp_get_max_threads();
+    int chunk = n / (4*threads) > 0 ? n / (4*threads) : 1;
+#pragma omp parallel for num_threads(threads) schedule(dynamic, chunk)
+    for(i=0; i < n; i++)
+      fn(ctx, i);
+  }
+#else
+  (void)numThreads;
+  for(i=0; i < n; i++)
+    fn(ctx, i);
+#endif
+}
@@ -0,0 +1,89 @@
+/*
+ *  threadpool.h
+ *
+ *  Per-instance worker threads for the parallel loops of vid.stab.
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VS_THREADPOOL_H
+#define VS_THREADPOOL_H
+
+#include "vidstab_api.h"
+
+/* A pool is owned by one instance (e.g. VSMotionDetect) and keeps its threads
+   for the lifetime of the instance, so a frame costs no thread creation and
+   no OpenMP team, and nothing global (like omp_set_num_threads) is touched.
+   Several instances in one process each have their own pool.
+
+   The pool is compiled in with VS_USE_THREADPOOL (cmake -DUSE_THREADPOOL=ON,
+   the default), on POSIX threads or the Windows API. Without it, or if the
+   threads cannot be started, vsThreadPoolCreate returns NULL and
+   vsParallelFor falls back to OpenMP (USE_OMP) or runs serially. */
+typedef struct _vsthreadpool VSThreadPool;
+
+/// body of a parallel loop: called once for every index i, in any order
+typedef void (*vsParallelFn)(void* ctx, int i);
+
+/** Parallel loops run by the host application, e.g. on the thread pool it
+ *  already has, instead of threads of vid.stab (see VSMotionDetectConfig and
+ *  VSTransformConfig). parallel_for(ctx, n, fn, arg) has to call fn(arg, i)
+ *  for every i = 0 .. n-1, on any threads and in any order, and return when
+ *  all calls are done. vid.stab never calls it from within one of the fn, but
+ *  several instances may call it at the same time from different threads.
+ *  A zeroed VSExecutor (parallel_for NULL) selects the built-in threads. */
+typedef struct _vsexecutor {
+  void (*parallel_for)(void* ctx, int n, vsParallelFn fn, void* arg);
+  void* ctx;  // passed to parallel_for
+} VSExecutor;
+
+/** starts numThreads-1 worker threads (the caller of vsParallelFor is the
+ *  last one). Returns NULL if numThreads < 2 or no pool is available. */
+VS_API VSThreadPool* vsThreadPoolCreate(int numThreads);
+
+/** a pool that hands every loop to the executor of the host; NULL if
+ *  exec->parallel_for is NULL. Available with and without VS_USE_THREADPOOL. */
+VS_API VSThreadPool* vsThreadPoolFromExecutor(const VSExecutor* exec);
+
+/// stops and joins the workers; NULL is fine
+VS_API void vsThreadPoolDestroy(VSThreadPool* pool);
+
+/// number of threads a job of the pool runs on (1 for NULL, 0 if unknown:
+/// pools of vsThreadPoolFromExecutor)
+VS_API int vsThreadPoolSize(const VSThreadPool* pool);
+
+/** number of threads to use if the caller does not say: the OpenMP default
+ *  with USE_OMP, otherwise the number of online processors */
+VS_API int vsDefaultNumThreads(void);
+
+/** runs fn(ctx, i) for i = 0 .. n-1 and returns when all are done.
+ *  On the pool the indices are handed out in chunks to whichever thread is
+ *  free, so uneven iterations balance out. A call while the pool is already
+ *  running a job -- from one of its own workers (nested loops) or from
+ *  another thread -- runs serially in the calling thread. A pool of
+ *  vsThreadPoolFromExecutor passes the loop on to the host; there only nested
+ *  calls run serially, the pool must not be used from two threads at once.
+ *  Without a pool the loop is an OpenMP loop on numThreads threads (0: OpenMP
+ *  default) or serial. fn must not depend on the order or on the thread it
+ *  runs on. */
+VS_API void vsParallelFor(VSThreadPool* pool, int numThreads, int n,
+                          vsParallelFn fn, void* ctx);
+
+#endif /* VS_THREADPOOL_H */
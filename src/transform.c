@@ -88,6 +88,11 @@ VSTransformConfig vsTransformGetDefaultConfig(const char* modName){
   /* Off: the rotational model needs a number only the user knows, and a wrong
      one is worse than none.  See VSTransformConfig.fov. */
   conf.fov            = 0.0;
+  conf.executor.parallel_for = NULL;
+  conf.executor.ctx   = NULL;
+  conf.numThreads     = 0;
+  conf.lensSampleFrames = 0;
+  conf.l1Window         = 0;
   return conf;
 }
 
@@ -107,7 +112,23 @@ const VSFrameInfo* vsTransformGetDestFrameInfo(const VSTransformData* td){
 
 int vsTransformDataInit(VSTransformData* td, const VSTransformConfig* conf,
                         const VSFrameInfo* fi_src, const VSFrameInfo* fi_dest){
+  return vsTransformDataInitContext(td, conf, fi_src, fi_dest, NULL);
+}
+
+int vsTransformDataInitContext(VSTransformData* td, const VSTransformConfig* conf,
+                               const VSFrameInfo* fi_src, const VSFrameInfo* fi_dest,
+                               const VSContext* ctx){
   td->conf = *conf;
+  if(ctx)
+    td->ctx = *ctx;
+  else
+    vsContextFromGlobals(&td->ctx);
+  if(!td->conf.executor.parallel_for)
+    td->conf.executor = td->ctx.executor;
+  if(td->conf.numThreads <= 0)
+    td->conf.numThreads = td->ctx.numThreads;
+  if(td->conf.numThreads <= 0)
+    td->conf.numThreads = VS_MAX(vsDefaultNumThreads()*0.8, 1);
 
   td->fiSrc = *fi_src;
   td->fiDest = *fi_dest;
@@ -149,6 +170,15 @@ int vsTransformDataInit(VSTransformData* td, const VSTransformConfig* conf,
      (see lensdistortion.h), so -1.0 is never a genuine effective k. */
   td->lensMapK   = -1.0;
   memset(td->lensMaps, 0, sizeof(td->lensMaps));
+  td->fitLensK   = 0.0;
+  td->pool = NULL;
+  if(td->conf.executor.parallel_for){
+    td->pool = vsThreadPoolFromExecutor(&td->conf.executor);
+    if(!td->pool){
+      vs_ctx_log_error(&td->ctx, td->conf.modName, "malloc failed");
+      return VS_ERROR;
+    }
+  }
   return VS_OK;
 }
 
@@ -161,6 +191,8 @@ void vsTransformDataCleanup(VSTransformData* td){
   if (td->conf.crop == VSKeepBorder && !vsFrameIsNull(&td->destbuf)) {
     vsFrameFree(&td->destbuf);
   }
+  vsThreadPoolDestroy(td->pool);
+  td->pool = NULL;
 }
 
 void vsTransformSetLensK(VSTransformData* td, double k){
@@ -188,7 +220,7 @@ void lensEnsureMaps(VSTransformData* td){
     if(vsLensPlaneMapInit(&td->lensMaps[p], &td->fiSrc, &td->fiDest, p, k,
                           k != 0.0 ? td->lensMode : VSLensCorrectOff) != VS_OK){
       int q;
-      vs_log_error(td->conf.modName, "lens map allocation failed, correction off\n");
+      vs_ctx_log_error(&td->ctx, td->conf.modName, "lens map allocation failed, correction off\n");
       for(q=0; q<3; q++) vsLensPlaneMapFree(&td->lensMaps[q]);
       td->lensActive = 0;
       /* Latch off at this k, not at 0.0: k is the effective (nonzero, since
@@ -213,10 +245,10 @@ void lensEnsureMaps(VSTransformData* td){
   /* Once per distinct k, not per frame: the guard above returns early on every
      later call.  Silent when no correction was asked for. */
   if(td->lensActive)
-    vs_log_info(td->conf.modName, "Lens correction: %s, k=%.4f\n",
+    vs_ctx_log_info(&td->ctx, td->conf.modName, "Lens correction: %s, k=%.4f\n",
                 getLensCorrectionModeName(td->lensMode), k);
   else if(td->lensMode != VSLensCorrectOff)
-    vs_log_info(td->conf.modName,
+    vs_ctx_log_info(&td->ctx, td->conf.modName,
                 "Lens correction: %s requested, inactive (no usable distortion estimate)\n",
                 getLensCorrectionModeName(td->lensMode));
 }
@@ -235,7 +267,7 @@ int vsTransformPrepare(VSTransformData* td, const VSFrame* src, VSFrame* dest){
       td->srcMalloced = 1;
     }
     if (vsFrameIsNull(&td->src)) {
-      vs_log_error(td->conf.modName, "vs_malloc failed\n");
+      vs_ctx_log_error(&td->ctx, td->conf.modName, "vs_malloc failed\n");
       return VS_ERROR;
     }
     vsFrameCopy(&td->src, src, &td->fiSrc);
@@ -248,7 +280,7 @@ int vsTransformPrepare(VSTransformData* td, const VSFrame* src, VSFrame* dest){
       //  the previous stabilized frame, so we use destbuf
       vsFrameAllocate(&td->destbuf,&td->fiDest);
       if (vsFrameIsNull(&td->destbuf)) {
-        vs_log_error(td->conf.modName, "vs_malloc failed\n");
+        vs_ctx_log_error(&td->ctx, td->conf.modName, "vs_malloc failed\n");
         return VS_ERROR;
       }
       // if we keep borders, save first frame into the background buffer (destbuf)
@@ -283,7 +315,7 @@ VSTransform vsGetNextTransform(const VSTransformData* td, VSTransformations* tra
   if (trans->current >= trans->len) {
     trans->current = trans->len;
     if(!trans->warned_end)
-      vs_log_warn(td->conf.modName, "not enough transforms found, use last transformation!\n");
+      vs_ctx_log_warn(&td->ctx, td->conf.modName, "not enough transforms found, use last transformation!\n");
     trans->warned_end = 1;
   }else{
     trans->current++;
@@ -327,7 +359,7 @@ int cameraPathOptimization(VSTransformData* td, VSTransformations* trans){
          shorter than 4 frames, without a zoom budget, and if the LP turns out
          to be infeasible. */
       if(cameraPathOptimalL1(td,trans)==VS_OK) return VS_OK;
-      vs_log_msg(td->conf.modName,
+      vs_ctx_log_msg(&td->ctx, td->conf.modName,
                  "L1 camera path optimization unavailable, using gaussian filter");
     }
 #endif // without an LP solver we always use the gaussian filter
@@ -347,7 +379,7 @@ int cameraPathGaussian(VSTransformData* td, VSTransformations* trans){
   if (trans->len < 1)
     return VS_ERROR;
   if (td->conf.verbose & VS_DEBUG) {
-    vs_log_msg(td->conf.modName, "Preprocess transforms:");
+    vs_ctx_log_msg(&td->ctx, td->conf.modName, "Preprocess transforms:");
   }
 
   /* relative to absolute (integrate transformations) */
@@ -362,46 +394,20 @@ int cameraPathGaussian(VSTransformData* td, VSTransformations* trans){
   if (td->conf.smoothing>0) {
     VSTransform* ts2 = vs_malloc(sizeof(VSTransform) * trans->len);
     memcpy(ts2, ts, sizeof(VSTransform) * trans->len);
-    int s = td->conf.smoothing * 2 + 1;
-    VSArray kernel = vs_array_new(s);
-    // initialize gaussian kernel
-    int mu        = td->conf.smoothing;
-    double sigma2 = sqr(mu/2.0);
-    for(int i=0; i<=mu; i++){
-      kernel.dat[i] = kernel.dat[s-i-1] = exp(-sqr(i-mu)/sigma2);
-    }
+    int mu = td->conf.smoothing;
+    VSArray kernel = vs_array_new(mu * 2 + 1);
+    gaussianKernel(kernel.dat, mu);
     // vs_array_print(kernel, stdout);
 
     for (int i = 0; i < trans->len; i++) {
-      // make a convolution:
-      double weightsum=0;
-      VSTransform avg = null_transform();
-      for(int k=0; k<s; k++){
-        int idx = i+k-mu;
-        if(idx>=0 && idx<trans->len){
-          if(unlikely(0 && ts2[idx].extra==1)){ // deal with scene cuts or bad frames
-            if(k<mu) { // in the past of our frame: ignore everthing before
-              avg=null_transform();
-              weightsum=0;
-              continue;
-            }else{           //current frame or in future: stop here
-              if(k==mu)      //for current frame: ignore completely
-                weightsum=0;
-              break;
-            }
-          }
-          weightsum+=kernel.dat[k];
-          avg=add_transforms_(avg, mult_transform(&ts2[idx], kernel.dat[k]));
-        }
-      }
+      double weightsum;
+      VSTransform avg = gaussianPathAvg(ts2, trans->len, i, kernel.dat, mu, &weightsum);
       if(weightsum>0){
-        avg = mult_transform(&avg, 1.0/weightsum);
-
         // high frequency must be transformed away
         ts[i] = sub_transforms(&ts[i], &avg);
       }
       if (td->conf.verbose & VS_DEBUG) {
-        vs_log_msg(td->conf.modName,
+        vs_ctx_log_msg(&td->ctx, td->conf.modName,
                    " avg: %5lf, %5lf, %5lf extra: %i weightsum %5lf",
                    avg.x, avg.y, avg.alpha, ts[i].extra, weightsum
                   );
@@ -413,6 +419,43 @@ int cameraPathGaussian(VSTransformData* td, VSTransformations* trans){
   return VS_OK;
 }
 
+void gaussianKernel(double* kernel, int mu){
+  int s = mu * 2 + 1;
+  double sigma2 = sqr(mu/2.0);
+  for(int i=0; i<=mu; i++){
+    kernel[i] = kernel[s-i-1] = exp(-sqr(i-mu)/sigma2);
+  }
+}
+
+VSTransform gaussianPathAvg(const VSTransform* ts, int len, int i, const double* kernel,
+                            int mu, double* weightsum){
+  // make a convolution:
+  int s = mu * 2 + 1;
+  VSTransform avg = null_transform();
+  *weightsum=0;
+  for(int k=0; k<s; k++){
+    int idx = i+k-mu;
+    if(idx>=0 && idx<len){
+      if(unlikely(0 && ts[idx].extra==1)){ // deal with scene cuts or bad frames
+        if(k<mu) { // in the past of our frame: ignore everthing before
+          avg=null_transform();
+          *weightsum=0;
+          continue;
+        }else{           //current frame or in future: stop here
+          if(k==mu)      //for current frame: ignore completely
+            *weightsum=0;
+          break;
+        }
+      }
+      *weightsum+=kernel[k];
+      avg=add_transforms_(avg, mult_transform(&ts[idx], kernel[k]));
+    }
+  }
+  if(*weightsum>0)
+    avg = mult_transform(&avg, 1.0/ *weightsum);
+  return avg;
+}
+
 /*
  *  We perform a low-pass filter in terms of transformations.
  *  This supports slow camera movement (low frequency), but in a smooth fasion.
@@ -424,7 +467,7 @@ int cameraPathAvg(VSTransformData* td, VSTransformations* trans){
   if (trans->len < 1)
     return VS_ERROR;
   if (td->conf.verbose & VS_DEBUG) {
-   vs_log_msg(td->conf.modName, "Preprocess transforms:");
+   vs_ctx_log_msg(&td->ctx, td->conf.modName, "Preprocess transforms:");
   }
   if (td->conf.smoothing>0) {
     /* smoothing */
@@ -476,11 +519,11 @@ int cameraPathAvg(VSTransformData* td, VSTransformations* trans){
       ts[i] = sub_transforms(&ts[i], &avg2);
 
       if (td->conf.verbose & VS_DEBUG) {
-        vs_log_msg(td->conf.modName,
+        vs_ctx_log_msg(&td->ctx, td->conf.modName,
                    "s_sum: %5lf %5lf %5lf, ts: %5lf, %5lf, %5lf\n",
                    s_sum.x, s_sum.y, s_sum.alpha,
                    ts[i].x, ts[i].y, ts[i].alpha);
-        vs_log_msg(td->conf.modName,
+        vs_ctx_log_msg(&td->ctx, td->conf.modName,
                    "  avg: %5lf, %5lf, %5lf avg2: %5lf, %5lf, %5lf",
                    avg.x, avg.y, avg.alpha,
                    avg2.x, avg2.y, avg2.alpha);
@@ -607,6 +650,20 @@ double vsTransformRequiredZoom(VSTransformData* td, const VSTransform* t){
 }
 
 
+void limitCorrection(const VSTransformData* td, VSTransform* t){
+  /*  invert? */
+  if (td->conf.invert)
+    *t = mult_transform(t, -1);
+
+  /* crop at maximal shift */
+  if (td->conf.maxShift != -1) {
+    t->x     = VS_CLAMP(t->x, -td->conf.maxShift, td->conf.maxShift);
+    t->y     = VS_CLAMP(t->y, -td->conf.maxShift, td->conf.maxShift);
+  }
+  if (td->conf.maxAngle != - 1.0)
+    t->alpha = VS_CLAMP(t->alpha, -td->conf.maxAngle, td->conf.maxAngle);
+}
+
 /**
  * vsPreprocessTransforms: camera path optimization, relative to absolute conversion,
  *  and cropping of too large transforms.
@@ -626,22 +683,8 @@ int vsPreprocessTransforms(VSTransformData* td, VSTransformations* trans)
   // works inplace on trans
   if(cameraPathOptimization(td, trans)!=VS_OK) return VS_ERROR;
   VSTransform* ts = trans->ts;
-  /*  invert? */
-  if (td->conf.invert) {
-    for (int i = 0; i < trans->len; i++) {
-      ts[i] = mult_transform(&ts[i], -1);
-    }
-  }
-
-  /* crop at maximal shift */
-  if (td->conf.maxShift != -1)
-    for (int i = 0; i < trans->len; i++) {
-      ts[i].x     = VS_CLAMP(ts[i].x, -td->conf.maxShift, td->conf.maxShift);
-      ts[i].y     = VS_CLAMP(ts[i].y, -td->conf.maxShift, td->conf.maxShift);
-    }
-  if (td->conf.maxAngle != - 1.0)
-    for (int i = 0; i < trans->len; i++)
-      ts[i].alpha = VS_CLAMP(ts[i].alpha, -td->conf.maxAngle, td->conf.maxAngle);
+  for (int i = 0; i < trans->len; i++)
+    limitCorrection(td, &ts[i]);
 
   /* Calc optimal zoom (1)
    *  cheap algo is to only consider translations
@@ -684,7 +727,7 @@ int vsPreprocessTransforms(VSTransformData* td, VSTransformations* trans)
 
     td->conf.zoom += zoom; // use maximum
     td->conf.zoom = VS_CLAMP(td->conf.zoom,-60,60);
-    vs_log_info(td->conf.modName, "Final zoom: %lf\n", td->conf.zoom);
+    vs_ctx_log_info(&td->ctx, td->conf.modName, "Final zoom: %lf\n", td->conf.zoom);
   }
   /* Calc optimal zoom (2)
    *  sliding average to zoom only as much as needed also using rotation angles
@@ -36,6 +36,8 @@
 #include "vidstabdefines.h"
 #include "vidstab_api.h"
 #include "lensmap.h"
+#include "threadpool.h"
+#include "vscontext.h"
 #ifdef TESTING
 #include "transformfloat.h"
 #endif
@@ -141,9 +143,25 @@ typedef struct _VSTransformConfig {
      * any lens correction, and after any crop or anamorphic squeeze -- not
      * the number on the lens barrel.  A wrong value is worse than 0. */
     double            fov;
-    /* The L1 optimal camera path (VSOptimalL1) has no parameters of its own:
-     * it reads its zoom budget off zoom/optZoom and its horizon off smoothing,
-     * see vsL1ConfigFromTransformConfig(). */
+    /* The L1 optimal camera path (VSOptimalL1) reads its zoom budget off
+     * zoom/optZoom and its horizon off smoothing, see
+     * vsL1ConfigFromTransformConfig(); l1Window below is its only own
+     * parameter. */
+    /* Parallel loops of the host application (see threadpool.h) for the rows
+     * of transformPlanar/transformPacked; zeroed (the default): OpenMP. */
+    VSExecutor        executor;
+    /* Threads of the OpenMP loops over the rows when there is no executor;
+     * 0 (the default): the numThreads of the context, else as the motion
+     * detection (VSMotionDetectConfig.numThreads). */
+    int               numThreads;
+    /* Frames vsStreamMotions2Transforms keeps, as a reservoir sample, for the
+     * lens estimate of a clip it does not hold; 0 (the default): 1000. */
+    int               lensSampleFrames;
+    /* Frames of the windows the L1 camera path is solved over, one after
+     * another, each keeping the first half of its solution (see
+     * VSL1Config.window); bounds memory and time on long clips. 0 (the
+     * default): the whole clip in one program. */
+    int               l1Window;
 } VSTransformConfig;
 
 typedef struct _VSTransformData {
@@ -173,6 +191,11 @@ typedef struct _VSTransformData {
     double            lensMapK;   /* k the maps were built for; see lensEnsureMaps() for
                                       the sentinel that means "no map built yet" */
     VSLensPlaneMap    lensMaps[3];
+    double            fitLensK;   /* k the transforms were fitted through, 0.0 if
+                                      none; stored with them (vsWriteTransformsToFile) */
+
+    VSThreadPool*     pool;       /* of conf.executor, NULL: OpenMP on conf.numThreads */
+    VSContext         ctx;        /* logger and executor default, see vscontext.h */
 
     int initialized; // 1 if initialized and 2 if configured
 } VSTransformData;
@@ -219,6 +242,13 @@ VS_API VSTransformConfig vsTransformGetDefaultConfig(const char* modName);
 VS_API int vsTransformDataInit(VSTransformData* td, const VSTransformConfig* conf,
                         const VSFrameInfo* fi_src, const VSFrameInfo* fi_dest);
 
+/** vsTransformDataInit with the logger and executor default of ctx (copied,
+ *  see vscontext.h) instead of the process-wide ones; NULL: as
+ *  vsTransformDataInit */
+VS_API int vsTransformDataInitContext(VSTransformData* td, const VSTransformConfig* conf,
+                                      const VSFrameInfo* fi_src, const VSFrameInfo* fi_dest,
+                                      const VSContext* ctx);
+
 
 /** Deletes internal data structures.
  * In order to use the VSTransformData again, you have to call vsTransformDataInit
@@ -45,6 +45,23 @@ VS_API int cameraPathAvg(VSTransformData* td, VSTransformations* trans);
 VS_API int cameraPathGaussian(VSTransformData* td, VSTransformations* trans);
 VS_API int cameraPathOptimalL1(VSTransformData* td, VSTransformations* trans);
 
+/** the weights of the gaussian camera path filter, 2*mu+1 of them */
+void gaussianKernel(double* kernel, int mu);
+
+/** the gaussian average of the camera path ts (len frames) around frame i,
+    over the frames of the window that exist; weightsum is the sum of their
+    weights (0: the average is null) */
+VSTransform gaussianPathAvg(const VSTransform* ts, int len, int i, const double* kernel,
+                            int mu, double* weightsum);
+
+/** inverts (conf.invert) and crops (maxShift, maxAngle) a correction, as
+    vsPreprocessTransforms does after the camera path */
+void limitCorrection(const VSTransformData* td, VSTransform* t);
+
+/** frames vsStreamMotions2Transforms samples for the lens estimate of td
+    (conf.lensSampleFrames or its default), 0 if it does not estimate it */
+int lensSampleSize(const VSTransformData* td);
+
 /** Builds (or rebuilds) td->lensMaps for the current td->lensK, if needed. */
 void lensEnsureMaps(VSTransformData* td);
 
@@ -30,6 +30,7 @@
 #include "transform.h"
 #include "transform_internal.h"
 #include "transformtype_operations.h"
+#include <string.h>
 
 //#include <math.h>
 //#include <libgen.h>
@@ -340,9 +341,96 @@ static void interpolateNall(uint8_t *dest, fp16 x, fp16 y,
  * Preconditions:
  *  The frame must be in Packed format
  */
+/* The loop invariants of transformPacked, one row of it is one index of
+   vsParallelFor (see VSTransformConfig.executor). */
+typedef struct {
+  VSTransformData* td;
+  const uint8_t *D_1;
+  uint8_t *D_2;
+  fp16 c_s_x, c_s_y;
+  int32_t c_d_x, c_d_y;
+  fp16 zcos_a, zsin_a, c_tx, c_ty;
+  int channels;
+  const VSLensPlaneMap* lm;
+  int lensOn, wobble, lsx, lsy;
+  int64_t domR2;
+  double fFov, fovS;
+  double rb[9];
+} TransformPackedRows;
+
+static void transformPackedRow(void* ctx, int y)
+{
+  const TransformPackedRows* r = (const TransformPackedRows*)ctx;
+  const VSTransformData* td = r->td;
+  const uint8_t *D_1 = r->D_1;
+  uint8_t *D_2 = r->D_2;
+  const fp16 c_s_x = r->c_s_x, c_s_y = r->c_s_y;
+  const int32_t c_d_x = r->c_d_x, c_d_y = r->c_d_y;
+  const fp16 zcos_a = r->zcos_a, zsin_a = r->zsin_a, c_tx = r->c_tx, c_ty = r->c_ty;
+  const int channels = r->channels;
+  const VSLensPlaneMap* lm = r->lm;
+  const int lensOn = r->lensOn, wobble = r->wobble, lsx = r->lsx, lsy = r->lsy;
+  const int64_t domR2 = r->domR2;
+  const double fFov = r->fFov, fovS = r->fovS;
+  const double* rb = r->rb;
+  int32_t y_d1 = (y - c_d_y);
+  int x;
+  /* row-constant half of the projection; see transformPlanar */
+  double fovXr = 0.0, fovYr = 0.0, fovZr = 0.0;
+  if (fFov > 0.0 && !wobble) {
+    double ly = fp16ToF(iToFp16(y_d1));
+    fovXr = rb[1]*ly + rb[2]*fFov;
+    fovYr = rb[4]*ly + rb[5]*fFov;
+    fovZr = rb[7]*ly + rb[8]*fFov;
+  }
+  for (x = 0; x < td->fiDest.width; x++) {
+    int32_t x_d1 = (x - c_d_x);
+    fp16 dx = iToFp16(x_d1), dy = iToFp16(y_d1);
+    fp16 x_s, y_s;
+    if (wobble) {
+      int64_t lx = (int64_t)dx * (1 << lsx), ly = (int64_t)dy * (1 << lsy);
+      int32_t g  = vsLensLutFp(lm->gU, lx*lx + ly*ly, lm->idxScaleU);
+      dx = (fp16)(((int64_t)dx * g) >> 16);
+      dy = (fp16)(((int64_t)dy * g) >> 16);
+    }
+    if (fFov > 0.0) {
+      double lx = fp16ToF(dx);
+      double Xr = fovXr, Yr = fovYr, Zr = fovZr, invZ;
+      if (wobble) {   /* dy is per-pixel here, so the row hoist does not hold */
+        double ly = fp16ToF(dy);
+        Xr = rb[1]*ly + rb[2]*fFov;
+        Yr = rb[4]*ly + rb[5]*fFov;
+        Zr = rb[7]*ly + rb[8]*fFov;
+      }
+      invZ = 1.0 / (rb[6]*lx + Zr);
+      x_s = fToFp16(fovS * (rb[0]*lx + Xr) * invZ) + c_s_x;
+      y_s = fToFp16(fovS * (rb[3]*lx + Yr) * invZ) + c_s_y;
+    } else {
+    x_s = (fp16)((((int64_t)zcos_a*dx + (int64_t)zsin_a*dy) >> 16)) + c_tx;
+    y_s = (fp16)(((-(int64_t)zsin_a*dx + (int64_t)zcos_a*dy) >> 16)) + c_ty;
+    }
+    if (lensOn) {
+      int64_t ex = x_s - c_s_x, ey = y_s - c_s_y;
+      int64_t lx = ex * (1 << lsx), ly = ey * (1 << lsy);
+      int64_t r2 = lx*lx + ly*ly;
+      if (r2 > domR2) { x_s = iToFp16(VS_LENS_OUTSIDE_PX); y_s = iToFp16(VS_LENS_OUTSIDE_PX); }
+      else {
+        int32_t g = vsLensLutFp(lm->gD, r2, lm->idxScaleD);
+        x_s = (fp16)(c_s_x + ((ex * g) >> 16));
+        y_s = (fp16)(c_s_y + ((ey * g) >> 16));
+      }
+    }
+
+    // linesize is in bytes, only the column is scaled by the channel count
+    interpolateNall(&D_2[x * channels + y * td->destbuf.linesize[0]],
+                    x_s, y_s, D_1, td->src.linesize[0],
+                    td->fiSrc.width, td->fiSrc.height,
+                    channels, td->conf.crop);
+  }
+}
+
 int transformPacked(VSTransformData* td, VSTransform t)
 {
-  int y = 0;
   uint8_t *D_1, *D_2;
 
   lensEnsureMaps(td);
@@ -409,66 +497,177 @@ int transformPacked(VSTransformData* td, VSTransform t)
   }
 
   /* All channels.  Rows are independent; see transformPlanar. */
-#ifdef USE_OMP
-#pragma omp parallel for schedule(static)
-#endif
-  for (y = 0; y < td->fiDest.height; y++) {
-    int32_t y_d1 = (y - c_d_y);
-    int x;
-    /* row-constant half of the projection; see transformPlanar */
-    double fovXr = 0.0, fovYr = 0.0, fovZr = 0.0;
-    if (fFov > 0.0 && !wobble) {
-      double ly = fp16ToF(iToFp16(y_d1));
-      fovXr = rb[1]*ly + rb[2]*fFov;
-      fovYr = rb[4]*ly + rb[5]*fFov;
-      fovZr = rb[7]*ly + rb[8]*fFov;
+  TransformPackedRows rows = { td, D_1, D_2, c_s_x, c_s_y, c_d_x, c_d_y,
+                               zcos_a, zsin_a, c_tx, c_ty, channels, lm,
+                               lensOn, wobble, lsx, lsy, domR2, fFov, fovS };
+  memcpy(rows.rb, rb, sizeof(rb));
+  vsParallelFor(td->pool, td->conf.numThreads, td->fiDest.height, transformPackedRow, &rows);
+  return VS_OK;
+}
+
+/* The loop invariants of one plane of transformPlanar, one row of it is one
+   index of vsParallelFor (see VSTransformConfig.executor). */
+typedef struct {
+  VSTransformData* td;
+  const uint8_t *dat_1;
+  uint8_t *dat_2;
+  int plane, dw, sw, sh;
+  uint8_t black;
+  fp16 c_s_x, c_s_y;
+  int32_t c_d_x, c_d_y;
+  fp16 zcos_a, zsin_xy, zsin_yx, c_tx, c_ty;
+  const VSLensPlaneMap* lm;
+  int lensOn, wobble, lsx, lsy;
+  int64_t domR2;
+  double fFov, fovSx, fovSy, lxScale, lyScale;
+  double rb[9];
+} TransformPlanarRows;
+
+static void transformPlanarRow(void* ctx, int y)
+{
+  const TransformPlanarRows* r = (const TransformPlanarRows*)ctx;
+  const VSTransformData* td = r->td;
+  const uint8_t *dat_1 = r->dat_1;
+  uint8_t *dat_2 = r->dat_2;
+  const int plane = r->plane, dw = r->dw, sw = r->sw, sh = r->sh;
+  const uint8_t black = r->black;
+  const fp16 c_s_x = r->c_s_x, c_s_y = r->c_s_y;
+  const int32_t c_d_x = r->c_d_x, c_d_y = r->c_d_y;
+  const fp16 zcos_a = r->zcos_a, zsin_xy = r->zsin_xy, zsin_yx = r->zsin_yx;
+  const fp16 c_tx = r->c_tx, c_ty = r->c_ty;
+  const VSLensPlaneMap* lm = r->lm;
+  const int lensOn = r->lensOn, wobble = r->wobble, lsx = r->lsx, lsy = r->lsy;
+  const int64_t domR2 = r->domR2;
+  const double fFov = r->fFov, fovSx = r->fovSx, fovSy = r->fovSy;
+  const double lxScale = r->lxScale, lyScale = r->lyScale;
+  const double* rb = r->rb;
+  // swapping of the loops brought 15% performace gain
+  int32_t y_d1 = (y - c_d_y);
+  int32_t x;
+  /* The ly half of the fov projection is constant along a row -- but only
+     while dy is, which wobble breaks by rescaling dy per pixel.  Hoist it
+     for the other cases; the values are identical to the per-pixel ones,
+     same operands in the same order, so nothing moves in the output. */
+  double fovXr = 0.0, fovYr = 0.0, fovZr = 0.0;
+  if (fFov > 0.0 && !wobble) {
+    double ly = fp16ToF(iToFp16(y_d1)) * lyScale;
+    fovXr = rb[1]*ly + rb[2]*fFov;
+    fovYr = rb[4]*ly + rb[5]*fFov;
+    fovZr = rb[7]*ly + rb[8]*fFov;
+  }
+  /* Wobble's undistort radius, stepped rather than recomputed.  Its input
+     is the destination pixel itself, so along a row lx grows by exactly
+     Lx = 1<<(16+lsx) per column and r2u = lx^2 + ly^2 is a quadratic in x
+     -- a quadratic is generated exactly by two running adds, so the two
+     64-bit squarings per pixel become two 64-bit additions.  All integer,
+     so this is the same sequence of r2u values to the bit, not an
+     approximation of it.  (The distort stage below cannot use this: its
+     input is x_s, which wobble has already put through a non-linear
+     scaling.) */
+  int64_t r2u = 0, r2uStep = 0, r2uStep2 = 0;
+  if (wobble) {
+    int64_t Lx  = (int64_t)1 << (16 + lsx);
+    int64_t lx0 = (int64_t)iToFp16(0 - c_d_x) * (1 << lsx);
+    int64_t ly0 = (int64_t)iToFp16(y_d1)      * (1 << lsy);
+    r2u       = lx0*lx0 + ly0*ly0;
+    r2uStep   = 2*lx0*Lx + Lx*Lx;
+    r2uStep2  = 2*Lx*Lx;
+  }
+  /* On the plain similarity path (no wobble ahead of it, no fov) the whole
+     backward map is affine in x, so x_s and y_s can be stepped too.  This
+     is exact, not merely close: dx is x_d1<<16, whose low 16 bits are
+     zero, so
+         (zcos_a*(x_d1<<16) + zsin_xy*dy) >> 16
+       = zcos_a*x_d1 + (zsin_xy*dy >> 16)
+     -- the arithmetic shift floors, and it floors the same way whether the
+     first term is inside or outside it.  So consecutive x_s differ by
+     exactly zcos_a and consecutive y_s by exactly -zsin_yx.  And with ex,
+     ey then linear in x, the distort stage's radius is a quadratic in x,
+     steppable by the same two-add scheme as r2u above. */
+  const int plain = (!wobble && fFov <= 0.0);
+  fp16 xsInc = 0, ysInc = 0;
+  int64_t r2d = 0, r2dStep = 0, r2dStep2 = 0;
+  if (plain) {
+    fp16 dx0 = iToFp16(0 - c_d_x), dy0 = iToFp16(y_d1);
+    xsInc = (fp16)((( (int64_t)zcos_a *dx0 + (int64_t)zsin_xy*dy0) >> 16)) + c_tx;
+    ysInc = (fp16)(((-(int64_t)zsin_yx*dx0 + (int64_t)zcos_a *dy0) >> 16)) + c_ty;
+    if (lensOn) {
+      int64_t lx0 = (int64_t)(xsInc - c_s_x) * (1 << lsx);
+      int64_t ly0 = (int64_t)(ysInc - c_s_y) * (1 << lsy);
+      int64_t dlx = (int64_t)zcos_a  * (1 << lsx);
+      int64_t dly = -(int64_t)zsin_yx * (1 << lsy);
+      r2d      = lx0*lx0 + ly0*ly0;
+      r2dStep  = 2*lx0*dlx + dlx*dlx + 2*ly0*dly + dly*dly;
+      r2dStep2 = 2*(dlx*dlx + dly*dly);
+    }
+  }
+  for (x = 0; x < dw; x++) {
+    int32_t x_d1 = (x - c_d_x);
+    fp16 dx = iToFp16(x_d1), dy = iToFp16(y_d1);
+    fp16 x_s, y_s;
+    if (wobble) {
+      int32_t g = vsLensLutFp(lm->gU, r2u, lm->idxScaleU);
+      r2u      += r2uStep;      /* see the row prologue */
+      r2uStep  += r2uStep2;
+      dx = (fp16)(((int64_t)dx * g) >> 16);
+      dy = (fp16)(((int64_t)dy * g) >> 16);
     }
-    for (x = 0; x < td->fiDest.width; x++) {
-      int32_t x_d1 = (x - c_d_x);
-      fp16 dx = iToFp16(x_d1), dy = iToFp16(y_d1);
-      fp16 x_s, y_s;
-      if (wobble) {
-        int64_t lx = (int64_t)dx * (1 << lsx), ly = (int64_t)dy * (1 << lsy);
-        int32_t g  = vsLensLutFp(lm->gU, lx*lx + ly*ly, lm->idxScaleU);
-        dx = (fp16)(((int64_t)dx * g) >> 16);
-        dy = (fp16)(((int64_t)dy * g) >> 16);
+    /* The rotation terms are 16.16; multiplying by a 16.16 offset needs the
+       extra shift the integer form did not.  One expression serves both
+       paths: with the lens off, dx is exactly x_d1<<16, so
+       (zcos_a*(x_d1<<16))>>16 == zcos_a*x_d1 with no rounding at all --
+       the int64 intermediate only removes an overflow risk that the
+       wobble scaling introduces. */
+    if (fFov > 0.0) {
+      double lx = fp16ToF(dx) * lxScale;
+      double Xr = fovXr, Yr = fovYr, Zr = fovZr, invZ;
+      if (wobble) {   /* dy is per-pixel here, so the row hoist does not hold */
+        double ly = fp16ToF(dy) * lyScale;
+        Xr = rb[1]*ly + rb[2]*fFov;
+        Yr = rb[4]*ly + rb[5]*fFov;
+        Zr = rb[7]*ly + rb[8]*fFov;
       }
-      if (fFov > 0.0) {
-        double lx = fp16ToF(dx);
-        double Xr = fovXr, Yr = fovYr, Zr = fovZr, invZ;
-        if (wobble) {   /* dy is per-pixel here, so the row hoist does not hold */
-          double ly = fp16ToF(dy);
-          Xr = rb[1]*ly + rb[2]*fFov;
-          Yr = rb[4]*ly + rb[5]*fFov;
-          Zr = rb[7]*ly + rb[8]*fFov;
-        }
-        invZ = 1.0 / (rb[6]*lx + Zr);
-        x_s = fToFp16(fovS * (rb[0]*lx + Xr) * invZ) + c_s_x;
-        y_s = fToFp16(fovS * (rb[3]*lx + Yr) * invZ) + c_s_y;
+      invZ = 1.0 / (rb[6]*lx + Zr);
+      x_s = fToFp16(fovSx * (rb[0]*lx + Xr) * invZ) + c_s_x;
+      y_s = fToFp16(fovSy * (rb[3]*lx + Yr) * invZ) + c_s_y;
+    } else if (plain) {
+      x_s = xsInc;  xsInc += zcos_a;    /* exact; see the row prologue */
+      y_s = ysInc;  ysInc -= zsin_yx;
+    } else {
+    x_s = (fp16)((((int64_t)zcos_a *dx + (int64_t)zsin_xy*dy) >> 16)) + c_tx;
+    y_s = (fp16)(((-(int64_t)zsin_yx*dx + (int64_t)zcos_a *dy) >> 16)) + c_ty;
+    }
+    if (lensOn) {
+      int64_t ex = x_s - c_s_x, ey = y_s - c_s_y;
+      int64_t r2;
+      if (plain) {
+        r2 = r2d;                       /* stepped, not squared */
+        r2d     += r2dStep;
+        r2dStep += r2dStep2;
       } else {
-      x_s = (fp16)((((int64_t)zcos_a*dx + (int64_t)zsin_a*dy) >> 16)) + c_tx;
-      y_s = (fp16)(((-(int64_t)zsin_a*dx + (int64_t)zcos_a*dy) >> 16)) + c_ty;
-      }
-      if (lensOn) {
-        int64_t ex = x_s - c_s_x, ey = y_s - c_s_y;
         int64_t lx = ex * (1 << lsx), ly = ey * (1 << lsy);
-        int64_t r2 = lx*lx + ly*ly;
-        if (r2 > domR2) { x_s = iToFp16(VS_LENS_OUTSIDE_PX); y_s = iToFp16(VS_LENS_OUTSIDE_PX); }
-        else {
-          int32_t g = vsLensLutFp(lm->gD, r2, lm->idxScaleD);
-          x_s = (fp16)(c_s_x + ((ex * g) >> 16));
-          y_s = (fp16)(c_s_y + ((ey * g) >> 16));
-        }
+        r2 = lx*lx + ly*ly;
+      }
+      if (r2 > domR2) { x_s = iToFp16(VS_LENS_OUTSIDE_PX); y_s = iToFp16(VS_LENS_OUTSIDE_PX); }
+      else {
+        int32_t g = vsLensLutFp(lm->gD, r2, lm->idxScaleD);
+        x_s = (fp16)(c_s_x + ((ex * g) >> 16));
+        y_s = (fp16)(c_s_y + ((ey * g) >> 16));
       }
-
-      // linesize is in bytes, only the column is scaled by the channel count
-      interpolateNall(&D_2[x * channels + y * td->destbuf.linesize[0]],
-                      x_s, y_s, D_1, td->src.linesize[0],
-                      td->fiSrc.width, td->fiSrc.height,
-                      channels, td->conf.crop);
     }
+    uint8_t *dest = &dat_2[x + y * td->destbuf.linesize[plane]];
+    /* This used to read "inlining the interpolation function would bring
+       10% (but then we cannot use the function pointer anymore...)".  It
+       was tried: calling interpolateBiLin directly for the default type
+       and keeping the pointer for the other three is consistently SLOWER
+       on a modern compiler -- 20.7 -> 23.2 ms/frame at 1080p lens=full,
+       and slower at every thread count.  The indirect call predicts
+       perfectly, while the inlined body costs I-cache and registers in a
+       loop that is already register-hungry.  See docs/simd.md. */
+    td->interpolate(dest, x_s, y_s, dat_1,
+                    td->src.linesize[plane], sw, sh,
+                    td->conf.crop ? black : *dest);
   }
-  return VS_OK;
 }
 
 /**
@@ -488,7 +687,6 @@ int transformPacked(VSTransformData* td, VSTransform t)
  */
 int transformPlanar(VSTransformData* td, VSTransform t)
 {
-  int32_t y = 0;
   uint8_t *dat_1, *dat_2;
 
   lensEnsureMaps(td);
@@ -594,138 +792,13 @@ int transformPlanar(VSTransformData* td, VSTransform t)
        *dest, but only the very pixel it is about to write.  This is the whole
        of the stage's parallelism and it was not being used -- unlike motion
        detection and the blur, the transform ran on one core. */
-#ifdef USE_OMP
-#pragma omp parallel for schedule(static)
-#endif
-    for (y = 0; y < dh; y++) {
-      // swapping of the loops brought 15% performace gain
-      int32_t y_d1 = (y - c_d_y);
-      int32_t x;
-      /* The ly half of the fov projection is constant along a row -- but only
-         while dy is, which wobble breaks by rescaling dy per pixel.  Hoist it
-         for the other cases; the values are identical to the per-pixel ones,
-         same operands in the same order, so nothing moves in the output. */
-      double fovXr = 0.0, fovYr = 0.0, fovZr = 0.0;
-      if (fFov > 0.0 && !wobble) {
-        double ly = fp16ToF(iToFp16(y_d1)) * lyScale;
-        fovXr = rb[1]*ly + rb[2]*fFov;
-        fovYr = rb[4]*ly + rb[5]*fFov;
-        fovZr = rb[7]*ly + rb[8]*fFov;
-      }
-      /* Wobble's undistort radius, stepped rather than recomputed.  Its input
-         is the destination pixel itself, so along a row lx grows by exactly
-         Lx = 1<<(16+lsx) per column and r2u = lx^2 + ly^2 is a quadratic in x
-         -- a quadratic is generated exactly by two running adds, so the two
-         64-bit squarings per pixel become two 64-bit additions.  All integer,
-         so this is the same sequence of r2u values to the bit, not an
-         approximation of it.  (The distort stage below cannot use this: its
-         input is x_s, which wobble has already put through a non-linear
-         scaling.) */
-      int64_t r2u = 0, r2uStep = 0, r2uStep2 = 0;
-      if (wobble) {
-        int64_t Lx  = (int64_t)1 << (16 + lsx);
-        int64_t lx0 = (int64_t)iToFp16(0 - c_d_x) * (1 << lsx);
-        int64_t ly0 = (int64_t)iToFp16(y_d1)      * (1 << lsy);
-        r2u       = lx0*lx0 + ly0*ly0;
-        r2uStep   = 2*lx0*Lx + Lx*Lx;
-        r2uStep2  = 2*Lx*Lx;
-      }
-      /* On the plain similarity path (no wobble ahead of it, no fov) the whole
-         backward map is affine in x, so x_s and y_s can be stepped too.  This
-         is exact, not merely close: dx is x_d1<<16, whose low 16 bits are
-         zero, so
-             (zcos_a*(x_d1<<16) + zsin_xy*dy) >> 16
-           = zcos_a*x_d1 + (zsin_xy*dy >> 16)
-         -- the arithmetic shift floors, and it floors the same way whether the
-         first term is inside or outside it.  So consecutive x_s differ by
-         exactly zcos_a and consecutive y_s by exactly -zsin_yx.  And with ex,
-         ey then linear in x, the distort stage's radius is a quadratic in x,
-         steppable by the same two-add scheme as r2u above. */
-      const int plain = (!wobble && fFov <= 0.0);
-      fp16 xsInc = 0, ysInc = 0;
-      int64_t r2d = 0, r2dStep = 0, r2dStep2 = 0;
-      if (plain) {
-        fp16 dx0 = iToFp16(0 - c_d_x), dy0 = iToFp16(y_d1);
-        xsInc = (fp16)((( (int64_t)zcos_a *dx0 + (int64_t)zsin_xy*dy0) >> 16)) + c_tx;
-        ysInc = (fp16)(((-(int64_t)zsin_yx*dx0 + (int64_t)zcos_a *dy0) >> 16)) + c_ty;
-        if (lensOn) {
-          int64_t lx0 = (int64_t)(xsInc - c_s_x) * (1 << lsx);
-          int64_t ly0 = (int64_t)(ysInc - c_s_y) * (1 << lsy);
-          int64_t dlx = (int64_t)zcos_a  * (1 << lsx);
-          int64_t dly = -(int64_t)zsin_yx * (1 << lsy);
-          r2d      = lx0*lx0 + ly0*ly0;
-          r2dStep  = 2*lx0*dlx + dlx*dlx + 2*ly0*dly + dly*dly;
-          r2dStep2 = 2*(dlx*dlx + dly*dly);
-        }
-      }
-      for (x = 0; x < dw; x++) {
-        int32_t x_d1 = (x - c_d_x);
-        fp16 dx = iToFp16(x_d1), dy = iToFp16(y_d1);
-        fp16 x_s, y_s;
-        if (wobble) {
-          int32_t g = vsLensLutFp(lm->gU, r2u, lm->idxScaleU);
-          r2u      += r2uStep;      /* see the row prologue */
-          r2uStep  += r2uStep2;
-          dx = (fp16)(((int64_t)dx * g) >> 16);
-          dy = (fp16)(((int64_t)dy * g) >> 16);
-        }
-        /* The rotation terms are 16.16; multiplying by a 16.16 offset needs the
-           extra shift the integer form did not.  One expression serves both
-           paths: with the lens off, dx is exactly x_d1<<16, so
-           (zcos_a*(x_d1<<16))>>16 == zcos_a*x_d1 with no rounding at all --
-           the int64 intermediate only removes an overflow risk that the
-           wobble scaling introduces. */
-        if (fFov > 0.0) {
-          double lx = fp16ToF(dx) * lxScale;
-          double Xr = fovXr, Yr = fovYr, Zr = fovZr, invZ;
-          if (wobble) {   /* dy is per-pixel here, so the row hoist does not hold */
-            double ly = fp16ToF(dy) * lyScale;
-            Xr = rb[1]*ly + rb[2]*fFov;
-            Yr = rb[4]*ly + rb[5]*fFov;
-            Zr = rb[7]*ly + rb[8]*fFov;
-          }
-          invZ = 1.0 / (rb[6]*lx + Zr);
-          x_s = fToFp16(fovSx * (rb[0]*lx + Xr) * invZ) + c_s_x;
-          y_s = fToFp16(fovSy * (rb[3]*lx + Yr) * invZ) + c_s_y;
-        } else if (plain) {
-          x_s = xsInc;  xsInc += zcos_a;    /* exact; see the row prologue */
-          y_s = ysInc;  ysInc -= zsin_yx;
-        } else {
-        x_s = (fp16)((((int64_t)zcos_a *dx + (int64_t)zsin_xy*dy) >> 16)) + c_tx;
-        y_s = (fp16)(((-(int64_t)zsin_yx*dx + (int64_t)zcos_a *dy) >> 16)) + c_ty;
-        }
-        if (lensOn) {
-          int64_t ex = x_s - c_s_x, ey = y_s - c_s_y;
-          int64_t r2;
-          if (plain) {
-            r2 = r2d;                       /* stepped, not squared */
-            r2d     += r2dStep;
-            r2dStep += r2dStep2;
-          } else {
-            int64_t lx = ex * (1 << lsx), ly = ey * (1 << lsy);
-            r2 = lx*lx + ly*ly;
-          }
-          if (r2 > domR2) { x_s = iToFp16(VS_LENS_OUTSIDE_PX); y_s = iToFp16(VS_LENS_OUTSIDE_PX); }
-          else {
-            int32_t g = vsLensLutFp(lm->gD, r2, lm->idxScaleD);
-            x_s = (fp16)(c_s_x + ((ex * g) >> 16));
-            y_s = (fp16)(c_s_y + ((ey * g) >> 16));
-          }
-        }
-        uint8_t *dest = &dat_2[x + y * td->destbuf.linesize[plane]];
-        /* This used to read "inlining the interpolation function would bring
-           10% (but then we cannot use the function pointer anymore...)".  It
-           was tried: calling interpolateBiLin directly for the default type
-           and keeping the pointer for the other three is consistently SLOWER
-           on a modern compiler -- 20.7 -> 23.2 ms/frame at 1080p lens=full,
-           and slower at every thread count.  The indirect call predicts
-           perfectly, while the inlined body costs I-cache and registers in a
-           loop that is already register-hungry.  See docs/simd.md. */
-        td->interpolate(dest, x_s, y_s, dat_1,
-                        td->src.linesize[plane], sw, sh,
-                        td->conf.crop ? black : *dest);
-      }
-    }
+    TransformPlanarRows rows = { td, dat_1, dat_2, plane, dw, sw, sh, black,
+                                 c_s_x, c_s_y, c_d_x, c_d_y, zcos_a, zsin_xy,
+                                 zsin_yx, c_tx, c_ty, lm, lensOn, wobble, lsx,
+                                 lsy, domR2, fFov, fovSx, fovSy, lxScale,
+                                 lyScale };
+    memcpy(rows.rb, rb, sizeof(rb));
+    vsParallelFor(td->pool, td->conf.numThreads, dh, transformPlanarRow, &rows);
   }
 
   return VS_OK;
@@ -512,12 +512,27 @@ LocalMotion sub_localmotion(const LocalMotion* lm1, const LocalMotion* lm2){
  */
 LocalMotion cleanmean_localmotions(const LocalMotions* localmotions)
 {
-  int len = vs_vector_size(localmotions);
+  VSMotionSet motions;
+  LocalMotion m = null_localmotion();
+  if(vs_motionset_from_vector(&motions, localmotions) != VS_OK)
+    return m;
+  m = cleanmean_motionset(&motions);
+  vs_motionset_fini(&motions);
+  return m;
+}
+
+LocalMotion cleanmean_motionset(const VSMotionSet* motions)
+{
+  int len = motions->num;
   int i, cut = len / 5;
-  int* xs = localmotions_getx(localmotions);
-  int* ys = localmotions_gety(localmotions);
+  int* xs = (int*)vs_malloc(sizeof(int) * 2 * len);
+  int* ys = xs + len;
   LocalMotion m = null_localmotion();
   m.v.x=0; m.v.y=0;
+  for (i = 0; i < len; i++){
+    xs[i] = motions->lms[i].v.x;
+    ys[i] = motions->lms[i].v.y;
+  }
   qsort(xs,len, sizeof(int), cmp_int);
   for (i = cut; i < len - cut; i++){ // all but cutted
     m.v.x += xs[i];
@@ -527,7 +542,6 @@ LocalMotion cleanmean_localmotions(const LocalMotions* localmotions)
     m.v.y += ys[i];
   }
   vs_free(xs);
-  vs_free(ys);
   m.v.x/=(len - (2.0 * cut));
   m.v.y/=(len - (2.0 * cut));
   return m;
@@ -541,6 +555,14 @@ VSArray localmotionsGetMatch(const LocalMotions* localmotions){
   return m;
 }
 
+VSArray motionsetGetMatch(const VSMotionSet* motions){
+  VSArray m = vs_array_new(motions->num);
+  for (int i=0; i<m.len; i++){
+    m.dat[i]=motions->lms[i].match;
+  }
+  return m;
+}
+
 
 /*
  * Local variables:
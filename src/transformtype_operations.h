@@ -28,6 +28,7 @@
 #include "transformtype.h"
 #include "vidstabdefines.h"
 #include "vsvector.h"
+#include "motionset.h"
 #include "frameinfo.h"
 #include "vidstab_api.h"
 
@@ -169,8 +170,12 @@ VS_API LocalMotion sub_localmotion(const LocalMotion* lm1, const LocalMotion* lm
  * considerung only v.x and v.y
  */
 VS_API LocalMotion cleanmean_localmotions(const LocalMotions* localmotions);
+/// cleanmean_localmotions of a motion set
+VS_API LocalMotion cleanmean_motionset(const VSMotionSet* motions);
 
 VS_API VSArray localmotionsGetMatch(const LocalMotions* localmotions);
+/// the match values of the motions of a set
+VS_API VSArray motionsetGetMatch(const VSMotionSet* motions);
 
 /* helper functions */
 
@@ -0,0 +1,662 @@
+/*
+ * trffile.c -- random access to the frames of a binary .trf file, and a
+ *               buffered writer for it
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ */
+
+#include "trffile.h"
+#include "localmotion2transform.h"
+#include "serialize.h"
+#include "vidstabdefines.h"
+#include "vsthread.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char* trfmodname = "vid.stab - trf";
+
+/* 'TRF', the version digit, accuracy, shakiness, stepsize and mincontrast */
+#define VS_TRF_HEADER_SIZE 24
+/* frame number and number of local motions */
+#define VS_TRF_FRAME_HEADER_SIZE 8
+/* a version 1 record: five int16 and two double */
+#define VS_TRF_RECORD_SIZE_V1 26
+
+/* --- the values on disk are little endian on every host ------------------- */
+static int16_t rdInt16(const unsigned char* p){
+  return (int16_t)(uint16_t)(p[0] | p[1] << 8);
+}
+
+static int32_t rdInt32(const unsigned char* p){
+  return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8
+                   | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static float rdFloat(const unsigned char* p){
+  uint32_t v = (uint32_t)rdInt32(p);
+  float f;
+  memcpy(&f, &v, 4);
+  return f;
+}
+
+static double rdDouble(const unsigned char* p){
+  uint64_t v = 0;
+  double d;
+  for(int i=7; i >= 0; i--)
+    v = v << 8 | p[i];
+  memcpy(&d, &v, 8);
+  return d;
+}
+
+static unsigned char* wrInt16(unsigned char* p, int16_t v){
+  p[0] = (unsigned char)((uint16_t)v & 0xff);
+  p[1] = (unsigned char)((uint16_t)v >> 8);
+  return p + 2;
+}
+
+static unsigned char* wrInt32(unsigned char* p, int32_t v){
+  for(int i=0; i < 4; i++)
+    p[i] = (unsigned char)((uint32_t)v >> 8*i);
+  return p + 4;
+}
+
+static unsigned char* wrFloat(unsigned char* p, float f){
+  uint32_t v;
+  memcpy(&v, &f, 4);
+  return wrInt32(p, (int32_t)v);
+}
+
+static unsigned char* wrDouble(unsigned char* p, double d){
+  uint64_t v;
+  memcpy(&v, &d, 8);
+  for(int i=0; i < 8; i++)
+    p[i] = (unsigned char)(v >> 8*i);
+  return p + 8;
+}
+
+static int hostIsLittleEndian(void){
+  const uint16_t one = 1;
+  return *(const unsigned char*)&one == 1;
+}
+
+/* --- mapping -------------------------------------------------------------- */
+static int mapFile(VSTrfFile* trf, const char* filename){
+#ifdef _WIN32
+  LARGE_INTEGER size;
+  HANDLE mapping;
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(file == INVALID_HANDLE_VALUE)
+    return VS_ERROR;
+  if(!GetFileSizeEx(file, &size) || size.QuadPart < 1
+     || (unsigned long long)size.QuadPart > (size_t)-1){
+    CloseHandle(file);
+    return VS_ERROR;
+  }
+  mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file); // the mapping keeps the file open
+  if(!mapping)
+    return VS_ERROR;
+  trf->data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if(!trf->data){
+    CloseHandle(mapping);
+    return VS_ERROR;
+  }
+  trf->size = (size_t)size.QuadPart;
+  trf->mapping = mapping;
+  return VS_OK;
+#else
+  struct stat st;
+  void* data;
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    return VS_ERROR;
+  if(fstat(fd, &st) != 0 || st.st_size < 1
+     || (unsigned long long)st.st_size > (size_t)-1){
+    close(fd);
+    return VS_ERROR;
+  }
+  data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file open
+  if(data == MAP_FAILED)
+    return VS_ERROR;
+  trf->data = (const unsigned char*)data;
+  trf->size = (size_t)st.st_size;
+  trf->mapping = data;
+  return VS_OK;
+#endif
+}
+
+/* where the file cannot be mapped (a pipe, some network file systems) it is
+   read into memory instead */
+static int readFile(VSTrfFile* trf, const char* filename){
+  FILE* f = fopen(filename, "rb");
+  unsigned char* data = 0;
+  size_t size = 0, capacity = 0, n;
+  if(!f)
+    return VS_ERROR;
+  do{
+    if(size == capacity){
+      unsigned char* ndata;
+      capacity = capacity ? 2*capacity : 1<<16;
+      ndata = (unsigned char*)vs_realloc(data, capacity);
+      if(!ndata){
+        vs_free(data);
+        fclose(f);
+        return VS_ERROR;
+      }
+      data = ndata;
+    }
+    n = fread(data + size, 1, capacity - size, f);
+    size += n;
+  }while(n > 0);
+  fclose(f);
+  trf->data = data;
+  trf->size = size;
+  trf->mapping = NULL;
+  return VS_OK;
+}
+
+static void unmapFile(VSTrfFile* trf){
+  if(!trf->data)
+    return;
+  if(!trf->mapping){
+    vs_free((void*)trf->data);
+  }else{
+#ifdef _WIN32
+    UnmapViewOfFile(trf->data);
+    CloseHandle((HANDLE)trf->mapping);
+#else
+    munmap((void*)trf->data, trf->size);
+#endif
+  }
+  trf->data = NULL;
+  trf->mapping = NULL;
+  trf->size = 0;
+}
+
+/* --- the index ------------------------------------------------------------ */
+static int setIndex(VSTrfFile* trf, int frameNum, size_t offset, int* capacity){
+  if(frameNum > *capacity){
+    int ncap = *capacity < 1024 ? 1024 : *capacity;
+    size_t* nindex;
+    while(ncap < frameNum) ncap *= 2; // frameNum <= VS_MAX_FRAMES
+    nindex = (size_t*)vs_realloc(trf->index, sizeof(size_t) * ncap);
+    if(!nindex)
+      return VS_ERROR;
+    memset(nindex + *capacity, 0, sizeof(size_t) * (ncap - *capacity));
+    trf->index = nindex;
+    *capacity = ncap;
+  }
+  /* a frame that occurs twice is taken from its last record, as
+     vsReadLocalMotionsFile does */
+  trf->index[frameNum-1] = offset;
+  if(frameNum > trf->numFrames)
+    trf->numFrames = frameNum;
+  return VS_OK;
+}
+
+static int buildIndex(VSTrfFile* trf){
+  size_t pos = VS_TRF_HEADER_SIZE;
+  int capacity = 0;
+  while(trf->size - pos >= VS_TRF_FRAME_HEADER_SIZE){
+    int frameNum = rdInt32(trf->data + pos);
+    int len = rdInt32(trf->data + pos + 4);
+    size_t bytes;
+    if(frameNum == VS_TRF_END_OF_FRAMES) // the global transforms follow
+      return VS_OK;
+    if(len < 0 || len > VS_MAX_LOCALMOTIONS_PER_FRAME){
+      vs_log_error(trfmodname, "Implausible number of localmotions (%i) at byte "
+                   "%lu: the transform file is corrupt\n", len, (unsigned long)pos);
+      return VS_OK;
+    }
+    bytes = (size_t)len * trf->recordSize;
+    if(bytes > trf->size - pos - VS_TRF_FRAME_HEADER_SIZE){
+      vs_log_error(trfmodname, "The transform file is truncated in frame %i\n",
+                   frameNum);
+      return VS_OK;
+    }
+    if(frameNum < 1 || frameNum > VS_MAX_FRAMES){
+      vs_log_info(trfmodname, "VID.STAB file: implausible frame number (%i), "
+                  "expect 1..%i", frameNum, VS_MAX_FRAMES);
+    }else if(setIndex(trf, frameNum, pos, &capacity) != VS_OK){
+      vs_log_error(trfmodname, "Cannot allocate the frame index\n");
+      return VS_ERROR;
+    }
+    pos += VS_TRF_FRAME_HEADER_SIZE + bytes;
+  }
+  if(pos != trf->size)
+    vs_log_error(trfmodname, "The transform file is truncated after frame %i\n",
+                 trf->numFrames);
+  return VS_OK;
+}
+
+int vsTrfOpen(VSTrfFile* trf, const char* filename){
+  assert(trf && filename);
+  memset(trf, 0, sizeof(VSTrfFile));
+  if(mapFile(trf, filename) != VS_OK && readFile(trf, filename) != VS_OK){
+    vs_log_error(trfmodname, "Cannot open %s\n", filename);
+    return VS_ERROR;
+  }
+  if(trf->size < VS_TRF_HEADER_SIZE || memcmp(trf->data, "TRF", 3) != 0
+     || (trf->data[3] != '0' + LIBVIDSTAB_FILE_FORMAT_VERSION
+         && trf->data[3] != '0' + LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT)){
+    vs_log_error(trfmodname, "%s is not a binary transform file of version "
+                 "%i or %i\n", filename, LIBVIDSTAB_FILE_FORMAT_VERSION,
+                 LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT);
+    vsTrfClose(trf);
+    return VS_ERROR;
+  }
+  trf->version = trf->data[3] - '0';
+  if(trf->version == LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT){
+    trf->serializationMode = COMPACT_SERIALIZATION_MODE;
+    trf->recordSize = sizeof(VSCompactMotion);
+  }else{
+    trf->serializationMode = BINARY_SERIALIZATION_MODE;
+    trf->recordSize = VS_TRF_RECORD_SIZE_V1;
+  }
+  if(buildIndex(trf) != VS_OK){
+    vsTrfClose(trf);
+    return VS_ERROR;
+  }
+  return VS_OK;
+}
+
+void vsTrfClose(VSTrfFile* trf){
+  assert(trf);
+  unmapFile(trf);
+  if(trf->index) vs_free(trf->index);
+  trf->index = NULL;
+  trf->numFrames = 0;
+}
+
+int vsTrfNumFrames(const VSTrfFile* trf){
+  assert(trf);
+  return trf->numFrames;
+}
+
+/* --- frames --------------------------------------------------------------- */
+int vsTrfGetFrame(const VSTrfFile* trf, int i, VSTrfFrame* frame){
+  assert(trf && frame);
+  frame->num = 0;
+  frame->data = NULL;
+  if(i < 0 || i >= trf->numFrames)
+    return VS_ERROR;
+  frame->frameNum = i+1;
+  frame->recordSize = trf->recordSize;
+  if(trf->index[i]){
+    const unsigned char* p = trf->data + trf->index[i];
+    frame->num = rdInt32(p + 4);
+    if(frame->num > 0)
+      frame->data = p + VS_TRF_FRAME_HEADER_SIZE;
+  }
+  return VS_OK;
+}
+
+const VSCompactMotion* vsTrfFrameCompact(const VSTrfFrame* frame){
+  assert(frame);
+  /* records start at a multiple of 4 from the (page aligned) start of the
+     file, the check only guards a file that was read into memory */
+  if(frame->recordSize != sizeof(VSCompactMotion) || !frame->data
+     || !hostIsLittleEndian() || ((uintptr_t)frame->data & 3) != 0)
+    return NULL;
+  return (const VSCompactMotion*)frame->data;
+}
+
+LocalMotion vsTrfFrameMotion(const VSTrfFrame* frame, int k){
+  const unsigned char* p;
+  LocalMotion lm;
+  assert(frame && k >= 0 && k < frame->num);
+  p = frame->data + (size_t)k * frame->recordSize;
+  lm.v.x = rdInt16(p);
+  lm.v.y = rdInt16(p + 2);
+  lm.f.x = rdInt16(p + 4);
+  lm.f.y = rdInt16(p + 6);
+  lm.f.size = rdInt16(p + 8);
+  if(frame->recordSize == sizeof(VSCompactMotion)){
+    lm.contrast = rdFloat(p + 12);
+    lm.match = rdFloat(p + 16);
+  }else{
+    lm.contrast = rdDouble(p + 10);
+    lm.match = rdDouble(p + 18);
+  }
+  return lm;
+}
+
+int vsTrfGetFrameMotions(const void* dat, int i, VSMotionSet* S){
+  const VSTrfFile* trf = (const VSTrfFile*)dat;
+  const VSCompactMotion* cms;
+  VSTrfFrame frame;
+  S->num = 0;
+  if(vsTrfGetFrame(trf, i, &frame) != VS_OK
+     || vs_motionset_reserve(S, frame.num) != VS_OK)
+    return VS_ERROR;
+  cms = vsTrfFrameCompact(&frame);
+  for(int k=0; k < frame.num; k++)
+    S->lms[k] = cms ? vs_expand_motion(&cms[k]) : vsTrfFrameMotion(&frame, k);
+  S->num = frame.num;
+  return VS_OK;
+}
+
+typedef struct {
+  const VSTrfFile* trf;
+  int first;
+} VSTrfRange;
+
+static int trfRangeFrame(const void* dat, int i, VSMotionSet* S){
+  const VSTrfRange* range = (const VSTrfRange*)dat;
+  return vsTrfGetFrameMotions(range->trf, range->first + i, S);
+}
+
+int vsTrfMotions2Transforms(VSTransformData* td, const VSTrfFile* trf,
+                            int first, int num, VSTransformations* trans){
+  VSTrfRange range;
+  assert(td && trf && trans);
+  if(first < 0 || num < 0 || num > trf->numFrames - first){
+    vs_ctx_log_error(&td->ctx, td->conf.modName, "frames %i..%i are not in the transform "
+                 "file (%i frames)\n", first, first+num-1, trf->numFrames);
+    return VS_ERROR;
+  }
+  range.trf = trf;
+  range.first = first;
+  return vsMotionFrames2Transforms(td, num, trfRangeFrame, &range, trans);
+}
+
+
+/* --- buffered writing ----------------------------------------------------- */
+/* blocks of a writer: one the caller fills, the others queued for the
+   thread, which writes them in turn */
+#define VS_TRF_WRITER_BLOCKS 4
+
+typedef struct vstrfblock_ {
+  unsigned char* data;
+  size_t used;
+  size_t capacity;
+} VSTrfBlock;
+
+struct vstrfwriter_ {
+  FILE* f;
+  VSContext ctx;            // for the log
+  const char* modName;
+  int serializationMode;
+  int recordSize;
+  VSTrfBlock blocks[VS_TRF_WRITER_BLOCKS];
+  int fill;                 // the block the caller fills
+  int error;                // a block could not be written
+  int reported;             // the error has been logged
+  int background;
+#ifdef VS_USE_THREADPOOL
+  vs_thread thread;
+  vs_mutex lock;            // guards next, pending, quit, error and the queued blocks
+  vs_cond cond;             // pending or quit changed
+  int next;                 // the block the thread writes next
+  int pending;              // queued blocks: next, next+1, ... (mod VS_TRF_WRITER_BLOCKS)
+  int quit;
+#endif
+};
+
+/// room for n more bytes in b
+static int reserveBlock(VSTrfBlock* b, size_t n){
+  if(b->used + n <= b->capacity)
+    return 1;
+  size_t capacity = b->capacity ? 2*b->capacity : VS_TRF_WRITER_BLOCK_SIZE;
+  if(capacity < b->used + n)
+    capacity = b->used + n;
+  unsigned char* data = (unsigned char*)vs_realloc(b->data, capacity);
+  if(!data)
+    return 0;
+  b->data = data;
+  b->capacity = capacity;
+  return 1;
+}
+
+static int writeBlock(FILE* f, VSTrfBlock* b){
+  int ok = b->used == 0 || fwrite(b->data, 1, b->used, f) == b->used;
+  b->used = 0;
+  return ok;
+}
+
+#ifdef VS_USE_THREADPOOL
+VS_THREAD_MAIN(writerMain)
+{
+  VSTrfWriter* w = (VSTrfWriter*)arg;
+  vs_mutex_lock(&w->lock);
+  for(;;){
+    while(w->pending == 0 && !w->quit)
+      vs_cond_wait(&w->cond, &w->lock);
+    if(w->pending == 0)
+      break; // quit, and everything is written
+    VSTrfBlock* b = &w->blocks[w->next];
+    vs_mutex_unlock(&w->lock);
+    int ok = writeBlock(w->f, b); // the caller does not touch a queued block
+    vs_mutex_lock(&w->lock);
+    if(!ok)
+      w->error = 1;
+    w->next = (w->next + 1) % VS_TRF_WRITER_BLOCKS;
+    w->pending--;
+    vs_cond_broadcast(&w->cond);
+  }
+  vs_mutex_unlock(&w->lock);
+  return 0;
+}
+#endif
+
+/// VS_ERROR if a block could not be written, logged the first time
+static int writerStatus(VSTrfWriter* w){
+  int error;
+#ifdef VS_USE_THREADPOOL
+  if(w->background){
+    vs_mutex_lock(&w->lock);
+    error = w->error;
+    vs_mutex_unlock(&w->lock);
+  }else
+#endif
+    error = w->error;
+  if(error && !w->reported){
+    vs_ctx_log_error(&w->ctx, w->modName, "cannot write the transform file\n");
+    w->reported = 1;
+  }
+  return error ? VS_ERROR : VS_OK;
+}
+
+/// writes the block of the caller, or queues it and takes the next free one
+static void handOver(VSTrfWriter* w){
+  VSTrfBlock* b = &w->blocks[w->fill];
+  if(b->used == 0)
+    return;
+#ifdef VS_USE_THREADPOOL
+  if(w->background){
+    vs_mutex_lock(&w->lock);
+    w->pending++;
+    vs_cond_broadcast(&w->cond);
+    while(w->pending == VS_TRF_WRITER_BLOCKS) // the storage is behind
+      vs_cond_wait(&w->cond, &w->lock);
+    vs_mutex_unlock(&w->lock);
+    w->fill = (w->fill + 1) % VS_TRF_WRITER_BLOCKS;
+    return;
+  }
+#endif
+  if(!writeBlock(w->f, b))
+    w->error = 1;
+}
+
+static VSTrfWriter* createWriter(const VSMotionDetect* md, FILE* f, int background,
+                                 int header){
+  assert(md && f);
+  if(md->serializationMode != BINARY_SERIALIZATION_MODE
+     && md->serializationMode != COMPACT_SERIALIZATION_MODE){
+    vs_ctx_log_error(&md->ctx, md->conf.modName, "the trf writer writes binary files "
+                     "only, use vsWriteMotionSetToFile for text\n");
+    return NULL;
+  }
+  VSTrfWriter* w = (VSTrfWriter*)vs_zalloc(sizeof(VSTrfWriter));
+  if(!w)
+    return NULL;
+  w->f = f;
+  w->ctx = md->ctx;
+  w->modName = md->conf.modName;
+  w->serializationMode = md->serializationMode;
+  w->recordSize = md->serializationMode == COMPACT_SERIALIZATION_MODE
+    ? (int)sizeof(VSCompactMotion) : VS_TRF_RECORD_SIZE_V1;
+
+  // the header of vsPrepareFile
+  VSTrfBlock* b = &w->blocks[0];
+  if(header){
+    if(!reserveBlock(b, VS_TRF_HEADER_SIZE)){
+      vs_free(w);
+      return NULL;
+    }
+    unsigned char* p = b->data;
+    const int version = md->serializationMode == COMPACT_SERIALIZATION_MODE
+      ? LIBVIDSTAB_FILE_FORMAT_VERSION_COMPACT : LIBVIDSTAB_FILE_FORMAT_VERSION;
+    memcpy(p, "TRF", 3);
+    p[3] = (unsigned char)('0' + version);
+    p = wrInt32(p + 4, md->conf.accuracy);
+    p = wrInt32(p, md->conf.shakiness);
+    p = wrInt32(p, md->conf.stepSize);
+    p = wrDouble(p, md->conf.contrastThreshold);
+    b->used = p - b->data;
+  }
+
+#ifdef VS_USE_THREADPOOL
+  if(background){
+    vs_mutex_init(&w->lock);
+    vs_cond_init(&w->cond);
+    w->background = vs_thread_start(&w->thread, writerMain, w);
+    if(!w->background){ // the caller writes
+      vs_cond_destroy(&w->cond);
+      vs_mutex_destroy(&w->lock);
+    }
+  }
+#else
+  (void)background;
+#endif
+  return w;
+}
+
+VSTrfWriter* vsTrfWriterCreate(const VSMotionDetect* md, FILE* f, int background){
+  return createWriter(md, f, background, 1);
+}
+
+VSTrfWriter* vsTrfWriterAppend(const VSMotionDetect* md, FILE* f, int background){
+  return createWriter(md, f, background, 0);
+}
+
+int vsTrfWriterBackground(const VSTrfWriter* w){
+  return w->background;
+}
+
+int vsTrfWriterWrite(VSTrfWriter* w, int frameNum, const VSMotionSet* lms){
+  assert(w && lms);
+  if(writerStatus(w) != VS_OK)
+    return VS_ERROR;
+  VSTrfBlock* b = &w->blocks[w->fill];
+  if(!reserveBlock(b, VS_TRF_FRAME_HEADER_SIZE + (size_t)lms->num * w->recordSize)){
+    vs_ctx_log_error(&w->ctx, w->modName, "cannot allocate the block of frame %i\n",
+                     frameNum);
+    return VS_ERROR;
+  }
+  unsigned char* p = wrInt32(b->data + b->used, frameNum);
+  p = wrInt32(p, lms->num);
+  for(int k=0; k < lms->num; k++){
+    const LocalMotion* lm = MSGet(lms, k);
+    if(w->serializationMode == COMPACT_SERIALIZATION_MODE){
+      VSCompactMotion cm = vs_compact_motion(lm);
+      p = wrInt16(p, cm.vx);
+      p = wrInt16(p, cm.vy);
+      p = wrInt16(p, cm.fx);
+      p = wrInt16(p, cm.fy);
+      p = wrInt16(p, cm.fsize);
+      p = wrInt16(p, cm.reserved);
+      p = wrFloat(p, cm.contrast);
+      p = wrFloat(p, cm.match);
+    }else{
+      p = wrInt16(p, lm->v.x);
+      p = wrInt16(p, lm->v.y);
+      p = wrInt16(p, lm->f.x);
+      p = wrInt16(p, lm->f.y);
+      p = wrInt16(p, lm->f.size);
+      p = wrDouble(p, lm->contrast);
+      p = wrDouble(p, lm->match);
+    }
+  }
+  b->used = p - b->data;
+  if(b->used >= VS_TRF_WRITER_BLOCK_SIZE)
+    handOver(w);
+  return VS_OK;
+}
+
+int vsTrfWriterFlush(VSTrfWriter* w){
+  assert(w);
+  handOver(w);
+#ifdef VS_USE_THREADPOOL
+  if(w->background){
+    vs_mutex_lock(&w->lock);
+    while(w->pending > 0)
+      vs_cond_wait(&w->cond, &w->lock);
+    vs_mutex_unlock(&w->lock);
+  }
+#endif
+  if(fflush(w->f) != 0)
+    w->error = 1; // the thread is idle now
+  return writerStatus(w);
+}
+
+int vsTrfWriterClose(VSTrfWriter* w){
+  if(!w)
+    return VS_OK;
+  int res = vsTrfWriterFlush(w);
+#ifdef VS_USE_THREADPOOL
+  if(w->background){
+    vs_mutex_lock(&w->lock);
+    w->quit = 1;
+    vs_cond_broadcast(&w->cond);
+    vs_mutex_unlock(&w->lock);
+    vs_thread_join(w->thread);
+    vs_cond_destroy(&w->cond);
+    vs_mutex_destroy(&w->lock);
+  }
+#endif
+  for(int k=0; k < VS_TRF_WRITER_BLOCKS; k++)
+    vs_free(w->blocks[k].data);
+  vs_free(w);
+  return res;
+}
+
+/*
+ * Local variables:
+ *   c-file-style: "stroustrup"
+ *   c-file-offsets: ((case-label . *) (statement-case-intro . *))
+ *   indent-tabs-mode: nil
+ *   c-basic-offset: 2 t
+ * End:
+ *
+ * vim: expandtab shiftwidth=2:
+ */
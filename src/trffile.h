@@ -0,0 +1,179 @@
+/*
+ * trffile.h -- random access to the frames of a binary .trf file, and a
+ *               buffered writer for it
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ */
+#ifndef VSTRFFILE_H
+#define VSTRFFILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "motiondetect.h"
+#include "motionset.h"
+#include "transform.h"
+#include "vidstab_api.h"
+
+/**
+   A binary .trf file (version 1 or 2) mapped into memory, with the offset of
+   every frame. Opening it walks the frame headers once and parses no local
+   motion; a frame is then found without reading the frames before it, so a
+   part of a long clip can be stabilised again without reading the file again.
+   Text files are not supported, read them with vsReadLocalMotionsFile.
+*/
+typedef struct vstrffile_ VSTrfFile;
+struct vstrffile_ {
+  const unsigned char* data; // the file contents
+  size_t size;
+  int serializationMode;     // BINARY_SERIALIZATION_MODE or COMPACT_SERIALIZATION_MODE
+  int version;               // file format version
+  int recordSize;            // bytes per local motion (26 or 20)
+  size_t* index;             // offset of the header of frame i, 0 if the file has none
+  int numFrames;             // the largest frame number in the file
+  void* mapping;             // platform handle of the mapping, NULL if data was read
+};
+
+/// a frame of a VSTrfFile: its records in place in the mapping
+typedef struct vstrfframe_ {
+  int frameNum;              // 1 based, as in the file
+  int num;                   // number of local motions
+  int recordSize;
+  const unsigned char* data; // the first record, NULL if num is 0
+} VSTrfFrame;
+
+/**
+ * vsTrfOpen:
+ *     maps the binary .trf file filename and indexes its frames. A record
+ *     that runs past the end of the file (a truncated file) ends the index.
+ * Return Value:
+ *     VS_OK on success, VS_ERROR if the file cannot be opened or mapped or
+ *     is not a binary .trf of a known version (trf is then closed).
+ */
+VS_API int vsTrfOpen(VSTrfFile* trf, const char* filename);
+
+/// unmaps the file and releases the index
+VS_API void vsTrfClose(VSTrfFile* trf);
+
+/// number of frames, the frame number of the last frame in the file
+VS_API int vsTrfNumFrames(const VSTrfFile* trf);
+
+/**
+ * vsTrfGetFrame:
+ *     the view of frame i (0 based, frame number i+1). A frame the file does
+ *     not contain has no motions.
+ * Return Value:
+ *     VS_OK, or VS_ERROR if i is not in [0, vsTrfNumFrames).
+ */
+VS_API int vsTrfGetFrame(const VSTrfFile* trf, int i, VSTrfFrame* frame);
+
+/**
+ * vsTrfFrameCompact:
+ *     the motions of a frame of a version 2 file as VSCompactMotion, in
+ *     place in the mapping (no copy). NULL for a version 1 file, a frame
+ *     without motions, or a big endian host; use vsTrfFrameMotion then.
+ */
+VS_API const VSCompactMotion* vsTrfFrameCompact(const VSTrfFrame* frame);
+
+/// the k-th local motion of a frame, decoded from its record (any version)
+VS_API LocalMotion vsTrfFrameMotion(const VSTrfFrame* frame, int k);
+
+/// fills S (initialized) with the motions of frame i of trf, a VSMotionFrameFn
+VS_API int vsTrfGetFrameMotions(const void* trf, int i, VSMotionSet* S);
+
+/**
+ * vsTrfMotions2Transforms:
+ *     the transforms of the frames first ... first+num-1 (0 based), as
+ *     vsLocalmotions2Transforms gives them for these frames alone. The lens
+ *     distortion, if estimated, is estimated over this range.
+ */
+VS_API int vsTrfMotions2Transforms(VSTransformData* td, const VSTrfFile* trf,
+                                   int first, int num, VSTransformations* trans);
+
+/**
+   Writes a binary .trf file (version 1 or 2, as md->serializationMode says)
+   a whole frame at a time: the header and records of a frame are encoded
+   into a memory block, and a full block goes out with a single fwrite, where
+   vsWriteMotionSetToFile makes one per value. The bytes are those of
+   vsPrepareFile and vsWriteMotionSetToFile.
+
+   With a background thread (VS_USE_THREADPOOL) full blocks are handed to it
+   and the caller goes on with the next frame while the block is written, so
+   slow storage (e.g. a network share) does not hold up the detection. Only a
+   few blocks are in flight; if the storage cannot keep up the caller waits
+   for a free one. A write error of the thread is returned by the next call.
+*/
+typedef struct vstrfwriter_ VSTrfWriter;
+
+/// size of a block, a frame larger than this gets a block of its own
+#define VS_TRF_WRITER_BLOCK_SIZE (1<<18)
+
+/**
+ * vsTrfWriterCreate:
+ *     a writer to f, which has to be open in binary mode, and puts the file
+ *     header (as vsPrepareFile) into its first block. background asks for a
+ *     thread that writes the blocks; without VS_USE_THREADPOOL or if no
+ *     thread can be started the blocks are written by the caller.
+ * Return Value:
+ *     the writer, NULL if md is in ASCII_SERIALIZATION_MODE (use
+ *     vsWriteMotionSetToFile then) or on lack of memory.
+ */
+VS_API VSTrfWriter* vsTrfWriterCreate(const VSMotionDetect* md, FILE* f, int background);
+
+/// as vsTrfWriterCreate for a file that has its header, e.g. one resumed at a
+/// checkpoint (vsMotionDetectResume); the frames are appended where f is
+VS_API VSTrfWriter* vsTrfWriterAppend(const VSMotionDetect* md, FILE* f, int background);
+
+/// 1 if the blocks of w are written by a background thread
+VS_API int vsTrfWriterBackground(const VSTrfWriter* w);
+
+/**
+ * vsTrfWriterWrite:
+ *     appends the motions of the frame frameNum (1 based, as md->frameNum for
+ *     vsWriteMotionSetToFile). The frame is written when its block is full,
+ *     at vsTrfWriterFlush or at vsTrfWriterClose.
+ * Return Value:
+ *     VS_OK, VS_ERROR on lack of memory or if an earlier block could not be
+ *     written.
+ */
+VS_API int vsTrfWriterWrite(VSTrfWriter* w, int frameNum, const VSMotionSet* lms);
+
+/// writes out every frame so far and flushes f, returns VS_ERROR on a write error
+VS_API int vsTrfWriterFlush(VSTrfWriter* w);
+
+/**
+ * vsTrfWriterClose:
+ *     flushes (vsTrfWriterFlush), stops the thread and releases w. f stays
+ *     open. NULL is fine.
+ * Return Value:
+ *     VS_OK if every frame was written, VS_ERROR otherwise.
+ */
+VS_API int vsTrfWriterClose(VSTrfWriter* w);
+
+#endif  /* VSTRFFILE_H */
+
+/*
+ * Local variables:
+ *   c-file-style: "stroustrup"
+ *   c-file-offsets: ((case-label . *) (statement-case-intro . *))
+ *   indent-tabs-mode: nil
+ *   c-basic-offset: 2 t
+ * End:
+ *
+ * vim: expandtab shiftwidth=2:
+ */
@@ -0,0 +1,109 @@
+/*
+ *  vscontext.h
+ *
+ *  Per-instance library state: kernels, logging and thread settings.
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VS_CONTEXT_H
+#define VS_CONTEXT_H
+
+#include "transformtype.h"
+#include "vidstabdefines.h"
+#include "threadpool.h"
+#include "vidstab_api.h"
+
+/* --- kernels of the motion detection ------------------------------------- */
+
+typedef unsigned int (*vsCompareSubImgFn)(unsigned char* const I1,
+                                          unsigned char* const I2,
+                                          const Field* field,
+                                          int linesize1, int linesize2, int height,
+                                          int bytesPerPixel, int d_x, int d_y,
+                                          unsigned int threshold);
+
+/// \param linesize distance between two rows in BYTES (see vidstabdefines.h)
+typedef double (*vsContrastSubImg1Fn)(unsigned char* const I, const Field* field,
+                                      int linesize, int height);
+
+/** maximal number of displacements one vsCompareSubImgRunFn call evaluates */
+#define VS_SAD_RUN 8
+
+/** SADs of a planar field for the n <= VS_SAD_RUN displacements
+    (d_x + k*step, d_y), k = 0..n-1, in one pass over the field: each block of
+    I1 is loaded once and compared against all n windows of I2. step may be
+    negative. The early exit of compareSubImg holds per candidate: errors[k] is
+    the exact SAD if that is <= threshold, otherwise only known to be greater
+    than threshold; the pass stops once all candidates are above it. */
+typedef void (*vsCompareSubImgRunFn)(unsigned char* const I1, unsigned char* const I2,
+                                     const Field* field,
+                                     int linesize1, int linesize2, int height,
+                                     int d_x, int d_y, int step, int n,
+                                     unsigned int threshold, unsigned int* errors);
+
+/** converts one row of width packed pixels to luma,
+    Y = (77 R + 150 G + 29 B + 128) >> 8 (BT.601 weights in 8 bit fixed point).
+    \param bytesPerPixel 3 or 4 (the fourth byte is ignored)
+    \param rIndex offset of the red byte in a pixel: 0 for RGB, 2 for BGR */
+typedef void (*vsRgbToLumaFn)(unsigned char* Y, const unsigned char* src,
+                              int width, int bytesPerPixel, int rIndex);
+
+/* Everything an instance (VSMotionDetect, VSTransformData) would otherwise
+   take from process-wide variables. vsMotionDetectInitContext and
+   vsTransformDataInitContext copy it into the instance, so it may be a
+   temporary and changing it later affects no running instance. Instances
+   with different contexts share nothing and take no lock.
+
+   The plain vsMotionDetectInit and vsTransformDataInit use the default
+   context: a copy of the globals (compareSubImg, ..., vs_log) as they are at
+   that moment, after vs_simd_init. The allocator stays process-wide (vs_malloc
+   and friends): frames and vectors are allocated and freed all over the
+   library and also by the caller. */
+typedef struct _vscontext {
+  /* motion detection kernels, see motiondetect_opt.h */
+  vsCompareSubImgFn    compareSubImg;
+  vsCompareSubImgRunFn compareSubImgRun;
+  vsContrastSubImg1Fn  contrastSubImg1;
+  vsRgbToLumaFn        rgbToLuma;
+  const char*          simdName;    // kernel family, e.g. "AVX2" (for logging)
+  /* messages of the instance */
+  vs_log_t             log;
+  /* used where the config leaves them at their defaults (numThreads 0, no
+     executor) */
+  int                  numThreads;
+  VSExecutor           executor;
+} VSContext;
+
+/** fills ctx with the kernels for this machine and the default logger. It
+ *  writes no global but the CPU flags, which are detected once under
+ *  vs_call_once (see vs_cpu_flags), so it is safe from any thread at any time */
+VS_API void vsContextInit(VSContext* ctx);
+
+/** fills ctx from the globals (see above), calls vs_simd_init first */
+VS_API void vsContextFromGlobals(VSContext* ctx);
+
+/// messages through the logger of a context, as vs_log_error etc.
+#define vs_ctx_log_error(ctx, ...) (ctx)->log(VS_ERROR_TYPE, __VA_ARGS__)
+#define vs_ctx_log_warn(ctx, ...)  (ctx)->log(VS_WARN_TYPE,  __VA_ARGS__)
+#define vs_ctx_log_info(ctx, ...)  (ctx)->log(VS_INFO_TYPE,  __VA_ARGS__)
+#define vs_ctx_log_msg(ctx, ...)   (ctx)->log(VS_MSG_TYPE,   __VA_ARGS__)
+
+#endif /* VS_CONTEXT_H */
@@ -0,0 +1,138 @@
+/*
+ *  vsthread.h
+ *
+ *  The few thread primitives of vid.stab, on POSIX threads or Win32
+ *  (internal; all but vs_call_once only with VS_USE_THREADPOOL).
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ *  This file is part of vid.stab video stabilization library
+ *
+ *  vid.stab is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation; either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  vid.stab is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with vid.stab; see the file COPYING.LESSER.  If not, see
+ *  <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VS_THREAD_H
+#define VS_THREAD_H
+
+#ifdef VS_USE_THREADPOOL
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+typedef SRWLOCK            vs_mutex;
+typedef CONDITION_VARIABLE vs_cond;
+typedef HANDLE             vs_thread;
+#define vs_mutex_init(m)     InitializeSRWLock(m)
+#define vs_mutex_destroy(m)  ((void)(m))
+#define vs_mutex_lock(m)     AcquireSRWLockExclusive(m)
+#define vs_mutex_unlock(m)   ReleaseSRWLockExclusive(m)
+#define vs_cond_init(c)      InitializeConditionVariable(c)
+#define vs_cond_destroy(c)   ((void)(c))
+#define vs_cond_wait(c,m)    SleepConditionVariableSRW(c, m, INFINITE, 0)
+#define vs_cond_broadcast(c) WakeAllConditionVariable(c)
+/// declares the entry function of a thread, started with vs_thread_start
+#define VS_THREAD_MAIN(name) static unsigned __stdcall name(void* arg)
+typedef unsigned (__stdcall *vs_thread_main)(void*);
+#else
+#include <pthread.h>
+typedef pthread_mutex_t vs_mutex;
+typedef pthread_cond_t  vs_cond;
+typedef pthread_t       vs_thread;
+#define vs_mutex_init(m)     pthread_mutex_init(m, NULL)
+#define vs_mutex_destroy(m)  pthread_mutex_destroy(m)
+#define vs_mutex_lock(m)     pthread_mutex_lock(m)
+#define vs_mutex_unlock(m)   pthread_mutex_unlock(m)
+#define vs_cond_init(c)      pthread_cond_init(c, NULL)
+#define vs_cond_destroy(c)   pthread_cond_destroy(c)
+#define vs_cond_wait(c,m)    pthread_cond_wait(c, m)
+#define vs_cond_broadcast(c) pthread_cond_broadcast(c)
+/// declares the entry function of a thread, started with vs_thread_start
+#define VS_THREAD_MAIN(name) static void* name(void* arg)
+typedef void* (*vs_thread_main)(void*);
+#endif
+
+/// starts fn(arg) on a new thread, false if the system gives none
+static inline int vs_thread_start(vs_thread* t, vs_thread_main fn, void* arg){
+#ifdef _WIN32
+  *t = (HANDLE)_beginthreadex(NULL, 0, fn, arg, 0, NULL);
+  return *t != 0;
+#else
+  return pthread_create(t, NULL, fn, arg) == 0;
+#endif
+}
+
+/// waits for the thread to return
+static inline void vs_thread_join(vs_thread t){
+#ifdef _WIN32
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+#else
+  pthread_join(t, NULL);
+#endif
+}
+#endif /* VS_USE_THREADPOOL */
+
+/* vs_call_once(&once, fn) runs fn the first time and returns once it has run,
+   however many threads call it: what fn wrote is then visible to every
+   caller. Without a thread library it is a compare-and-swap on GCC/Clang;
+   with neither the first call has to happen before any thread is started. */
+typedef void (*vs_once_fn)(void);
+#ifdef _WIN32
+#include <windows.h>
+typedef INIT_ONCE vs_once;
+#define VS_ONCE_INIT INIT_ONCE_STATIC_INIT
+static inline BOOL CALLBACK vs_once_run(PINIT_ONCE once, PVOID fn, PVOID* context){
+  (void)once; (void)context;
+  (*(vs_once_fn*)fn)();
+  return TRUE;
+}
+static inline void vs_call_once(vs_once* once, vs_once_fn fn){
+  InitOnceExecuteOnce(once, vs_once_run, &fn, NULL);
+}
+#elif defined(VS_USE_THREADPOOL)
+typedef pthread_once_t vs_once;
+#define VS_ONCE_INIT PTHREAD_ONCE_INIT
+static inline void vs_call_once(vs_once* once, vs_once_fn fn){
+  pthread_once(once, fn);
+}
+#elif defined(__GNUC__)
+typedef int vs_once; // 0 not run, 1 running, 2 done
+#define VS_ONCE_INIT 0
+static inline void vs_call_once(vs_once* once, vs_once_fn fn){
+  int expected = 0;
+  if(__atomic_load_n(once, __ATOMIC_ACQUIRE) == 2)
+    return;
+  if(__atomic_compare_exchange_n(once, &expected, 1, 0,
+                                 __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
+    fn();
+    __atomic_store_n(once, 2, __ATOMIC_RELEASE);
+    return;
+  }
+  while(__atomic_load_n(once, __ATOMIC_ACQUIRE) != 2)
+    ;
+}
+#else
+typedef int vs_once;
+#define VS_ONCE_INIT 0
+static inline void vs_call_once(vs_once* once, vs_once_fn fn){
+  if(*once)
+    return;
+  fn();
+  *once = 1;
+}
+#endif
+
+#endif /* VS_THREAD_H */
+
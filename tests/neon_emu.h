@@ -21,6 +21,9 @@
 typedef struct { uint8_t  v[16]; } uint8x16_t;
 typedef struct { uint16_t v[8];  } uint16x8_t;
 typedef struct { uint32_t v[4];  } uint32x4_t;
+typedef struct { uint8_t  v[8];  } uint8x8_t;
+typedef struct { uint8x16_t val[3]; } uint8x16x3_t;
+typedef struct { uint8x16_t val[4]; } uint8x16x4_t;
 
 static inline uint8x16_t vld1q_u8(const uint8_t* p) {
   uint8x16_t r;
@@ -99,4 +102,68 @@ static inline uint8_t vmaxvq_u8(uint8x16_t a) {
   return m;
 }
 
+/* luma conversion (rgbToLuma_neon) */
+static inline void vst1q_u8(uint8_t* p, uint8x16_t a) {
+  memcpy(p, a.v, 16);
+}
+
+static inline uint8x16x3_t vld3q_u8(const uint8_t* p) {
+  uint8x16x3_t r; int i, c;
+  for (i = 0; i < 16; i++)
+    for (c = 0; c < 3; c++) r.val[c].v[i] = p[3*i + c];
+  return r;
+}
+
+static inline uint8x16x4_t vld4q_u8(const uint8_t* p) {
+  uint8x16x4_t r; int i, c;
+  for (i = 0; i < 16; i++)
+    for (c = 0; c < 4; c++) r.val[c].v[i] = p[4*i + c];
+  return r;
+}
+
+static inline uint8x8_t vdup_n_u8(uint8_t x) {
+  uint8x8_t r; int i;
+  for (i = 0; i < 8; i++) r.v[i] = x;
+  return r;
+}
+
+static inline uint8x8_t vget_low_u8(uint8x16_t a) {
+  uint8x8_t r;
+  memcpy(r.v, a.v, 8);
+  return r;
+}
+
+static inline uint8x8_t vget_high_u8(uint8x16_t a) {
+  uint8x8_t r;
+  memcpy(r.v, a.v + 8, 8);
+  return r;
+}
+
+static inline uint8x16_t vcombine_u8(uint8x8_t lo, uint8x8_t hi) {
+  uint8x16_t r;
+  memcpy(r.v, lo.v, 8);
+  memcpy(r.v + 8, hi.v, 8);
+  return r;
+}
+
+/* widening multiply, and multiply-accumulate */
+static inline uint16x8_t vmull_u8(uint8x8_t a, uint8x8_t b) {
+  uint16x8_t r; int i;
+  for (i = 0; i < 8; i++) r.v[i] = (uint16_t)(a.v[i] * b.v[i]);
+  return r;
+}
+
+static inline uint16x8_t vmlal_u8(uint16x8_t acc, uint8x8_t a, uint8x8_t b) {
+  uint16x8_t r; int i;
+  for (i = 0; i < 8; i++) r.v[i] = (uint16_t)(acc.v[i] + a.v[i] * b.v[i]);
+  return r;
+}
+
+/* rounding shift right and narrow: (a + (1 << (n-1))) >> n */
+static inline uint8x8_t vrshrn_n_u16(uint16x8_t a, int n) {
+  uint8x8_t r; int i;
+  for (i = 0; i < 8; i++) r.v[i] = (uint8_t)(((uint32_t)a.v[i] + (1u << (n-1))) >> n);
+  return r;
+}
+
 #endif /* VS_NEON_EMU_H */
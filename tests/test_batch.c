@@ -0,0 +1,93 @@
+/* vsMotionDetectionBatch has to give exactly the motions of the sequential
+   calls, for every mode that carries state from frame to frame. The frames are
+   fed as batches of different lengths, so batches start with a frame that has
+   to be compared with the reference left by the previous batch. */
+
+static int batch_same_motions(const LocalMotions* a, const LocalMotions* b){
+  if(vs_vector_size(a) != vs_vector_size(b))
+    return 0;
+  for(int i=0; i < vs_vector_size(a); i++){
+    if(memcmp(LMGet(a,i), LMGet(b,i), sizeof(LocalMotion)) != 0)
+      return 0;
+  }
+  return 1;
+}
+
+static void batch_compare(const char* name, const VSMotionDetectConfig* mdconf,
+                          const VSFrameInfo* fi, VSFrame* frames, int num){
+  static const int batches[] = {1, 3, 2, 4, 1, 5};
+  VSMotionDetect mdseq, mdbatch;
+  LocalMotions* seq   = (LocalMotions*)vs_malloc(sizeof(LocalMotions)*num);
+  LocalMotions* batch = (LocalMotions*)vs_malloc(sizeof(LocalMotions)*num);
+  int i, k = 0, b = 0, allok = 1;
+
+  test_bool(vsMotionDetectInit(&mdseq, mdconf, fi) == VS_OK);
+  test_bool(vsMotionDetectInit(&mdbatch, mdconf, fi) == VS_OK);
+  for(i=0; i < num; i++)
+    test_bool(vsMotionDetection(&mdseq, &seq[i], &frames[i]) == VS_OK);
+  while(k < num){
+    int n = VS_MIN(batches[b % (int)(sizeof(batches)/sizeof(batches[0]))], num-k);
+    test_bool(vsMotionDetectionBatch(&mdbatch, frames + k, n, batch + k) == VS_OK);
+    k += n;
+    b++;
+  }
+  for(i=0; i < num; i++){
+    if(!batch_same_motions(&seq[i], &batch[i])){
+      fprintf(stderr,"%s: frame %i differs (%i vs %i motions)\n", name, i,
+              vs_vector_size(&seq[i]), vs_vector_size(&batch[i]));
+      allok = 0;
+    }
+    vs_vector_del(&seq[i]);
+    vs_vector_del(&batch[i]);
+  }
+  test_bool(allok);
+  test_bool(mdbatch.frameNum == mdseq.frameNum);
+  vsMotionDetectionCleanup(&mdseq);
+  vsMotionDetectionCleanup(&mdbatch);
+  vs_free(seq);
+  vs_free(batch);
+}
+
+void test_batch(TestData* testdata){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_batch");
+  VSFrame frames[10];
+  int loglevel = vs_log_level;
+  int i;
+  vs_log_level = 1;
+  // forth and back, that gives a longer sequence than the test frames
+  for(i=0; i < 10; i++)
+    frames[i] = testdata->frames[i < 5 ? i : 9-i];
+
+  batch_compare("default", &mdconf, &testdata->fi, frames, 10);
+  mdconf.pyramidLevels = 2;
+  batch_compare("pyramid", &mdconf, &testdata->fi, frames, 10);
+  mdconf.pyramidLevels = 0;
+  mdconf.contrastMode = VSContrastVariance;
+  batch_compare("variance", &mdconf, &testdata->fi, frames, 10);
+  mdconf.detectScale = 2;
+  batch_compare("reduced resolution", &mdconf, &testdata->fi, frames, 10);
+  mdconf.detectScale = 1;
+  mdconf.contrastMode = VSContrastMinMax;
+  mdconf.virtualTripod = 3;
+  batch_compare("tripod", &mdconf, &testdata->fi, frames, 10);
+  mdconf.virtualTripod = 0;
+
+  { // packed frames are searched in place
+    VSFrameInfo fi;
+    VSFrame packed[6];
+    test_bool(vsFrameInfoInit(&fi, 320, 240, PF_RGB24));
+    vsFrameAllocate(&packed[0], &fi);
+    fillPackedNoise(&packed[0], &fi, 17);
+    for(i=1; i < 6; i++){
+      vsFrameAllocate(&packed[i], &fi);
+      shiftPacked(&packed[i], &packed[0], &fi, 2*i, -i);
+    }
+    batch_compare("packed", &mdconf, &fi, packed, 6);
+    mdconf.packedLuma = 1;
+    batch_compare("packed luma", &mdconf, &fi, packed, 6);
+    mdconf.packedLuma = 0;
+    for(i=0; i < 6; i++)
+      vsFrameFree(&packed[i]);
+  }
+  vs_log_level = loglevel;
+}
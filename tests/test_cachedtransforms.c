@@ -0,0 +1,150 @@
+/* The global transforms stored in the .trf (vsWriteTransformsToFile).
+
+   A transform pass that stores its transforms in a binary file gives them
+   back to the next pass with the same fitting parameters, bit for bit and
+   without the fit; other parameters, a lens sample of another size among
+   them, fit again and replace them. Every reader
+   of the frames still sees the frames and only the frames, and text files
+   have no such section. */
+
+/* the transforms of name through vsCachedMotions2Transforms */
+static int cached_transforms(TestData* testdata, const char* name, int store,
+                             VSTransformConfig tconf, VSTransformations* trans,
+                             double* lensK){
+  VSTransformData td;
+  FILE* f = fopen(name, store ? "r+b" : "rb");
+  int ok;
+  *lensK = 0;
+  if(!f) return 0;
+  vsTransformationsInit(trans);
+  ok = vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi) == VS_OK;
+  ok &= vsCachedMotions2Transforms(&td, f, trans, store) == VS_OK;
+  *lensK = td.fitLensK;
+  fclose(f);
+  vsTransformDataCleanup(&td);
+  return ok;
+}
+
+/* whether name holds transforms for tconf */
+static int cached_has(TestData* testdata, const char* name, VSTransformConfig tconf){
+  VSTransformData td;
+  VSTransformations trans;
+  FILE* f = fopen(name, "rb");
+  int has;
+  if(!f) return 0;
+  vsTransformationsInit(&trans);
+  vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi);
+  has = vsReadTransformsFromFile(&td, f, &trans) == VS_OK;
+  fclose(f);
+  vsTransformationsCleanup(&trans);
+  vsTransformDataCleanup(&td);
+  return has;
+}
+
+void test_cachedtransforms(TestData* testdata){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_cachedtransforms");
+  VSMotionDetect md;
+  VSMotionSet sets[COMPACT_NFRAMES];
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_cachedtransforms");
+  VSTransformConfig simple;
+  VSTransformations t1, t2, t3;
+  VSManyLocalMotions mlms;
+  VSTrfFile trf;
+  double k1, k2;
+  int loglevel = vs_log_level;
+  FILE* f;
+
+  vs_log_level = 1;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    test_bool(vsMotionDetectionSet(&md, &sets[i], &testdata->frames[i]) == VS_OK);
+  vsMotionDetectionCleanup(&md);
+  tconf.estimateLensDistortion = 1;
+  tconf.simpleMotionCalculation = 0;
+  simple = tconf;
+  simple.simpleMotionCalculation = 1;
+
+  const char* names[2] = { "cached_v1.trf", "cached_v2.trf" };
+  const int modes[2] = { BINARY_SERIALIZATION_MODE, COMPACT_SERIALIZATION_MODE };
+  for(int v=0; v < 2; v++){
+    char name[1024];
+    snprintf(name, sizeof(name), "%s", testOut(names[v]));
+    test_bool(compact_write(name, modes[v], sets, &testdata->fi));
+    long size = compact_file_size(name);
+    test_bool(!cached_has(testdata, name, tconf));
+
+    // the first pass fits and stores, the second reads
+    test_bool(cached_transforms(testdata, name, 1, tconf, &t1, &k1));
+    test_bool(t1.len == COMPACT_NFRAMES);
+    long stored = compact_file_size(name);
+    test_bool(stored == size + 8 + 4 + 7*4 + 2*8 + 4 + COMPACT_NFRAMES*52 + 12);
+    test_bool(cached_has(testdata, name, tconf));
+    test_bool(!cached_has(testdata, name, simple));
+    test_bool(cached_transforms(testdata, name, 0, tconf, &t2, &k2));
+    test_bool(compact_same_transforms(&t1, &t2) && k1 == k2);
+    vsTransformationsCleanup(&t2);
+
+    // the same as a pass over the frames of the file
+    f = fopen(name, "rb");
+    {
+      VSTransformData td;
+      vsTransformationsInit(&t2);
+      test_bool(vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi) == VS_OK);
+      test_bool(vsStreamMotions2Transforms(&td, f, &t2) == VS_OK);
+      test_bool(compact_same_transforms(&t1, &t2));
+      vsTransformDataCleanup(&td);
+      vsTransformationsCleanup(&t2);
+    }
+    fclose(f);
+
+    // other parameters fit again and replace the section in place
+    test_bool(cached_transforms(testdata, name, 1, simple, &t3, &k2));
+    test_bool(!compact_same_transforms(&t1, &t3) && k2 == 0);
+    test_bool(compact_file_size(name) == stored);
+    test_bool(cached_has(testdata, name, simple));
+    test_bool(!cached_has(testdata, name, tconf));
+    vsTransformationsCleanup(&t3);
+    vsTransformationsCleanup(&t1);
+
+    // a lens sample smaller than the clip is another fit
+    VSTransformConfig sample = tconf;
+    sample.lensSampleFrames = COMPACT_NFRAMES - 2;
+    test_bool(cached_transforms(testdata, name, 1, tconf, &t1, &k1));
+    test_bool(!cached_has(testdata, name, sample));
+    test_bool(cached_transforms(testdata, name, 1, sample, &t3, &k2));
+    test_bool(cached_has(testdata, name, sample));
+    test_bool(!cached_has(testdata, name, tconf));
+    vsTransformationsCleanup(&t3);
+    vsTransformationsCleanup(&t1);
+    // without the lens the sample does not matter
+    VSTransformConfig nolens = simple;
+    nolens.lensSampleFrames = COMPACT_NFRAMES - 2;
+    test_bool(cached_transforms(testdata, name, 1, simple, &t1, &k1));
+    test_bool(cached_has(testdata, name, nolens));
+    vsTransformationsCleanup(&t1);
+
+    // the readers of the frames stop before the section
+    f = fopen(name, "rb");
+    test_bool(vsReadLocalMotionsFile(f, &mlms) == VS_OK);
+    fclose(f);
+    test_bool(vs_vector_size(&mlms) == COMPACT_NFRAMES);
+    for(int i=0; i < COMPACT_NFRAMES; i++)
+      test_bool(vs_vector_size(VSMLMGet(&mlms, i)) == sets[i].num);
+    compact_free_many(&mlms);
+    test_bool(vsTrfOpen(&trf, name) == VS_OK);
+    test_bool(vsTrfNumFrames(&trf) == COMPACT_NFRAMES);
+    vsTrfClose(&trf);
+  }
+
+  // text files keep the frames only, and are fitted every time
+  test_bool(compact_write(testOut("cached.trf"), ASCII_SERIALIZATION_MODE, sets,
+                          &testdata->fi));
+  test_bool(cached_transforms(testdata, testOut("cached.trf"), 1, tconf, &t1, &k1));
+  test_bool(t1.len == COMPACT_NFRAMES);
+  test_bool(!cached_has(testdata, testOut("cached.trf"), tconf));
+  vsTransformationsCleanup(&t1);
+
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    vs_motionset_fini(&sets[i]);
+  vs_log_level = loglevel;
+}
@@ -0,0 +1,157 @@
+/* Checkpoints of the detection (vsMotionDetectCheckpoint, vsMotionDetectResume).
+
+   A detection that is saved after some frames, goes on, dies, and is resumed
+   from the checkpoint writes the .trf an uninterrupted run writes, byte for
+   byte: with the search pyramid and the motion prediction, with a virtual
+   tripod, and through the buffered writer. A checkpoint of other settings,
+   of a .trf that has changed, or one that is incomplete is refused. */
+
+#define CKPT_SAVED 3  // frames detected before the checkpoint
+
+/* detects the frames first..last-1 with md and appends them to f, through w
+   if given */
+static int ckpt_detect(VSMotionDetect* md, TestData* testdata, FILE* f, VSTrfWriter* w,
+                       int first, int last){
+  int ok = 1;
+  for(int i=first; ok && i < last; i++){
+    VSMotionSet set;
+    VSFrame frame;
+    // the detection may draw into the frame (show), keep the test frames
+    vsFrameAllocate(&frame, &testdata->fi);
+    vsFrameCopy(&frame, &testdata->frames[i], &testdata->fi);
+    ok = vsMotionDetectionSet(md, &set, &frame) == VS_OK;
+    if(ok)
+      ok = w ? vsTrfWriterWrite(w, md->frameNum, &set) == VS_OK
+        : vsWriteMotionSetToFile(md, f, &set) == VS_OK;
+    vs_motionset_fini(&set);
+    vsFrameFree(&frame);
+  }
+  return ok;
+}
+
+static int ckpt_init(VSMotionDetect* md, VSMotionDetectConfig conf, int mode,
+                     TestData* testdata){
+  md->serializationMode = mode;
+  return vsMotionDetectInit(md, &conf, &testdata->fi) == VS_OK;
+}
+
+/* an uninterrupted run to ref, and one that dies after a checkpoint and is
+   resumed to name */
+static int ckpt_run(TestData* testdata, VSMotionDetectConfig conf, int mode, int writer,
+                    const char* ref, const char* name){
+  VSMotionDetect md;
+  char ckpt[1024];
+  FILE* f;
+  int ok;
+  snprintf(ckpt, sizeof(ckpt), "%s.ckpt", name);
+
+  f = fopen(ref, "wb");
+  ok = f && ckpt_init(&md, conf, mode, testdata);
+  ok = ok && vsPrepareFile(&md, f) == VS_OK;
+  ok = ok && ckpt_detect(&md, testdata, f, NULL, 0, COMPACT_NFRAMES);
+  if(f) fclose(f);
+  vsMotionDetectionCleanup(&md);
+
+  // saved after CKPT_SAVED frames, then one more frame before it dies
+  f = fopen(name, "w+b");
+  ok = ok && f && ckpt_init(&md, conf, mode, testdata);
+  VSTrfWriter* w = ok && writer ? vsTrfWriterCreate(&md, f, 1) : NULL;
+  ok = ok && (!writer || w) && (w || vsPrepareFile(&md, f) == VS_OK);
+  ok = ok && ckpt_detect(&md, testdata, f, w, 0, CKPT_SAVED);
+  ok = ok && (!w || vsTrfWriterFlush(w) == VS_OK);
+  ok = ok && vsMotionDetectCheckpoint(&md, f, ckpt) == VS_OK;
+  ok = ok && ckpt_detect(&md, testdata, f, w, CKPT_SAVED, CKPT_SAVED+1);
+  ok = ok && vsTrfWriterClose(w) == VS_OK;
+  if(f) fclose(f);
+  vsMotionDetectionCleanup(&md);
+
+  // a new process picks it up
+  f = fopen(name, "r+b");
+  ok = ok && f && ckpt_init(&md, conf, mode, testdata);
+  ok = ok && vsMotionDetectResume(&md, f, ckpt) == VS_OK && md.frameNum == CKPT_SAVED;
+  w = ok && writer ? vsTrfWriterAppend(&md, f, 1) : NULL;
+  ok = ok && ckpt_detect(&md, testdata, f, w, CKPT_SAVED, COMPACT_NFRAMES);
+  ok = ok && vsTrfWriterClose(w) == VS_OK;
+  if(f) fclose(f);
+  vsMotionDetectionCleanup(&md);
+  return ok && trfwriter_same_files(ref, name);
+}
+
+void test_checkpoint(TestData* testdata){
+  VSMotionDetectConfig conf = vsMotionDetectGetDefaultConfig("test_checkpoint");
+  VSMotionDetect md;
+  char ref[1024], name[1024], ckpt[1024+8];
+  int loglevel = vs_log_level;
+  FILE* f;
+
+  vs_log_level = 1;
+  snprintf(ref, sizeof(ref), "%s", testOut("ckpt_ref.trf"));
+  snprintf(name, sizeof(name), "%s", testOut("ckpt.trf"));
+  snprintf(ckpt, sizeof(ckpt), "%s.ckpt", name);
+
+  test_bool(ckpt_run(testdata, conf, BINARY_SERIALIZATION_MODE, 0, ref, name));
+  test_bool(ckpt_run(testdata, conf, ASCII_SERIALIZATION_MODE, 0, ref, name));
+  test_bool(ckpt_run(testdata, conf, COMPACT_SERIALIZATION_MODE, 1, ref, name));
+  VSMotionDetectConfig pyr = conf;
+  pyr.pyramidLevels = 2;
+  pyr.motionPrediction = 1;
+  test_bool(ckpt_run(testdata, pyr, BINARY_SERIALIZATION_MODE, 0, ref, name));
+  VSMotionDetectConfig tripod = conf;
+  tripod.virtualTripod = 2;
+  test_bool(ckpt_run(testdata, tripod, BINARY_SERIALIZATION_MODE, 0, ref, name));
+
+  // other settings: refused, md untouched
+  VSMotionDetectConfig other = conf;
+  other.contrastThreshold = conf.contrastThreshold + 0.1;
+  test_bool(ckpt_run(testdata, conf, BINARY_SERIALIZATION_MODE, 0, ref, name));
+  f = fopen(name, "r+b");
+  test_bool(ckpt_init(&md, other, BINARY_SERIALIZATION_MODE, testdata));
+  test_bool(vsMotionDetectResume(&md, f, ckpt) == VS_ERROR);
+  test_bool(md.frameNum == 0 && !md.hasSeenOneFrame);
+  vsMotionDetectionCleanup(&md);
+  fclose(f);
+
+  // a .trf that does not end as it did at the checkpoint (the checkpoint is
+  // after CKPT_SAVED frames, the file holds all now, cut it before that)
+  f = fopen(ref, "rb");
+  FILE* g = fopen(testOut("ckpt_cut.trf"), "wb");
+  for(long k=0; k < 30; k++)
+    fputc(fgetc(f), g);
+  fclose(f);
+  fclose(g);
+  f = fopen(testOut("ckpt_cut.trf"), "r+b");
+  test_bool(ckpt_init(&md, conf, BINARY_SERIALIZATION_MODE, testdata));
+  test_bool(vsMotionDetectResume(&md, f, ckpt) == VS_ERROR);
+  vsMotionDetectionCleanup(&md);
+  fclose(f);
+
+  // an incomplete checkpoint, it lacks only the closing mark: neither the
+  // reference nor the .trf are touched
+  long size = compact_file_size(ckpt);
+  long trfSize = compact_file_size(name);
+  f = fopen(ckpt, "rb");
+  g = fopen(testOut("ckpt_cut.ckpt"), "wb");
+  for(long k=0; k < size-1; k++)
+    fputc(fgetc(f), g);
+  fclose(f);
+  fclose(g);
+  f = fopen(name, "r+b");
+  test_bool(ckpt_init(&md, conf, BINARY_SERIALIZATION_MODE, testdata));
+  const int rowBytes = md.currfi.width * md.currfi.bytesPerPixel;
+  for(int y=0; y < md.currfi.height; y++)
+    memset(md.prev.data[0] + (size_t)y * md.prev.linesize[0], 0x5a, rowBytes);
+  test_bool(vsMotionDetectResume(&md, f, testOut("ckpt_cut.ckpt")) == VS_ERROR);
+  test_bool(vsMotionDetectResume(&md, f, testOut("ckpt_missing.ckpt")) == VS_ERROR);
+  test_bool(md.frameNum == 0);
+  int kept = 1;
+  for(int y=0; y < md.currfi.height; y++)
+    for(int x=0; x < rowBytes; x++)
+      kept = kept && md.prev.data[0][(size_t)y * md.prev.linesize[0] + x] == 0x5a;
+  test_bool(kept);
+  fflush(f);
+  test_bool(compact_file_size(name) == trfSize);
+  vsMotionDetectionCleanup(&md);
+  fclose(f);
+
+  vs_log_level = loglevel;
+}
@@ -0,0 +1,216 @@
+/* The compact local motions (VSCompactMotion, format version 2).
+
+   A compact .trf has the version 2 header and 20 byte records, and every
+   reader takes it as well as version 1. vsReadCompactMotionsFile gives the
+   motions vsReadLocalMotionsFile gives, and vsCompactMotions2Transforms the
+   transforms vsLocalmotions2Transforms gives, bit for bit, also with the lens
+   estimation on. */
+
+#define COMPACT_NFRAMES 5
+
+static long compact_file_size(const char* name){
+  FILE* f = fopen(name, "rb");
+  long size;
+  if(!f) return -1;
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+/* writes the motions of all frames with the given serialization mode */
+static int compact_write(const char* name, int mode, VSMotionSet* sets,
+                         const VSFrameInfo* fi){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_compact");
+  VSMotionDetect md;
+  FILE* f = fopen(name, "wb");
+  int ok;
+  if(!f) return 0;
+  md.serializationMode = mode;
+  ok = vsMotionDetectInit(&md, &mdconf, fi) == VS_OK;
+  ok &= md.serializationMode == mode;
+  ok &= vsPrepareFile(&md, f) == VS_OK;
+  for(int i=0; ok && i < COMPACT_NFRAMES; i++){
+    md.frameNum = i+1;
+    ok &= vsWriteMotionSetToFile(&md, f, &sets[i]) == VS_OK;
+  }
+  fclose(f);
+  vsMotionDetectionCleanup(&md);
+  return ok;
+}
+
+/* the compact clip holds the motions of mlms, with contrast and match
+   rounded to float when rounded is set */
+static int compact_same_motions(const VSManyCompactMotions* cms,
+                                const VSManyLocalMotions* mlms, int rounded){
+  if(vs_compactmotions_num_frames(cms) != vs_vector_size(mlms))
+    return 0;
+  for(int i=0; i < vs_vector_size(mlms); i++){
+    const LocalMotions* lms = VSMLMGet(mlms, i);
+    int num;
+    const VSCompactMotion* cm = vs_compactmotions_frame(cms, i, &num);
+    if(num != vs_vector_size(lms))
+      return 0;
+    for(int k=0; k < num; k++){
+      const LocalMotion* lm = LMGet(lms, k);
+      double contrast = rounded ? (float)lm->contrast : lm->contrast;
+      double match = rounded ? (float)lm->match : lm->match;
+      if(cm[k].vx != lm->v.x || cm[k].vy != lm->v.y || cm[k].fx != lm->f.x
+         || cm[k].fy != lm->f.y || cm[k].fsize != lm->f.size
+         || cm[k].contrast != contrast || cm[k].match != match)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+static void compact_free_many(VSManyLocalMotions* mlms){
+  for(int i=0; i < vs_vector_size(mlms); i++)
+    if(VSMLMGet(mlms, i))
+      vs_vector_del(VSMLMGet(mlms, i));
+  vs_vector_del(mlms);
+}
+
+static int compact_same_transforms(const VSTransformations* a, const VSTransformations* b){
+  if(a->len != b->len)
+    return 0;
+  for(int i=0; i < a->len; i++){
+    const VSTransform* s = &a->ts[i];
+    const VSTransform* t = &b->ts[i];
+    if(s->x != t->x || s->y != t->y || s->alpha != t->alpha || s->zoom != t->zoom
+       || s->barrel != t->barrel || s->extra != t->extra)
+      return 0;
+  }
+  return 1;
+}
+
+/* the transforms of both clips with the given configuration */
+static int compact_transforms_agree(TestData* testdata, VSManyLocalMotions* mlms,
+                                    VSManyCompactMotions* cms, int simple, int lens){
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_compact");
+  VSTransformData td1, td2;
+  VSTransformations t1, t2;
+  int ok;
+  tconf.simpleMotionCalculation = simple;
+  tconf.estimateLensDistortion = lens;
+  vsTransformationsInit(&t1);
+  vsTransformationsInit(&t2);
+  ok = vsTransformDataInit(&td1, &tconf, &testdata->fi, &testdata->fi) == VS_OK;
+  ok &= vsTransformDataInit(&td2, &tconf, &testdata->fi, &testdata->fi) == VS_OK;
+  ok &= vsLocalmotions2Transforms(&td1, mlms, &t1) == VS_OK;
+  ok &= vsCompactMotions2Transforms(&td2, cms, &t2) == VS_OK;
+  ok &= t1.len == COMPACT_NFRAMES && compact_same_transforms(&t1, &t2);
+  vsTransformationsCleanup(&t1);
+  vsTransformationsCleanup(&t2);
+  vsTransformDataCleanup(&td1);
+  vsTransformDataCleanup(&td2);
+  return ok;
+}
+
+void test_compact(TestData* testdata){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_compact");
+  VSMotionDetect md;
+  VSMotionSet sets[COMPACT_NFRAMES];
+  VSManyLocalMotions mlms, mlms1;
+  VSManyCompactMotions cms;
+  char head[4];
+  long total = 0;
+  int loglevel = vs_log_level;
+  FILE* f;
+
+  vs_log_level = 1;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  for(int i=0; i < COMPACT_NFRAMES; i++){
+    test_bool(vsMotionDetectionSet(&md, &sets[i], &testdata->frames[i]) == VS_OK);
+    total += sets[i].num;
+  }
+  vsMotionDetectionCleanup(&md);
+  test_bool(total > 0);
+
+  // the conversion keeps the positions and rounds contrast and match
+  if(sets[1].num > 0){
+    VSCompactMotion cm = vs_compact_motion(MSGet(&sets[1], 0));
+    LocalMotion lm = vs_expand_motion(&cm);
+    test_bool(sizeof(VSCompactMotion) == 20 && cm.reserved == 0);
+    test_bool(lm.v.x == MSGet(&sets[1], 0)->v.x && lm.f.size == MSGet(&sets[1], 0)->f.size);
+    test_bool(lm.match == (float)MSGet(&sets[1], 0)->match);
+  }
+
+  // both versions on disk: the header, and 20 instead of 26 bytes a motion
+  test_bool(compact_write(testOut("compact_v1.trf"), BINARY_SERIALIZATION_MODE,
+                          sets, &testdata->fi));
+  test_bool(compact_write(testOut("compact_v2.trf"), COMPACT_SERIALIZATION_MODE,
+                          sets, &testdata->fi));
+  test_bool(compact_write(testOut("compact.trf"), ASCII_SERIALIZATION_MODE,
+                          sets, &testdata->fi));
+  f = fopen(testOut("compact_v2.trf"), "rb");
+  test_bool(f && fread(head, 1, 4, f) == 4 && memcmp(head, "TRF2", 4) == 0);
+  rewind(f);
+  test_bool(vsGuessSerializationMode(f) == COMPACT_SERIALIZATION_MODE);
+  test_bool(vsReadFileVersion(f, COMPACT_SERIALIZATION_MODE) == 2);
+  fclose(f);
+  long size1 = compact_file_size(testOut("compact_v1.trf"));
+  long size2 = compact_file_size(testOut("compact_v2.trf"));
+  fprintf(stderr, "%li motions: version 1 %li bytes, version 2 %li bytes\n",
+          total, size1, size2);
+  test_bool(size1 == 24 + COMPACT_NFRAMES*8 + 26*total);
+  test_bool(size2 == 24 + COMPACT_NFRAMES*8 + 20*total);
+
+  // version 2 through both readers
+  f = fopen(testOut("compact_v2.trf"), "rb");
+  test_bool(vsReadLocalMotionsFile(f, &mlms) == VS_OK);
+  fclose(f);
+  f = fopen(testOut("compact_v2.trf"), "rb");
+  test_bool(vsReadCompactMotionsFile(f, &cms) == VS_OK);
+  fclose(f);
+  test_bool(vs_vector_size(&mlms) == COMPACT_NFRAMES);
+  test_bool(compact_same_motions(&cms, &mlms, 0));
+  test_bool(compact_transforms_agree(testdata, &mlms, &cms, 0, 0));
+  test_bool(compact_transforms_agree(testdata, &mlms, &cms, 1, 0));
+  test_bool(compact_transforms_agree(testdata, &mlms, &cms, 0, 1));
+  compact_free_many(&mlms);
+  vs_compactmotions_fini(&cms);
+
+  // version 1 and ascii files are still read, into both
+  const char* older[2] = { "compact_v1.trf", "compact.trf" };
+  for(int k=0; k < 2; k++){
+    f = fopen(testOut(older[k]), "rb");
+    test_bool(vsReadLocalMotionsFile(f, &mlms1) == VS_OK);
+    fclose(f);
+    f = fopen(testOut(older[k]), "rb");
+    test_bool(vsReadCompactMotionsFile(f, &cms) == VS_OK);
+    fclose(f);
+    test_bool(vs_vector_size(&mlms1) == COMPACT_NFRAMES);
+    for(int i=0; i < COMPACT_NFRAMES && k == 0; i++)
+      test_bool(vs_vector_size(VSMLMGet(&mlms1, i)) == sets[i].num
+                && (sets[i].num == 0
+                    || LMGet(VSMLMGet(&mlms1, i), 0)->match == MSGet(&sets[i], 0)->match));
+    test_bool(compact_same_motions(&cms, &mlms1, 1));
+    compact_free_many(&mlms1);
+    vs_compactmotions_fini(&cms);
+  }
+
+  // frames that are missing or set twice
+  vs_compactmotions_init(&cms);
+  test_bool(vs_compactmotions_set_frame(&cms, 3, &sets[1]) == VS_OK);
+  test_bool(vs_compactmotions_set_frame(&cms, 1, &sets[2]) == VS_OK);
+  test_bool(vs_compactmotions_set_frame(&cms, 1, &sets[3]) == VS_OK);
+  test_bool(vs_compactmotions_set_frame(&cms, -1, &sets[3]) == VS_ERROR);
+  test_bool(vs_compactmotions_num_frames(&cms) == 4);
+  int num;
+  test_bool(vs_compactmotions_frame(&cms, 0, &num) == NULL && num == 0);
+  test_bool(vs_compactmotions_frame(&cms, 4, &num) == NULL && num == 0);
+  vs_compactmotions_frame(&cms, 1, &num);
+  test_bool(num == sets[3].num);
+  VSMotionSet got;
+  vs_motionset_init(&got, 0);
+  test_bool(vs_compactmotions_get_frame(&cms, 3, &got) == VS_OK && got.num == sets[1].num);
+  test_bool(vs_compactmotions_get_frame(&cms, 2, &got) == VS_OK && got.num == 0);
+  vs_motionset_fini(&got);
+  vs_compactmotions_fini(&cms);
+  test_bool(cms.motions == NULL && cms.numFrames == 0);
+
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    vs_motionset_fini(&sets[i]);
+  vs_log_level = loglevel;
+}
@@ -0,0 +1,80 @@
+/* Consensus early exit of the coarse search (VSMotionDetectConfig.consensusFields).
+
+   On the translations of the test frames the coarse fields agree and the
+   search has to stop early, with the transforms still found; on the rotated
+   frames the fields in the corners disagree with the median and every field
+   has to be searched. The rounds have a fixed size, so the local motions must
+   not depend on the number of threads (issue #111). */
+
+/* runs the detection over the test frames, returns 0 if a transform was not
+   recovered and stores the number of motions per frame in nums */
+static int consensus_run(TestData* testdata, int consensusFields, int threads,
+                         LocalMotions* kept, int* nums){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_consensus");
+  VSMotionDetect md;
+  int allok = 1;
+
+  mdconf.consensusFields = consensusFields;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  md.conf.numThreads = threads;
+  for(int i=0; i<5; i++){
+    LocalMotions lms;
+    VSTransform t, orig, diff;
+    test_bool(vsMotionDetection(&md, &lms, &testdata->frames[i]) == VS_OK);
+    nums[i] = vs_vector_size(&lms);
+    t = vsSimpleMotionsToTransform(testdata->fi, "test_consensus", &lms);
+    orig = mult_transform_(getTestFrameTransform(i), -1.0);
+    diff = sub_transforms(&t, &orig);
+    if(!(fabs(diff.x)<2 && fabs(diff.y)<2 && fabs(diff.alpha)<0.005)){
+      fprintf(stderr,"consensus %i frame %i: difference ", consensusFields, i);
+      storeVSTransform(stderr,&diff);
+      allok = 0;
+    }
+    if(kept) kept[i] = lms;
+    else vs_vector_del(&lms);
+  }
+  vsMotionDetectionCleanup(&md);
+  return allok;
+}
+
+void test_consensus(TestData* testdata){
+  LocalMotions lms1[5], lms2[5];
+  int full[5], cons[5], cons2[5];
+  int loglevel = vs_log_level;
+  int threads2 = 3;
+#ifdef USE_OMP
+  if(omp_get_max_threads() > 3) threads2 = omp_get_max_threads();
+#endif
+
+  vs_log_level = 1;
+  test_bool(consensus_run(testdata, 0, 1, NULL, full));
+  test_bool(consensus_run(testdata, 16, 1, lms1, cons));
+  test_bool(consensus_run(testdata, 16, threads2, lms2, cons2));
+  vs_log_level = loglevel;
+  for(int i=1; i<5; i++)
+    fprintf(stderr,"frame %i: %i motions, %i with consensus exit\n", i, full[i], cons[i]);
+
+  // pure translations: the coarse search stops early
+  test_bool(cons[1] < full[1] && cons[2] < full[2]);
+  // rotations: no consensus, the same fields as without
+  test_bool(cons[3] == full[3] && cons[4] == full[4]);
+
+  int same = 1;
+  for(int i=0; i<5; i++){
+    if(vs_vector_size(&lms1[i]) != vs_vector_size(&lms2[i])){
+      same = 0;
+    }else{
+      for(int k=0; k < vs_vector_size(&lms1[i]); k++){
+        const LocalMotion* a = LMGet(&lms1[i],k);
+        const LocalMotion* b = LMGet(&lms2[i],k);
+        same &= a->v.x == b->v.x && a->v.y == b->v.y && a->f.x == b->f.x
+          && a->f.y == b->f.y && a->match == b->match && a->contrast == b->contrast;
+      }
+    }
+    vs_vector_del(&lms1[i]);
+    vs_vector_del(&lms2[i]);
+  }
+  if(!same)
+    fprintf(stderr,"local motions differ between 1 and %i threads\n", threads2);
+  test_bool(same);
+}
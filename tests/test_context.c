@@ -0,0 +1,151 @@
+/* Instances with their own VSContext (vscontext.h).
+
+   vsContextInit has to pick the same kernels as vs_simd_init without touching
+   the globals. Two detections with different contexts run at the same time on
+   two threads: each one reaches only its own kernels and logger, the globals
+   stay as they were, and both give the same local motions as an instance on
+   the default context. A transform takes its logger, its executor and its
+   number of threads from the context. */
+
+static vsCompareSubImgFn context_compare_orig;
+static unsigned long context_compares[2];
+static int context_logs[2];
+
+static unsigned int context_compare0(unsigned char* const I1, unsigned char* const I2,
+                                     const Field* field, int linesize1, int linesize2,
+                                     int height, int bytesPerPixel, int d_x, int d_y,
+                                     unsigned int threshold){
+  context_compares[0]++;
+  return context_compare_orig(I1, I2, field, linesize1, linesize2, height,
+                              bytesPerPixel, d_x, d_y, threshold);
+}
+
+static unsigned int context_compare1(unsigned char* const I1, unsigned char* const I2,
+                                     const Field* field, int linesize1, int linesize2,
+                                     int height, int bytesPerPixel, int d_x, int d_y,
+                                     unsigned int threshold){
+  context_compares[1]++;
+  return context_compare_orig(I1, I2, field, linesize1, linesize2, height,
+                              bytesPerPixel, d_x, d_y, threshold);
+}
+
+static int context_log0(int type, const char* tag, const char* format, ...){
+  (void)type; (void)tag; (void)format;
+  context_logs[0]++;
+  return VS_OK;
+}
+
+static int context_log1(int type, const char* tag, const char* format, ...){
+  (void)type; (void)tag; (void)format;
+  context_logs[1]++;
+  return VS_OK;
+}
+
+typedef struct {
+  TestData* testdata;
+  VSContext ctx[2];
+  LocalMotions lms[2][5];
+  int ok[2];
+} ContextTestJob;
+
+/* detection over the test frames with the context of instance i */
+static void context_detect(void* arg, int i){
+  ContextTestJob* job = (ContextTestJob*)arg;
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_context");
+  VSMotionDetect md;
+  job->ok[i] = vsMotionDetectInitContext(&md, &mdconf, &job->testdata->fi,
+                                         &job->ctx[i]) == VS_OK;
+  if(!job->ok[i])
+    return;
+  job->ok[i] = md.conf.numThreads == 1 && md.pool == NULL;
+  for(int f=0; f < 5; f++)
+    job->ok[i] &= vsMotionDetection(&md, &job->lms[i][f], &job->testdata->frames[f]) == VS_OK;
+  vsMotionDetectionCleanup(&md);
+}
+
+void test_context(TestData* testdata){
+  VSContext def, fresh;
+  ContextTestJob job;
+  LocalMotions lms[5];
+  int loglevel = vs_log_level;
+
+  vsContextFromGlobals(&def);
+  vsContextInit(&fresh);
+  test_bool(fresh.compareSubImg == def.compareSubImg);
+  test_bool(fresh.compareSubImgRun == def.compareSubImgRun);
+  test_bool(fresh.contrastSubImg1 == def.contrastSubImg1);
+  test_bool(fresh.rgbToLuma == def.rgbToLuma);
+  test_bool(strcmp(fresh.simdName, def.simdName) == 0);
+  test_bool(fresh.log == vs_log && fresh.numThreads == 0 && !fresh.executor.parallel_for);
+
+  // the reference: an instance on the default context
+  vs_log_level = 1;
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_context");
+  VSMotionDetect md;
+  mdconf.numThreads = 1;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  test_bool(md.ctx.compareSubImg == compareSubImg && md.ctx.log == vs_log);
+  for(int f=0; f < 5; f++)
+    test_bool(vsMotionDetection(&md, &lms[f], &testdata->frames[f]) == VS_OK);
+  vsMotionDetectionCleanup(&md);
+  vs_log_level = loglevel;
+
+  // two instances with their own kernels and loggers, at the same time
+  job.testdata = testdata;
+  context_compare_orig = fresh.compareSubImg;
+  for(int i=0; i < 2; i++){
+    job.ctx[i] = fresh;
+    job.ctx[i].compareSubImg = i ? context_compare1 : context_compare0;
+    job.ctx[i].log = i ? context_log1 : context_log0;
+    job.ctx[i].numThreads = 1; // the counters are not thread safe
+    context_compares[i] = 0;
+    context_logs[i] = 0;
+  }
+  VSThreadPool* pool = vsThreadPoolCreate(2);
+  vsParallelFor(pool, 2, 2, context_detect, &job);
+  vsThreadPoolDestroy(pool);
+  test_bool(compareSubImg == def.compareSubImg && vs_log == def.log);
+  for(int i=0; i < 2; i++){
+    test_bool(job.ok[i]);
+    test_bool(context_compares[i] > 0 && context_logs[i] > 0);
+    int same = pool_same_motions(lms, job.lms[i], 5);
+    if(!same)
+      fprintf(stderr,"instance %i: local motions differ from the default context\n", i);
+    test_bool(same);
+    for(int f=0; f < 5; f++)
+      vs_vector_del(&job.lms[i][f]);
+  }
+  fprintf(stderr,"compares: %lu and %lu, messages: %i and %i\n",
+          context_compares[0], context_compares[1], context_logs[0], context_logs[1]);
+  test_bool(context_compares[0] == context_compares[1]);
+  for(int f=0; f < 5; f++)
+    vs_vector_del(&lms[f]);
+
+  // a transform with the logger and the executor of its context
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_context");
+  VSTransformData td;
+  PoolTestHost host = { NULL, 0, 0, 0 };
+  VSContext tctx = fresh;
+  tctx.log = context_log0;
+  tctx.executor.parallel_for = pool_host_for;
+  tctx.executor.ctx = &host;
+  test_bool(vsTransformDataInitContext(&td, &tconf, &testdata->fi, &testdata->fi,
+                                       &tctx) == VS_OK);
+  test_bool(td.ctx.log == context_log0 && td.pool != NULL);
+  vsTransformDataCleanup(&td);
+  test_bool(vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi) == VS_OK);
+  test_bool(td.ctx.log == vs_log && td.pool == NULL && td.conf.numThreads >= 1);
+  vsTransformDataCleanup(&td);
+  // the threads of a transform without an executor: its own, else the context's
+  tctx = fresh;
+  tctx.numThreads = 3;
+  test_bool(vsTransformDataInitContext(&td, &tconf, &testdata->fi, &testdata->fi,
+                                       &tctx) == VS_OK);
+  test_bool(td.pool == NULL && td.conf.numThreads == 3);
+  vsTransformDataCleanup(&td);
+  tconf.numThreads = 1;
+  test_bool(vsTransformDataInitContext(&td, &tconf, &testdata->fi, &testdata->fi,
+                                       &tctx) == VS_OK);
+  test_bool(td.conf.numThreads == 1);
+  vsTransformDataCleanup(&td);
+}
@@ -85,3 +85,106 @@ void test_contrastImg(const TestData* testdata){
   }
 #endif
 }
+
+/* direct sum and sum of squares of a size x size block */
+static void contrast_box_direct(const VSFrame* f, int x, int y, int size,
+                                uint32_t* sum, uint64_t* sqsum){
+  *sum = 0; *sqsum = 0;
+  for(int j=y; j < y+size; j++){
+    const uint8_t* p = f->data[0] + j*f->linesize[0];
+    for(int i=x; i < x+size; i++){
+      *sum   += p[i];
+      *sqsum += (uint32_t)p[i]*p[i];
+    }
+  }
+}
+
+/* VSContrastVariance: the summed-area tables built along with the blur have to
+   be exact, the blur itself must not change, and detection has to work with
+   the fields selected by it. */
+void test_contrastIntegral(TestData* testdata){
+  const VSFrameInfo* fi = &testdata->fi;
+  VSFrame blur, blurI, tmp;
+  VSIntegralImage ii;
+  int s, p, allok = 1;
+  static const int sizes[] = {16, 48, 112};
+  static const int pos[][2] = { {0,0}, {200,150}, {900,500}, {640,360} };
+  static const int blursizes[] = {1, 6, 15};
+
+  fprintf(stderr,"********** Contrast from summed-area tables:\n");
+  vsFrameAllocate(&blur, fi);
+  vsFrameAllocate(&blurI, fi);
+  vsFrameAllocate(&tmp, fi);
+  test_bool(vsIntegralImageAllocate(&ii, fi->width, fi->height) == VS_OK);
+  for(int b=0; b < (int)(sizeof(blursizes)/sizeof(blursizes[0])); b++){
+    boxblurPlanar(&blur, &testdata->frames[0], &tmp, fi, blursizes[b], BoxBlurNoColor);
+    boxblurPlanarIntegral(&blurI, &testdata->frames[0], &tmp, fi, blursizes[b], &ii);
+    for(int j=0; j < fi->height; j++)
+      if(memcmp(blur.data[0] + j*blur.linesize[0], blurI.data[0] + j*blurI.linesize[0],
+                fi->width) != 0)
+        allok = 0;
+    for(s=0; s < (int)(sizeof(sizes)/sizeof(sizes[0])); s++){
+      for(p=0; p < (int)(sizeof(pos)/sizeof(pos[0])); p++){
+        uint32_t sumD, sumI;
+        uint64_t sqD, sqI;
+        contrast_box_direct(&blurI, pos[p][0], pos[p][1], sizes[s], &sumD, &sqD);
+        vsIntegralImageBox(&ii, pos[p][0], pos[p][1], sizes[s], &sumI, &sqI);
+        if(sumD != sumI || sqD != sqI){
+          fprintf(stderr,"  SAT MISMATCH blur=%i size=%i pos=(%i,%i)\n",
+                  blursizes[b], sizes[s], pos[p][0], pos[p][1]);
+          allok = 0;
+        }
+      }
+    }
+  }
+  test_bool(allok);
+  // a block as high as the frame
+  {
+    uint32_t sumD, sumI;
+    uint64_t sqD, sqI;
+    contrast_box_direct(&blurI, 0, 0, fi->height, &sumD, &sqD);
+    vsIntegralImageBox(&ii, 0, 0, fi->height, &sumI, &sqI);
+    test_bool(sumD == sumI && sqD == sqI);
+  }
+  vsIntegralImageFree(&ii);
+  vsFrameFree(&blur);
+  vsFrameFree(&blurI);
+  vsFrameFree(&tmp);
+
+  // detection with the variance contrast
+  {
+    VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_contrastIntegral");
+    VSMotionDetect md;
+    int loglevel = vs_log_level;
+    mdconf.contrastMode = VSContrastVariance;
+    vs_log_level = 1;
+    test_bool(vsMotionDetectInit(&md, &mdconf, fi) == VS_OK);
+    vs_log_level = loglevel;
+    for(int i=0; i<5; i++){
+      LocalMotions lms;
+      VSTransform t, orig, diff;
+      test_bool(vsMotionDetection(&md, &lms, &testdata->frames[i]) == VS_OK);
+      if(i == 0){ // compare with the definition on the blurred frame
+        for(int f=0; f < md.fieldscoarse.fieldNum; f += 7){
+          const Field* fld = &md.fieldscoarse.fields[f];
+          uint32_t sum;
+          uint64_t sq;
+          int s2 = fld->size/2;
+          double n = (double)fld->size*fld->size;
+          // the blurred frame has become the reference by now
+          contrast_box_direct(&md.prev, fld->x - s2, fld->y - s2, fld->size, &sum, &sq);
+          double mean = sum/n;
+          double c = sqrt(3*(sq/n - mean*mean))/(mean + 0.05);
+          test_bool(fabs(contrastSubImgIntegral(&md, fld) - c) < 1e-9);
+        }
+      }
+      t = vsSimpleMotionsToTransform(md.fi, "test_contrastIntegral", &lms);
+      test_bool(vs_vector_size(&lms) > 0 || i == 0);
+      vs_vector_del(&lms);
+      orig = mult_transform_(getTestFrameTransform(i), -1.0);
+      diff = sub_transforms(&t, &orig);
+      test_bool(fabs(diff.x)<2 && fabs(diff.y)<2 && fabs(diff.alpha)<0.005);
+    }
+    vsMotionDetectionCleanup(&md);
+  }
+}
@@ -0,0 +1,183 @@
+/* Detection at reduced resolution (VSMotionDetectConfig.detectScale).
+
+   The downsampling is fused into the box blur, so boxblurPlanarScaled has to
+   give exactly the blurred full frame sampled at the block centres, summed-area
+   tables included. The detection on the small image has to find the
+   transforms of the test frames as the full resolution does, with local motions
+   in source pixels, and it has to compare far fewer pixels to get there. */
+
+static unsigned long long detectscale_pixels;
+static vsCompareSubImgFn detectscale_compare_orig;
+static vsCompareSubImgRunFn detectscale_run_orig;
+
+static unsigned int detectscale_counting_compare(unsigned char* const I1, unsigned char* const I2,
+                                                 const Field* field,
+                                                 int linesize1, int linesize2, int height,
+                                                 int bytesPerPixel, int d_x, int d_y,
+                                                 unsigned int threshold){
+  detectscale_pixels += (unsigned long long)field->size * field->size;
+  return detectscale_compare_orig(I1, I2, field, linesize1, linesize2, height,
+                                  bytesPerPixel, d_x, d_y, threshold);
+}
+
+static void detectscale_counting_run(unsigned char* const I1, unsigned char* const I2,
+                                     const Field* field,
+                                     int linesize1, int linesize2, int height,
+                                     int d_x, int d_y, int step, int n,
+                                     unsigned int threshold, unsigned int* errors){
+  detectscale_pixels += (unsigned long long)n * field->size * field->size;
+  detectscale_run_orig(I1, I2, field, linesize1, linesize2, height,
+                       d_x, d_y, step, n, threshold, errors);
+}
+
+/* boxblurPlanarScaled against boxblurPlanar plus subsampling */
+static int detectscale_blur(const VSFrame* src, const VSFrameInfo* fi, int scale,
+                            int size){
+  VSFrameInfo sfi;
+  VSFrame full, small;
+  VSIntegralImage ii, ref;
+  int ok = 1;
+  vsFrameInfoInit(&sfi, fi->width/scale, fi->height/scale, PF_GRAY8);
+  vsFrameAllocate(&full, fi);
+  vsFrameAllocate(&small, &sfi);
+  test_bool(vsIntegralImageAllocate(&ii, sfi.width, sfi.height) == VS_OK);
+  test_bool(vsIntegralImageAllocate(&ref, sfi.width, sfi.height) == VS_OK);
+
+  boxblurPlanar(&full, src, NULL, fi, size, BoxBlurNoColor);
+  boxblurPlanarScaled(&small, src, NULL, fi, size, scale, &ii, NULL, 0);
+  for(int y=0; y < sfi.height && ok; y++){
+    for(int x=0; x < sfi.width; x++){
+      uint8_t want = full.data[0][(y*scale + scale/2)*full.linesize[0] + x*scale + scale/2];
+      if(small.data[0][y*small.linesize[0] + x] != want){
+        fprintf(stderr,"scale %i size %i: pixel %i,%i is %i, expected %i\n", scale,
+                size, x, y, small.data[0][y*small.linesize[0] + x], want);
+        ok = 0;
+        break;
+      }
+    }
+  }
+  vsIntegralImageCompute(&ref, small.data[0], small.linesize[0], NULL, 0);
+  for(int k=0; k < (sfi.width+1)*(sfi.height+1) && ok; k++){
+    if(ii.sum[k] != ref.sum[k] || ii.sqsum[k] != ref.sqsum[k]){
+      fprintf(stderr,"scale %i size %i: summed-area table differs at %i\n",
+              scale, size, k);
+      ok = 0;
+    }
+  }
+  vsIntegralImageFree(&ii);
+  vsIntegralImageFree(&ref);
+  vsFrameFree(&full);
+  vsFrameFree(&small);
+  return ok;
+}
+
+/* runs the detection over the test frames (converted to fi) and returns the
+   compared pixels, or 0 if a transform was not recovered or a local motion
+   is not in source pixels */
+static unsigned long long detectscale_run(VSFrame* frames,
+                                          const VSFrameInfo* fi, int scale,
+                                          int packedLuma){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_detectscale");
+  VSMotionDetect md;
+  int allok = 1;
+
+  mdconf.detectScale = scale;
+  mdconf.packedLuma = packedLuma;
+  mdconf.numThreads = 1; // the counter is not thread safe
+  test_bool(vsMotionDetectInit(&md, &mdconf, fi) == VS_OK);
+  md.conf.numThreads = 1;
+  test_bool(md.conf.detectScale == scale);
+  test_bool(md.currfi.width == fi->width/scale && md.currfi.height == fi->height/scale);
+
+  detectscale_compare_orig = md.ctx.compareSubImg;
+  md.ctx.compareSubImg = detectscale_counting_compare;
+  detectscale_run_orig = md.ctx.compareSubImgRun;
+  md.ctx.compareSubImgRun = detectscale_counting_run;
+  detectscale_pixels = 0;
+  for(int i=0; i<5; i++){
+    LocalMotions lms;
+    VSTransform t, orig, diff;
+    test_bool(vsMotionDetection(&md, &lms, &frames[i]) == VS_OK);
+    for(int k=0; k < vs_vector_size(&lms) && i > 0; k++){
+      const LocalMotion* lm = LMGet(&lms,k);
+      if(lm->f.x < lm->f.size/2 || lm->f.x > fi->width - lm->f.size/2
+         || lm->f.y < lm->f.size/2 || lm->f.y > fi->height - lm->f.size/2
+         || (lm->f.size != md.fieldscoarse.fieldSize*scale
+             && lm->f.size != md.fieldsfine.fieldSize*scale)){
+        fprintf(stderr,"scale %i frame %i: field %i,%i size %i\n", scale, i,
+                lm->f.x, lm->f.y, lm->f.size);
+        allok = 0;
+      }
+    }
+    t = vsSimpleMotionsToTransform(*fi, "test_detectscale", &lms);
+    vs_vector_del(&lms);
+    orig = mult_transform_(getTestFrameTransform(i), -1.0);
+    diff = sub_transforms(&t, &orig);
+    if(!(fabs(diff.x)<2 && fabs(diff.y)<2 && fabs(diff.alpha)<0.005)){
+      fprintf(stderr,"scale %i frame %i: difference ", scale, i);
+      storeVSTransform(stderr,&diff);
+      allok = 0;
+    }
+  }
+  vsMotionDetectionCleanup(&md);
+  test_bool(allok);
+  return allok ? detectscale_pixels : 0;
+}
+
+void test_detectscale(TestData* testdata){
+  int loglevel = vs_log_level;
+  const VSFrameInfo* fi = &testdata->fi;
+
+  test_bool(detectscale_blur(&testdata->frames[0], fi, 2, 6));
+  test_bool(detectscale_blur(&testdata->frames[0], fi, 3, 7));
+  test_bool(detectscale_blur(&testdata->frames[1], fi, 4, 3));
+
+  VSMotionDetect md;
+  vs_log_level = 1;
+  unsigned long long full = detectscale_run(testdata->frames, fi, 1, 0);
+  unsigned long long half = detectscale_run(testdata->frames, fi, 2, 0);
+  vs_log_level = loglevel;
+  fprintf(stderr,"compared pixels: full resolution %llu, half %llu\n", full, half);
+  test_bool(full > 0 && half > 0);
+  test_bool(half < full/2);
+
+  /* packed RGB through packedLuma: the luma is converted at full size and
+     then downsampled with the blur */
+  {
+    VSFrameInfo pfi;
+    VSFrame packed[5];
+    test_bool(vsFrameInfoInit(&pfi, fi->width, fi->height, PF_RGB24));
+    for(int i=0; i<5; i++){
+      vsFrameAllocate(&packed[i], &pfi);
+      for(int y=0; y < fi->height; y++){
+        const uint8_t* s = testdata->frames[i].data[0] + y*testdata->frames[i].linesize[0];
+        uint8_t* d = packed[i].data[0] + y*packed[i].linesize[0];
+        for(int x=0; x < fi->width; x++)
+          d[3*x] = d[3*x+1] = d[3*x+2] = s[x];
+      }
+    }
+    vs_log_level = 1;
+    test_bool(detectscale_run(packed, &pfi, 2, 1) > 0);
+    vs_log_level = loglevel;
+    for(int i=0; i<5; i++)
+      vsFrameFree(&packed[i]);
+  }
+
+  /* packed input without luma and frames too small for the factor fall back */
+  {
+    VSFrameInfo sfi;
+    VSMotionDetectConfig conf = vsMotionDetectGetDefaultConfig("test_detectscale_small");
+    conf.detectScale = 4;
+    test_bool(vsFrameInfoInit(&sfi, 320, 240, PF_GRAY8));
+    vs_log_level = 1;
+    test_bool(vsMotionDetectInit(&md, &conf, &sfi) == VS_OK);
+    test_bool(md.conf.detectScale == 2);
+    vsMotionDetectionCleanup(&md);
+    test_bool(vsFrameInfoInit(&sfi, 640, 480, PF_RGB24));
+    test_bool(vsMotionDetectInit(&md, &conf, &sfi) == VS_OK);
+    test_bool(md.conf.detectScale == 1);
+    test_bool(md.currfi.width == 640);
+    vsMotionDetectionCleanup(&md);
+    vs_log_level = loglevel;
+  }
+}
@@ -0,0 +1,195 @@
+/* Sub-pixel fit of the coarse minima (VSMotionDetectConfig.skipFinePass).
+
+   On a clean pan the fits agree with the coarse transform and the fine pass
+   must not run at all, while the frame transforms stay those of the full
+   detection. When the frame holds two different motions the coarse fields do
+   not agree and the fine pass has to run again. Whether it runs is seen from
+   the compared pixels of the fine fields. On a pan by half pixels the fit
+   has to recover the fraction, which shows in the transform kept for the
+   motion prediction. The local motions keep the integral coarse vectors, so
+   the transforms the second pass fits to them stay within half a pixel of
+   those of the full detection, with and without the prediction. */
+
+#define FINE_FRAMES 8
+#define FINE_W 480
+#define FINE_H 320
+
+static unsigned long long finepass_pixels;
+static int finepass_size;
+static vsCompareSubImgFn finepass_compare_orig;
+static vsCompareSubImgRunFn finepass_run_orig;
+
+static unsigned int finepass_counting_compare(unsigned char* const I1, unsigned char* const I2,
+                                              const Field* field,
+                                              int linesize1, int linesize2, int height,
+                                              int bytesPerPixel, int d_x, int d_y,
+                                              unsigned int threshold){
+  if(field->size == finepass_size)
+    finepass_pixels += (unsigned long long)field->size * field->size;
+  return finepass_compare_orig(I1, I2, field, linesize1, linesize2, height,
+                               bytesPerPixel, d_x, d_y, threshold);
+}
+
+static void finepass_counting_run(unsigned char* const I1, unsigned char* const I2,
+                                  const Field* field,
+                                  int linesize1, int linesize2, int height,
+                                  int d_x, int d_y, int step, int n,
+                                  unsigned int threshold, unsigned int* errors){
+  if(field->size == finepass_size)
+    finepass_pixels += (unsigned long long)n * field->size * field->size;
+  finepass_run_orig(I1, I2, field, linesize1, linesize2, height,
+                    d_x, d_y, step, n, threshold, errors);
+}
+
+/* detects the motion of the frames and returns the compared pixels of the
+   fine fields; ts gets the simple transforms of the local motions, fitted
+   those the second pass fits, and last the transform of the last frame kept
+   for the motion prediction */
+static unsigned long long finepass_run(int skip, int prediction, VSFrame* frames,
+                                       const VSFrameInfo* fi, VSTransform* ts,
+                                       VSTransform* fitted, VSTransform* last){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_finepass");
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_finepass");
+  VSMotionDetect md;
+  VSTransformData td;
+  mdconf.skipFinePass = skip;
+  mdconf.motionPrediction = prediction;
+  mdconf.numThreads = 1; // the counter is not thread safe
+  test_bool(vsMotionDetectInit(&md, &mdconf, fi) == VS_OK);
+  md.conf.numThreads = 1;
+  finepass_size = md.fieldsfine.fieldSize;
+  test_bool(finepass_size != md.fieldscoarse.fieldSize);
+  finepass_compare_orig = md.ctx.compareSubImg;
+  md.ctx.compareSubImg = finepass_counting_compare;
+  finepass_run_orig = md.ctx.compareSubImgRun;
+  md.ctx.compareSubImgRun = finepass_counting_run;
+  test_bool(vsTransformDataInit(&td, &tconf, fi, fi) == VS_OK);
+  finepass_pixels = 0;
+  for(int i=0; i < FINE_FRAMES; i++){
+    LocalMotions lms;
+    test_bool(vsMotionDetection(&md, &lms, &frames[i]) == VS_OK);
+    ts[i] = vsSimpleMotionsToTransform(md.fi, "test_finepass", &lms);
+    fitted[i] = vsMotionsToTransform(&td, &lms, NULL);
+    vs_vector_del(&lms);
+  }
+  *last = md.prediction;
+  vsTransformDataCleanup(&td);
+  vsMotionDetectionCleanup(&md);
+  return finepass_pixels;
+}
+
+/* the transforms fitted to the local motions of a frame whose fine pass
+   was skipped are within half a pixel, 0.1 degree and 0.5 % zoom of those
+   of the full detection (see VSMotionDetectConfig.skipFinePass) */
+static int finepass_fits_agree(const VSTransform* full, const VSTransform* skip){
+  int ok = 1;
+  for(int i=1; i < FINE_FRAMES; i++){
+    if(fabs(skip[i].x - full[i].x) > 0.5 || fabs(skip[i].y - full[i].y) > 0.5
+       || fabs(skip[i].alpha - full[i].alpha) > 0.1*M_PI/180
+       || fabs(skip[i].zoom - full[i].zoom) > 0.5){
+      fprintf(stderr,"frame %i: fitted with the fine pass skipped %f %f %f %f, "
+              "full %f %f %f %f\n", i, skip[i].x, skip[i].y, skip[i].alpha, skip[i].zoom,
+              full[i].x, full[i].y, full[i].alpha, full[i].zoom);
+      ok = 0;
+    }
+  }
+  return ok;
+}
+
+enum { FinePan, FineSplit, FineHalfPel };
+
+/* frame i shows the base image panned by (5,3) px per frame; with FineSplit
+   the right half pans by (-6,3) instead, FineHalfPel pans by (5.5,3) */
+static void finepass_frames(VSFrame* frames, const VSFrameInfo* fi,
+                            const uint8_t* base, int bw, int mode){
+  for(int i=0; i < FINE_FRAMES; i++){
+    vsFrameAllocate(&frames[i], fi);
+    for(int y=0; y < FINE_H; y++){
+      for(int x=0; x < FINE_W; x++){
+        int ox2 = 2*(20 + 5*i); // in half pixels
+        if(mode == FineSplit && x >= FINE_W/2)
+          ox2 = 2*(60 - 6*i);
+        if(mode == FineHalfPel)
+          ox2 = 40 + 11*i;
+        const uint8_t* p = base + (y + 20 + 3*i)*bw + x + ox2/2;
+        frames[i].data[0][y*frames[i].linesize[0] + x] =
+          (ox2 & 1) ? (uint8_t)((p[0] + p[1] + 1)/2) : p[0];
+      }
+    }
+  }
+}
+
+void test_finepass(void){
+  VSFrameInfo fi;
+  VSFrame frames[FINE_FRAMES];
+  VSTransform full[FINE_FRAMES], skip[FINE_FRAMES], lastFull, lastSkip;
+  VSTransform fitFull[FINE_FRAMES], fitSkip[FINE_FRAMES];
+  int loglevel = vs_log_level;
+  int bw = FINE_W + 120, bh = FINE_H + 60;
+  uint8_t* base = (uint8_t*)vs_malloc(bw*bh);
+  int i, allok = 1;
+
+  srand(11);
+  for(int y=0; y < bh; y += 4)
+    for(int x=0; x < bw; x += 4){
+      uint8_t v = (uint8_t)(rand()%256);
+      for(int k=0; k < 16; k++)
+        base[(y + k/4)*bw + x + k%4] = v;
+    }
+  test_bool(vsFrameInfoInit(&fi, FINE_W, FINE_H, PF_GRAY8));
+
+  finepass_frames(frames, &fi, base, bw, FinePan);
+  vs_log_level = 1;
+  unsigned long long pixelsFull = finepass_run(0, 1, frames, &fi, full, fitFull, &lastFull);
+  unsigned long long pixelsSkip = finepass_run(1, 1, frames, &fi, skip, fitSkip, &lastSkip);
+  vs_log_level = loglevel;
+  fprintf(stderr,"compared pixels in fine fields, pan: with fine pass %llu, "
+          "skipped %llu\n", pixelsFull, pixelsSkip);
+  for(i=1; i < FINE_FRAMES; i++){
+    if(fabs(skip[i].x - 5) > 0.5 || fabs(skip[i].y - 3) > 0.5
+       || fabs(skip[i].x - full[i].x) > 0.5 || fabs(skip[i].y - full[i].y) > 0.5){
+      fprintf(stderr,"frame %i: skipped %f %f full %f %f\n", i,
+              skip[i].x, skip[i].y, full[i].x, full[i].y);
+      allok = 0;
+    }
+  }
+  test_bool(allok);
+  test_bool(finepass_fits_agree(fitFull, fitSkip));
+  test_bool(pixelsFull > 0);
+  test_bool(pixelsSkip == 0);
+  for(i=0; i < FINE_FRAMES; i++)
+    vsFrameFree(&frames[i]);
+
+  finepass_frames(frames, &fi, base, bw, FineSplit);
+  vs_log_level = 1;
+  pixelsFull = finepass_run(0, 1, frames, &fi, full, fitFull, &lastFull);
+  pixelsSkip = finepass_run(1, 1, frames, &fi, skip, fitSkip, &lastSkip);
+  vs_log_level = loglevel;
+  fprintf(stderr,"compared pixels in fine fields, two motions: with fine pass %llu, "
+          "skip mode %llu\n", pixelsFull, pixelsSkip);
+  test_bool(pixelsSkip == pixelsFull);
+  for(i=0; i < FINE_FRAMES; i++)
+    vsFrameFree(&frames[i]);
+
+  finepass_frames(frames, &fi, base, bw, FineHalfPel);
+  vs_log_level = 1;
+  pixelsFull = finepass_run(0, 1, frames, &fi, full, fitFull, &lastFull);
+  pixelsSkip = finepass_run(1, 1, frames, &fi, skip, fitSkip, &lastSkip);
+  vs_log_level = loglevel;
+  fprintf(stderr,"half pixel pan: last transform x %f (with fine pass), "
+          "%f (sub-pixel fit), fine field pixels %llu / %llu\n",
+          lastFull.x, lastSkip.x, pixelsFull, pixelsSkip);
+  test_bool(pixelsSkip < pixelsFull);
+  test_bool(fabs(lastSkip.x - 5.5) < 0.2);
+  test_bool(fabs(lastSkip.y - 3) < 0.2);
+  // the local motions keep the integral coarse vectors, the fraction is lost
+  test_bool(finepass_fits_agree(fitFull, fitSkip));
+  vs_log_level = 1;
+  finepass_run(0, 0, frames, &fi, full, fitFull, &lastFull);
+  finepass_run(1, 0, frames, &fi, skip, fitSkip, &lastSkip);
+  vs_log_level = loglevel;
+  test_bool(finepass_fits_agree(fitFull, fitSkip));
+  for(i=0; i < FINE_FRAMES; i++)
+    vsFrameFree(&frames[i]);
+  vs_free(base);
+}
@@ -1161,9 +1161,58 @@ static void ldCheckTransformPass(double trueK, int enable, const char* label,
   }
   fprintf(stderr, "%s: worst per-frame shift error %.4f px\n", label, worstXY);
   if(worstXYOut) *worstXYOut = worstXY;
+  vsTransformDataCleanup(&td);
+
+  /* the streaming pass, from the same motions in a .trf, fits the same
+     transforms through the same k */
+  {
+    VSMotionDetect md;
+    VSTransformations strans;
+    FILE* f = tmpfile();
+    test_bool(f != NULL);
+    memset(&md, 0, sizeof(md));
+    md.serializationMode = BINARY_SERIALIZATION_MODE;
+    test_bool(vsPrepareFile(&md, f) == VS_OK);
+    for(i=0; i<vs_vector_size(&mlms); i++){
+      md.frameNum = i+1;
+      test_bool(vsWriteToFile(&md, f, VSMLMGet(&mlms, i)) == VS_OK);
+    }
+    rewind(f);
+    test_bool(vsTransformDataInit(&td, &tdconf, &clip.fi, &clip.fi) == VS_OK);
+    memset(&strans, 0, sizeof(strans));
+    test_bool(vsStreamMotions2Transforms(&td, f, &strans) == VS_OK);
+    test_bool(strans.len == trans.len);
+    for(i=0; i<trans.len && i<strans.len; i++)
+      test_bool(strans.ts[i].x == trans.ts[i].x && strans.ts[i].y == trans.ts[i].y
+                && strans.ts[i].alpha == trans.ts[i].alpha
+                && strans.ts[i].barrel == trans.ts[i].barrel);
+    /* stored in the file, the transforms come back with the k of the fit,
+       which reaches the render path as it does from the fit */
+    {
+      VSTransformData td2;
+      VSTransformations ctrans;
+      test_bool(vsWriteTransformsToFile(&td, f, &strans) == VS_OK);
+      test_bool(vsTransformDataInit(&td2, &tdconf, &clip.fi, &clip.fi) == VS_OK);
+      memset(&ctrans, 0, sizeof(ctrans));
+      test_bool(vsReadTransformsFromFile(&td2, f, &ctrans) == VS_OK);
+      test_bool(ctrans.len == strans.len && td2.fitLensK == td.fitLensK
+                && td2.lensK == td.lensK && (enable || td.fitLensK == 0));
+      for(i=0; i<ctrans.len && i<strans.len; i++)
+        test_bool(ctrans.ts[i].x == strans.ts[i].x && ctrans.ts[i].y == strans.ts[i].y
+                  && ctrans.ts[i].alpha == strans.ts[i].alpha
+                  && ctrans.ts[i].zoom == strans.ts[i].zoom
+                  && ctrans.ts[i].barrel == strans.ts[i].barrel
+                  && ctrans.ts[i].rshutter == strans.ts[i].rshutter
+                  && ctrans.ts[i].extra == strans.ts[i].extra);
+      vsTransformationsCleanup(&ctrans);
+      vsTransformDataCleanup(&td2);
+    }
+    vsTransformationsCleanup(&strans);
+    vsTransformDataCleanup(&td);
+    fclose(f);
+  }
 
   vsTransformationsCleanup(&trans);
-  vsTransformDataCleanup(&td);
   for(i=0; i<vs_vector_size(&mlms); i++) vs_vector_del(VSMLMGet(&mlms, i));
   vs_vector_del(&mlms);
   ldFreeClip(&clip);
@@ -0,0 +1,123 @@
+/* The contiguous motion sets (motionset.h).
+
+   The container has to grow, append and convert to and from LocalMotions
+   without losing or reordering a motion. vsMotionDetectionSet has to find
+   the motions vsMotionDetection finds, and the transforms and the stored
+   .trf data of a set have to be those of the same motions as LocalMotions. */
+
+static int motionset_same(const VSMotionSet* set, const LocalMotions* lms){
+  if(set->num != vs_vector_size(lms))
+    return 0;
+  for(int i=0; i < set->num; i++){
+    const LocalMotion* a = MSGet(set,i);
+    const LocalMotion* b = LMGet(lms,i);
+    if(a->v.x != b->v.x || a->v.y != b->v.y || a->f.x != b->f.x || a->f.y != b->f.y
+       || a->f.size != b->f.size || a->contrast != b->contrast || a->match != b->match)
+      return 0;
+  }
+  return 1;
+}
+
+static int motionset_same_transform(VSTransform a, VSTransform b){
+  return a.x == b.x && a.y == b.y && a.alpha == b.alpha && a.zoom == b.zoom
+    && a.extra == b.extra;
+}
+
+/* the bytes vsStoreLocalmotions resp. vsStoreMotionSet write for the same
+   motions have to be the same */
+static int motionset_same_stored(const VSMotionSet* set, const LocalMotions* lms, int mode){
+  FILE* f1 = tmpfile();
+  FILE* f2 = tmpfile();
+  int same = 1, c1, c2;
+  if(!f1 || !f2){
+    if(f1) fclose(f1);
+    if(f2) fclose(f2);
+    return 0;
+  }
+  same &= vsStoreLocalmotions(f1, lms, mode) > 0;
+  same &= vsStoreMotionSet(f2, set, mode) > 0;
+  rewind(f1);
+  rewind(f2);
+  do{
+    c1 = fgetc(f1);
+    c2 = fgetc(f2);
+    same &= c1 == c2;
+  }while(c1 != EOF && c2 != EOF);
+  fclose(f1);
+  fclose(f2);
+  return same;
+}
+
+void test_motionset(TestData* testdata){
+  VSMotionSet set, other;
+  LocalMotions lms;
+  LocalMotion lm = null_localmotion();
+  int loglevel = vs_log_level;
+
+  // the container
+  test_bool(vs_motionset_init(&set, 0) == VS_OK);
+  test_bool(vs_motionset_size(&set) == 0 && set.lms == NULL);
+  for(int i=0; i < 1000; i++){
+    lm.v.x = i; lm.v.y = -i; lm.f.x = 2*i; lm.match = i/4.0;
+    test_bool(vs_motionset_append(&set, &lm) == VS_OK);
+  }
+  test_bool(vs_motionset_size(&set) == 1000 && set.capacity >= 1000);
+  int inorder = 1;
+  for(int i=0; i < 1000; i++)
+    inorder &= MSGet(&set,i)->v.x == i && MSGet(&set,i)->v.y == -i
+      && MSGet(&set,i)->f.x == 2*i && MSGet(&set,i)->match == i/4.0;
+  test_bool(inorder);
+  test_bool(vs_motionset_reserve(&set, VS_MOTIONSET_MAX_SIZE + 1) == VS_ERROR);
+  test_bool(vs_motionset_size(&set) == 1000);
+
+  test_bool(vs_motionset_to_vector(&set, &lms) == VS_OK);
+  test_bool(motionset_same(&set, &lms));
+  test_bool(vs_motionset_from_vector(&other, &lms) == VS_OK);
+  test_bool(motionset_same(&other, &lms));
+  test_bool(vs_motionset_append_set(&other, &set) == VS_OK);
+  test_bool(other.num == 2000 && MSGet(&other,1999)->v.x == 999
+            && MSGet(&other,999)->v.x == 999 && MSGet(&other,1000)->v.x == 0);
+  vs_vector_del(&lms);
+  vs_motionset_fini(&other);
+  test_bool(other.num == 0 && other.lms == NULL);
+  vs_motionset_fini(&set);
+  vs_motionset_fini(&set); // twice is fine
+
+  test_bool(vs_motionset_to_vector(&set, &lms) == VS_OK);
+  test_bool(vs_vector_size(&lms) == 0);
+  vs_vector_del(&lms);
+
+  // detection, transforms and storing of the same frames through both APIs
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_motionset");
+  VSMotionDetect md1, md2;
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_motionset");
+  VSTransformData td;
+  vs_log_level = 1;
+  mdconf.numThreads = 1;
+  test_bool(vsMotionDetectInit(&md1, &mdconf, &testdata->fi) == VS_OK);
+  test_bool(vsMotionDetectInit(&md2, &mdconf, &testdata->fi) == VS_OK);
+  test_bool(vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi) == VS_OK);
+  for(int i=0; i < 5; i++){
+    test_bool(vsMotionDetection(&md1, &lms, &testdata->frames[i]) == VS_OK);
+    test_bool(vsMotionDetectionSet(&md2, &set, &testdata->frames[i]) == VS_OK);
+    int same = motionset_same(&set, &lms);
+    if(!same)
+      fprintf(stderr,"frame %i: %i motions in the set, %i in the vector\n", i,
+              set.num, vs_vector_size(&lms));
+    test_bool(same);
+    test_bool(i == 0 || set.num > 0);
+    test_bool(motionset_same_transform(vsMotionsToTransform(&td, &lms, 0),
+                                       vsMotionSetToTransform(&td, &set, 0)));
+    test_bool(motionset_same_transform(
+                vsSimpleMotionsToTransform(testdata->fi, "test_motionset", &lms),
+                vsSimpleMotionSetToTransform(testdata->fi, "test_motionset", &set)));
+    test_bool(motionset_same_stored(&set, &lms, ASCII_SERIALIZATION_MODE));
+    test_bool(motionset_same_stored(&set, &lms, BINARY_SERIALIZATION_MODE));
+    vs_vector_del(&lms);
+    vs_motionset_fini(&set);
+  }
+  vsTransformDataCleanup(&td);
+  vsMotionDetectionCleanup(&md1);
+  vsMotionDetectionCleanup(&md2);
+  vs_log_level = loglevel;
+}
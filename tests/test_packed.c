@@ -252,7 +252,7 @@ static void test_packed_translate(VSPixelFormat pf){
 
 /* --- motion detection on packed frames ---------------------------------- */
 
-static void test_packed_motiondetect(VSPixelFormat pf){
+static void test_packed_motiondetect(VSPixelFormat pf, int packedLuma){
   VSFrameInfo fi;
   VSFrame f1, f2;
   VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_packed_md");
@@ -261,8 +261,8 @@ static void test_packed_motiondetect(VSPixelFormat pf){
   const int dx = 8, dy = -6;
   VSTransform t;
 
-  fprintf(stderr,"--- motion detection, %s, shift (%i,%i) ---\n",
-          packedFormatName(pf), dx, dy);
+  fprintf(stderr,"--- motion detection, %s%s, shift (%i,%i) ---\n",
+          packedFormatName(pf), packedLuma ? " (luma)" : "", dx, dy);
   test_bool(vsFrameInfoInit(&fi, 320, 240, pf) == 1);
   vsFrameAllocate(&f1,&fi);
   vsFrameAllocate(&f2,&fi);
@@ -270,8 +270,11 @@ static void test_packed_motiondetect(VSPixelFormat pf){
   fillPackedNoise(&f1,&fi,42);
   shiftPacked(&f2,&f1,&fi,dx,dy);
 
+  mdconf.packedLuma = packedLuma;
   test_bool(vsMotionDetectInit(&md, &mdconf, &fi) == VS_OK);
   md.conf.numThreads = 1;
+  /* with packedLuma the search runs on a planar luma copy */
+  test_bool(md.currfi.pFormat == (packedLuma ? PF_GRAY8 : pf));
   test_bool(vsMotionDetection(&md, &lms, &f1) == VS_OK);
   vs_vector_del(&lms);
   test_bool(vsMotionDetection(&md, &lms, &f2) == VS_OK);
@@ -353,8 +356,11 @@ void test_packed(void){
   test_packed_translate(PF_RGB24);
   test_packed_translate(PF_BGR24);
   test_packed_translate(PF_RGBA);
-  test_packed_motiondetect(PF_RGB24);
-  test_packed_motiondetect(PF_RGBA);
+  test_packed_motiondetect(PF_RGB24, 0);
+  test_packed_motiondetect(PF_RGBA, 0);
+  test_packed_motiondetect(PF_RGB24, 1);
+  test_packed_motiondetect(PF_BGR24, 1);
+  test_packed_motiondetect(PF_RGBA, 1);
   test_packed_show(PF_RGB24);
   test_packed_show(PF_BGR24);
   test_packed_show(PF_RGBA);
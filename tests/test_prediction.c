@@ -0,0 +1,112 @@
+/* Temporal motion prediction (VSMotionDetectConfig.motionPrediction).
+
+   The frames are windows into one large noise image that pan smoothly, with
+   one sudden jump. The prediction has to find the same motion as the full
+   search with far fewer comparisons, and the jump must be caught by the
+   fallback to the full window. */
+
+#define PRED_FRAMES 16
+#define PRED_W 480
+#define PRED_H 320
+
+static void prediction_offset(int i, int* ox, int* oy){
+  *ox = 20 + 7*i + (i >= 10 ? 30 : 0); // jump between frame 9 and 10
+  *oy = 20 + 4*i;
+}
+
+/* only the coarse fields are counted, the fine pass does not change */
+static unsigned long long prediction_pixels;
+static vsCompareSubImgFn prediction_compare_orig;
+static vsCompareSubImgRunFn prediction_run_orig;
+
+static unsigned int prediction_counting_compare(unsigned char* const I1, unsigned char* const I2,
+                                                const Field* field,
+                                                int linesize1, int linesize2, int height,
+                                                int bytesPerPixel, int d_x, int d_y,
+                                                unsigned int threshold){
+  if(field->size > 16)
+    prediction_pixels += (unsigned long long)field->size * field->size;
+  return prediction_compare_orig(I1, I2, field, linesize1, linesize2, height,
+                                 bytesPerPixel, d_x, d_y, threshold);
+}
+
+static void prediction_counting_run(unsigned char* const I1, unsigned char* const I2,
+                                    const Field* field,
+                                    int linesize1, int linesize2, int height,
+                                    int d_x, int d_y, int step, int n,
+                                    unsigned int threshold, unsigned int* errors){
+  if(field->size > 16)
+    prediction_pixels += (unsigned long long)n * field->size * field->size;
+  prediction_run_orig(I1, I2, field, linesize1, linesize2, height,
+                      d_x, d_y, step, n, threshold, errors);
+}
+
+static unsigned long long prediction_run(int predict, VSFrame* frames,
+                                         const VSFrameInfo* fi, VSTransform* ts){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_prediction");
+  VSMotionDetect md;
+  mdconf.motionPrediction = predict;
+  mdconf.numThreads = 1; // the counter is not thread safe
+  test_bool(vsMotionDetectInit(&md, &mdconf, fi) == VS_OK);
+  md.conf.numThreads = 1;
+  prediction_compare_orig = md.ctx.compareSubImg;
+  md.ctx.compareSubImg = prediction_counting_compare;
+  prediction_run_orig = md.ctx.compareSubImgRun;
+  md.ctx.compareSubImgRun = prediction_counting_run;
+  prediction_pixels = 0;
+  for(int i=0; i < PRED_FRAMES; i++){
+    LocalMotions lms;
+    test_bool(vsMotionDetection(&md, &lms, &frames[i]) == VS_OK);
+    ts[i] = vsSimpleMotionsToTransform(md.fi, "test_prediction", &lms);
+    vs_vector_del(&lms);
+  }
+  vsMotionDetectionCleanup(&md);
+  return prediction_pixels;
+}
+
+void test_prediction(void){
+  VSFrameInfo fi;
+  VSFrame frames[PRED_FRAMES];
+  VSTransform full[PRED_FRAMES], pred[PRED_FRAMES];
+  int loglevel = vs_log_level;
+  int bw = PRED_W + 200, bh = PRED_H + 100;
+  uint8_t* base = (uint8_t*)vs_malloc(bw*bh);
+  int i, allok = 1;
+
+  srand(7);
+  for(int y=0; y < bh; y += 4)
+    for(int x=0; x < bw; x += 4){
+      uint8_t v = (uint8_t)(rand()%256);
+      for(int k=0; k < 16; k++)
+        base[(y + k/4)*bw + x + k%4] = v;
+    }
+  test_bool(vsFrameInfoInit(&fi, PRED_W, PRED_H, PF_GRAY8));
+  for(i=0; i < PRED_FRAMES; i++){ // views into the base image
+    int ox, oy;
+    prediction_offset(i, &ox, &oy);
+    vsFrameNull(&frames[i]);
+    frames[i].data[0] = base + oy*bw + ox;
+    frames[i].linesize[0] = bw;
+  }
+
+  vs_log_level = 1;
+  unsigned long long pixelsFull = prediction_run(0, frames, &fi, full);
+  unsigned long long pixelsPred = prediction_run(1, frames, &fi, pred);
+  vs_log_level = loglevel;
+  fprintf(stderr,"compared pixels in coarse fields: full search %llu, with prediction %llu\n",
+          pixelsFull, pixelsPred);
+  for(i=1; i < PRED_FRAMES; i++){
+    int ox0, oy0, ox1, oy1;
+    prediction_offset(i-1, &ox0, &oy0);
+    prediction_offset(i, &ox1, &oy1);
+    if(fabs(pred[i].x - (ox1-ox0)) > 0.5 || fabs(pred[i].y - (oy1-oy0)) > 0.5
+       || fabs(pred[i].x - full[i].x) > 0.5 || fabs(pred[i].y - full[i].y) > 0.5){
+      fprintf(stderr,"frame %i: predicted %f %f full %f %f expected %i %i\n", i,
+              pred[i].x, pred[i].y, full[i].x, full[i].y, ox1-ox0, oy1-oy0);
+      allok = 0;
+    }
+  }
+  test_bool(allok);
+  test_bool(2*pixelsPred < pixelsFull);
+  vs_free(base);
+}
@@ -0,0 +1,107 @@
+/* Coarse-to-fine search (VSMotionDetectConfig.pyramidLevels).
+
+   The pyramid must find the same motion as the exhaustive scan on the test
+   frames, and it has to get there with far less work -- that is the whole
+   point of it, so it is asserted rather than just timed. The work is counted
+   as the number of pixels compareSubImg and compareSubImgRun were asked to
+   compare, a run of n candidates counting n times: the coarse levels make
+   more calls than the stepped full resolution scan, on fields a quarter or a
+   sixteenth of the size. */
+
+static unsigned long pyramid_compare_calls;
+static unsigned long long pyramid_compare_pixels;
+static vsCompareSubImgFn pyramid_compare_orig;
+static vsCompareSubImgRunFn pyramid_run_orig;
+
+static unsigned int pyramid_counting_compare(unsigned char* const I1, unsigned char* const I2,
+                                             const Field* field,
+                                             int linesize1, int linesize2, int height,
+                                             int bytesPerPixel, int d_x, int d_y,
+                                             unsigned int threshold){
+  pyramid_compare_calls++;
+  pyramid_compare_pixels += (unsigned long long)field->size * field->size;
+  return pyramid_compare_orig(I1, I2, field, linesize1, linesize2, height,
+                              bytesPerPixel, d_x, d_y, threshold);
+}
+
+static void pyramid_counting_run(unsigned char* const I1, unsigned char* const I2,
+                                 const Field* field,
+                                 int linesize1, int linesize2, int height,
+                                 int d_x, int d_y, int step, int n,
+                                 unsigned int threshold, unsigned int* errors){
+  pyramid_compare_calls += n;
+  pyramid_compare_pixels += (unsigned long long)n * field->size * field->size;
+  pyramid_run_orig(I1, I2, field, linesize1, linesize2, height,
+                   d_x, d_y, step, n, threshold, errors);
+}
+
+/* runs the detection over the test frames and returns the number of pixels
+   compareSubImg compared, or 0 if a transform was not recovered */
+static unsigned long long pyramid_run(TestData* testdata, int levels){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_pyramid");
+  VSMotionDetect md;
+  unsigned long long pixels;
+  int allok = 1;
+  int i;
+
+  mdconf.pyramidLevels = levels;
+  mdconf.numThreads = 1; // the call counter is not thread safe
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  md.conf.numThreads = 1;
+  test_bool(md.pyramidLevels == levels);
+
+  pyramid_compare_orig = md.ctx.compareSubImg;
+  md.ctx.compareSubImg = pyramid_counting_compare;
+  pyramid_run_orig = md.ctx.compareSubImgRun;
+  md.ctx.compareSubImgRun = pyramid_counting_run;
+  pyramid_compare_calls = 0;
+  pyramid_compare_pixels = 0;
+  for(i=0; i<5; i++){
+    LocalMotions lms;
+    VSTransform t, orig, diff;
+    test_bool(vsMotionDetection(&md, &lms, &testdata->frames[i]) == VS_OK);
+    t = vsSimpleMotionsToTransform(testdata->fi, "test_pyramid", &lms);
+    vs_vector_del(&lms);
+    orig = mult_transform_(getTestFrameTransform(i), -1.0);
+    diff = sub_transforms(&t, &orig);
+    if(!(fabs(diff.x)<2 && fabs(diff.y)<2 && fabs(diff.alpha)<0.005)){
+      fprintf(stderr,"levels %i frame %i: difference ", levels, i);
+      storeVSTransform(stderr,&diff);
+      allok = 0;
+    }
+  }
+  pixels = pyramid_compare_pixels;
+  fprintf(stderr,"%i pyramid levels: %lu candidates compared, %llu pixels\n",
+          levels, pyramid_compare_calls, pixels);
+
+  vsMotionDetectionCleanup(&md);
+  test_bool(allok);
+  return allok ? pixels : 0;
+}
+
+void test_pyramid(TestData* testdata){
+  int loglevel = vs_log_level;
+  vs_log_level = 1;
+  unsigned long long full = pyramid_run(testdata, 0);
+  unsigned long long pyr1 = pyramid_run(testdata, 1);
+  unsigned long long pyr2 = pyramid_run(testdata, 2);
+  vs_log_level = loglevel;
+  test_bool(full > 0 && pyr1 > 0 && pyr2 > 0);
+  test_bool(pyr2 < pyr1);
+  test_bool(pyr1 < full);
+
+  /* a frame too small for the requested depth gets the levels that fit */
+  {
+    VSFrameInfo fi;
+    VSMotionDetect md;
+    VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_pyramid_small");
+    mdconf.pyramidLevels = VS_MAX_PYRAMID_LEVELS;
+    test_bool(vsFrameInfoInit(&fi, 320, 240, PF_GRAY8));
+    vs_log_level = 1;
+    test_bool(vsMotionDetectInit(&md, &mdconf, &fi) == VS_OK);
+    vs_log_level = loglevel;
+    test_bool(md.pyramidLevels >= 0 && md.pyramidLevels < VS_MAX_PYRAMID_LEVELS);
+    test_bool((md.fieldscoarse.fieldSize >> md.pyramidLevels) >= VS_SIMD_FIELD_ALIGNMENT);
+    vsMotionDetectionCleanup(&md);
+  }
+}
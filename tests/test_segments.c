@@ -0,0 +1,210 @@
+/* Segments of a clip detected independently (vsMotionDetectPrime) and
+   joined (vsMergeMotionsFiles).
+
+   Detecting the clip in segments, each primed with the frame its first frame
+   is measured against, and merging the files gives the file of one detection
+   of the whole clip, byte for byte: for every encoding, for any cut, with the
+   search pyramid and with a virtual tripod. Segments numbered on their own
+   are renumbered, read from a pipe too; segments of other settings, with a
+   gap inside or a gap or an overlap between them are refused. */
+
+/* detects the frames first .. last-1 of the clip to name, primed with the
+   frame before first as a segment of it */
+static int segments_detect(TestData* testdata, VSMotionDetectConfig conf, int mode,
+                           int first, int last, const char* name){
+  VSMotionDetect md;
+  FILE* f = fopen(name, "wb");
+  int ok = f && ckpt_init(&md, conf, mode, testdata);
+  ok = ok && vsPrepareFile(&md, f) == VS_OK;
+  if(ok && first > 0){
+    int tripod = conf.virtualTripod;
+    int ref = tripod >= 1 && first >= tripod ? tripod-1 : first-1;
+    VSFrame frame;
+    vsFrameAllocate(&frame, &testdata->fi);
+    vsFrameCopy(&frame, &testdata->frames[ref], &testdata->fi);
+    ok = vsMotionDetectPrime(&md, &frame, first) == VS_OK && md.frameNum == first;
+    vsFrameFree(&frame);
+  }
+  ok = ok && ckpt_detect(&md, testdata, f, NULL, first, last);
+  if(f) fclose(f);
+  vsMotionDetectionCleanup(&md);
+  return ok;
+}
+
+/* detects the segments of the clip cut before the frames cuts[1..num-1],
+   one detection each, to name.0, name.1, ... and merges them into name */
+static int segments_run(TestData* testdata, VSMotionDetectConfig conf, int mode,
+                        const int* cuts, int num, const char* name){
+  FILE* segments[COMPACT_NFRAMES];
+  char seg[1024+16];
+  int ok = 1;
+
+  for(int k=0; k < num; k++){
+    int first = cuts[k], last = k+1 < num ? cuts[k+1] : COMPACT_NFRAMES;
+    snprintf(seg, sizeof(seg), "%s.%i", name, k);
+    ok = ok && segments_detect(testdata, conf, mode, first, last, seg);
+  }
+
+  for(int k=0; k < num; k++){
+    snprintf(seg, sizeof(seg), "%s.%i", name, k);
+    segments[k] = fopen(seg, "rb");
+    ok = ok && segments[k];
+  }
+  FILE* out = fopen(name, "wb");
+  ok = ok && out && vsMergeMotionsFiles(out, segments, num) == VS_OK;
+  if(out) fclose(out);
+  for(int k=0; k < num; k++)
+    if(segments[k]) fclose(segments[k]);
+  return ok;
+}
+
+/* a whole detection to ref, the segments merged to name, the same files */
+static int segments_agree(TestData* testdata, VSMotionDetectConfig conf, int mode,
+                          const int* cuts, int num, const char* ref, const char* name){
+  int ok = segments_run(testdata, conf, mode, cuts, 1, ref);
+  ok = ok && segments_run(testdata, conf, mode, cuts, num, name);
+  return ok && trfwriter_same_files(ref, name);
+}
+
+/* merges the files a and b into out */
+static int segments_merge2(const char* out, const char* a, const char* b){
+  FILE* segments[2] = { fopen(a, "rb"), fopen(b, "rb") };
+  FILE* f = fopen(out, "wb");
+  int res = segments[0] && segments[1] && f
+    ? vsMergeMotionsFiles(f, segments, 2) : VS_ERROR;
+  for(int k=0; k < 2; k++)
+    if(segments[k]) fclose(segments[k]);
+  if(f) fclose(f);
+  return res;
+}
+
+void test_segments(TestData* testdata){
+  VSMotionDetectConfig conf = vsMotionDetectGetDefaultConfig("test_segments");
+  VSMotionSet sets[COMPACT_NFRAMES];
+  VSManyLocalMotions mlms;
+  VSMotionDetect md;
+  char ref[1024], name[1024];
+  int loglevel = vs_log_level;
+  FILE* f;
+
+  vs_log_level = 1;
+  snprintf(ref, sizeof(ref), "%s", testOut("segments_ref.trf"));
+  snprintf(name, sizeof(name), "%s", testOut("segments.trf"));
+
+  const int halves[2] = { 0, 2 };
+  const int thirds[3] = { 0, 1, 3 };
+  const int singles[COMPACT_NFRAMES] = { 0, 1, 2, 3, 4 };
+  const int modes[3] = { BINARY_SERIALIZATION_MODE, COMPACT_SERIALIZATION_MODE,
+                         ASCII_SERIALIZATION_MODE };
+  for(int v=0; v < 3; v++){
+    test_bool(segments_agree(testdata, conf, modes[v], halves, 2, ref, name));
+    test_bool(segments_agree(testdata, conf, modes[v], thirds, 3, ref, name));
+  }
+  test_bool(segments_agree(testdata, conf, BINARY_SERIALIZATION_MODE, singles,
+                           COMPACT_NFRAMES, ref, name));
+  VSMotionDetectConfig pyr = conf;
+  pyr.pyramidLevels = 2;
+  test_bool(segments_agree(testdata, pyr, BINARY_SERIALIZATION_MODE, thirds, 3, ref, name));
+  VSMotionDetectConfig tripod = conf;
+  tripod.virtualTripod = 2;
+  test_bool(segments_agree(testdata, tripod, BINARY_SERIALIZATION_MODE, thirds, 3, ref, name));
+  test_bool(segments_agree(testdata, tripod, BINARY_SERIALIZATION_MODE, singles,
+                           COMPACT_NFRAMES, ref, name));
+
+  // with the prediction only the first frame of a segment may differ
+  VSMotionDetectConfig pred = conf;
+  pred.motionPrediction = 1;
+  test_bool(segments_run(testdata, pred, BINARY_SERIALIZATION_MODE, halves, 2, name));
+  f = fopen(name, "rb");
+  test_bool(vsReadLocalMotionsFile(f, &mlms) == VS_OK);
+  fclose(f);
+  test_bool(vs_vector_size(&mlms) == COMPACT_NFRAMES);
+  test_bool(vs_vector_size(VSMLMGet(&mlms, halves[1])) > 0);
+  compact_free_many(&mlms);
+
+  test_bool(ckpt_init(&md, conf, BINARY_SERIALIZATION_MODE, testdata));
+  test_bool(vsMotionDetectPrime(&md, &testdata->frames[0], 0) == VS_ERROR);
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    test_bool(vsMotionDetectionSet(&md, &sets[i], &testdata->frames[i]) == VS_OK);
+  vsMotionDetectionCleanup(&md);
+
+  // a segment numbered on its own follows the one before
+  test_bool(compact_write(testOut("segments_a.trf"), BINARY_SERIALIZATION_MODE, sets,
+                          &testdata->fi));
+  test_bool(segments_merge2(name, testOut("segments_a.trf"), testOut("segments_a.trf"))
+            == VS_OK);
+  {
+    VSTrfFile trf;
+    VSMotionSet set;
+    test_bool(vsTrfOpen(&trf, name) == VS_OK);
+    test_bool(vsTrfNumFrames(&trf) == 2*COMPACT_NFRAMES);
+    for(int i=0; i < 2*COMPACT_NFRAMES; i++){
+      test_bool(vs_motionset_init(&set, 0) == VS_OK);
+      test_bool(vsTrfGetFrameMotions(&trf, i, &set) == VS_OK);
+      test_bool(set.num == sets[i % COMPACT_NFRAMES].num);
+      vs_motionset_fini(&set);
+    }
+    vsTrfClose(&trf);
+  }
+
+#ifndef _WIN32
+  // from a pipe
+  {
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), "cat %s", testOut("segments_a.trf"));
+    FILE* segments[2] = { fopen(testOut("segments_a.trf"), "rb"), popen(cmd, "r") };
+    f = fopen(testOut("segments_pipe.trf"), "wb");
+    test_bool(segments[0] && segments[1] && f);
+    test_bool(vsMergeMotionsFiles(f, segments, 2) == VS_OK);
+    fclose(segments[0]);
+    pclose(segments[1]);
+    fclose(f);
+    test_bool(trfwriter_same_files(name, testOut("segments_pipe.trf")));
+  }
+#endif
+
+  // another encoding, other settings, a gap, no frames: refused
+  test_bool(compact_write(testOut("segments_b.trf"), COMPACT_SERIALIZATION_MODE, sets,
+                          &testdata->fi));
+  test_bool(segments_merge2(name, testOut("segments_a.trf"), testOut("segments_b.trf"))
+            == VS_ERROR);
+  VSMotionDetectConfig other = conf;
+  other.shakiness = conf.shakiness - 1;
+  test_bool(segments_run(testdata, other, BINARY_SERIALIZATION_MODE, halves, 1,
+                         testOut("segments_c.trf")));
+  test_bool(segments_merge2(name, testOut("segments_a.trf"), testOut("segments_c.trf"))
+            == VS_ERROR);
+  test_bool(trffile_write(testOut("segments_gaps.trf"), BINARY_SERIALIZATION_MODE, sets,
+                          &testdata->fi));
+  test_bool(segments_merge2(name, testOut("segments_a.trf"), testOut("segments_gaps.trf"))
+            == VS_ERROR);
+  {
+    md.serializationMode = BINARY_SERIALIZATION_MODE;
+    test_bool(vsMotionDetectInit(&md, &conf, &testdata->fi) == VS_OK);
+    f = fopen(testOut("segments_empty.trf"), "wb");
+    test_bool(vsPrepareFile(&md, f) == VS_OK);
+    fclose(f);
+    vsMotionDetectionCleanup(&md);
+  }
+  test_bool(segments_merge2(name, testOut("segments_a.trf"), testOut("segments_empty.trf"))
+            == VS_ERROR);
+  // primed segments with a gap or an overlap between them
+  test_bool(segments_detect(testdata, conf, BINARY_SERIALIZATION_MODE, 0, 2,
+                            testOut("segments_d.trf")));
+  test_bool(segments_detect(testdata, conf, BINARY_SERIALIZATION_MODE, 3, 5,
+                            testOut("segments_e.trf")));
+  test_bool(segments_merge2(name, testOut("segments_d.trf"), testOut("segments_e.trf"))
+            == VS_ERROR);
+  test_bool(segments_detect(testdata, conf, BINARY_SERIALIZATION_MODE, 1, 5,
+                            testOut("segments_e.trf")));
+  test_bool(segments_merge2(name, testOut("segments_d.trf"), testOut("segments_e.trf"))
+            == VS_ERROR);
+  test_bool(segments_detect(testdata, conf, BINARY_SERIALIZATION_MODE, 2, 5,
+                            testOut("segments_e.trf")));
+  test_bool(segments_merge2(name, testOut("segments_d.trf"), testOut("segments_e.trf"))
+            == VS_OK);
+
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    vs_motionset_fini(&sets[i]);
+  vs_log_level = loglevel;
+}
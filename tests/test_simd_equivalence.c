@@ -4,6 +4,8 @@
  * the plain C reference implementations:
  *   compareSubImg_thr        (src/motiondetect.c)      <-> compareSubImg_thr_sse2 (src/motiondetect_opt.c)
  *   contrastSubImg           (src/motiondetect.c)      <-> contrastSubImg1_SSE    (src/motiondetect_opt.c)
+ *   rgbToLuma_C              (src/motiondetect_opt.c)  <-> rgbToLuma_avx2/_neon
+ *   compareSubImg_thr, one candidate at a time  <-> compareSubImgRun_C/_sse2/_avx2/_neon
  *
  * IMPORTANT -- only field sizes that are a multiple of 16 are legal input for
  * the SSE2 routines: their inner loops advance 16 bytes per iteration
@@ -29,6 +31,62 @@
  *           very same (tx,ty) and the same final minerror.
  */
 
+/* compareSubImgRun against compareSubImg_thr called for each candidate.
+   With threshold UINT_MAX every error must be the exact sum. With a finite
+   threshold a candidate whose exact sum is within it must still get exactly
+   that, and any other one only has to come out above the threshold (see
+   vsCompareSubImgRunFn) -- that is all the spiral search relies on. The
+   thresholds include the smallest sum of the run, so there are runs where
+   only one candidate survives. Also used for the C reference, so it is
+   outside the #ifdef below. */
+static void simd_test_compare_run(const TestData* testdata, const char* name,
+                                  vsCompareSubImgRunFn run){
+  static const int steps[] = { 1, 3, 6, -6, 16 };
+  int s, p, st, n, dy, t, k;
+  int mismatches = 0;
+  unsigned char* I1 = testdata->frames[0].data[0];
+  unsigned char* I2 = testdata->frames[1].data[0];
+  int w1 = testdata->frames[0].linesize[0];
+  int w2 = testdata->frames[1].linesize[0];
+  int h  = testdata->fi.height;
+
+  fprintf(stderr,"*** [%s] compareSubImgRun vs single candidates\n", name);
+  for (s = 0; s < 5; s++) {
+    for (p = 0; p < 4; p++) {
+      Field f;
+      f.size = (s + 1) * 16;
+      f.x    = p == 0 ? 400 : 200 + 233 * p;
+      f.y    = p == 0 ? 300 : 150 + 120 * p;
+      for (st = 0; st < (int)(sizeof(steps)/sizeof(steps[0])); st++) {
+        for (n = 1; n <= VS_SAD_RUN; n++) {
+          for (dy = -8; dy <= 8; dy += 8) {
+            const int dx = steps[st] > 0 ? -16 : 16;
+            unsigned int exact[VS_SAD_RUN], errors[VS_SAD_RUN];
+            unsigned int mini = UINT_MAX;
+            for (k = 0; k < n; k++) {
+              exact[k] = compareSubImg_thr(I1, I2, &f, w1, w2, h, 1,
+                                           dx + k * steps[st], dy, UINT_MAX);
+              mini = VS_MIN(mini, exact[k]);
+            }
+            for (t = 0; t < 3; t++) {
+              unsigned int thr = t == 0 ? UINT_MAX : (t == 1 ? mini : mini + mini / 8);
+              run(I1, I2, &f, w1, w2, h, dx, dy, steps[st], n, thr, errors);
+              for (k = 0; k < n; k++) {
+                int ok = exact[k] <= thr ? errors[k] == exact[k] : errors[k] > thr;
+                if (!ok && mismatches++ < 10)
+                  fprintf(stderr,"  MISMATCH [%s] size=%i pos=(%i,%i) d=(%i+%i*%i,%i) "
+                          "thr=%u: exact=%u run=%u\n", name, f.size, f.x, f.y,
+                          dx, k, steps[st], dy, thr, exact[k], errors[k]);
+                test_bool(ok);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 #if defined(VS_HAVE_SSE2) || defined(VS_HAVE_AVX2) || defined(VS_HAVE_AVX512) \
  || defined(VS_HAVE_NEON)
 #define SIMD_HAVE_ANY_KERNEL 1
@@ -50,29 +108,38 @@
 
    `requires == VS_CPU_NONE` means "always safe to call": that is the NEON
    kernel when it was built against the scalar emulation in neon_emu.h, which
-   is plain C and runs anywhere. */
+   is plain C and runs anywhere.
+
+   `run` and `luma` are NULL where the kernel set has no such kernel. */
 typedef struct {
   const char*         name;
   unsigned int        requires;
   vsCompareSubImgFn   cmp;
   vsContrastSubImg1Fn con;
+  vsCompareSubImgRunFn run;
+  vsRgbToLumaFn       luma;
 } SimdKernel;
 
 static const SimdKernel simd_kernels[] = {
 #ifdef VS_HAVE_SSE2
-  { "SSE2",   VS_CPU_SSE2,   compareSubImg_thr_sse2,   contrastSubImg1_SSE    },
+  { "SSE2",   VS_CPU_SSE2,   compareSubImg_thr_sse2,   contrastSubImg1_SSE,
+    compareSubImgRun_sse2, NULL },
 #endif
 #ifdef VS_HAVE_AVX2
-  { "AVX2",   VS_CPU_AVX2,   compareSubImg_thr_avx2,   contrastSubImg1_avx2   },
+  { "AVX2",   VS_CPU_AVX2,   compareSubImg_thr_avx2,   contrastSubImg1_avx2,
+    compareSubImgRun_avx2, rgbToLuma_avx2 },
 #endif
 #ifdef VS_HAVE_AVX512
-  { "AVX512", VS_CPU_AVX512, compareSubImg_thr_avx512, contrastSubImg1_avx512 },
+  { "AVX512", VS_CPU_AVX512, compareSubImg_thr_avx512, contrastSubImg1_avx512,
+    NULL, NULL },
 #endif
 #ifdef VS_HAVE_NEON
 #ifdef VS_NEON_EMULATION
-  { "NEON(emulated)", VS_CPU_NONE, compareSubImg_thr_neon, contrastSubImg1_neon },
+  { "NEON(emulated)", VS_CPU_NONE, compareSubImg_thr_neon, contrastSubImg1_neon,
+    compareSubImgRun_neon, rgbToLuma_neon },
 #else
-  { "NEON",   VS_CPU_NEON,   compareSubImg_thr_neon,   contrastSubImg1_neon   },
+  { "NEON",   VS_CPU_NEON,   compareSubImg_thr_neon,   contrastSubImg1_neon,
+    compareSubImgRun_neon, rgbToLuma_neon },
 #endif
 #endif
 };
@@ -259,9 +326,41 @@ static void simd_test_contrast(const TestData* testdata, const SimdKernel* k){
   }
 }
 
+/* rgbToLuma: integer arithmetic only, so the rows must be byte-identical.
+   The widths cover the scalar tails of both kernels, and the byte after the
+   row must stay untouched. */
+static void simd_test_luma(const SimdKernel* k){
+  static const int widths[] = { 1, 7, 8, 9, 10, 15, 16, 17, 31, 33, 100, 1283 };
+  unsigned char src[1283*4];
+  unsigned char yC[1284], yO[1284];
+  unsigned int seed = 12345;
+  int w, bpp, r, i;
+  fprintf(stderr,"*** [%s] rgbToLuma: strict equality vs C\n", k->name);
+  for (i = 0; i < (int)sizeof(src); i++) {
+    seed = seed * 1103515245u + 12345u;
+    src[i] = (unsigned char)(seed >> 16);
+  }
+  for (w = 0; w < (int)(sizeof(widths)/sizeof(widths[0])); w++) {
+    for (bpp = 3; bpp <= 4; bpp++) {
+      for (r = 0; r <= 2; r += 2) {
+        const int width = widths[w];
+        memset(yC, 0xAA, sizeof(yC));
+        memset(yO, 0xAA, sizeof(yO));
+        rgbToLuma_C(yC, src, width, bpp, r);
+        k->luma(yO, src, width, bpp, r);
+        if (memcmp(yC, yO, width + 1) != 0)
+          fprintf(stderr,"  LUMA MISMATCH [%s] width=%i bpp=%i rIndex=%i\n",
+                  k->name, width, bpp, r);
+        test_bool(memcmp(yC, yO, width + 1) == 0);
+      }
+    }
+  }
+}
+
 #endif /* SIMD_HAVE_ANY_KERNEL */
 
 void test_simd_equivalence(const TestData* testdata){
+  simd_test_compare_run(testdata, "C", compareSubImgRun_C);
 #ifdef SIMD_HAVE_ANY_KERNEL
   int i, checked = 0;
   unsigned int cpu = vs_cpu_flags();
@@ -281,6 +380,10 @@ void test_simd_equivalence(const TestData* testdata){
     simd_test_compare_threshold(testdata, k);
     simd_test_compare_argmin(testdata, k);
     simd_test_contrast(testdata, k);
+    if (k->run)
+      simd_test_compare_run(testdata, k->name, k->run);
+    if (k->luma)
+      simd_test_luma(k);
     checked++;
   }
   fprintf(stderr,"********** %i of %i kernel(s) checked on this machine\n",
@@ -0,0 +1,182 @@
+/* Stabilization in a single pass (VSStabilizer).
+
+   With the gaussian camera path the frames come out as the two passes
+   (detection, vsLocalmotions2Transforms, vsPreprocessTransforms, transform)
+   give them, bit for bit, transforms and pixels, for a window shorter than
+   the clip, one longer and none at all, and for absolute transforms. A frame
+   comes out smoothing frames after it went in. The optimal zoom over the window covers
+   every frame, and the static one only zooms in. */
+
+#define STAB_NFRAMES 14
+
+/* the clip: the test frames forth and back */
+static const VSFrame* stab_frame(TestData* testdata, int i){
+  int p = i % (2*COMPACT_NFRAMES - 2);
+  return &testdata->frames[p < COMPACT_NFRAMES ? p : 2*COMPACT_NFRAMES - 2 - p];
+}
+
+static int stab_get_frame(const void* sets, int i, VSMotionSet* S){
+  S->num = 0;
+  return vs_motionset_append_set(S, &((const VSMotionSet*)sets)[i]);
+}
+
+/* the two passes: the transforms to trans and the frames to out */
+static int stab_twopass(TestData* testdata, VSMotionDetectConfig mdconf,
+                        VSTransformConfig tconf, VSTransformations* trans, VSFrame* out){
+  VSMotionDetect md;
+  VSTransformData td;
+  VSMotionSet sets[STAB_NFRAMES];
+  VSFrame frame;
+  int ok = vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK;
+  vsFrameAllocate(&frame, &testdata->fi);
+  for(int i=0; i < STAB_NFRAMES; i++){
+    vsFrameCopy(&frame, stab_frame(testdata, i), &testdata->fi);
+    ok &= vsMotionDetectionSet(&md, &sets[i], &frame) == VS_OK;
+  }
+  vsMotionDetectionCleanup(&md);
+
+  vsTransformationsInit(trans);
+  ok &= vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi) == VS_OK;
+  ok &= vsMotionFrames2Transforms(&td, STAB_NFRAMES, stab_get_frame, sets, trans) == VS_OK;
+  ok &= vsPreprocessTransforms(&td, trans) == VS_OK;
+  for(int i=0; ok && i < STAB_NFRAMES; i++){
+    vsFrameCopy(&frame, stab_frame(testdata, i), &testdata->fi);
+    ok &= vsTransformPrepare(&td, &frame, &out[i]) == VS_OK;
+    ok &= vsDoTransform(&td, trans->ts[i]) == VS_OK;
+    ok &= vsTransformFinish(&td) == VS_OK;
+  }
+  vsTransformDataCleanup(&td);
+  vsFrameFree(&frame);
+  for(int i=0; i < STAB_NFRAMES; i++)
+    vs_motionset_fini(&sets[i]);
+  return ok;
+}
+
+/* the single pass, checking that every frame comes out when its window is
+   complete */
+static int stab_onepass(TestData* testdata, VSMotionDetectConfig mdconf,
+                        VSTransformConfig tconf, VSTransformations* trans, VSFrame* out){
+  VSStabilizer s;
+  VSFrame frame;
+  int ok = vsStabilizerInit(&s, &mdconf, &tconf, &testdata->fi) == VS_OK;
+  int lookahead = VS_MAX(tconf.smoothing, 0);
+  int done = 0;
+  if(!ok) return 0;
+  vsTransformationsInit(trans);
+  trans->ts = vs_malloc(sizeof(VSTransform) * STAB_NFRAMES);
+  trans->len = STAB_NFRAMES;
+  vsFrameAllocate(&frame, &testdata->fi);
+  for(int i=0; ok && i < STAB_NFRAMES; i++){
+    vsFrameCopy(&frame, stab_frame(testdata, i), &testdata->fi);
+    ok &= vsStabilizerPush(&s, &frame) == VS_OK;
+    ok &= vsStabilizerReady(&s) == (i >= lookahead ? 1 : 0);
+    while(ok && vsStabilizerReady(&s) > 0){
+      ok &= done == i - lookahead;
+      ok &= vsStabilizerPop(&s, &out[done], &trans->ts[done]) == VS_OK;
+      done++;
+    }
+  }
+  vsStabilizerFinish(&s);
+  ok &= vsStabilizerPush(&s, &frame) == VS_ERROR;
+  while(ok && vsStabilizerReady(&s) > 0){
+    ok &= vsStabilizerPop(&s, &out[done], &trans->ts[done]) == VS_OK;
+    done++;
+  }
+  ok &= done == STAB_NFRAMES && vsStabilizerPop(&s, &out[0], NULL) == VS_ERROR;
+  vsFrameFree(&frame);
+  vsStabilizerCleanup(&s);
+  return ok;
+}
+
+static int stab_same_frames(const VSFrame* a, const VSFrame* b, const VSFrameInfo* fi){
+  for(int i=0; i < STAB_NFRAMES; i++)
+    for(int p=0; p < fi->planes; p++){
+      int w = fi->width >> vsGetPlaneWidthSubS(fi, p);
+      int h = fi->height >> vsGetPlaneHeightSubS(fi, p);
+      for(int y=0; y < h; y++)
+        if(memcmp(a[i].data[p] + y*a[i].linesize[p], b[i].data[p] + y*b[i].linesize[p], w))
+          return 0;
+    }
+  return 1;
+}
+
+static int stab_agree(TestData* testdata, VSMotionDetectConfig mdconf, VSTransformConfig tconf,
+                      VSFrame* out1, VSFrame* out2){
+  VSTransformations t1, t2;
+  int ok = stab_twopass(testdata, mdconf, tconf, &t1, out1);
+  ok = ok && stab_onepass(testdata, mdconf, tconf, &t2, out2);
+  ok = ok && compact_same_transforms(&t1, &t2) && stab_same_frames(out1, out2, &testdata->fi);
+  vsTransformationsCleanup(&t1);
+  vsTransformationsCleanup(&t2);
+  return ok;
+}
+
+void test_stabilizer(TestData* testdata){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_stabilizer");
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_stabilizer");
+  VSFrame out1[STAB_NFRAMES], out2[STAB_NFRAMES];
+  VSTransformations trans;
+  int loglevel = vs_log_level;
+
+  vs_log_level = 1;
+  for(int i=0; i < STAB_NFRAMES; i++){
+    vsFrameAllocate(&out1[i], &testdata->fi);
+    vsFrameAllocate(&out2[i], &testdata->fi);
+  }
+  tconf.camPathAlgo = VSGaussian;
+  tconf.estimateLensDistortion = 0;
+  tconf.optZoom = 0;
+
+  // a window shorter than the clip, and longer
+  tconf.smoothing = 3;
+  test_bool(stab_agree(testdata, mdconf, tconf, out1, out2));
+  tconf.smoothing = 10;
+  test_bool(stab_agree(testdata, mdconf, tconf, out1, out2));
+  VSTransformConfig simple = tconf;
+  simple.smoothing = 2;
+  simple.simpleMotionCalculation = 1;
+  simple.zoom = 5;
+  simple.maxShift = 4;
+  simple.crop = VSCropBorder;
+  test_bool(stab_agree(testdata, mdconf, simple, out1, out2));
+  // tripod: absolute transforms, no smoothing
+  VSMotionDetectConfig tripod = mdconf;
+  tripod.virtualTripod = 1;
+  VSTransformConfig absolute = tconf;
+  absolute.relative = 0;
+  absolute.smoothing = 0;
+  test_bool(stab_agree(testdata, tripod, absolute, out1, out2));
+  // no smoothing of relative transforms: each frame leaves before the next
+  VSTransformConfig unsmoothed = tconf;
+  unsmoothed.smoothing = 0;
+  test_bool(stab_agree(testdata, mdconf, unsmoothed, out1, out2));
+
+  // the adaptive zoom covers every frame
+  VSTransformConfig zoom = tconf;
+  zoom.smoothing = 3;
+  zoom.optZoom = 2;
+  test_bool(stab_onepass(testdata, mdconf, zoom, &trans, out2));
+  {
+    VSTransformData td;
+    test_bool(vsTransformDataInit(&td, &zoom, &testdata->fi, &testdata->fi) == VS_OK);
+    for(int i=0; i < STAB_NFRAMES; i++){
+      VSTransform t = trans.ts[i];
+      t.zoom = 0;
+      test_bool(trans.ts[i].zoom >= vsTransformRequiredZoom(&td, &t));
+    }
+    vsTransformDataCleanup(&td);
+  }
+  vsTransformationsCleanup(&trans);
+  // the static one does not zoom out again
+  zoom.optZoom = 1;
+  test_bool(stab_onepass(testdata, mdconf, zoom, &trans, out2));
+  for(int i=1; i < STAB_NFRAMES; i++)
+    test_bool(trans.ts[i].zoom >= trans.ts[i-1].zoom);
+  vsTransformationsCleanup(&trans);
+
+  for(int i=0; i < STAB_NFRAMES; i++){
+    vsFrameFree(&out1[i]);
+    vsFrameFree(&out2[i]);
+  }
+  vs_log_level = loglevel;
+}
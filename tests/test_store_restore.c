@@ -42,7 +42,8 @@ int test_store_restore(TestData* testdata, int serializationMode){
   fclose(f);
 
   f = fopen(testOut("lmstest"),"rb");
-  test_bool(vsReadFileVersion(f,serializationMode)==1);
+  test_bool(vsReadFileVersion(f,serializationMode)
+            ==(serializationMode==COMPACT_SERIALIZATION_MODE ? 2 : 1));
   LocalMotions read1;
   test_bool(vsReadFromFile(f,&read1,serializationMode)==1);
   compare_localmotions(&lms,&read1);
@@ -0,0 +1,110 @@
+/* The streaming transform pass (vsStreamMotions2Transforms).
+
+   Reading the .trf frame by frame has to give the transforms of reading it
+   whole and running vsLocalmotions2Transforms, bit for bit, for every
+   encoding, with gaps in the file, and with the lens estimation on as long as
+   the clip fits into the lens sample. A smaller sample still gives a
+   transform per frame, and a stream that cannot be rewound is fitted without
+   the lens. */
+
+/* the transforms of the file name, read whole or streamed */
+static int stream_transforms(TestData* testdata, const char* name, int stream,
+                             VSTransformConfig tconf, VSTransformations* trans){
+  VSTransformData td;
+  FILE* f = fopen(name, "rb");
+  int ok;
+  if(!f) return 0;
+  vsTransformationsInit(trans);
+  ok = vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi) == VS_OK;
+  if(stream){
+    ok &= vsStreamMotions2Transforms(&td, f, trans) == VS_OK;
+  }else{
+    VSManyLocalMotions mlms;
+    ok &= vsReadLocalMotionsFile(f, &mlms) == VS_OK;
+    ok &= vsLocalmotions2Transforms(&td, &mlms, trans) == VS_OK;
+    compact_free_many(&mlms);
+  }
+  fclose(f);
+  vsTransformDataCleanup(&td);
+  return ok;
+}
+
+static int stream_agrees(TestData* testdata, const char* name, VSTransformConfig tconf){
+  VSTransformations t1, t2;
+  int ok = stream_transforms(testdata, name, 0, tconf, &t1);
+  ok &= stream_transforms(testdata, name, 1, tconf, &t2);
+  ok &= t1.len > 0 && compact_same_transforms(&t1, &t2);
+  vsTransformationsCleanup(&t1);
+  vsTransformationsCleanup(&t2);
+  return ok;
+}
+
+void test_stream(TestData* testdata){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_stream");
+  VSMotionDetect md;
+  VSMotionSet sets[COMPACT_NFRAMES];
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_stream");
+  VSTransformations t1, t2;
+  int loglevel = vs_log_level;
+
+  vs_log_level = 1;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    test_bool(vsMotionDetectionSet(&md, &sets[i], &testdata->frames[i]) == VS_OK);
+  vsMotionDetectionCleanup(&md);
+
+  const char* names[3] = { "stream_v1.trf", "stream_v2.trf", "stream.trf" };
+  const int modes[3] = { BINARY_SERIALIZATION_MODE, COMPACT_SERIALIZATION_MODE,
+                         ASCII_SERIALIZATION_MODE };
+  for(int v=0; v < 3; v++){
+    test_bool(compact_write(testOut(names[v]), modes[v], sets, &testdata->fi));
+    tconf.estimateLensDistortion = 1;
+    tconf.simpleMotionCalculation = 0;
+    test_bool(stream_agrees(testdata, testOut(names[v]), tconf));
+    tconf.estimateLensDistortion = 0;
+    test_bool(stream_agrees(testdata, testOut(names[v]), tconf));
+    tconf.simpleMotionCalculation = 1;
+    test_bool(stream_agrees(testdata, testOut(names[v]), tconf));
+  }
+
+  // gaps and a repeated frame
+  tconf = vsTransformGetDefaultConfig("test_stream");
+  tconf.estimateLensDistortion = 0;
+  test_bool(trffile_write(testOut("stream_gaps.trf"), BINARY_SERIALIZATION_MODE, sets,
+                          &testdata->fi));
+  test_bool(stream_agrees(testdata, testOut("stream_gaps.trf"), tconf));
+
+  // a sample smaller than the clip
+  tconf = vsTransformGetDefaultConfig("test_stream");
+  tconf.lensSampleFrames = 2;
+  test_bool(stream_transforms(testdata, testOut("stream_v2.trf"), 1, tconf, &t1));
+  test_bool(t1.len == COMPACT_NFRAMES);
+  vsTransformationsCleanup(&t1);
+
+#ifndef _WIN32
+  // a pipe is read once, without the lens
+  {
+    char cmd[1024];
+    VSTransformData td;
+    FILE* p;
+    snprintf(cmd, sizeof(cmd), "cat %s", testOut("stream_v1.trf"));
+    tconf = vsTransformGetDefaultConfig("test_stream");
+    p = popen(cmd, "r");
+    test_bool(p != NULL);
+    vsTransformationsInit(&t1);
+    test_bool(vsTransformDataInit(&td, &tconf, &testdata->fi, &testdata->fi) == VS_OK);
+    test_bool(vsStreamMotions2Transforms(&td, p, &t1) == VS_OK);
+    vsTransformDataCleanup(&td);
+    pclose(p);
+    tconf.estimateLensDistortion = 0;
+    test_bool(stream_transforms(testdata, testOut("stream_v1.trf"), 1, tconf, &t2));
+    test_bool(compact_same_transforms(&t1, &t2));
+    vsTransformationsCleanup(&t1);
+    vsTransformationsCleanup(&t2);
+  }
+#endif
+
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    vs_motionset_fini(&sets[i]);
+  vs_log_level = loglevel;
+}
@@ -0,0 +1,237 @@
+/* The worker pool of the motion detection (threadpool.h).
+
+   vsParallelFor has to run every index exactly once, on the pool, in a nested
+   call (which finds the pool busy and runs serially) and without a pool. The
+   detection has to give the same local motions on the pool as on one thread,
+   single frames and batches alike. With an executor of the host every loop
+   goes to the host, never nested, and detection and transform give the same
+   results as without. */
+
+typedef struct {
+  int* counts;
+  int n;             // inner loop length of the nested case
+  VSThreadPool* pool;
+} PoolTestJob;
+
+static void pool_count(void* ctx, int i){
+  PoolTestJob* job = (PoolTestJob*)ctx;
+  job->counts[i]++;
+}
+
+static void pool_nested_inner(void* ctx, int j){
+  int* row = (int*)ctx;
+  row[j]++;
+}
+
+static void pool_nested_outer(void* ctx, int i){
+  PoolTestJob* job = (PoolTestJob*)ctx;
+  vsParallelFor(job->pool, 0, job->n, pool_nested_inner, job->counts + i*job->n);
+}
+
+/* runs a loop of n on pool, nested if inner > 0, and checks that every index
+   ran once */
+static int pool_run(VSThreadPool* pool, int numThreads, int n, int inner){
+  int total = inner > 0 ? n*inner : n;
+  int* counts = (int*)vs_zalloc(sizeof(int) * (total > 0 ? total : 1));
+  PoolTestJob job = { counts, inner, pool };
+  int ok = 1;
+  vsParallelFor(pool, numThreads, n, inner > 0 ? pool_nested_outer : pool_count, &job);
+  for(int i=0; i < total; i++){
+    if(counts[i] != 1){
+      fprintf(stderr,"pool of %i, n %i (inner %i): index %i ran %i times\n",
+              vsThreadPoolSize(pool), n, inner, i, counts[i]);
+      ok = 0;
+      break;
+    }
+  }
+  vs_free(counts);
+  return ok;
+}
+
+/* executor of a "host": runs the loops on its own pool (or serially if it
+   has none) and counts them */
+typedef struct {
+  VSThreadPool* pool;
+  int calls;
+  int active;
+  int nested;
+} PoolTestHost;
+
+static void pool_host_for(void* ctx, int n, vsParallelFn fn, void* arg){
+  PoolTestHost* host = (PoolTestHost*)ctx;
+  if(host->active)
+    host->nested++;
+  host->active++;
+  host->calls++;
+  vsParallelFor(host->pool, 0, n, fn, arg);
+  host->active--;
+}
+
+/* detection over the test frames, forth and back, with numThreads or the
+   executor of host */
+static void pool_detect(TestData* testdata, int numThreads, PoolTestHost* host,
+                        int batch, LocalMotions* lms, int* haspool){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_threadpool");
+  VSMotionDetect md;
+  VSFrame frames[8];
+  for(int i=0; i < 8; i++)
+    frames[i] = testdata->frames[i < 5 ? i : 8-i];
+  mdconf.numThreads = numThreads;
+  if(host){
+    mdconf.executor.parallel_for = pool_host_for;
+    mdconf.executor.ctx = host;
+  }
+  mdconf.contrastMode = VSContrastVariance; // the summed-area tables too
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  *haspool = md.pool != NULL;
+  if(batch){
+    test_bool(vsMotionDetectionBatch(&md, frames, 3, lms) == VS_OK);
+    test_bool(vsMotionDetectionBatch(&md, frames + 3, 5, lms + 3) == VS_OK);
+  }else{
+    for(int i=0; i < 8; i++)
+      test_bool(vsMotionDetection(&md, &lms[i], &frames[i]) == VS_OK);
+  }
+  vsMotionDetectionCleanup(&md);
+  test_bool(md.pool == NULL);
+}
+
+static int pool_same_motions(const LocalMotions* a, const LocalMotions* b, int num){
+  int same = 1;
+  for(int i=0; i < num; i++){
+    if(vs_vector_size(&a[i]) != vs_vector_size(&b[i])){
+      same = 0;
+      continue;
+    }
+    for(int k=0; k < vs_vector_size(&a[i]); k++){
+      const LocalMotion* x = LMGet(&a[i],k);
+      const LocalMotion* y = LMGet(&b[i],k);
+      same &= x->v.x == y->v.x && x->v.y == y->v.y && x->f.x == y->f.x
+        && x->f.y == y->f.y && x->match == y->match && x->contrast == y->contrast;
+    }
+  }
+  return same;
+}
+
+/* transforms frame with and without the executor of host, 0 if the results
+   differ */
+static int pool_transform(const VSFrame* frame, const VSFrameInfo* fi,
+                          PoolTestHost* host){
+  VSTransformConfig conf = vsTransformGetDefaultConfig("test_threadpool");
+  VSTransform t = null_transform();
+  VSFrame out[2];
+  int same = 1;
+  t.x = 7.5; t.y = -3.25; t.alpha = 0.03; t.zoom = 2;
+  conf.crop = VSCropBorder;
+  for(int k=0; k < 2; k++){
+    VSTransformData td;
+    VSFrame src, dest;
+    vsFrameAllocate(&src, fi);
+    vsFrameAllocate(&dest, fi);
+    vsFrameAllocate(&out[k], fi);
+    vsFrameCopy(&src, frame, fi);
+    if(k){
+      conf.executor.parallel_for = pool_host_for;
+      conf.executor.ctx = host;
+    }
+    test_bool(vsTransformDataInit(&td, &conf, fi, fi) == VS_OK);
+    test_bool(vsTransformPrepare(&td, &src, &dest) == VS_OK);
+    test_bool(vsDoTransform(&td, t) == VS_OK);
+    test_bool(vsTransformFinish(&td) == VS_OK);
+    vsFrameCopy(&out[k], &dest, fi);
+    vsTransformDataCleanup(&td);
+    test_bool(td.pool == NULL);
+    vsFrameFree(&src);
+    vsFrameFree(&dest);
+  }
+  for(int p=0; p < fi->planes; p++){
+    int w = fi->width  >> vsGetPlaneWidthSubS(fi, p);
+    int h = fi->height >> vsGetPlaneHeightSubS(fi, p);
+    if(fi->pFormat > PF_PACKED)
+      w *= fi->bytesPerPixel;
+    for(int y=0; y < h; y++)
+      same &= memcmp(out[0].data[p] + y*out[0].linesize[p],
+                     out[1].data[p] + y*out[1].linesize[p], w) == 0;
+  }
+  vsFrameFree(&out[0]);
+  vsFrameFree(&out[1]);
+  return same;
+}
+
+void test_threadpool(TestData* testdata){
+  static const int sizes[] = {1, 2, 7, 64, 1000};
+  int loglevel = vs_log_level;
+
+  test_bool(vsThreadPoolCreate(1) == NULL);
+  test_bool(vsThreadPoolSize(NULL) == 1);
+  test_bool(vsDefaultNumThreads() >= 1);
+  for(int t=2; t <= 5; t++){
+    VSThreadPool* pool = vsThreadPoolCreate(t);
+#ifdef VS_USE_THREADPOOL
+    test_bool(pool != NULL && vsThreadPoolSize(pool) == t);
+#else
+    test_bool(pool == NULL);
+#endif
+    for(unsigned s=0; s < sizeof(sizes)/sizeof(sizes[0]); s++){
+      test_bool(pool_run(pool, t, sizes[s], 0));
+      test_bool(pool_run(NULL, t, sizes[s], 0));
+    }
+    test_bool(pool_run(pool, t, 13, 17));  // nested: the inner loops run serially
+    test_bool(pool_run(pool, t, 0, 0));
+    vsThreadPoolDestroy(pool);
+  }
+  vsThreadPoolDestroy(NULL);
+
+  LocalMotions one[8], many[8];
+  int haspool;
+  vs_log_level = 1;
+  for(int batch=0; batch < 2; batch++){
+    pool_detect(testdata, 1, NULL, batch, one, &haspool);
+    test_bool(!haspool);
+    pool_detect(testdata, 4, NULL, batch, many, &haspool);
+#ifdef VS_USE_THREADPOOL
+    test_bool(haspool);
+#endif
+    int same = pool_same_motions(one, many, 8);
+    if(!same)
+      fprintf(stderr,"%s: local motions differ between 1 and 4 threads\n",
+              batch ? "batch" : "single frames");
+    test_bool(same);
+    for(int i=0; i < 8; i++)
+      vs_vector_del(&many[i]);
+
+    /* executors of a host with and without threads, the first also shared
+       by the transforms below */
+    PoolTestHost host[2] = { { vsThreadPoolCreate(3), 0, 0, 0 }, { NULL, 0, 0, 0 } };
+    for(int h=0; h < 2; h++){
+      pool_detect(testdata, 4, &host[h], batch, many, &haspool);
+      test_bool(haspool);
+      test_bool(host[h].calls > 0 && host[h].nested == 0);
+      same = pool_same_motions(one, many, 8);
+      if(!same)
+        fprintf(stderr,"%s: local motions differ with the executor\n",
+                batch ? "batch" : "single frames");
+      test_bool(same);
+      for(int i=0; i < 8; i++)
+        vs_vector_del(&many[i]);
+    }
+    for(int i=0; i < 8; i++)
+      vs_vector_del(&one[i]);
+
+    if(!batch){
+      VSFrameInfo pfi;
+      VSFrame packed;
+      int calls = host[0].calls;
+      test_bool(pool_transform(&testdata->frames[1], &testdata->fi, &host[0]));
+      test_bool(host[0].calls > calls);
+      test_bool(vsFrameInfoInit(&pfi, 320, 240, PF_RGB24));
+      vsFrameAllocate(&packed, &pfi);
+      fillPackedNoise(&packed, &pfi, 5);
+      calls = host[0].calls;
+      test_bool(pool_transform(&packed, &pfi, &host[0]));
+      test_bool(host[0].calls > calls);
+      vsFrameFree(&packed);
+    }
+    vsThreadPoolDestroy(host[0].pool);
+  }
+  vs_log_level = loglevel;
+}
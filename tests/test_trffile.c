@@ -0,0 +1,159 @@
+/* Random access to a binary .trf (trffile.h).
+
+   Every frame of a mapped file has to be the frame vsReadLocalMotionsFile
+   reads, for both versions, with gaps and a repeated frame in the file. A
+   version 2 frame is a view into the mapping. The transforms of a range of
+   frames are those of the same frames read sequentially, and a text or
+   truncated file is handled like the sequential reader handles it. */
+
+/* writes frames 1..COMPACT_NFRAMES, then frame 8 (a gap) and frame 2 again */
+static int trffile_write(const char* name, int mode, VSMotionSet* sets,
+                         const VSFrameInfo* fi){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_trffile");
+  VSMotionDetect md;
+  FILE* f = fopen(name, "wb");
+  int ok;
+  if(!f) return 0;
+  md.serializationMode = mode;
+  ok = vsMotionDetectInit(&md, &mdconf, fi) == VS_OK;
+  ok &= vsPrepareFile(&md, f) == VS_OK;
+  for(int i=0; ok && i < COMPACT_NFRAMES; i++){
+    md.frameNum = i+1;
+    ok &= vsWriteMotionSetToFile(&md, f, &sets[i]) == VS_OK;
+  }
+  md.frameNum = 8;
+  ok &= vsWriteMotionSetToFile(&md, f, &sets[3]) == VS_OK;
+  md.frameNum = 2;
+  ok &= vsWriteMotionSetToFile(&md, f, &sets[4]) == VS_OK;
+  fclose(f);
+  vsMotionDetectionCleanup(&md);
+  return ok;
+}
+
+static int trffile_same_frames(const VSTrfFile* trf, const VSManyLocalMotions* mlms){
+  VSMotionSet set;
+  int same = vsTrfNumFrames(trf) == vs_vector_size(mlms);
+  vs_motionset_init(&set, 0);
+  for(int i=0; same && i < vsTrfNumFrames(trf); i++){
+    const LocalMotions* lms = VSMLMGet(mlms, i);
+    int num = lms ? vs_vector_size(lms) : 0;
+    VSTrfFrame frame;
+    same &= vsTrfGetFrame(trf, i, &frame) == VS_OK && frame.frameNum == i+1
+      && frame.num == num;
+    same &= vsTrfGetFrameMotions(trf, i, &set) == VS_OK && set.num == num;
+    for(int k=0; same && k < num; k++){
+      const LocalMotion* a = LMGet(lms, k);
+      LocalMotion b = vsTrfFrameMotion(&frame, k);
+      const LocalMotion* c = MSGet(&set, k);
+      same &= a->v.x == b.v.x && a->v.y == b.v.y && a->f.x == b.f.x && a->f.y == b.f.y
+        && a->f.size == b.f.size && a->contrast == b.contrast && a->match == b.match;
+      same &= c->v.x == b.v.x && c->v.y == b.v.y && c->f.x == b.f.x && c->f.y == b.f.y
+        && c->f.size == b.f.size && c->contrast == b.contrast && c->match == b.match;
+    }
+  }
+  vs_motionset_fini(&set);
+  return same;
+}
+
+/* frames 1..3 of the file through vsTrfMotions2Transforms and the same frames
+   of the sequential read through vsLocalmotions2Transforms */
+static int trffile_range_transforms(TestData* testdata, const VSTrfFile* trf,
+                                    const VSManyLocalMotions* mlms){
+  VSTransformConfig tconf = vsTransformGetDefaultConfig("test_trffile");
+  VSTransformData td1, td2;
+  VSTransformations t1, t2;
+  VSManyLocalMotions part;
+  int ok;
+  tconf.estimateLensDistortion = 0;
+  vs_vector_init(&part, 3);
+  for(int i=1; i <= 3; i++)
+    vs_vector_append(&part, VSMLMGet(mlms, i));
+  vsTransformationsInit(&t1);
+  vsTransformationsInit(&t2);
+  ok = vsTransformDataInit(&td1, &tconf, &testdata->fi, &testdata->fi) == VS_OK;
+  ok &= vsTransformDataInit(&td2, &tconf, &testdata->fi, &testdata->fi) == VS_OK;
+  ok &= vsLocalmotions2Transforms(&td1, &part, &t1) == VS_OK;
+  ok &= vsTrfMotions2Transforms(&td2, trf, 1, 3, &t2) == VS_OK;
+  ok &= t2.len == 3 && compact_same_transforms(&t1, &t2);
+  vsTransformationsCleanup(&t2);
+  ok &= vsTrfMotions2Transforms(&td2, trf, 2, vsTrfNumFrames(trf), &t2) == VS_ERROR;
+  vsTransformationsCleanup(&t1);
+  vsTransformDataCleanup(&td1);
+  vsTransformDataCleanup(&td2);
+  part.nelems = 0; // the elements belong to mlms
+  vs_vector_del(&part);
+  return ok;
+}
+
+void test_trffile(TestData* testdata){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_trffile");
+  VSMotionDetect md;
+  VSMotionSet sets[COMPACT_NFRAMES];
+  VSManyLocalMotions mlms;
+  VSTrfFile trf;
+  VSTrfFrame frame;
+  int loglevel = vs_log_level;
+  FILE* f;
+
+  vs_log_level = 1;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    test_bool(vsMotionDetectionSet(&md, &sets[i], &testdata->frames[i]) == VS_OK);
+  vsMotionDetectionCleanup(&md);
+
+  const char* names[2] = { "trffile_v1.trf", "trffile_v2.trf" };
+  const int modes[2] = { BINARY_SERIALIZATION_MODE, COMPACT_SERIALIZATION_MODE };
+  for(int v=0; v < 2; v++){
+    test_bool(trffile_write(testOut(names[v]), modes[v], sets, &testdata->fi));
+    f = fopen(testOut(names[v]), "rb");
+    test_bool(vsReadLocalMotionsFile(f, &mlms) == VS_OK);
+    fclose(f);
+    test_bool(vsTrfOpen(&trf, testOut(names[v])) == VS_OK);
+    test_bool(trf.version == v+1 && trf.serializationMode == modes[v]);
+    test_bool(vsTrfNumFrames(&trf) == 8);
+    test_bool(trffile_same_frames(&trf, &mlms));
+    // the gap and the frame written twice
+    test_bool(vsTrfGetFrame(&trf, 6, &frame) == VS_OK && frame.num == 0 && !frame.data);
+    test_bool(vsTrfGetFrame(&trf, 1, &frame) == VS_OK && frame.num == sets[4].num);
+    test_bool(vsTrfGetFrame(&trf, 8, &frame) == VS_ERROR);
+    test_bool(vsTrfGetFrame(&trf, -1, &frame) == VS_ERROR);
+    // zero copy views of version 2 on a little endian host
+    test_bool(vsTrfGetFrame(&trf, 3, &frame) == VS_OK && frame.num == sets[3].num);
+    const VSCompactMotion* cms = vsTrfFrameCompact(&frame);
+    const uint16_t one = 1;
+    if(v == 1 && *(const unsigned char*)&one == 1 && frame.num > 0){
+      test_bool(cms != NULL && (const unsigned char*)cms >= trf.data
+                && (const unsigned char*)(cms + frame.num) <= trf.data + trf.size);
+      test_bool(cms[0].vx == MSGet(&sets[3], 0)->v.x
+                && cms[0].match == (float)MSGet(&sets[3], 0)->match);
+    }else{
+      test_bool(cms == NULL);
+    }
+    test_bool(trffile_range_transforms(testdata, &trf, &mlms));
+    vsTrfClose(&trf);
+    compact_free_many(&mlms);
+  }
+
+  // a truncated file: the frames before the cut
+  f = fopen(testOut("trffile_v2.trf"), "rb");
+  FILE* g = fopen(testOut("trffile_cut.trf"), "wb");
+  long cut = 24 + 8 + 20*sets[0].num + 8 + 20*sets[1].num + 13;
+  for(long k=0; k < cut; k++)
+    fputc(fgetc(f), g);
+  fclose(f);
+  fclose(g);
+  test_bool(vsTrfOpen(&trf, testOut("trffile_cut.trf")) == VS_OK);
+  test_bool(vsTrfNumFrames(&trf) == 2);
+  vsTrfClose(&trf);
+
+  // text files and missing files are not opened
+  test_bool(compact_write(testOut("trffile.txt"), ASCII_SERIALIZATION_MODE, sets,
+                          &testdata->fi));
+  test_bool(vsTrfOpen(&trf, testOut("trffile.txt")) == VS_ERROR);
+  test_bool(trf.data == NULL && trf.index == NULL);
+  test_bool(vsTrfOpen(&trf, testOut("trffile_missing.trf")) == VS_ERROR);
+
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    vs_motionset_fini(&sets[i]);
+  vs_log_level = loglevel;
+}
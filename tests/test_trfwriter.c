@@ -0,0 +1,136 @@
+/* The buffered .trf writer (VSTrfWriter).
+
+   Its files are those of vsPrepareFile and vsWriteMotionSetToFile, byte for
+   byte, for both versions, written by the caller or by the background thread,
+   also when the clip spans many blocks and a frame does not fit into one. A
+   failed write is reported by the writer, and a text file is not its job. */
+
+#define TRFWRITER_NFRAMES 200
+
+static int trfwriter_same_files(const char* a, const char* b){
+  FILE* f = fopen(a, "rb");
+  FILE* g = fopen(b, "rb");
+  int same = f && g;
+  while(same){
+    int c = fgetc(f);
+    same = c == fgetc(g);
+    if(c == EOF)
+      break;
+  }
+  if(f) fclose(f);
+  if(g) fclose(g);
+  return same;
+}
+
+/* the clip: the detected frames in turn, and one huge frame in the middle */
+static const VSMotionSet* trfwriter_frame(VSMotionSet* sets, const VSMotionSet* huge, int i){
+  return i == TRFWRITER_NFRAMES/2 ? huge : &sets[i % COMPACT_NFRAMES];
+}
+
+/* writes the clip with the writer, background < 0 uses vsWriteMotionSetToFile */
+static int trfwriter_write(const char* name, int mode, int background, VSMotionSet* sets,
+                           const VSMotionSet* huge, const VSFrameInfo* fi){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_trfwriter");
+  VSMotionDetect md;
+  FILE* f = fopen(name, "wb");
+  int ok;
+  if(!f) return 0;
+  md.serializationMode = mode;
+  ok = vsMotionDetectInit(&md, &mdconf, fi) == VS_OK;
+  if(background < 0){
+    ok &= vsPrepareFile(&md, f) == VS_OK;
+    for(int i=0; ok && i < TRFWRITER_NFRAMES; i++){
+      md.frameNum = i+1;
+      ok &= vsWriteMotionSetToFile(&md, f, trfwriter_frame(sets, huge, i)) == VS_OK;
+    }
+  }else{
+    VSTrfWriter* w = vsTrfWriterCreate(&md, f, background);
+    ok &= w != NULL;
+    for(int i=0; ok && i < TRFWRITER_NFRAMES; i++)
+      ok &= vsTrfWriterWrite(w, i+1, trfwriter_frame(sets, huge, i)) == VS_OK;
+    ok &= vsTrfWriterFlush(w) == VS_OK;
+    ok &= vsTrfWriterClose(w) == VS_OK;
+  }
+  fclose(f);
+  vsMotionDetectionCleanup(&md);
+  return ok;
+}
+
+void test_trfwriter(TestData* testdata){
+  VSMotionDetectConfig mdconf = vsMotionDetectGetDefaultConfig("test_trfwriter");
+  VSMotionDetect md;
+  VSMotionSet sets[COMPACT_NFRAMES];
+  VSMotionSet huge;
+  VSManyLocalMotions mlms;
+  int loglevel = vs_log_level;
+  FILE* f;
+
+  vs_log_level = 1;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    test_bool(vsMotionDetectionSet(&md, &sets[i], &testdata->frames[i]) == VS_OK);
+  vsMotionDetectionCleanup(&md);
+  // a frame larger than a block in either version
+  test_bool(sets[1].num > 0 && vs_motionset_init(&huge, 0) == VS_OK);
+  while(sets[1].num > 0 && (long)huge.num * 20 <= VS_TRF_WRITER_BLOCK_SIZE)
+    test_bool(vs_motionset_append_set(&huge, &sets[1]) == VS_OK);
+
+  const char* names[2] = { "trfwriter_v1.trf", "trfwriter_v2.trf" };
+  const int modes[2] = { BINARY_SERIALIZATION_MODE, COMPACT_SERIALIZATION_MODE };
+  for(int v=0; v < 2; v++){
+    char ref[1024];
+    snprintf(ref, sizeof(ref), "%s", testOut(names[v]));
+    test_bool(trfwriter_write(ref, modes[v], -1, sets, &huge, &testdata->fi));
+    for(int background=0; background < 2; background++){
+      test_bool(trfwriter_write(testOut("trfwriter.trf"), modes[v], background, sets, &huge,
+                                &testdata->fi));
+      test_bool(trfwriter_same_files(ref, testOut("trfwriter.trf")));
+    }
+    f = fopen(ref, "rb");
+    test_bool(vsReadLocalMotionsFile(f, &mlms) == VS_OK);
+    fclose(f);
+    test_bool(vs_vector_size(&mlms) == TRFWRITER_NFRAMES);
+    test_bool(vs_vector_size(VSMLMGet(&mlms, TRFWRITER_NFRAMES/2)) == huge.num);
+    compact_free_many(&mlms);
+  }
+
+  // the thread is there where the build has threads
+  md.serializationMode = BINARY_SERIALIZATION_MODE;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  f = fopen(testOut("trfwriter.trf"), "wb");
+  VSTrfWriter* w = vsTrfWriterCreate(&md, f, 1);
+#ifdef VS_USE_THREADPOOL
+  test_bool(w && vsTrfWriterBackground(w));
+#else
+  test_bool(w && !vsTrfWriterBackground(w));
+#endif
+  test_bool(vsTrfWriterClose(w) == VS_OK);
+  fclose(f);
+
+  // a stream that cannot be written: the error comes back
+  for(int background=0; background < 2; background++){
+    int ok = 1;
+    f = fopen(testOut("trfwriter_v1.trf"), "rb");
+    w = vsTrfWriterCreate(&md, f, background);
+    test_bool(w != NULL);
+    for(int i=0; ok && i < TRFWRITER_NFRAMES; i++)
+      ok = vsTrfWriterWrite(w, i+1, &huge) == VS_OK;
+    test_bool(vsTrfWriterClose(w) == VS_ERROR);
+    fclose(f);
+  }
+  vsMotionDetectionCleanup(&md);
+
+  // text is written with vsWriteMotionSetToFile
+  md.serializationMode = ASCII_SERIALIZATION_MODE;
+  test_bool(vsMotionDetectInit(&md, &mdconf, &testdata->fi) == VS_OK);
+  f = fopen(testOut("trfwriter.trf"), "wb");
+  test_bool(vsTrfWriterCreate(&md, f, 0) == NULL);
+  fclose(f);
+  vsMotionDetectionCleanup(&md);
+  test_bool(vsTrfWriterClose(NULL) == VS_OK);
+
+  vs_motionset_fini(&huge);
+  for(int i=0; i < COMPACT_NFRAMES; i++)
+    vs_motionset_fini(&sets[i]);
+  vs_log_level = loglevel;
+}
@@ -40,6 +40,11 @@
 #include "test_compareimg.c"
 #include "test_simd_equivalence.c"
 #include "test_motiondetect.c"
+#include "test_pyramid.c"
+#include "test_prediction.c"
+#include "test_finepass.c"
+#include "test_detectscale.c"
+#include "test_consensus.c"
 #include "test_store_restore.c"
 #include "test_serialize_robust.c"
 #include "test_vsvector.c"
@@ -52,6 +57,18 @@
 #include "test_chroma_geometry.c"
 #include "test_determinism.c"
 #include "test_packed.c"
+#include "test_batch.c"
+#include "test_threadpool.c"
+#include "test_context.c"
+#include "test_motionset.c"
+#include "test_compact.c"
+#include "test_trffile.c"
+#include "test_stream.c"
+#include "test_trfwriter.c"
+#include "test_cachedtransforms.c"
+#include "test_checkpoint.c"
+#include "test_segments.c"
+#include "test_stabilizer.c"
 #include "test_draw.c"
 #include "test_synthetic.c"
 #include "test_tripod.c"
@@ -156,6 +173,64 @@ int main(int argc, char** argv){
     UNIT(test_motionDetect(&testdata));
   }
 
+  if(all || contains(argv,argc,"--testPYR", "coarse-to-fine pyramid search")){
+    UNIT(test_pyramid(&testdata));
+  }
+
+  if(all || contains(argv,argc,"--testPRED", "temporal motion prediction")){
+    UNIT(test_prediction());
+  }
+
+  if(all || contains(argv,argc,"--testFINE", "sub-pixel fit instead of the fine pass")){
+    UNIT(test_finepass());
+  }
+
+  if(all || contains(argv,argc,"--testSCALE", "detection at reduced resolution")){
+    UNIT(test_detectscale(&testdata));
+  }
+
+  if(all || contains(argv,argc,"--testCONS", "consensus early exit of the coarse search")){
+    UNIT(test_consensus(&testdata));
+  }
+
+  if(all || contains(argv,argc,"--testPOOL", "worker pool of the motion detection")){
+    UNIT(test_threadpool(&testdata));
+  }
+  if(all || contains(argv,argc,"--testCTX", "instances with their own context")){
+    UNIT(test_context(&testdata));
+  }
+  if(all || contains(argv,argc,"--testMSET", "contiguous motion sets")){
+    UNIT(test_motionset(&testdata));
+  }
+  if(all || contains(argv,argc,"--testCOMPACT", "compact local motions and .trf version 2")){
+    UNIT(test_compact(&testdata));
+  }
+  if(all || contains(argv,argc,"--testTRF", "memory mapped .trf with random frame access")){
+    UNIT(test_trffile(&testdata));
+  }
+  if(all || contains(argv,argc,"--testSTREAM", "streaming transform pass")){
+    UNIT(test_stream(&testdata));
+  }
+  if(all || contains(argv,argc,"--testTRFW", "buffered .trf writer")){
+    UNIT(test_trfwriter(&testdata));
+  }
+  if(all || contains(argv,argc,"--testGTC", "global transforms stored in the .trf")){
+    UNIT(test_cachedtransforms(&testdata));
+  }
+  if(all || contains(argv,argc,"--testCKPT", "resumable detection with checkpoints")){
+    UNIT(test_checkpoint(&testdata));
+  }
+  if(all || contains(argv,argc,"--testSEG", "segments detected independently and merged")){
+    UNIT(test_segments(&testdata));
+  }
+  if(all || contains(argv,argc,"--testSTAB", "single pass stabilization")){
+    UNIT(test_stabilizer(&testdata));
+  }
+
+  if(all || contains(argv,argc,"--testBATCH", "frame-parallel batch detection")){
+    UNIT(test_batch(&testdata));
+  }
+
   if(all || contains(argv,argc,"--testLM", "localmotion2transform")){
     UNIT(test_localmotion2transform(&testdata));
   }
@@ -171,6 +246,7 @@ int main(int argc, char** argv){
   if(all || contains(argv,argc,"--testSR", "store_restore")){
     UNIT(test_store_restore(&testdata, ASCII_SERIALIZATION_MODE));
     UNIT(test_store_restore(&testdata, BINARY_SERIALIZATION_MODE));
+    UNIT(test_store_restore(&testdata, COMPACT_SERIALIZATION_MODE));
     UNIT(test_store_restore(&testdata, 0)); // test default binary selection
   }
 
@@ -184,6 +260,7 @@ int main(int argc, char** argv){
 
   if(all || contains(argv,argc,"--testCT", "contrastImg")){
     UNIT(test_contrastImg(&testdata));
+    UNIT(test_contrastIntegral(&testdata));
   }
 
   if(all || contains(argv,argc,"--testPK", "packed pixel formats")){
@@ -326,6 +403,9 @@ int main(int argc, char** argv){
     UNIT(test_l1_transformLS());
     UNIT(test_l1_campath());
     UNIT(test_l1_reference());
+    UNIT(test_l1_window());
+    UNIT(test_lp_restart());
+    UNIT(test_l1_threads());
     UNIT(test_l1_campath_transforms(&testdata));
     UNIT(test_l1_synthetic_detection());
   }
@@ -0,0 +1,54 @@
+/* trfmerge.c -- joins the local motions files of the segments of a clip.
+
+   usage: trfmerge out.trf segment0.trf segment1.trf ...
+
+   The segments are detected independently, every one but the first primed
+   with the frame before it (vsMotionDetectPrime), on as many threads,
+   processes or machines as there are segments. "-" reads a segment from
+   stdin. */
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include "libvidstab.h"
+
+int main(int argc, char** argv){
+  FILE* segments[256];
+  FILE* out;
+  int num = argc - 2;
+  int res;
+
+  if(num < 1 || num > (int)(sizeof(segments)/sizeof(segments[0]))){
+    fprintf(stderr, "usage: %s out.trf segment0.trf [segment1.trf ...]\n", argv[0]);
+    return 2;
+  }
+#ifdef _WIN32
+  _setmode(_fileno(stdin), _O_BINARY);
+#endif
+  for(int k=0; k < num; k++){
+    const char* name = argv[k+2];
+    segments[k] = strcmp(name, "-") == 0 ? stdin : fopen(name, "rb");
+    if(!segments[k]){
+      fprintf(stderr, "%s: cannot open %s\n", argv[0], name);
+      return 1;
+    }
+  }
+  out = fopen(argv[1], "wb");
+  if(!out){
+    fprintf(stderr, "%s: cannot create %s\n", argv[0], argv[1]);
+    return 1;
+  }
+  res = vsMergeMotionsFiles(out, segments, num);
+  if(fclose(out) != 0)
+    res = VS_ERROR;
+  for(int k=0; k < num; k++)
+    if(segments[k] != stdin)
+      fclose(segments[k]);
+  if(res != VS_OK){
+    fprintf(stderr, "%s: cannot merge the segments into %s\n", argv[0], argv[1]);
+    return 1;
+  }
+  return 0;
+}